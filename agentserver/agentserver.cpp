@@ -22,23 +22,64 @@
 #include "agentthread.h"
 #include "libs/xdgbasedirs_p.h"
 #include "libs/protocol_p.h"
+#include "shared/akcrash.h"
 #include "shared/akdebug.h"
+#include "shared/akstandarddirs.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
 #include <QtCore/QPluginLoader>
+#include <QtCore/QSettings>
 #include <QtCore/QTimer>
 #include <QtDBus/QDBusConnection>
 
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
 using namespace Akonadi;
 
+// The agent whose thread crashes is written to this file
+static QByteArray s_crashFile;
+
+static void recordCrashingAgent( int signal )
+{
+  Q_UNUSED( signal );
+#ifdef Q_OS_UNIX
+  const AgentThread *thread = qobject_cast<AgentThread *>( QThread::currentThread() );
+  if ( !thread || s_crashFile.isEmpty() ) {
+    return;
+  }
+
+  const int fd = ::open( s_crashFile.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+  if ( fd >= 0 ) {
+    const char *identifier = thread->identifierData();
+    const ssize_t result = ::write( fd, identifier, strlen( identifier ) );
+    Q_UNUSED( result );
+    ::close( fd );
+  }
+#endif
+}
+
 AgentServer::AgentServer( QObject *parent )
   : QObject( parent )
   , m_processingConfigureRequests( false )
   , m_quiting( false )
 {
+  const QString dataDir = AkStandardDirs::saveDir( "data" );
+  m_stateFile = dataDir + QLatin1String( "/agentserverrc" );
+  s_crashFile = QFile::encodeName( dataDir + QLatin1String( "/agentserver_crashed" ) );
+  AkonadiCrash::setEmergencyMethod( recordCrashingAgent );
+
   QDBusConnection::sessionBus().registerObject( QLatin1String( AKONADI_DBUS_AGENTSERVER_PATH ),
                                                 this, QDBusConnection::ExportScriptableSlots );
+
+  // bring back the agents that were running when we crashed
+  QTimer::singleShot( 0, this, SLOT(restoreAgents()) );
 }
 
 AgentServer::~AgentServer()
@@ -66,11 +107,23 @@ void AgentServer::startAgent( const QString &identifier, const QString &typeIden
 {
   akDebug() << Q_FUNC_INFO << identifier << typeIdentifier << fileName;
 
+  // restored after a crash already, or asked for twice
+  if ( m_agents.contains( identifier ) ) {
+    return;
+  }
+
+  if ( isQuarantined( identifier ) ) {
+    akError() << "Not starting agent" << identifier << "because it crashed the agent server"
+              << CrashLimit << "times within an hour, call clearQuarantine() to start it again";
+    return;
+  }
+
   //First try to load it staticly
   Q_FOREACH ( QObject *plugin, QPluginLoader::staticInstances() ) {
     if ( plugin->objectName() == fileName ) {
       AgentThread *thread = new AgentThread( identifier, plugin, this );
       m_agents.insert( identifier, thread );
+      saveAgent( identifier, typeIdentifier, fileName );
       thread->start();
       return;
     }
@@ -85,6 +138,7 @@ void AgentServer::startAgent( const QString &identifier, const QString &typeIden
 
   AgentThread *thread = new AgentThread( identifier, loader->instance(), this );
   m_agents.insert( identifier, thread );
+  saveAgent( identifier, typeIdentifier, fileName );
   thread->start();
 }
 
@@ -98,6 +152,10 @@ void AgentServer::stopAgent( const QString &identifier )
   thread->quit();
   thread->wait();
   delete thread;
+
+  if ( !m_quiting ) {
+    removeAgent( identifier );
+  }
 }
 
 void AgentServer::quit()
@@ -111,9 +169,121 @@ void AgentServer::quit()
     stopAgent( it.key() );
   }
 
+  // a clean shutdown, nothing to restore
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.remove( QLatin1String( "Agents" ) );
+  state.sync();
+
   QCoreApplication::instance()->quit();
 }
 
+QStringList AgentServer::quarantinedAgents() const
+{
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Crashes" ) );
+  QStringList agents;
+  Q_FOREACH ( const QString &identifier, state.childKeys() ) {
+    if ( isQuarantined( identifier ) ) {
+      agents << identifier;
+    }
+  }
+  return agents;
+}
+
+void AgentServer::clearQuarantine( const QString &identifier )
+{
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Crashes" ) );
+  state.remove( identifier );
+  state.sync();
+}
+
+bool AgentServer::isQuarantined( const QString &identifier ) const
+{
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Crashes" ) );
+  const uint since = QDateTime::currentDateTime().toTime_t() - CrashInterval;
+  int crashes = 0;
+  Q_FOREACH ( const QString &time, state.value( identifier ).toStringList() ) {
+    if ( time.toUInt() >= since ) {
+      ++crashes;
+    }
+  }
+  return crashes >= CrashLimit;
+}
+
+void AgentServer::saveAgent( const QString &identifier, const QString &typeIdentifier, const QString &fileName )
+{
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Agents" ) );
+  state.beginGroup( identifier );
+  state.setValue( QLatin1String( "Type" ), typeIdentifier );
+  state.setValue( QLatin1String( "FileName" ), fileName );
+  state.endGroup();
+  state.endGroup();
+  // has to be on disk before we might crash
+  state.sync();
+}
+
+void AgentServer::removeAgent( const QString &identifier )
+{
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Agents" ) );
+  state.remove( identifier );
+  state.endGroup();
+  state.sync();
+}
+
+void AgentServer::recordCrash()
+{
+  QFile file( QFile::decodeName( s_crashFile ) );
+  if ( !file.open( QIODevice::ReadOnly ) ) {
+    return;
+  }
+  const QString identifier = QString::fromUtf8( file.readAll() );
+  file.close();
+  file.remove();
+  if ( identifier.isEmpty() ) {
+    return;
+  }
+
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Crashes" ) );
+  const uint now = QDateTime::currentDateTime().toTime_t();
+  QStringList crashes;
+  Q_FOREACH ( const QString &time, state.value( identifier ).toStringList() ) {
+    if ( time.toUInt() + CrashInterval >= now ) {
+      crashes << time;
+    }
+  }
+  crashes << QString::number( now );
+  state.setValue( identifier, crashes );
+  state.sync();
+
+  akError() << "Agent" << identifier << "crashed the agent server," << crashes.count() << "crashes within the last hour";
+}
+
+void AgentServer::restoreAgents()
+{
+  recordCrash();
+
+  QSettings state( m_stateFile, QSettings::IniFormat );
+  state.beginGroup( QLatin1String( "Agents" ) );
+  Q_FOREACH ( const QString &identifier, state.childGroups() ) {
+    state.beginGroup( identifier );
+    const QString typeIdentifier = state.value( QLatin1String( "Type" ) ).toString();
+    const QString fileName = state.value( QLatin1String( "FileName" ) ).toString();
+    state.endGroup();
+
+    akDebug() << "Restarting agent" << identifier << "after a crash of the agent server";
+    startAgent( identifier, typeIdentifier, fileName );
+    if ( !m_agents.contains( identifier ) ) {
+      // quarantined or gone, control will ask for it again if needed
+      removeAgent( identifier );
+    }
+  }
+}
+
 void AgentServer::processConfigureRequest()
 {
   if ( m_processingConfigureRequests ) {
@@ -25,11 +25,22 @@
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QQueue>
+#include <QtCore/QStringList>
 
 namespace Akonadi {
 
 class AgentThread;
 
+/**
+ * Hosts agent plugins in threads of this process.
+ *
+ * The agents that are running are kept in a state file, so that they are
+ * restarted right away when the agent server is restarted after a crash. An
+ * agent that crashed the agent server CrashLimit times within CrashInterval
+ * seconds is not started anymore until its crashes expire or
+ * clearQuarantine() is called, so that a single broken agent can't take down
+ * all the others over and over again.
+ */
 class AgentServer : public QObject
 {
   Q_OBJECT
@@ -38,6 +49,11 @@ class AgentServer : public QObject
   typedef QPair<QString, qlonglong> ConfigureInfo;
 
   public:
+    enum {
+      CrashLimit = 3,
+      CrashInterval = 3600
+    };
+
     explicit AgentServer( QObject *parent = 0 );
     ~AgentServer();
 
@@ -48,10 +64,24 @@ class AgentServer : public QObject
     Q_SCRIPTABLE void stopAgent( const QString &identifier );
     Q_SCRIPTABLE void quit();
 
+    /**
+     * Returns the agents that are not started because they crashed the agent
+     * server too often.
+     */
+    Q_SCRIPTABLE QStringList quarantinedAgents() const;
+    Q_SCRIPTABLE void clearQuarantine( const QString &identifier );
+
   private Q_SLOTS:
     void processConfigureRequest();
+    void restoreAgents();
 
   private:
+    bool isQuarantined( const QString &identifier ) const;
+    void saveAgent( const QString &identifier, const QString &typeIdentifier, const QString &fileName );
+    void removeAgent( const QString &identifier );
+    void recordCrash();
+
+    QString m_stateFile;
     QHash<QString, AgentThread *> m_agents;
     QQueue<ConfigureInfo> m_configureQueue;
     AgentPluginLoader m_agentLoader;
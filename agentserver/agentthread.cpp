@@ -32,11 +32,22 @@ using namespace Akonadi;
 AgentThread::AgentThread( const QString &identifier, QObject *factory, QObject *parent )
   : QThread( parent )
   , m_identifier( identifier )
+  , m_identifierData( identifier.toUtf8() )
   , m_factory( factory )
   , m_instance( 0 )
 {
 }
 
+QString AgentThread::identifier() const
+{
+  return m_identifier;
+}
+
+const char *AgentThread::identifierData() const
+{
+  return m_identifierData.constData();
+}
+
 void AgentThread::run()
 {
   const bool invokeSucceeded = QMetaObject::invokeMethod( m_factory,
@@ -20,6 +20,7 @@
 #ifndef AKONADI_AGENTTHREAD_H
 #define AKONADI_AGENTTHREAD_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QThread>
 
 namespace Akonadi {
@@ -41,6 +42,16 @@ class AgentThread : public QThread
      */
     AgentThread( const QString &identifier, QObject *factory, QObject *parent = 0 );
 
+    /**
+     * Returns the identifier of the agent.
+     */
+    QString identifier() const;
+
+    /**
+     * Returns the identifier of the agent in UTF-8, usable from a crash handler.
+     */
+    const char *identifierData() const;
+
     /**
      * Configures the agent.
      *
@@ -53,6 +64,7 @@ class AgentThread : public QThread
 
   private:
     QString m_identifier;
+    QByteArray m_identifierData;
     QObject *m_factory;
     QObject *m_instance;
 };
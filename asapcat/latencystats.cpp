@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "latencystats.h"
+
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+
+QByteArray LatencyStats::commandType( const QByteArray &command )
+{
+  int end = command.indexOf( ' ' );
+  if ( end < 0 ) {
+    return command;
+  }
+  const QByteArray first = command.left( end );
+  // scope selectors are part of the command type
+  if ( first == "UID" || first == "RID" || first == "HRID" || first == "GID" ) {
+    const int next = command.indexOf( ' ', end + 1 );
+    end = next < 0 ? command.size() : next;
+  }
+  return command.left( end );
+}
+
+void LatencyStats::record( const QByteArray &type, qint64 usecs )
+{
+  m_samples[type].append( usecs );
+  m_sorted[type] = false;
+}
+
+void LatencyStats::merge( const LatencyStats &other )
+{
+  QHash<QByteArray, QVector<qint64> >::const_iterator it = other.m_samples.constBegin();
+  for ( ; it != other.m_samples.constEnd(); ++it ) {
+    m_samples[it.key()] += it.value();
+    m_sorted[it.key()] = false;
+  }
+}
+
+QList<QByteArray> LatencyStats::commandTypes() const
+{
+  QList<QByteArray> types = m_samples.keys();
+  qSort( types );
+  return types;
+}
+
+int LatencyStats::count( const QByteArray &type ) const
+{
+  return m_samples.value( type ).count();
+}
+
+const QVector<qint64> &LatencyStats::sorted( const QByteArray &type ) const
+{
+  QVector<qint64> &samples = m_samples[type];
+  if ( !m_sorted.value( type ) ) {
+    std::sort( samples.begin(), samples.end() );
+    m_sorted[type] = true;
+  }
+  return samples;
+}
+
+qint64 LatencyStats::percentile( const QByteArray &type, double percent ) const
+{
+  const QVector<qint64> &samples = sorted( type );
+  if ( samples.isEmpty() ) {
+    return 0;
+  }
+  // nearest rank
+  const int rank = static_cast<int>( std::ceil( percent / 100.0 * samples.count() ) );
+  return samples.at( qBound( 0, rank - 1, samples.count() - 1 ) );
+}
+
+QByteArray LatencyStats::report( qint64 elapsed ) const
+{
+  QByteArray report;
+  report += QString::fromLatin1( "%1 %2 %3 %4 %5 %6 %7\n" )
+              .arg( QLatin1String( "command" ), -16 )
+              .arg( QLatin1String( "count" ), 8 )
+              .arg( QLatin1String( "ops/s" ), 10 )
+              .arg( QLatin1String( "p50 ms" ), 10 )
+              .arg( QLatin1String( "p90 ms" ), 10 )
+              .arg( QLatin1String( "p99 ms" ), 10 )
+              .arg( QLatin1String( "max ms" ), 10 ).toLatin1();
+
+  Q_FOREACH ( const QByteArray &type, commandTypes() ) {
+    const int n = count( type );
+    report += QString::fromLatin1( "%1 %2 %3 %4 %5 %6 %7\n" )
+                .arg( QString::fromLatin1( type ), -16 )
+                .arg( n, 8 )
+                .arg( elapsed > 0 ? n * 1000.0 / elapsed : 0.0, 10, 'f', 1 )
+                .arg( percentile( type, 50 ) / 1000.0, 10, 'f', 3 )
+                .arg( percentile( type, 90 ) / 1000.0, 10, 'f', 3 )
+                .arg( percentile( type, 99 ) / 1000.0, 10, 'f', 3 )
+                .arg( percentile( type, 100 ) / 1000.0, 10, 'f', 3 ).toLatin1();
+  }
+  return report;
+}
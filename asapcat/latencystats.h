@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+/**
+ * Collects the latencies of the commands sent by LoadSessions, grouped by
+ * command type (e.g. "X-AKAPPEND" or "UID FETCH").
+ */
+class LatencyStats
+{
+  public:
+    /**
+     * Returns the command type of @p command, which must not include the tag.
+     */
+    static QByteArray commandType( const QByteArray &command );
+
+    void record( const QByteArray &type, qint64 usecs );
+    void merge( const LatencyStats &other );
+
+    QList<QByteArray> commandTypes() const;
+    int count( const QByteArray &type ) const;
+
+    /**
+     * Returns the latency in microseconds below which @p percent percent of
+     * the commands of @p type finished.
+     */
+    qint64 percentile( const QByteArray &type, double percent ) const;
+
+    /**
+     * Returns a table with count, throughput and latency percentiles of all
+     * command types, @p elapsed is the wall time of the run in milliseconds.
+     */
+    QByteArray report( qint64 elapsed ) const;
+
+  private:
+    const QVector<qint64> &sorted( const QByteArray &type ) const;
+
+    mutable QHash<QByteArray, QVector<qint64> > m_samples;
+    mutable QHash<QByteArray, bool> m_sorted;
+};
+
+#endif // LATENCYSTATS_H
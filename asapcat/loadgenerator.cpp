@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "loadgenerator.h"
+#include "loadsession.h"
+
+LoadGenerator::LoadGenerator( const QString &serverAddress, const Workload &workload,
+                              int sessions, int iterations, QObject *parent )
+  : QObject( parent )
+  , m_elapsed( 0 )
+  , m_running( 0 )
+{
+  m_timer.invalidate();
+  for ( int i = 0; i < sessions; ++i ) {
+    LoadSession *session = new LoadSession( serverAddress, workload, iterations,
+                                            "asapcat-" + QByteArray::number( i ), this );
+    connect( session, SIGNAL(finished()), SLOT(sessionFinished()) );
+    m_sessions << session;
+  }
+}
+
+LoadGenerator::~LoadGenerator()
+{
+}
+
+bool LoadGenerator::isFinished() const
+{
+  return m_running == 0 && m_timer.isValid();
+}
+
+qint64 LoadGenerator::elapsed() const
+{
+  return m_elapsed;
+}
+
+int LoadGenerator::failures() const
+{
+  int failures = 0;
+  Q_FOREACH ( LoadSession *session, m_sessions ) {
+    failures += session->failures();
+  }
+  return failures;
+}
+
+LatencyStats LoadGenerator::stats() const
+{
+  LatencyStats stats;
+  Q_FOREACH ( LoadSession *session, m_sessions ) {
+    stats.merge( session->stats() );
+  }
+  return stats;
+}
+
+void LoadGenerator::start()
+{
+  m_running = m_sessions.count();
+  m_timer.start();
+  Q_FOREACH ( LoadSession *session, m_sessions ) {
+    session->start();
+  }
+  if ( m_sessions.isEmpty() ) {
+    Q_EMIT finished();
+  }
+}
+
+void LoadGenerator::sessionFinished()
+{
+  if ( --m_running > 0 ) {
+    return;
+  }
+  m_elapsed = m_timer.elapsed();
+  Q_EMIT finished();
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include "latencystats.h"
+#include "workload.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+class LoadSession;
+
+/**
+ * Runs a Workload in a number of concurrent LoadSessions and aggregates
+ * their latencies.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+  public:
+    LoadGenerator( const QString &serverAddress, const Workload &workload,
+                   int sessions, int iterations, QObject *parent = 0 );
+    ~LoadGenerator();
+
+    bool isFinished() const;
+
+    /**
+     * Wall time of the run in milliseconds.
+     */
+    qint64 elapsed() const;
+
+    int failures() const;
+    LatencyStats stats() const;
+
+  public Q_SLOTS:
+    void start();
+
+  Q_SIGNALS:
+    void finished();
+
+  private Q_SLOTS:
+    void sessionFinished();
+
+  private:
+    QVector<LoadSession*> m_sessions;
+    QElapsedTimer m_timer;
+    qint64 m_elapsed;
+    int m_running;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "loadsession.h"
+
+#include <shared/akdebug.h>
+#include <shared/akstandarddirs.h>
+
+#include <QSettings>
+
+LoadSession::LoadSession( const QString &serverAddress, const Workload &workload, int iterations,
+                          const QByteArray &name, QObject *parent )
+  : QObject( parent )
+  , m_serverAddress( serverAddress )
+  , m_socket( 0 )
+  , m_timedCommands( 0 )
+  , m_pendingTimed( false )
+  , m_tag( 0 )
+  , m_literalRemaining( 0 )
+  , m_failures( 0 )
+  , m_finished( false )
+{
+  m_queue << "LOGIN " + name;
+  m_queue += workload.setup;
+  for ( int i = 0; i < iterations; ++i ) {
+    m_queue += workload.commands;
+  }
+  m_timedCommands = iterations * workload.commands.count();
+  m_queue << "LOGOUT";
+}
+
+LoadSession::~LoadSession()
+{
+}
+
+QString LoadSession::defaultServerAddress()
+{
+  const QSettings connectionSettings( AkStandardDirs::connectionConfigFile(), QSettings::IniFormat );
+#ifdef Q_OS_WIN
+  return connectionSettings.value( QLatin1String( "Data/NamedPipe" ), QString() ).toString();
+#else
+  return connectionSettings.value( QLatin1String( "Data/UnixPath" ), QString() ).toString();
+#endif
+}
+
+const LatencyStats &LoadSession::stats() const
+{
+  return m_stats;
+}
+
+int LoadSession::failures() const
+{
+  return m_failures;
+}
+
+bool LoadSession::isFinished() const
+{
+  return m_finished;
+}
+
+void LoadSession::start()
+{
+  m_socket = new QLocalSocket( this );
+  connect( m_socket, SIGNAL(error(QLocalSocket::LocalSocketError)), SLOT(serverError(QLocalSocket::LocalSocketError)) );
+  connect( m_socket, SIGNAL(readyRead()), SLOT(serverRead()) );
+  connect( m_socket, SIGNAL(connected()), SLOT(sendNext()) );
+  m_socket->connectToServer( m_serverAddress );
+}
+
+void LoadSession::sendNext()
+{
+  if ( m_queue.isEmpty() ) {
+    m_socket->disconnectFromServer();
+    finish();
+    return;
+  }
+
+  const QByteArray command = m_queue.takeFirst();
+  m_pendingTag = 'A' + QByteArray::number( ++m_tag );
+  m_pendingType = LatencyStats::commandType( command );
+  // everything between the setup and LOGOUT
+  m_pendingTimed = m_queue.count() < m_timedCommands + 1 && !m_queue.isEmpty();
+
+  m_timer.start();
+  m_socket->write( m_pendingTag + ' ' + command + '\n' );
+}
+
+void LoadSession::serverRead()
+{
+  while ( m_socket->bytesAvailable() > 0 ) {
+    // skip the payload of FETCH responses
+    if ( m_literalRemaining > 0 ) {
+      const QByteArray data = m_socket->read( m_literalRemaining );
+      m_literalRemaining -= data.size();
+      continue;
+    }
+    if ( !m_socket->canReadLine() ) {
+      return;
+    }
+
+    const QByteArray line = m_socket->readLine();
+    const QByteArray trimmed = line.trimmed();
+    if ( trimmed.endsWith( '}' ) ) {
+      const int start = trimmed.lastIndexOf( '{' );
+      bool ok = false;
+      const qint64 size = trimmed.mid( start + 1, trimmed.size() - start - 2 ).toLongLong( &ok );
+      if ( start >= 0 && ok ) {
+        m_literalRemaining = size;
+        continue;
+      }
+    }
+
+    // untagged responses and continuation requests
+    if ( !line.startsWith( m_pendingTag + ' ' ) ) {
+      continue;
+    }
+
+    const QByteArray status = trimmed.mid( m_pendingTag.size() + 1, 2 );
+    if ( status != "OK" ) {
+      ++m_failures;
+      akError() << "Command" << m_pendingType << "failed:" << trimmed;
+    } else if ( m_pendingTimed ) {
+      m_stats.record( m_pendingType, m_timer.nsecsElapsed() / 1000 );
+    }
+    m_pendingTag.clear();
+    sendNext();
+  }
+}
+
+void LoadSession::serverError( QLocalSocket::LocalSocketError socketError )
+{
+  // expected after LOGOUT
+  if ( socketError != QLocalSocket::PeerClosedError || !m_queue.isEmpty() ) {
+    ++m_failures;
+    akError() << "Session error:" << m_socket->errorString();
+  }
+  finish();
+}
+
+void LoadSession::finish()
+{
+  if ( m_finished ) {
+    return;
+  }
+  m_finished = true;
+  Q_EMIT finished();
+}
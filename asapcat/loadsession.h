@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef LOADSESSION_H
+#define LOADSESSION_H
+
+#include "latencystats.h"
+#include "workload.h"
+
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QObject>
+
+/**
+ * A client session that logs in, runs a Workload and measures the time
+ * between sending each command and receiving its tagged response.
+ *
+ * Commands are sent one after the other, like the Akonadi client library
+ * does within one session.
+ */
+class LoadSession : public QObject
+{
+    Q_OBJECT
+  public:
+    LoadSession( const QString &serverAddress, const Workload &workload, int iterations,
+                 const QByteArray &name, QObject *parent = 0 );
+    ~LoadSession();
+
+    /**
+     * Returns the address of the running Akonadi server.
+     */
+    static QString defaultServerAddress();
+
+    const LatencyStats &stats() const;
+    int failures() const;
+    bool isFinished() const;
+
+  public Q_SLOTS:
+    void start();
+
+  Q_SIGNALS:
+    void finished();
+
+  private Q_SLOTS:
+    void sendNext();
+    void serverRead();
+    void serverError( QLocalSocket::LocalSocketError socketError );
+
+  private:
+    void finish();
+
+    QString m_serverAddress;
+    QLocalSocket *m_socket;
+    QList<QByteArray> m_queue;
+    int m_timedCommands;
+
+    QByteArray m_pendingTag;
+    QByteArray m_pendingType;
+    bool m_pendingTimed;
+    QElapsedTimer m_timer;
+    int m_tag;
+    qint64 m_literalRemaining;
+
+    LatencyStats m_stats;
+    int m_failures;
+    bool m_finished;
+};
+
+#endif // LOADSESSION_H
@@ -18,28 +18,107 @@
  ***************************************************************************/
 
 #include <session.h>
+#include "loadgenerator.h"
+#include "loadsession.h"
+#include "workload.h"
 
 #include <shared/akapplication.h>
 #include <shared/akstandarddirs.h>
+#include <shared/akdebug.h>
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QFile>
+
+#include <iostream>
+
+static int runLoad( const boost::program_options::variables_map &args )
+{
+  const std::string type = args.count( "workload" ) ? args["workload"].as<std::string>() : "replay";
+  const qint64 collection = args["collection"].as<qint64>();
+
+  Workload workload;
+  if ( type == "replay" ) {
+    const QString input = QString::fromStdString( args["input"].as<std::string>() );
+    QFile file;
+    bool opened = false;
+    if ( input == QLatin1String( "-" ) ) {
+      opened = file.open( stdin, QFile::ReadOnly );
+    } else {
+      file.setFileName( input );
+      opened = file.open( QFile::ReadOnly );
+    }
+    if ( !opened ) {
+      akFatal() << "Failed to open" << input;
+    }
+    workload = Workload::fromScript( &file );
+  } else if ( type == "append" ) {
+    QList<QByteArray> messages;
+    if ( args.count( "maildir" ) ) {
+      messages = Workload::readMaildir( QString::fromStdString( args["maildir"].as<std::string>() ) );
+    } else {
+      messages = Workload::generateMessages( args["count"].as<int>(), args["size"].as<int>() );
+    }
+    workload = Workload::append( collection, messages, QByteArray( args["mimetype"].as<std::string>().c_str() ) );
+  } else if ( type == "fetch" ) {
+    workload = Workload::fetch( collection );
+  } else if ( type == "store" ) {
+    workload = Workload::flagStorm( collection, args["count"].as<int>() );
+  } else if ( type == "search" ) {
+    workload = Workload::search( collection, QByteArray( args["query"].as<std::string>().c_str() ) );
+  } else {
+    akFatal() << "Unknown workload" << type.c_str();
+  }
+
+  const QString serverAddress = LoadSession::defaultServerAddress();
+  if ( serverAddress.isEmpty() ) {
+    akFatal() << "Unable to determine server address.";
+  }
+
+  const int sessions = args.count( "sessions" ) ? args["sessions"].as<int>() : 1;
+  LoadGenerator generator( serverAddress, workload, sessions, args["iterations"].as<int>() );
+  QObject::connect( &generator, SIGNAL(finished()), QCoreApplication::instance(), SLOT(quit()) );
+  QMetaObject::invokeMethod( &generator, "start", Qt::QueuedConnection );
+  QCoreApplication::exec();
+
+  std::cerr << sessions << " sessions, " << generator.elapsed() << " ms, "
+            << generator.failures() << " failed commands" << std::endl;
+  std::cerr << generator.stats().report( generator.elapsed() ).constData();
+  return generator.failures() > 0 ? 1 : 0;
+}
 
 int main( int argc, char **argv )
 {
   AkCoreApplication app( argc, argv );
   app.setDescription( QLatin1String( "Akonadi ASAP cat\n"
     "This is a development tool, only use this if you know what you are doing.\n\n"
-    "Usage: asapcat [input]" ) );
+    "Usage: asapcat [input]\n"
+    "       asapcat --workload <replay|append|fetch|store|search> [--sessions <n>] [input]\n\n"
+    "With --workload or --sessions, asapcat runs the workload in concurrent sessions\n"
+    "and reports latency percentiles per command type." ) );
 
   boost::program_options::options_description options;
   options.add_options()
-    ( "input", boost::program_options::value<std::string>()->default_value( "-" ), "input to read commands from" );
+    ( "input", boost::program_options::value<std::string>()->default_value( "-" ), "input to read commands from" )
+    ( "workload", boost::program_options::value<std::string>(), "load test: replay (the input), append, fetch, store or search" )
+    ( "sessions", boost::program_options::value<int>(), "load test: number of concurrent sessions" )
+    ( "iterations", boost::program_options::value<int>()->default_value( 1 ), "load test: how often each session runs the workload" )
+    ( "collection", boost::program_options::value<qint64>()->default_value( 1 ), "load test: collection to operate on" )
+    ( "maildir", boost::program_options::value<std::string>(), "append: maildir to read the messages from" )
+    ( "count", boost::program_options::value<int>()->default_value( 100 ), "append: number of generated messages, store: number of flag changes" )
+    ( "size", boost::program_options::value<int>()->default_value( 4096 ), "append: size of generated messages" )
+    ( "mimetype", boost::program_options::value<std::string>()->default_value( "message/rfc822" ), "append: mimetype of the items" )
+    ( "query", boost::program_options::value<std::string>()->default_value( "{\"subTerms\":[{\"key\":\"subject\",\"value\":\"Message\",\"cond\":5}],\"rel\":0,\"negated\":false}" ), "search: search query" );
   app.addCommandLineOptions( options );
   app.addPositionalCommandLineOption( "input", 1 );
 
   app.parseCommandLine();
 
+  const boost::program_options::variables_map &args = app.commandLineArguments();
+  if ( args.count( "workload" ) || args.count( "sessions" ) ) {
+    return runLoad( args );
+  }
+
   Session session( QString::fromStdString( app.commandLineArguments()["input"].as<std::string>() ) );
   QObject::connect( &session, SIGNAL(disconnected()), QCoreApplication::instance(), SLOT(quit()) );
   QMetaObject::invokeMethod( &session, "connectToHost", Qt::QueuedConnection );
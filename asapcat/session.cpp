@@ -18,6 +18,7 @@
  ***************************************************************************/
 
 #include "session.h"
+#include "loadsession.h"
 
 #include <shared/akstandarddirs.h>
 #include <shared/akdebug.h>
@@ -26,7 +27,6 @@
 #include <QDebug>
 #include <QFile>
 #include <QSocketNotifier>
-#include <QSettings>
 #include <QLocalSocket>
 
 #include <iostream>
@@ -67,14 +67,7 @@ Session::~Session()
 
 void Session::connectToHost()
 {
-  const QSettings connectionSettings( AkStandardDirs::connectionConfigFile(), QSettings::IniFormat );
-
-  QString serverAddress;
-#ifdef Q_OS_WIN
-  serverAddress = connectionSettings.value( QLatin1String( "Data/NamedPipe" ), QString() ).toString();
-#else
-  serverAddress = connectionSettings.value( QLatin1String( "Data/UnixPath" ), QString() ).toString();
-#endif
+  const QString serverAddress = LoadSession::defaultServerAddress();
   if ( serverAddress.isEmpty() ) {
     akFatal() << "Unable to determine server address.";
   }
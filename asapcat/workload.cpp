@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "workload.h"
+
+#include <libs/imapparser_p.h>
+
+#include <QDir>
+#include <QFile>
+#include <QRegExp>
+#include <QStringList>
+
+using namespace Akonadi;
+
+Workload Workload::fromScript( QIODevice *device )
+{
+  Workload workload;
+  const QRegExp literal( QLatin1String( "\\{(\\d+)\\+?\\}\\s*$" ) );
+
+  QByteArray command;
+  while ( !device->atEnd() ) {
+    const QByteArray line = device->readLine();
+    command += line;
+    // the rest of the command follows the literal
+    if ( literal.indexIn( QString::fromLatin1( line ) ) >= 0 ) {
+      command += device->read( literal.cap( 1 ).toLongLong() );
+      continue;
+    }
+
+    command = command.trimmed();
+    if ( command.isEmpty() ) {
+      continue;
+    }
+    // strip the tag, the session uses its own
+    const int tagEnd = command.indexOf( ' ' );
+    const QByteArray withoutTag = tagEnd < 0 ? QByteArray() : command.mid( tagEnd + 1 );
+    command.clear();
+
+    const QByteArray type = withoutTag.left( withoutTag.indexOf( ' ' ) ).toUpper();
+    if ( withoutTag.isEmpty() || type == "LOGIN" || type == "LOGOUT" ) {
+      continue;
+    }
+    workload.commands << withoutTag;
+  }
+  return workload;
+}
+
+Workload Workload::append( qint64 collection, const QList<QByteArray> &messages, const QByteArray &mimeType )
+{
+  Workload workload;
+  int i = 0;
+  Q_FOREACH ( const QByteArray &message, messages ) {
+    const QByteArray size = QByteArray::number( message.size() );
+    workload.commands << "X-AKAPPEND " + QByteArray::number( collection ) + ' ' + size
+                         + " (\\MimeType[" + mimeType + "] \\RemoteId[asapcat-" + QByteArray::number( ++i ) + "])"
+                         + " (PLD:RFC822[0] {" + size + "}\n" + message + ')';
+  }
+  return workload;
+}
+
+Workload Workload::fetch( qint64 collection )
+{
+  Workload workload;
+  workload.setup << "UID SELECT SILENT " + QByteArray::number( collection );
+  workload.commands << "FETCH 1:* CACHEONLY EXTERNALPAYLOAD (UID REMOTEID REMOTEREVISION COLLECTIONID FLAGS SIZE PLD:RFC822)";
+  return workload;
+}
+
+Workload Workload::flagStorm( qint64 collection, int count )
+{
+  Workload workload;
+  workload.setup << "UID SELECT SILENT " + QByteArray::number( collection );
+  for ( int i = 0; i < count; ++i ) {
+    workload.commands << ( i % 2 == 0 ? "STORE 1:* (+FLAGS.SILENT (\\SEEN))" : "STORE 1:* (-FLAGS.SILENT (\\SEEN))" );
+  }
+  return workload;
+}
+
+Workload Workload::search( qint64 collection, const QByteArray &query )
+{
+  Workload workload;
+  workload.setup << "CAPABILITY (NOTIFY 3 SERVERSEARCH)";
+  workload.commands << "SEARCH COLLECTIONS (" + QByteArray::number( collection ) + ") QUERY "
+                       + ImapParser::quote( query ) + " (UID)";
+  return workload;
+}
+
+QList<QByteArray> Workload::readMaildir( const QString &path )
+{
+  QList<QByteArray> messages;
+  Q_FOREACH ( const QString &subDir, QStringList() << QLatin1String( "cur" ) << QLatin1String( "new" ) ) {
+    const QDir dir( path + QLatin1Char( '/' ) + subDir );
+    Q_FOREACH ( const QString &fileName, dir.entryList( QDir::Files, QDir::Name ) ) {
+      QFile file( dir.absoluteFilePath( fileName ) );
+      if ( file.open( QIODevice::ReadOnly ) ) {
+        messages << file.readAll();
+      }
+    }
+  }
+  return messages;
+}
+
+QList<QByteArray> Workload::generateMessages( int count, int size )
+{
+  QList<QByteArray> messages;
+  const QByteArray line = "The quick brown fox jumps over the lazy dog.\n";
+  for ( int i = 0; i < count; ++i ) {
+    QByteArray message = "From: asapcat@example.org\n"
+                         "To: akonadi@example.org\n"
+                         "Subject: Message " + QByteArray::number( i ) + "\n"
+                         "Message-ID: <asapcat-" + QByteArray::number( i ) + "@example.org>\n\n";
+    while ( message.size() < size ) {
+      message += line;
+    }
+    messages << message;
+  }
+  return messages;
+}
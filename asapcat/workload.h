@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <QByteArray>
+#include <QList>
+
+class QIODevice;
+class QString;
+
+/**
+ * The commands a LoadSession sends to the server, without tags.
+ *
+ * The setup commands are sent once after login and are not timed, the
+ * commands are sent (and timed) once per iteration.
+ */
+class Workload
+{
+  public:
+    QList<QByteArray> setup;
+    QList<QByteArray> commands;
+
+    /**
+     * Replays the commands of an asap script (as in asapcat/tests), except for
+     * LOGIN and LOGOUT. Literals are supported.
+     */
+    static Workload fromScript( QIODevice *device );
+
+    /**
+     * Appends each of @p messages to @p collection.
+     */
+    static Workload append( qint64 collection, const QList<QByteArray> &messages,
+                            const QByteArray &mimeType = "message/rfc822" );
+
+    /**
+     * Fetches all items of @p collection including their payload.
+     */
+    static Workload fetch( qint64 collection );
+
+    /**
+     * Sets and removes the \SEEN flag on all items of @p collection @p count times.
+     */
+    static Workload flagStorm( qint64 collection, int count );
+
+    /**
+     * Runs the server-side search @p query on @p collection.
+     */
+    static Workload search( qint64 collection, const QByteArray &query );
+
+    /**
+     * Reads all messages of the maildir at @p path.
+     */
+    static QList<QByteArray> readMaildir( const QString &path );
+
+    /**
+     * Generates @p count mails with bodies of @p size bytes.
+     */
+    static QList<QByteArray> generateMessages( int count, int size );
+};
+
+#endif // WORKLOAD_H
@@ -122,6 +122,7 @@
 #define AKONADI_PARAM_INVALIDATECACHE              "INVALIDATECACHE"
 #define AKONADI_PARAM_MIMETYPE                     "MIMETYPE"
 #define AKONADI_PARAM_MERGE                        "MERGE"
+#define AKONADI_PARAM_MODSEQ                       "MODSEQ"
 #define AKONADI_PARAM_LEFT                         "LEFT"
 #define AKONADI_PARAM_LOCALPARTS                   "LOCALPARTS"
 #define AKONADI_PARAM_NAME                         "NAME"
@@ -144,6 +145,7 @@
 #define AKONADI_PARAM_REMOTEID                     "REMOTEID"
 #define AKONADI_PARAM_REMOTEREVISION               "REMOTEREVISION"
 #define AKONADI_PARAM_RESOURCE                     "RESOURCE"
+#define AKONADI_PARAM_CAPABILITY_RETRIEVALPRIORITY "RETRIEVALPRIORITY"
 #define AKONADI_PARAM_REVISION                     "REV"
 #define AKONADI_PARAM_RTAGS                        "RTAGS"
 #define AKONADI_PARAM_SILENT                       "SILENT"
@@ -158,6 +160,7 @@
 #define AKONADI_PARAM_TAGID                        "TAGID"
 #define AKONADI_PARAM_TYPE                         "TYPE"
 #define AKONADI_PARAM_UID                          "UID"
+#define AKONADI_PARAM_VANISHED                     "VANISHED"
 #define AKONADI_PARAM_VIRTREF                      "VIRTREF"
 #define AKONADI_PARAM_VIRTUAL                      "VIRTUAL"
 
@@ -61,6 +61,8 @@
 #include <qthread.h>
 #include "sqlite_blocking.h"
 
+#include <aksqlcolumn.h>
+
 Q_DECLARE_METATYPE(sqlite3*)
 Q_DECLARE_METATYPE(sqlite3_stmt*)
 
@@ -97,7 +99,7 @@ static QSqlError qMakeError(sqlite3 *access, const QString &descr, QSqlError::Er
                             int errorCode = -1)
 {
     return QSqlError(descr,
-                     QString::fromUtf16(static_cast<const ushort *>(sqlite3_errmsg16(access))),
+                     QString::fromUtf8(sqlite3_errmsg(access)),
                      type, errorCode);
 }
 
@@ -118,6 +120,9 @@ public:
     // initializes the recordInfo and the cache
     void initColumns(bool emptyResultset);
     void finalize();
+    // converts column i of the current row
+    QVariant columnValue(int i) const;
+    void readColumn(AkSqlColumn *column) const;
 
     QSQLiteResult* q;
     sqlite3 *access;
@@ -126,12 +131,17 @@ public:
 
     bool skippedStatus; // the status of the fetchNext() that's skipped
     bool skipRow; // skip the next fetchNext()?
+    // forward-only results are not cached, columns are converted on access
+    // directly from the statement, which is always positioned on the current row
+    bool lazy;
     QSqlRecord rInf;
     QVector<QVariant> firstRow;
+    // UTF-8 encoded text parameters, kept alive until the statement is reset
+    QVector<QByteArray> boundText;
 };
 
 QSQLiteResultPrivate::QSQLiteResultPrivate(QSQLiteResult* res) : q(res), access(0),
-    stmt(0), skippedStatus(false), skipRow(false)
+    stmt(0), skippedStatus(false), skipRow(false), lazy(false)
 {
 }
 
@@ -153,6 +163,7 @@ void QSQLiteResultPrivate::finalize()
 
     sqlite3_finalize(stmt);
     stmt = 0;
+    boundText.clear();
 }
 
 void QSQLiteResultPrivate::initColumns(bool emptyResultset)
@@ -164,13 +175,10 @@ void QSQLiteResultPrivate::initColumns(bool emptyResultset)
     q->init(nCols);
 
     for (int i = 0; i < nCols; ++i) {
-        QString colName = QString::fromUtf16(
-                    static_cast<const ushort *>(sqlite3_column_name16(stmt, i))
-                    ).remove(QLatin1Char('"'));
+        QString colName = QString::fromUtf8(sqlite3_column_name(stmt, i)).remove(QLatin1Char('"'));
 
         // must use typeName for resolving the type to match QSqliteDriver::record
-        QString typeName = QString::fromUtf16(
-                    static_cast<const ushort *>(sqlite3_column_decltype16(stmt, i)));
+        QString typeName = QString::fromUtf8(sqlite3_column_decltype(stmt, i));
 
         int dotIdx = colName.lastIndexOf(QLatin1Char('.'));
         QSqlField fld(colName.mid(dotIdx == -1 ? 0 : dotIdx + 1), qGetColumnType(typeName));
@@ -191,14 +199,15 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
         // already fetched
         Q_ASSERT(!initialFetch);
         skipRow = false;
-        for(int i=0;i<firstRow.count();i++)
-            values[i]=firstRow[i];
+        if (!lazy) {
+            for(int i=0;i<firstRow.count();i++)
+                values[i]=firstRow[i];
+        }
         return skippedStatus;
     }
     skipRow = initialFetch;
 
-    if(initialFetch) {
-        firstRow.clear();
+    if(initialFetch && !lazy) {
         firstRow.resize(sqlite3_column_count(stmt));
     }
 
@@ -218,41 +227,10 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
             initColumns(false);
         if (idx < 0 && !initialFetch)
             return true;
-        for (i = 0; i < rInf.count(); ++i) {
-            switch (sqlite3_column_type(stmt, i)) {
-            case SQLITE_BLOB:
-                values[i + idx] = QByteArray(static_cast<const char *>(
-                            sqlite3_column_blob(stmt, i)),
-                            sqlite3_column_bytes(stmt, i));
-                break;
-            case SQLITE_INTEGER:
-                values[i + idx] = sqlite3_column_int64(stmt, i);
-                break;
-            case SQLITE_FLOAT:
-                switch(q->numericalPrecisionPolicy()) {
-                    case QSql::LowPrecisionInt32:
-                        values[i + idx] = sqlite3_column_int(stmt, i);
-                        break;
-                    case QSql::LowPrecisionInt64:
-                        values[i + idx] = sqlite3_column_int64(stmt, i);
-                        break;
-                    case QSql::LowPrecisionDouble:
-                    case QSql::HighPrecision:
-                    default:
-                        values[i + idx] = sqlite3_column_double(stmt, i);
-                        break;
-                };
-                break;
-            case SQLITE_NULL:
-                values[i + idx] = QVariant(QVariant::String);
-                break;
-            default:
-                values[i + idx] = QString::fromUtf16(static_cast<const ushort *>(
-                            sqlite3_column_text16(stmt, i)),
-                            sqlite3_column_bytes16(stmt, i) / sizeof(ushort));
-                break;
-            }
-        }
+        if (lazy)
+            return true;
+        for (i = 0; i < rInf.count(); ++i)
+            values[i + idx] = columnValue(i);
         return true;
     case SQLITE_DONE:
         if (rInf.isEmpty())
@@ -282,6 +260,62 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
     return false;
 }
 
+QVariant QSQLiteResultPrivate::columnValue(int i) const
+{
+    switch (sqlite3_column_type(stmt, i)) {
+    case SQLITE_BLOB:
+        return QByteArray(static_cast<const char *>(sqlite3_column_blob(stmt, i)),
+                          sqlite3_column_bytes(stmt, i));
+    case SQLITE_INTEGER:
+        return sqlite3_column_int64(stmt, i);
+    case SQLITE_FLOAT:
+        switch(q->numericalPrecisionPolicy()) {
+            case QSql::LowPrecisionInt32:
+                return sqlite3_column_int(stmt, i);
+            case QSql::LowPrecisionInt64:
+                return sqlite3_column_int64(stmt, i);
+            case QSql::LowPrecisionDouble:
+            case QSql::HighPrecision:
+            default:
+                return sqlite3_column_double(stmt, i);
+        };
+    case SQLITE_NULL:
+        return QVariant(QVariant::String);
+    default:
+        // the database is UTF-8 encoded, so this doesn't need any conversion in sqlite
+        return QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, i)),
+                                 sqlite3_column_bytes(stmt, i));
+    }
+}
+
+void QSQLiteResultPrivate::readColumn(AkSqlColumn *column) const
+{
+    const int i = column->column;
+    switch (sqlite3_column_type(stmt, i)) {
+    case SQLITE_BLOB:
+        column->type = AkSqlColumn::Blob;
+        column->data = static_cast<const char *>(sqlite3_column_blob(stmt, i));
+        column->size = sqlite3_column_bytes(stmt, i);
+        break;
+    case SQLITE_INTEGER:
+        column->type = AkSqlColumn::Integer;
+        column->integer = sqlite3_column_int64(stmt, i);
+        break;
+    case SQLITE_FLOAT:
+        column->type = AkSqlColumn::Float;
+        column->real = sqlite3_column_double(stmt, i);
+        break;
+    case SQLITE_NULL:
+        column->type = AkSqlColumn::Null;
+        break;
+    default:
+        column->type = AkSqlColumn::Text;
+        column->data = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+        column->size = sqlite3_column_bytes(stmt, i);
+        break;
+    }
+}
+
 QSQLiteResult::QSQLiteResult(const QSQLiteDriver* db)
     : QSqlCachedResult(db)
 {
@@ -302,11 +336,34 @@ void QSQLiteResult::virtual_hook(int id, void *data)
         if (d->stmt)
             sqlite3_reset(d->stmt);
         break;
+    case AkSqlColumn::Hook: {
+        AkSqlColumn *column = static_cast<AkSqlColumn *>(data);
+        if (d->lazy && d->stmt && isValid() && column->column >= 0 && column->column < d->rInf.count())
+            d->readColumn(column);
+        break; }
     default:
         QSqlCachedResult::virtual_hook(id, data);
     }
 }
 
+QVariant QSQLiteResult::data(int i)
+{
+    if (!d->lazy)
+        return QSqlCachedResult::data(i);
+    if (!d->stmt || !isValid() || i < 0 || i >= d->rInf.count())
+        return QVariant();
+    return d->columnValue(i);
+}
+
+bool QSQLiteResult::isNull(int i)
+{
+    if (!d->lazy)
+        return QSqlCachedResult::isNull(i);
+    if (!d->stmt || !isValid() || i < 0 || i >= d->rInf.count())
+        return true;
+    return sqlite3_column_type(d->stmt, i) == SQLITE_NULL;
+}
+
 bool QSQLiteResult::reset(const QString &query)
 {
     if (!prepare(query))
@@ -323,14 +380,14 @@ bool QSQLiteResult::prepare(const QString &query)
 
     setSelect(false);
 
+    // the database uses UTF-8, preparing from UTF-16 would convert the statement twice
+    const QByteArray utf8Query = query.toUtf8();
 #if (SQLITE_VERSION_NUMBER >= 3003011)
-//    int res = sqlite3_prepare16_v2(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
-//                                   &d->stmt, 0);
-    int res = sqlite3_blocking_prepare16_v2(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
-                                            &d->stmt, 0);
+    int res = sqlite3_blocking_prepare_v2(d->access, utf8Query.constData(), utf8Query.size() + 1,
+                                          &d->stmt, 0);
 #else
-    int res = sqlite3_prepare16(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
-                                &d->stmt, 0);
+    int res = sqlite3_prepare(d->access, utf8Query.constData(), utf8Query.size() + 1,
+                              &d->stmt, 0);
 #endif
 
     if (res != SQLITE_OK) {
@@ -348,6 +405,7 @@ bool QSQLiteResult::exec()
 
     d->skippedStatus = false;
     d->skipRow = false;
+    d->lazy = isForwardOnly();
     d->rInf.clear();
     clearValues();
     setLastError(QSqlError());
@@ -361,6 +419,7 @@ bool QSQLiteResult::exec()
     }
     int paramCount = sqlite3_bind_parameter_count(d->stmt);
     if (paramCount == values.count()) {
+        d->boundText.resize(paramCount);
         for (int i = 0; i < paramCount; ++i) {
             res = SQLITE_OK;
             const QVariant value = values.at(i);
@@ -385,16 +444,17 @@ bool QSQLiteResult::exec()
                     res = sqlite3_bind_int64(d->stmt, i + 1, value.toLongLong());
                     break;
                 case QVariant::String: {
-                    // lifetime of string == lifetime of its qvariant
-                    const QString *str = static_cast<const QString*>(value.constData());
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str->utf16(),
-                                              (str->size()) * sizeof(QChar), SQLITE_STATIC);
+                    // lifetime of the encoded string == lifetime of the statement
+                    QByteArray &text = d->boundText[i];
+                    text = static_cast<const QString*>(value.constData())->toUtf8();
+                    res = sqlite3_bind_text(d->stmt, i + 1, text.constData(),
+                                            text.size(), SQLITE_STATIC);
                     break; }
                 default: {
-                    QString str = value.toString();
-                    // SQLITE_TRANSIENT makes sure that sqlite buffers the data
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str.utf16(),
-                                              (str.size()) * sizeof(QChar), SQLITE_TRANSIENT);
+                    QByteArray &text = d->boundText[i];
+                    text = value.toString().toUtf8();
+                    res = sqlite3_bind_text(d->stmt, i + 1, text.constData(),
+                                            text.size(), SQLITE_STATIC);
                     break; }
                 }
             }
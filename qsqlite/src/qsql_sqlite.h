@@ -79,6 +79,8 @@ protected:
     int numRowsAffected();
     QVariant lastInsertId() const;
     QSqlRecord record() const;
+    QVariant data(int i);
+    bool isNull(int i);
     void virtual_hook(int id, void *data);
 
 private:
@@ -89,14 +89,14 @@ int sqlite3_blocking_step(sqlite3_stmt *pStmt)
   return rc;
 }
 
-int sqlite3_blocking_prepare16_v2(sqlite3 *db, const void *zSql, int nSql,
-                                  sqlite3_stmt **ppStmt, const void **pzTail)
+int sqlite3_blocking_prepare_v2(sqlite3 *db, const char *zSql, int nSql,
+                                sqlite3_stmt **ppStmt, const char **pzTail)
 {
   int rc;
-  while (SQLITE_LOCKED_SHAREDCACHE == (rc = sqlite3_prepare16_v2(db, zSql, nSql, ppStmt, pzTail))) {
-    qDebug() << debugString() << "sqlite3_blocking_prepare16_v2: Waiting..."; QTime now; now.start();
+  while (SQLITE_LOCKED_SHAREDCACHE == (rc = sqlite3_prepare_v2(db, zSql, nSql, ppStmt, pzTail))) {
+    qDebug() << debugString() << "sqlite3_blocking_prepare_v2: Waiting..."; QTime now; now.start();
     rc = qSqlite3WaitForUnlockNotify(db);
-    qDebug() << debugString() << "sqlite3_blocking_prepare16_v2: Waited for " << now.elapsed() << "ms";
+    qDebug() << debugString() << "sqlite3_blocking_prepare_v2: Waited for " << now.elapsed() << "ms";
     if (rc != SQLITE_OK) {
       break;
     }
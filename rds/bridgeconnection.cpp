@@ -31,25 +31,95 @@
 #ifdef Q_OS_UNIX
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <unistd.h>
+
+#include "forwarder.h"
 #endif
 
 BridgeConnection::BridgeConnection( QTcpSocket *remoteSocket, QObject *parent )
   : QObject( parent )
   , m_localSocket( 0 )
   , m_remoteSocket( remoteSocket )
+  , m_forwarder( 0 )
 {
   // wait for the vtable to be complete
   QMetaObject::invokeMethod( this, "doConnects", Qt::QueuedConnection );
-  QMetaObject::invokeMethod( this, "connectLocal", Qt::QueuedConnection );
+  QMetaObject::invokeMethod( this, "doConnectLocal", Qt::QueuedConnection );
 }
 
 BridgeConnection::~BridgeConnection()
 {
+#ifdef Q_OS_UNIX
+  delete m_forwarder;
+#endif
   delete m_remoteSocket;
 }
 
+void BridgeConnection::doConnectLocal()
+{
+  connectLocal();
+
+  // sockets set up from a descriptor don't emit connected()
+  QLocalSocket *localSocket = qobject_cast<QLocalSocket *>( m_localSocket );
+  if ( localSocket && localSocket->state() == QLocalSocket::ConnectedState ) {
+    startForwarding();
+  }
+}
+
+void BridgeConnection::startForwarding()
+{
+#ifdef Q_OS_UNIX
+  QLocalSocket *localSocket = qobject_cast<QLocalSocket *>( m_localSocket );
+  if ( m_forwarder || !localSocket ) {
+    return;
+  }
+
+  // Hand the connections over to a Forwarder, which moves the data from its
+  // own thread without copying it through QIODevice buffers
+  const int remoteFd = ::dup( m_remoteSocket->socketDescriptor() );
+  const int localFd = ::dup( localSocket->socketDescriptor() );
+  if ( remoteFd < 0 || localFd < 0 ) {
+    qDebug() << "Can't take over the sockets, forwarding in the event loop";
+    if ( remoteFd >= 0 ) {
+      ::close( remoteFd );
+    }
+    if ( localFd >= 0 ) {
+      ::close( localFd );
+    }
+    slotDataAvailable();
+    return;
+  }
+
+  disconnect( m_remoteSocket, 0, this, 0 );
+  disconnect( m_localSocket, 0, this, 0 );
+  m_forwarder = new Forwarder( remoteFd, localFd );
+  // what has already been read by the sockets goes first
+  m_forwarder->setPendingData( localSocket->readAll(), m_remoteSocket->readAll() );
+  m_remoteSocket->abort();
+  localSocket->abort();
+
+  connect( m_forwarder, SIGNAL(finished()), SLOT(forwardingFinished()) );
+  m_forwarder->start();
+#else
+  slotDataAvailable();
+#endif
+}
+
+void BridgeConnection::forwardingFinished()
+{
+#ifdef Q_OS_UNIX
+  qDebug() << "Connection closed," << m_forwarder->bytesToSecond() << "bytes forwarded to the server,"
+           << m_forwarder->bytesToFirst() << "bytes to the client";
+#endif
+  deleteLater();
+}
+
 void BridgeConnection::slotDataAvailable()
 {
+  // keep the data in the remote socket until there is somewhere to send it to
+  if ( !m_localSocket->isOpen() ) {
+    return;
+  }
   if ( m_localSocket->bytesAvailable() > 0 ) {
     m_remoteSocket->write( m_localSocket->read( m_localSocket->bytesAvailable() ) );
   }
@@ -117,5 +187,5 @@ void BridgeConnection::doConnects()
   connect( m_remoteSocket, SIGNAL(disconnected()), SLOT(deleteLater()) );
   connect( m_localSocket, SIGNAL(readyRead()), SLOT(slotDataAvailable()) );
   connect( m_remoteSocket, SIGNAL(readyRead()), SLOT(slotDataAvailable()) );
-  connect( m_localSocket, SIGNAL(connected()), SLOT(slotDataAvailable()) );
+  connect( m_localSocket, SIGNAL(connected()), SLOT(startForwarding()) );
 }
@@ -24,6 +24,7 @@
 
 class QTcpSocket;
 class QIODevice;
+class Forwarder;
 
 class BridgeConnection : public QObject
 {
@@ -41,10 +42,14 @@ class BridgeConnection : public QObject
     QIODevice *m_localSocket;
 
   private Q_SLOTS:
+    void doConnectLocal();
+    void startForwarding();
+    void forwardingFinished();
     void slotDataAvailable();
 
   private:
     QTcpSocket *m_remoteSocket;
+    Forwarder *m_forwarder;
 };
 
 class AkonadiBridgeConnection : public BridgeConnection
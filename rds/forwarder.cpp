@@ -0,0 +1,341 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by Till Adam <adam@kde.org>                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.         *
+ ***************************************************************************/
+
+#include "forwarder.h"
+
+#include <QtCore/QDebug>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class Forwarder::Direction
+{
+  public:
+    Direction( int from, int to, const QByteArray &pending, Forwarder::Mode mode )
+      : m_from( from )
+      , m_to( to )
+      , m_splice( false )
+      , m_capacity( Forwarder::BufferSize )
+      , m_start( 0 )
+      , m_fill( 0 )
+      , m_pending( pending )
+      , m_pendingOffset( 0 )
+      , m_eof( false )
+      , m_closed( false )
+      , m_written( 0 )
+    {
+      m_pipe[0] = m_pipe[1] = -1;
+#ifdef Q_OS_LINUX
+      if ( mode == Forwarder::Splice && ::pipe2( m_pipe, O_NONBLOCK | O_CLOEXEC ) == 0 ) {
+        m_splice = true;
+        // the default pipe size of 64 KiB means a lot of syscalls for large payloads
+        ::fcntl( m_pipe[1], F_SETPIPE_SZ, static_cast<int>( Forwarder::BufferSize ) );
+        const int size = ::fcntl( m_pipe[1], F_GETPIPE_SZ );
+        m_capacity = size > 0 ? size : 65536;
+      }
+#else
+      Q_UNUSED( mode );
+#endif
+      if ( !m_splice ) {
+        m_buffer.resize( m_capacity );
+      }
+    }
+
+    ~Direction()
+    {
+      closePipe();
+    }
+
+    bool wantsRead() const
+    {
+      return !m_eof && m_fill < m_capacity;
+    }
+
+    bool wantsWrite() const
+    {
+      return m_fill > 0 || m_pendingOffset < m_pending.size();
+    }
+
+    bool isClosed() const
+    {
+      return m_closed;
+    }
+
+    qint64 written() const
+    {
+      return m_written;
+    }
+
+    /**
+     * Moves as much data as possible without blocking, returns false on errors.
+     */
+    bool transfer()
+    {
+      // bounded, so that a busy direction doesn't starve the other one
+      for ( int i = 0; i < 16; ++i ) {
+        bool progress = false;
+        if ( wantsRead() && !read( progress ) ) {
+          return false;
+        }
+        if ( wantsWrite() && !write( progress ) ) {
+          return false;
+        }
+        if ( m_eof && !wantsWrite() && !m_closed ) {
+          // pass the end of the stream on, the other direction may go on
+          ::shutdown( m_to, SHUT_WR );
+          m_closed = true;
+        }
+        if ( !progress ) {
+          break;
+        }
+      }
+      return true;
+    }
+
+  private:
+    static bool isTemporaryError()
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    void closePipe()
+    {
+      if ( m_pipe[0] >= 0 ) {
+        ::close( m_pipe[0] );
+        ::close( m_pipe[1] );
+        m_pipe[0] = m_pipe[1] = -1;
+      }
+    }
+
+    bool read( bool &progress )
+    {
+      ssize_t n = -1;
+#ifdef Q_OS_LINUX
+      if ( m_splice ) {
+        n = ::splice( m_from, 0, m_pipe[1], 0, m_capacity - m_fill, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+        if ( n < 0 && errno == EINVAL && m_fill == 0 && m_written == 0 ) {
+          // the socket type doesn't support splicing
+          qDebug() << "splice() not supported, copying instead";
+          closePipe();
+          m_splice = false;
+          m_capacity = Forwarder::BufferSize;
+          m_buffer.resize( m_capacity );
+        }
+      }
+#endif
+      if ( !m_splice ) {
+        if ( m_fill == 0 ) {
+          m_start = 0;
+        } else if ( m_start + m_fill == m_capacity ) {
+          ::memmove( m_buffer.data(), m_buffer.constData() + m_start, m_fill );
+          m_start = 0;
+        }
+        n = ::read( m_from, m_buffer.data() + m_start + m_fill, m_capacity - m_start - m_fill );
+      }
+
+      if ( n > 0 ) {
+        m_fill += n;
+        progress = true;
+        return true;
+      }
+      if ( n == 0 ) {
+        m_eof = true;
+        progress = true;
+        return true;
+      }
+      if ( isTemporaryError() ) {
+        return true;
+      }
+      qDebug() << "Reading failed:" << ::strerror( errno );
+      return false;
+    }
+
+    bool write( bool &progress )
+    {
+      ssize_t n = -1;
+      if ( m_pendingOffset < m_pending.size() ) {
+        n = ::write( m_to, m_pending.constData() + m_pendingOffset, m_pending.size() - m_pendingOffset );
+        if ( n > 0 ) {
+          m_pendingOffset += n;
+          if ( m_pendingOffset == m_pending.size() ) {
+            m_pending.clear();
+            m_pendingOffset = 0;
+          }
+        }
+      } else {
+#ifdef Q_OS_LINUX
+        if ( m_splice ) {
+          n = ::splice( m_pipe[0], 0, m_to, 0, m_fill, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+        } else
+#endif
+        {
+          n = ::write( m_to, m_buffer.constData() + m_start, m_fill );
+          if ( n > 0 ) {
+            m_start += n;
+          }
+        }
+        if ( n > 0 ) {
+          m_fill -= n;
+        }
+      }
+
+      if ( n > 0 ) {
+        m_written += n;
+        progress = true;
+        return true;
+      }
+      if ( n < 0 && isTemporaryError() ) {
+        return true;
+      }
+      qDebug() << "Writing failed:" << ::strerror( errno );
+      return false;
+    }
+
+    int m_from;
+    int m_to;
+    bool m_splice;
+    int m_pipe[2];
+    int m_capacity;
+    // copy mode: the data is at [m_start, m_start + m_fill) of m_buffer
+    QByteArray m_buffer;
+    int m_start;
+    int m_fill;
+    QByteArray m_pending;
+    int m_pendingOffset;
+    bool m_eof;
+    bool m_closed;
+    qint64 m_written;
+};
+
+Forwarder::Forwarder( int first, int second, QObject *parent )
+  : QThread( parent )
+  , m_first( first )
+  , m_second( second )
+  , m_mode( Splice )
+  , m_stop( 0 )
+  , m_bytesToFirst( 0 )
+  , m_bytesToSecond( 0 )
+{
+  if ( ::pipe( m_wakeUp ) != 0 ) {
+    m_wakeUp[0] = m_wakeUp[1] = -1;
+  }
+
+  ::fcntl( m_first, F_SETFL, ::fcntl( m_first, F_GETFL ) | O_NONBLOCK );
+  ::fcntl( m_second, F_SETFL, ::fcntl( m_second, F_GETFL ) | O_NONBLOCK );
+}
+
+Forwarder::~Forwarder()
+{
+  stop();
+  wait();
+
+  ::close( m_first );
+  ::close( m_second );
+  if ( m_wakeUp[0] >= 0 ) {
+    ::close( m_wakeUp[0] );
+    ::close( m_wakeUp[1] );
+  }
+}
+
+void Forwarder::setMode( Mode mode )
+{
+  m_mode = mode;
+}
+
+Forwarder::Mode Forwarder::mode() const
+{
+  return m_mode;
+}
+
+void Forwarder::setPendingData( const QByteArray &toFirst, const QByteArray &toSecond )
+{
+  m_pendingToFirst = toFirst;
+  m_pendingToSecond = toSecond;
+}
+
+void Forwarder::stop()
+{
+  m_stop.fetchAndStoreRelease( 1 );
+  if ( m_wakeUp[1] >= 0 ) {
+    const char c = 0;
+    const ssize_t result = ::write( m_wakeUp[1], &c, 1 );
+    Q_UNUSED( result );
+  }
+}
+
+qint64 Forwarder::bytesToFirst() const
+{
+  return m_bytesToFirst;
+}
+
+qint64 Forwarder::bytesToSecond() const
+{
+  return m_bytesToSecond;
+}
+
+void Forwarder::run()
+{
+  Direction toSecond( m_first, m_second, m_pendingToSecond, m_mode );
+  Direction toFirst( m_second, m_first, m_pendingToFirst, m_mode );
+
+  // deliver the pending data before waiting for anything
+  bool ok = toSecond.transfer() && toFirst.transfer();
+
+  while ( ok && !m_stop.fetchAndAddAcquire( 0 ) && !( toFirst.isClosed() && toSecond.isClosed() ) ) {
+    struct pollfd fds[3];
+    fds[0].fd = m_wakeUp[0];
+    fds[0].events = POLLIN;
+    // Only ask for input a direction has room for, that's the backpressure
+    fds[1].fd = m_first;
+    fds[1].events = ( toSecond.wantsRead() ? POLLIN : 0 ) | ( toFirst.wantsWrite() ? POLLOUT : 0 );
+    fds[2].fd = m_second;
+    fds[2].events = ( toFirst.wantsRead() ? POLLIN : 0 ) | ( toSecond.wantsWrite() ? POLLOUT : 0 );
+    for ( int i = 0; i < 3; ++i ) {
+      fds[i].revents = 0;
+      if ( fds[i].events == 0 ) {
+        fds[i].fd = -1;
+      }
+    }
+
+    if ( ::poll( fds, 3, -1 ) < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      qDebug() << "poll() failed:" << ::strerror( errno );
+      break;
+    }
+    if ( fds[0].revents ) {
+      break;
+    }
+
+    if ( ( fds[1].revents & ~POLLOUT ) || ( fds[2].revents & POLLOUT ) ) {
+      ok = toSecond.transfer();
+    }
+    if ( ok && ( ( fds[2].revents & ~POLLOUT ) || ( fds[1].revents & POLLOUT ) ) ) {
+      ok = toFirst.transfer();
+    }
+  }
+
+  m_bytesToFirst = toFirst.written();
+  m_bytesToSecond = toSecond.written();
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by Till Adam <adam@kde.org>                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.         *
+ ***************************************************************************/
+
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QThread>
+
+/**
+ * Forwards data between two connected sockets in both directions from a
+ * thread of its own.
+ *
+ * On Linux the data is moved with splice() through a pipe and never copied
+ * to user space, elsewhere (or when a socket type doesn't support splicing)
+ * it goes through a fixed buffer per direction.
+ *
+ * A side is only read from while the data read from it before has room in
+ * the pipe or buffer, so a slow reader throttles the writer on the other side
+ * through the TCP or local socket flow control instead of making the bridge
+ * buffer without limit.
+ *
+ * When one side closes, the remaining data is delivered and the other side
+ * is shut down for writing; the thread finishes once both directions are
+ * closed or on the first error.
+ */
+class Forwarder : public QThread
+{
+  Q_OBJECT
+
+  public:
+    enum Mode {
+      Splice, ///< splice() through a pipe where supported, copy otherwise
+      Copy    ///< always copy through a buffer
+    };
+
+    /**
+     * Amount of data in flight per direction.
+     */
+    enum {
+      BufferSize = 256 * 1024
+    };
+
+    /**
+     * Takes ownership of the socket descriptors @p first and @p second.
+     */
+    Forwarder( int first, int second, QObject *parent = 0 );
+    ~Forwarder();
+
+    /**
+     * Whether to use splice(), must be called before start().
+     */
+    void setMode( Mode mode );
+    Mode mode() const;
+
+    /**
+     * Data that has been read from the sockets before the forwarder took
+     * over, it is sent ahead of everything else. Must be called before start().
+     */
+    void setPendingData( const QByteArray &toFirst, const QByteArray &toSecond );
+
+    /**
+     * Makes the thread finish without waiting for the sockets to close.
+     */
+    void stop();
+
+    /**
+     * Total number of bytes written to the first and the second socket,
+     * valid once the thread has finished.
+     */
+    qint64 bytesToFirst() const;
+    qint64 bytesToSecond() const;
+
+  protected:
+    void run();
+
+  private:
+    class Direction;
+
+    int m_first;
+    int m_second;
+    int m_wakeUp[2];
+    Mode m_mode;
+    QByteArray m_pendingToFirst;
+    QByteArray m_pendingToSecond;
+    QAtomicInt m_stop;
+    qint64 m_bytesToFirst;
+    qint64 m_bytesToSecond;
+};
+
+#endif // FORWARDER_H
@@ -148,6 +148,28 @@ static bool checkAvailableAgentTypes()
   return true;
 }
 
+static bool queryStatistics( bool reset )
+{
+  QDBusInterface iface( AkDBus::serviceName( AkDBus::Server ), QLatin1String( "/storageDebug" ),
+                        QLatin1String( "org.freedesktop.Akonadi.StorageDebugger" ) );
+  if ( !iface.isValid() ) {
+    qWarning() << "Akonadi is not running.";
+    return false;
+  }
+
+  const QDBusReply<QString> reply = iface.call( QLatin1String( "statistics" ) );
+  if ( !reply.isValid() ) {
+    qWarning() << "Failed to retrieve statistics:" << reply.error().message();
+    return false;
+  }
+  fprintf( stdout, "%s", qPrintable( reply.value() ) );
+
+  if ( reset ) {
+    iface.call( QLatin1String( "resetStatistics" ) );
+  }
+  return true;
+}
+
 static bool statusServer()
 {
   checkAkonadiControlStatus();
@@ -168,7 +190,9 @@ int main( int argc, char **argv )
       "  restart    : Restart Akonadi server with all its processes\n"
       "  status     : Shows a status overview of the Akonadi server\n"
       "  vacuum     : Vacuum internal storage (WARNING: needs a lot of time and disk space!)\n"
-      "  fsck       : Check (and attempt to fix) consistency of the internal storage (can take some time)" ) );
+      "  fsck       : Check (and attempt to fix) consistency of the internal storage (can take some time)\n"
+      "  stats      : Shows latency statistics of client commands and database queries\n"
+      "  resetstats : Shows latency statistics and resets them afterwards" ) );
 
   app.parseCommandLine();
 
@@ -179,6 +203,8 @@ int main( int argc, char **argv )
   optionsList.append( QLatin1String( "restart" ) );
   optionsList.append( QLatin1String( "vacuum" ) );
   optionsList.append( QLatin1String( "fsck" ) );
+  optionsList.append( QLatin1String( "stats" ) );
+  optionsList.append( QLatin1String( "resetstats" ) );
 
   QStringList arguments = QCoreApplication::instance()->arguments();
   if ( AkApplication::hasInstanceIdentifier() ) { // HACK: we should port all of this to boost::program_options...
@@ -226,6 +252,14 @@ int main( int argc, char **argv )
   } else if ( arguments[1] == QLatin1String( "fsck" ) ) {
     QDBusInterface iface( AkDBus::serviceName( AkDBus::StorageJanitor ), QLatin1String( AKONADI_DBUS_STORAGEJANITOR_PATH ) );
     iface.call( QDBus::NoBlock, QLatin1String( "check" ) );
+  } else if ( arguments[1] == QLatin1String( "stats" ) ) {
+    if ( !queryStatistics( false ) ) {
+      return 6;
+    }
+  } else if ( arguments[1] == QLatin1String( "resetstats" ) ) {
+    if ( !queryStatistics( true ) ) {
+      return 6;
+    }
   }
   return 0;
 }
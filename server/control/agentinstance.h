@@ -59,6 +59,7 @@ class AgentInstance : public QObject
     void setIdentifier( const QString &identifier ) { mIdentifier = identifier; }
 
     QString agentType() const { return mType; }
+    void setAgentType( const QString &agentType ) { mType = agentType; }
     int status() const { return mStatus; }
     QString statusMessage() const { return mStatusMessage; }
     int progress() const { return mPercent; }
@@ -104,9 +105,6 @@ class AgentInstance : public QObject
   private:
     template <typename T> T *findInterface( AkDBus::AgentType agentType, const char *path = 0 );
 
-  protected:
-    void setAgentType( const QString &agentType ) { mType = agentType; }
-
   private:
     QString mIdentifier;
     QString mType;
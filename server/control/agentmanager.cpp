@@ -60,6 +60,7 @@ static bool enableAgentServerDefault = false;
 AgentManager::AgentManager( QObject *parent )
   : QObject( parent )
   , mAgentServer( 0 )
+  , mStartupScheduler( new AgentStartupScheduler( this, this ) )
 #ifndef QT_NO_DEBUG
   , mAgentWatcher( new QFileSystemWatcher( this ) )
 #endif
@@ -94,6 +95,8 @@ AgentManager::AgentManager( QObject *parent )
     mAgentServer->start( QLatin1String( "akonadi_agent_server" ), serviceArgs, Akonadi::ProcessControl::RestartOnCrash );
   }
 
+  connect( mStartupScheduler, SIGNAL(startFailed(QString)), SLOT(agentStartFailed(QString)) );
+
 #ifndef QT_NO_DEBUG
   connect( mAgentWatcher, SIGNAL(fileChanged(QString)), SLOT(agentExeChanged(QString)) );
 #endif
@@ -148,7 +151,9 @@ AgentManager::~AgentManager()
 void AgentManager::cleanup()
 {
   Q_FOREACH ( const AgentInstance::Ptr &instance, mAgentInstances ) {
-    instance->quit();
+    if ( !mStartupScheduler->cancel( instance->identifier() ) ) {
+      instance->quit();
+    }
   }
 
   mAgentInstances.clear();
@@ -241,17 +246,29 @@ QVariantMap AgentManager::agentCustomProperties( const QString &identifier ) con
 
 AgentInstance::Ptr AgentManager::createAgentInstance( const AgentType &info )
 {
+  AgentInstance::Ptr instance;
   switch ( info.launchMethod ) {
   case AgentType::Server:
-    return AgentInstance::Ptr( new Akonadi::AgentThreadInstance( this ) );
+    instance = AgentInstance::Ptr( new Akonadi::AgentThreadInstance( this ) );
+    break;
   case AgentType::Launcher: // Fall through
   case AgentType::Process:
-    return AgentInstance::Ptr( new Akonadi::AgentProcessInstance( this ) );
+    instance = AgentInstance::Ptr( new Akonadi::AgentProcessInstance( this ) );
+    break;
   default:
     Q_ASSERT_X( false, "AgentManger::createAgentInstance", "Unhandled AgentType::LaunchMethod case" );
+    return instance;
   }
 
-  return AgentInstance::Ptr();
+  // known before start(), instances waiting for their start are saved too
+  instance->setAgentType( info.identifier );
+  return instance;
+}
+
+bool AgentManager::startAgentInstance( const QString &identifier, const AgentType &type )
+{
+  const AgentInstance::Ptr instance = mAgentInstances.value( identifier );
+  return instance && instance->start( type );
 }
 
 QString AgentManager::createAgentInstance( const QString &identifier )
@@ -307,6 +324,7 @@ void AgentManager::removeAgentInstance( const QString &identifier )
   }
 
   mAgentInstances.remove( identifier );
+  mStartupScheduler->cancel( identifier );
 
   save();
 
@@ -475,6 +493,11 @@ void AgentManager::restartAgentInstance( const QString &identifier )
     return;
   }
 
+  // still waiting for its start, which will use the current executable anyway
+  if ( mStartupScheduler->isQueued( identifier ) ) {
+    return;
+  }
+
   mAgentInstances.value( identifier )->restartWhenIdle();
 }
 
@@ -596,11 +619,11 @@ void AgentManager::load()
       registerAgentAtServer( instanceIdentifier, type );
     }
 
+    // started by the scheduler, so that not all agents are starting at once
     const AgentInstance::Ptr instance = createAgentInstance( type );
     instance->setIdentifier( instanceIdentifier );
-    if ( instance->start( type ) ) {
-      mAgentInstances.insert( instanceIdentifier, instance );
-    }
+    mAgentInstances.insert( instanceIdentifier, instance );
+    mStartupScheduler->schedule( instanceIdentifier, type );
 
     file.endGroup();
   }
@@ -655,6 +678,8 @@ void AgentManager::serviceOwnerChanged( const QString &name, const QString &oldO
       return; // It went down: we don't care here.
     }
 
+    mStartupScheduler->agentRegistered( agentIdentifier );
+
     if ( !mAgentInstances.contains( agentIdentifier ) ) {
       return;
     }
@@ -807,19 +832,38 @@ void AgentManager::ensureAutoStart( const AgentType &info )
     return; // no an autostart agent
   }
 
-  org::freedesktop::Akonadi::AgentServer agentServer( AkDBus::serviceName( AkDBus::AgentServer ),
-                                                      QLatin1String( "/AgentServer" ), QDBusConnection::sessionBus(), this );
+  if ( mAgentInstances.contains( info.identifier ) ) {
+    return; // already running or scheduled for starting
+  }
 
-  if ( mAgentInstances.contains( info.identifier ) ||
-       ( agentServer.isValid() && agentServer.started( info.identifier ) ) ) {
-    return; // already running
+  // only agents running in the agent server can have been started without us knowing
+  if ( mAgentServer && info.launchMethod == AgentType::Server ) {
+    org::freedesktop::Akonadi::AgentServer agentServer( AkDBus::serviceName( AkDBus::AgentServer ),
+                                                        QLatin1String( "/AgentServer" ), QDBusConnection::sessionBus(), this );
+    if ( agentServer.isValid() && agentServer.started( info.identifier ) ) {
+      return; // already running
+    }
   }
 
   const AgentInstance::Ptr instance = createAgentInstance( info );
   instance->setIdentifier( info.identifier );
-  if ( instance->start( info ) ) {
-    mAgentInstances.insert( instance->identifier(), instance );
-    registerAgentAtServer( instance->identifier(), info );
+  mAgentInstances.insert( instance->identifier(), instance );
+  registerAgentAtServer( instance->identifier(), info );
+  save();
+  mStartupScheduler->schedule( instance->identifier(), info );
+}
+
+void AgentManager::agentStartFailed( const QString &identifier )
+{
+  if ( !mAgentInstances.contains( identifier ) ) {
+    return;
+  }
+
+  const QString type = mAgentInstances.value( identifier )->agentType();
+  mAgentInstances.remove( identifier );
+  // autostart instances are only written to agentsrc by ensureAutoStart(),
+  // configured instances have to stay there
+  if ( mAgents.value( type ).capabilities.contains( AgentType::CapabilityAutostart ) ) {
     save();
   }
 }
@@ -833,7 +877,7 @@ void AgentManager::agentExeChanged( const QString &fileName )
   Q_FOREACH ( const AgentType &type, mAgents ) {
     if ( fileName.endsWith( type.exec ) ) {
       Q_FOREACH ( const AgentInstance::Ptr &instance, mAgentInstances ) {
-        if ( instance->agentType() == type.identifier ) {
+        if ( instance->agentType() == type.identifier && !mStartupScheduler->isQueued( instance->identifier() ) ) {
           instance->restartWhenIdle();
         }
       }
@@ -27,6 +27,7 @@
 
 #include "agenttype.h"
 #include "agentinstance.h"
+#include "agentstartupscheduler.h"
 
 class QDir;
 #ifndef QT_NO_DEBUG
@@ -37,12 +38,13 @@ namespace Akonadi {
   class ProcessControl;
 }
 
+
 /**
  * The agent manager has knowledge about all available agents (it scans
  * for .desktop files in the agent directory) and the available configured
  * instances.
  */
-class AgentManager : public QObject, protected QDBusContext
+class AgentManager : public QObject, protected QDBusContext, public AgentLauncher
 {
   Q_OBJECT
   Q_CLASSINFO( "D-Bus Interface", "org.freedesktop.Akonadi.AgentManager" )
@@ -320,6 +322,7 @@ class AgentManager : public QObject, protected QDBusContext
     void agentExeChanged( const QString &fileName );
     void agentServerFailure();
     void serverFailure();
+    void agentStartFailed( const QString &identifier );
 
   private:
     /**
@@ -351,6 +354,7 @@ class AgentManager : public QObject, protected QDBusContext
     void readPluginInfos( const QDir &directory );
 
     AgentInstance::Ptr createAgentInstance( const AgentType &type );
+    bool startAgentInstance( const QString &identifier, const AgentType &type );
     bool checkAgentInterfaces( const QString &identifier, const QString &method ) const;
     bool checkInstance( const QString &identifier ) const;
     bool checkResourceInterface( const QString &identifier, const QString &method ) const;
@@ -377,6 +381,7 @@ class AgentManager : public QObject, protected QDBusContext
 
     Akonadi::ProcessControl *mAgentServer;
     Akonadi::ProcessControl *mStorageController;
+    AgentStartupScheduler *mStartupScheduler;
 #ifndef QT_NO_DEBUG
     QFileSystemWatcher *mAgentWatcher;
 #endif
@@ -71,18 +71,26 @@ bool AgentProcessInstance::start( const AgentType &agentInfo )
 
 void AgentProcessInstance::quit()
 {
-  mController->setCrashPolicy( Akonadi::ProcessControl::StopOnCrash );
+  if ( mController ) {
+    mController->setCrashPolicy( Akonadi::ProcessControl::StopOnCrash );
+  }
   AgentInstance::quit();
 }
 
 void AgentProcessInstance::cleanup()
 {
-  mController->setCrashPolicy( Akonadi::ProcessControl::StopOnCrash );
+  if ( mController ) {
+    mController->setCrashPolicy( Akonadi::ProcessControl::StopOnCrash );
+  }
   AgentInstance::cleanup();
 }
 
 void AgentProcessInstance::restartWhenIdle()
 {
+  if ( !mController ) {
+    return; // not started yet
+  }
+
   if ( mController->isRunning() ) {
     if ( status() != 1 ) {
       mController->restartOnceWhenFinished();
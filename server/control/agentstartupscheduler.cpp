@@ -0,0 +1,273 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by Till Adam <adam@kde.org>                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.         *
+ ***************************************************************************/
+
+#include "agentstartupscheduler.h"
+
+#include "akdebug.h"
+#include "libs/xdgbasedirs_p.h"
+
+#include <akstandarddirs.h>
+
+#include <QtCore/QSettings>
+#include <QtCore/QTimer>
+#include <QtDBus/QDBusConnection>
+
+AgentStartupScheduler::AgentStartupScheduler( AgentLauncher *launcher, QObject *parent )
+  : QObject( parent )
+  , mLauncher( launcher )
+  , mLastStaggeredLaunch( -1 )
+  , mStartupDuration( -1 )
+  , mStaggerTimer( new QTimer( this ) )
+  , mTimeoutTimer( new QTimer( this ) )
+{
+  mClock.start();
+
+  const QSettings settings( AkStandardDirs::agentConfigFile( Akonadi::XdgBaseDirs::ReadOnly ), QSettings::IniFormat );
+  mMaximumConcurrentStarts = qMax( 1, settings.value( QLatin1String( "AgentStartup/MaxConcurrent" ), 4 ).toInt() );
+  mStaggerInterval = qMax( 0, settings.value( QLatin1String( "AgentStartup/StaggerInterval" ), 2000 ).toInt() );
+  mRegistrationTimeout = qMax( 1000, settings.value( QLatin1String( "AgentStartup/RegistrationTimeout" ), 30000 ).toInt() );
+  mPriorityAgents = settings.value( QLatin1String( "AgentStartup/PriorityAgents" ) ).toStringList();
+
+  mStaggerTimer->setSingleShot( true );
+  connect( mStaggerTimer, SIGNAL(timeout()), SLOT(startNext()) );
+  mTimeoutTimer->setInterval( 1000 );
+  connect( mTimeoutTimer, SIGNAL(timeout()), SLOT(checkTimeouts()) );
+
+  QDBusConnection::sessionBus().registerObject( QLatin1String( "/AgentManager/Startup" ), this,
+                                                QDBusConnection::ExportScriptableSlots | QDBusConnection::ExportScriptableSignals );
+}
+
+AgentStartupScheduler::~AgentStartupScheduler()
+{
+}
+
+AgentStartupScheduler::Priority AgentStartupScheduler::priority( const AgentType &type, const QString &identifier ) const
+{
+  if ( mPriorityAgents.contains( identifier ) || mPriorityAgents.contains( type.identifier ) ) {
+    return High;
+  }
+  if ( type.capabilities.contains( AgentType::CapabilityPreprocessor ) ) {
+    return High;
+  }
+  if ( type.capabilities.contains( AgentType::CapabilityResource ) ) {
+    return Low;
+  }
+  return Normal;
+}
+
+void AgentStartupScheduler::schedule( const QString &identifier, const AgentType &type )
+{
+  if ( mQueue.contains( identifier ) || mStarting.contains( identifier ) ) {
+    return;
+  }
+
+  Entry entry;
+  entry.type = type;
+  entry.priority = priority( type, identifier );
+  entry.queued = mClock.elapsed();
+  entry.launched = -1;
+  entry.registered = -1;
+  entry.timedOut = false;
+  entry.failed = false;
+  mEntries.insert( identifier, entry );
+
+  // behind all entries of the same or a higher priority, so the order of
+  // agentsrc is kept within a priority
+  int pos = mQueue.count();
+  while ( pos > 0 && mEntries.value( mQueue.at( pos - 1 ) ).priority > entry.priority ) {
+    --pos;
+  }
+  mQueue.insert( pos, identifier );
+
+  // start after the current batch has been queued
+  QMetaObject::invokeMethod( this, "startNext", Qt::QueuedConnection );
+}
+
+bool AgentStartupScheduler::isQueued( const QString &identifier ) const
+{
+  return mQueue.contains( identifier );
+}
+
+bool AgentStartupScheduler::cancel( const QString &identifier )
+{
+  mStarting.removeAll( identifier );
+  if ( !mQueue.removeAll( identifier ) ) {
+    return false;
+  }
+  mEntries.remove( identifier );
+  return true;
+}
+
+void AgentStartupScheduler::agentRegistered( const QString &identifier )
+{
+  if ( !mEntries.contains( identifier ) ) {
+    return;
+  }
+
+  Entry &entry = mEntries[identifier];
+  if ( entry.registered < 0 ) {
+    entry.registered = mClock.elapsed();
+    if ( entry.launched >= 0 ) {
+      akDebug() << "Agent" << identifier << "registered" << entry.registered - entry.launched << "ms after its launch";
+    }
+  }
+
+  if ( mStarting.removeAll( identifier ) ) {
+    startNext();
+  }
+}
+
+void AgentStartupScheduler::startNext()
+{
+  while ( !mQueue.isEmpty() && mStarting.count() < mMaximumConcurrentStarts ) {
+    const QString identifier = mQueue.first();
+    Entry &entry = mEntries[identifier];
+
+    if ( entry.priority == Low && mStaggerInterval > 0 && mLastStaggeredLaunch >= 0 ) {
+      const qint64 wait = mLastStaggeredLaunch + mStaggerInterval - mClock.elapsed();
+      if ( wait > 0 ) {
+        if ( !mStaggerTimer->isActive() ) {
+          mStaggerTimer->start( wait );
+        }
+        return;
+      }
+    }
+
+    mQueue.removeFirst();
+    launch( identifier, entry );
+  }
+
+  if ( mQueue.isEmpty() && mStarting.isEmpty() ) {
+    finishStartup();
+  }
+}
+
+void AgentStartupScheduler::launch( const QString &identifier, Entry &entry )
+{
+  entry.launched = mClock.elapsed();
+  if ( entry.priority == Low ) {
+    mLastStaggeredLaunch = entry.launched;
+  }
+
+  if ( !mLauncher->startAgentInstance( identifier, entry.type ) ) {
+    entry.failed = true;
+    Q_EMIT startFailed( identifier );
+    return;
+  }
+
+  // the service of an already running unique agent might be registered already
+  if ( entry.registered < 0 ) {
+    mStarting.append( identifier );
+    if ( !mTimeoutTimer->isActive() ) {
+      mTimeoutTimer->start();
+    }
+  }
+}
+
+void AgentStartupScheduler::checkTimeouts()
+{
+  const qint64 now = mClock.elapsed();
+  Q_FOREACH ( const QString &identifier, mStarting ) {
+    Entry &entry = mEntries[identifier];
+    if ( now - entry.launched >= mRegistrationTimeout ) {
+      akError() << "Agent" << identifier << "did not register on D-Bus within" << mRegistrationTimeout << "ms";
+      entry.timedOut = true;
+      mStarting.removeAll( identifier );
+    }
+  }
+
+  if ( mStarting.isEmpty() ) {
+    mTimeoutTimer->stop();
+  }
+  startNext();
+}
+
+void AgentStartupScheduler::finishStartup()
+{
+  mTimeoutTimer->stop();
+  if ( mStartupDuration >= 0 || mEntries.isEmpty() ) {
+    return;
+  }
+
+  mStartupDuration = mClock.elapsed();
+  akDebug() << "Started" << mEntries.count() << "agent instances in" << mStartupDuration << "ms";
+  Q_EMIT startupFinished( mStartupDuration );
+}
+
+int AgentStartupScheduler::maximumConcurrentStarts() const
+{
+  return mMaximumConcurrentStarts;
+}
+
+void AgentStartupScheduler::setMaximumConcurrentStarts( int count )
+{
+  mMaximumConcurrentStarts = qMax( 1, count );
+  startNext();
+}
+
+int AgentStartupScheduler::staggerInterval() const
+{
+  return mStaggerInterval;
+}
+
+void AgentStartupScheduler::setStaggerInterval( int msecs )
+{
+  mStaggerInterval = qMax( 0, msecs );
+  mStaggerTimer->stop();
+  startNext();
+}
+
+int AgentStartupScheduler::registrationTimeout() const
+{
+  return mRegistrationTimeout;
+}
+
+int AgentStartupScheduler::pendingStarts() const
+{
+  return mQueue.count() + mStarting.count();
+}
+
+qlonglong AgentStartupScheduler::startupDuration() const
+{
+  return mStartupDuration;
+}
+
+QStringList AgentStartupScheduler::startupTimes() const
+{
+  static const char *priorityNames[] = { "high", "normal", "low" };
+
+  QStringList times;
+  for ( QHash<QString, Entry>::const_iterator it = mEntries.constBegin(); it != mEntries.constEnd(); ++it ) {
+    const Entry &entry = it.value();
+    QString line = QString::fromLatin1( "%1 priority=%2 queued=%3 launched=%4 registered=%5" )
+                     .arg( it.key() )
+                     .arg( QLatin1String( priorityNames[entry.priority] ) )
+                     .arg( entry.queued )
+                     .arg( entry.launched )
+                     .arg( entry.registered );
+    if ( entry.failed ) {
+      line += QLatin1String( " failed" );
+    } else if ( entry.timedOut ) {
+      line += QLatin1String( " timeout" );
+    }
+    times << line;
+  }
+  times.sort();
+  return times;
+}
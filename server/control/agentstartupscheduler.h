@@ -0,0 +1,191 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by Till Adam <adam@kde.org>                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.         *
+ ***************************************************************************/
+
+#ifndef AGENTSTARTUPSCHEDULER_H
+#define AGENTSTARTUPSCHEDULER_H
+
+#include "agenttype.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+
+class QTimer;
+
+/**
+ * Starts agent instances on behalf of the AgentStartupScheduler.
+ */
+class AgentLauncher
+{
+  public:
+    virtual ~AgentLauncher() {}
+
+    /**
+     * Starts the instance @p identifier of @p type.
+     * Returns false if it could not be started.
+     */
+    virtual bool startAgentInstance( const QString &identifier, const AgentType &type ) = 0;
+};
+
+/**
+ * Starts the configured agent instances at startup.
+ *
+ * Instead of launching all instances at once, at most maximumConcurrentStarts()
+ * instances are starting at any time; an instance counts as started once it
+ * registered its agent service on D-Bus, or after registrationTimeout(). The
+ * instances are started in the order of their priority:
+ *
+ * - High: the agents and resources listed in the AgentStartup/PriorityAgents
+ *   setting of agentsrc (by type or instance identifier), usually the ones
+ *   the user looks at first, and preprocessors, which new items wait for
+ * - Normal: all other agents
+ * - Low: all other resources
+ *
+ * Resources synchronize right after they start, so the launches of low
+ * priority resources are staggered by staggerInterval() to spread their
+ * initial synchronization over time.
+ *
+ * The time each instance took to start is exported on D-Bus under
+ * /AgentManager/Startup. The instances themselves are started by the
+ * AgentLauncher (the AgentManager).
+ */
+class AgentStartupScheduler : public QObject
+{
+  Q_OBJECT
+  Q_CLASSINFO( "D-Bus Interface", "org.freedesktop.Akonadi.AgentStartup" )
+
+  public:
+    enum Priority {
+      High,
+      Normal,
+      Low
+    };
+
+    explicit AgentStartupScheduler( AgentLauncher *launcher, QObject *parent = 0 );
+    ~AgentStartupScheduler();
+
+    /**
+     * Queues the instance @p identifier for starting with @p type.
+     */
+    void schedule( const QString &identifier, const AgentType &type );
+
+    /**
+     * Returns whether the instance @p identifier is queued and has not been
+     * started yet.
+     */
+    bool isQueued( const QString &identifier ) const;
+
+    /**
+     * Removes the instance @p identifier from the queue if it hasn't been started yet.
+     * Returns true if it was queued.
+     */
+    bool cancel( const QString &identifier );
+
+    /**
+     * Has to be called when the agent service of @p identifier is registered.
+     */
+    void agentRegistered( const QString &identifier );
+
+    Priority priority( const AgentType &type, const QString &identifier ) const;
+
+  public Q_SLOTS:
+    /**
+     * Maximum number of instances that are starting at the same time.
+     */
+    Q_SCRIPTABLE int maximumConcurrentStarts() const;
+    Q_SCRIPTABLE void setMaximumConcurrentStarts( int count );
+
+    /**
+     * Minimum time in milliseconds between the launches of two low priority resources.
+     */
+    Q_SCRIPTABLE int staggerInterval() const;
+    Q_SCRIPTABLE void setStaggerInterval( int msecs );
+
+    /**
+     * Time in milliseconds after which an instance that hasn't registered on
+     * D-Bus yet no longer holds up the others.
+     */
+    Q_SCRIPTABLE int registrationTimeout() const;
+
+    /**
+     * Number of instances that are queued or starting.
+     */
+    Q_SCRIPTABLE int pendingStarts() const;
+
+    /**
+     * Time in milliseconds from the start of akonadi_control until all
+     * instances of the initial startup were registered, -1 before.
+     */
+    Q_SCRIPTABLE qlonglong startupDuration() const;
+
+    /**
+     * One line per instance with its priority and the times it was queued,
+     * launched and registered at, in milliseconds since the start of
+     * akonadi_control.
+     */
+    Q_SCRIPTABLE QStringList startupTimes() const;
+
+  Q_SIGNALS:
+    /**
+     * Emitted when the initial startup is done.
+     */
+    Q_SCRIPTABLE void startupFinished( qlonglong msecs );
+
+    /**
+     * Emitted when AgentInstance::start() failed for @p identifier.
+     */
+    void startFailed( const QString &identifier );
+
+  private Q_SLOTS:
+    void startNext();
+    void checkTimeouts();
+
+  private:
+    struct Entry
+    {
+      AgentType type;
+      Priority priority;
+      qint64 queued;
+      qint64 launched;
+      qint64 registered;
+      bool timedOut;
+      bool failed;
+    };
+
+    void launch( const QString &identifier, Entry &entry );
+    void finishStartup();
+
+    AgentLauncher *mLauncher;
+    QList<QString> mQueue;
+    QStringList mStarting;
+    QHash<QString, Entry> mEntries;
+    QStringList mPriorityAgents;
+    int mMaximumConcurrentStarts;
+    int mStaggerInterval;
+    int mRegistrationTimeout;
+    QElapsedTimer mClock;
+    qint64 mLastStaggeredLaunch;
+    qint64 mStartupDuration;
+    QTimer *mStaggerTimer;
+    QTimer *mTimeoutTimer;
+};
+
+#endif // AGENTSTARTUPSCHEDULER_H
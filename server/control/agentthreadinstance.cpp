@@ -71,6 +71,10 @@ void AgentThreadInstance::quit()
 
 void AgentThreadInstance::restartWhenIdle()
 {
+  if ( mAgentType.identifier.isEmpty() ) {
+    return; // not started yet
+  }
+
   if ( status() != 1 && !identifier().isEmpty() ) {
     org::freedesktop::Akonadi::AgentServer agentServer( AkDBus::serviceName( AkDBus::AgentServer ),
                                                         QLatin1String( "/AgentServer" ), QDBusConnection::sessionBus() );
@@ -81,6 +85,10 @@ void AgentThreadInstance::restartWhenIdle()
 
 void AgentThreadInstance::agentServerRegistered()
 {
+  if ( mAgentType.identifier.isEmpty() ) {
+    return; // not started yet, will be by the AgentStartupScheduler
+  }
+
   start( mAgentType );
 }
 
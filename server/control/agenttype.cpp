@@ -18,7 +18,6 @@
 */
 
 #include "agenttype.h"
-#include "agentmanager.h"
 #include "libs/xdgbasedirs_p.h"
 #include "libs/capabilities_p.h"
 #include <akdebug.h>
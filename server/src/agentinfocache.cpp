@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "agentinfocache.h"
+
+#include "agentmanagerinterface.h"
+
+#include <akdbus.h>
+#include <akdebug.h>
+
+#include <QDBusConnection>
+#include <QDBusReply>
+#include <QDBusServiceWatcher>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+using namespace Akonadi::Server;
+
+AgentInfoCache *AgentInfoCache::sInstance = 0;
+
+AgentInfoCache::AgentInfoCache(const QString &service, QObject *parent)
+    : QObject(parent)
+    , mReloadScheduled(0)
+{
+    Q_ASSERT(sInstance == 0);
+    sInstance = this;
+
+    const QString serviceName = service.isEmpty() ? AkDBus::serviceName(AkDBus::Control) : service;
+    mManager = new OrgFreedesktopAkonadiAgentManagerInterface(serviceName, QLatin1String("/AgentManager"),
+                                                              QDBusConnection::sessionBus(), this);
+
+    connect(mManager, SIGNAL(agentTypeAdded(QString)), this, SLOT(agentTypeChanged(QString)));
+    connect(mManager, SIGNAL(agentTypeRemoved(QString)), this, SLOT(agentTypeChanged(QString)));
+    connect(mManager, SIGNAL(agentInstanceAdded(QString)), this, SLOT(agentInstanceAdded(QString)));
+    connect(mManager, SIGNAL(agentInstanceRemoved(QString)), this, SLOT(agentInstanceRemoved(QString)));
+    connect(mManager, SIGNAL(agentInstanceStatusChanged(QString,int,QString)),
+            this, SLOT(agentInstanceStatusChanged(QString,int,QString)));
+    connect(mManager, SIGNAL(agentInstanceOnlineChanged(QString,bool)),
+            this, SLOT(agentInstanceOnlineChanged(QString,bool)));
+
+    QDBusServiceWatcher *watcher = new QDBusServiceWatcher(serviceName, QDBusConnection::sessionBus(),
+                                                           QDBusServiceWatcher::WatchForOwnerChange, this);
+    connect(watcher, SIGNAL(serviceOwnerChanged(QString,QString,QString)),
+            this, SLOT(serviceOwnerChanged(QString,QString,QString)));
+
+    reload();
+}
+
+AgentInfoCache::~AgentInfoCache()
+{
+    sInstance = 0;
+}
+
+AgentInfoCache *AgentInfoCache::instance()
+{
+    return sInstance;
+}
+
+AgentInfo AgentInfoCache::agentInfo(const QString &identifier) const
+{
+    {
+        QReadLocker locker(&mLock);
+        QHash<QString, AgentInfo>::ConstIterator it = mInstances.constFind(identifier);
+        if (it != mInstances.constEnd()) {
+            return it.value();
+        }
+        if (mMissing.contains(identifier)) {
+            return AgentInfo();
+        }
+    }
+
+    // The instance might have been created before the AgentManager was
+    // available, look for it again without blocking the caller. Identifiers
+    // that are still unknown afterwards, like the one of the virtual search
+    // resource, don't cause further reloads.
+    {
+        QWriteLocker locker(&mLock);
+        mMissing.insert(identifier);
+    }
+    if (mReloadScheduled.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(const_cast<AgentInfoCache *>(this), "reload", Qt::QueuedConnection);
+    }
+    return AgentInfo();
+}
+
+int AgentInfoCache::count() const
+{
+    QReadLocker locker(&mLock);
+    return mInstances.count();
+}
+
+void AgentInfoCache::reload()
+{
+    mReloadScheduled.fetchAndStoreOrdered(0);
+
+    mTypeProperties.clear();
+    QHash<QString, AgentInfo> instances;
+    const QStringList identifiers = mManager->agentInstances();
+    Q_FOREACH (const QString &identifier, identifiers) {
+        const AgentInfo info = queryAgentInfo(identifier);
+        if (info.isValid()) {
+            instances.insert(identifier, info);
+        }
+    }
+
+    QWriteLocker locker(&mLock);
+    mInstances = instances;
+    Q_FOREACH (const QString &identifier, instances.keys()) {
+        mMissing.remove(identifier);
+    }
+}
+
+AgentInfo AgentInfoCache::queryAgentInfo(const QString &identifier)
+{
+    AgentInfo info;
+    const QDBusReply<QString> type = mManager->agentInstanceType(identifier);
+    if (!type.isValid() || type.value().isEmpty()) {
+        akError() << "Failed to query the type of agent" << identifier << type.error().message();
+        return info;
+    }
+    info.type = type.value();
+    applyTypeProperties(info, typeProperties(info.type));
+    info.online = mManager->agentInstanceOnline(identifier);
+    info.status = mManager->agentInstanceStatus(identifier);
+    return info;
+}
+
+QVariantMap AgentInfoCache::typeProperties(const QString &type)
+{
+    QHash<QString, QVariantMap>::ConstIterator it = mTypeProperties.constFind(type);
+    if (it != mTypeProperties.constEnd()) {
+        return it.value();
+    }
+
+    const QVariantMap properties = mManager->agentCustomProperties(type);
+    mTypeProperties.insert(type, properties);
+    return properties;
+}
+
+void AgentInfoCache::applyTypeProperties(AgentInfo &info, const QVariantMap &properties)
+{
+    info.hasLocalStorage = properties.value(QLatin1String("HasLocalStorage"), false).toBool();
+    info.movesWithoutPayload = properties.value(QLatin1String("MovesWithoutPayload"), false).toBool();
+}
+
+void AgentInfoCache::agentTypeChanged(const QString &type)
+{
+    // The custom properties of the type might have changed with it
+    mTypeProperties.remove(type);
+    const QVariantMap properties = typeProperties(type);
+
+    QWriteLocker locker(&mLock);
+    for (QHash<QString, AgentInfo>::Iterator it = mInstances.begin(); it != mInstances.end(); ++it) {
+        if (it.value().type == type) {
+            applyTypeProperties(it.value(), properties);
+        }
+    }
+}
+
+void AgentInfoCache::agentInstanceAdded(const QString &identifier)
+{
+    const AgentInfo info = queryAgentInfo(identifier);
+    if (!info.isValid()) {
+        return;
+    }
+
+    QWriteLocker locker(&mLock);
+    mInstances.insert(identifier, info);
+    mMissing.remove(identifier);
+}
+
+void AgentInfoCache::agentInstanceRemoved(const QString &identifier)
+{
+    QWriteLocker locker(&mLock);
+    mInstances.remove(identifier);
+}
+
+void AgentInfoCache::agentInstanceStatusChanged(const QString &identifier, int status, const QString &message)
+{
+    Q_UNUSED(message);
+
+    QWriteLocker locker(&mLock);
+    QHash<QString, AgentInfo>::Iterator it = mInstances.find(identifier);
+    if (it != mInstances.end()) {
+        it.value().status = status;
+    }
+}
+
+void AgentInfoCache::agentInstanceOnlineChanged(const QString &identifier, bool online)
+{
+    QWriteLocker locker(&mLock);
+    QHash<QString, AgentInfo>::Iterator it = mInstances.find(identifier);
+    if (it != mInstances.end()) {
+        it.value().online = online;
+    }
+}
+
+void AgentInfoCache::serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+{
+    Q_UNUSED(service);
+    Q_UNUSED(oldOwner);
+
+    if (newOwner.isEmpty()) {
+        QWriteLocker locker(&mLock);
+        mInstances.clear();
+        return;
+    }
+    reload();
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_AGENTINFOCACHE_H
+#define AKONADI_SERVER_AGENTINFOCACHE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+
+class OrgFreedesktopAkonadiAgentManagerInterface;
+
+namespace Akonadi
+{
+namespace Server
+{
+
+/**
+ * What the server needs to know about an agent instance.
+ */
+struct AgentInfo
+{
+    /**
+     * The status values of AgentBase.
+     */
+    enum Status {
+        Idle = 0,
+        Running,
+        Broken,
+        NotConfigured
+    };
+
+    AgentInfo()
+        : online(false)
+        , status(Idle)
+        , hasLocalStorage(false)
+        , movesWithoutPayload(false)
+    {
+    }
+
+    bool isValid() const
+    {
+        return !type.isEmpty();
+    }
+
+    QString type;
+    bool online;
+    int status;
+    bool hasLocalStorage;
+    /**
+     * Whether the resource moves items between its own collections in its
+     * backend, without the payload having to be in the cache
+     * (the MovesWithoutPayload custom property of the agent type).
+     */
+    bool movesWithoutPayload;
+};
+
+/**
+ * Keeps the type, online state and status of all agent instances, so that
+ * connection threads can look them up without calling the AgentManager of the
+ * control process over D-Bus.
+ *
+ * The cache is populated from the AgentManager when created and whenever the
+ * control process (re)appears, and is kept current from the signals of the
+ * AgentManager. It lives in the main thread, lookups are thread-safe and
+ * never block on D-Bus.
+ */
+class AgentInfoCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Creates the cache for the AgentManager registered as @p service, by
+     * default the one of the control process.
+     */
+    explicit AgentInfoCache(const QString &service = QString(), QObject *parent = 0);
+    virtual ~AgentInfoCache();
+
+    /**
+     * Returns the cache, or 0 if none has been created.
+     */
+    static AgentInfoCache *instance();
+
+    /**
+     * Returns what is known about the agent instance @p identifier. The
+     * returned info is invalid for unknown instances. Thread-safe.
+     */
+    AgentInfo agentInfo(const QString &identifier) const;
+
+    /**
+     * Number of agent instances in the cache.
+     */
+    int count() const;
+
+public Q_SLOTS:
+    /**
+     * Queries all agent instances from the AgentManager again.
+     */
+    void reload();
+
+private Q_SLOTS:
+    void agentTypeChanged(const QString &type);
+    void agentInstanceAdded(const QString &identifier);
+    void agentInstanceRemoved(const QString &identifier);
+    void agentInstanceStatusChanged(const QString &identifier, int status, const QString &message);
+    void agentInstanceOnlineChanged(const QString &identifier, bool online);
+    void serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+
+private:
+    AgentInfo queryAgentInfo(const QString &identifier);
+    QVariantMap typeProperties(const QString &type);
+    static void applyTypeProperties(AgentInfo &info, const QVariantMap &properties);
+
+    static AgentInfoCache *sInstance;
+
+    OrgFreedesktopAkonadiAgentManagerInterface *mManager;
+
+    // only used from the main thread
+    QHash<QString, QVariantMap> mTypeProperties;
+
+    mutable QAtomicInt mReloadScheduled;
+    mutable QReadWriteLock mLock;
+    QHash<QString, AgentInfo> mInstances;
+    mutable QSet<QString> mMissing;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_AGENTINFOCACHE_H
@@ -19,6 +19,7 @@
 
 #include "akonadi.h"
 #include "connectionthread.h"
+#include "connectionworkerpool.h"
 #include "serveradaptor.h"
 #include <akdbus.h>
 #include <akdebug.h>
@@ -34,7 +35,9 @@
 #include "tracer.h"
 #include "utils.h"
 #include "debuginterface.h"
+#include "agentinfocache.h"
 #include "storage/itemretrievalthread.h"
+#include "storage/accesstimetracker.h"
 #include "preprocessormanager.h"
 #include "search/searchmanager.h"
 #include "search/searchtaskmanagerthread.h"
@@ -72,10 +75,12 @@ AkonadiServer* AkonadiServer::s_instance = 0;
 AkonadiServer::AkonadiServer( QObject *parent )
     : QLocalServer( parent )
     , mCacheCleaner( 0 )
+    , mAccessTimeTracker( 0 )
     , mIntervalChecker( 0 )
     , mStorageJanitor( 0 )
     , mItemRetrievalThread( 0 )
     , mDatabaseProcess( 0 )
+    , mConnectionPool( 0 )
     , mAlreadyShutdown( false )
 {
 }
@@ -168,6 +173,7 @@ bool AkonadiServer::init()
     Tracer::self();
     new DebugInterface( this );
     ResourceManager::self();
+    new AgentInfoCache( QString(), this );
 
     // Initialize the preprocessor manager
     PreprocessorManager::init();
@@ -182,6 +188,13 @@ bool AkonadiServer::init()
         mCacheCleaner->start( QThread::IdlePriority );
     }
 
+    // Write the access time of fetched items in batches, 0 writes it on every fetch
+    const int accessTimeInterval = settings.value( QLatin1String( "Cache/AccessTimeFlushInterval" ), 60 ).toInt();
+    if ( accessTimeInterval > 0 ) {
+        mAccessTimeTracker = new AccessTimeTracker( accessTimeInterval, this );
+        mAccessTimeTracker->start( QThread::LowPriority );
+    }
+
     mIntervalChecker = new IntervalCheck( this );
     mIntervalChecker->start( QThread::IdlePriority );
 
@@ -191,6 +204,16 @@ bool AkonadiServer::init()
     mItemRetrievalThread = new ItemRetrievalThread( this );
     mItemRetrievalThread->start( QThread::HighPriority );
 
+    // Multiplex client connections onto a fixed number of threads instead of
+    // spawning a thread (and database connection) per client
+    const int workerThreads = settings.value( QLatin1String( "Connection/WorkerThreads" ), 0 ).toInt();
+    if ( workerThreads > 0 ) {
+        const int blockingThreads = settings.value( QLatin1String( "Connection/BlockingThreads" ), workerThreads ).toInt();
+        mConnectionPool = new ConnectionWorkerPool( workerThreads, blockingThreads, this );
+        akDebug() << "Serving connections from" << workerThreads << "worker threads and"
+                  << mConnectionPool->blockingSlotCount() << "threads for blocking commands";
+    }
+
     mAgentSearchManagerThread = new SearchTaskManagerThread( this );
     mAgentSearchManagerThread->start();
 
@@ -274,6 +297,14 @@ bool AkonadiServer::quit()
         quitThread( mConnections[i] );
     }
     mConnections.clear();
+    if ( mConnectionPool ) {
+        mConnectionPool->quit();
+        delete mConnectionPool;
+        mConnectionPool = 0;
+    }
+
+    // Write the remaining access times once no connection records them anymore
+    quitThread( mAccessTimeTracker );
 
     // Terminate the preprocessor manager before the database but after all connections are gone
     PreprocessorManager::done();
@@ -312,6 +343,10 @@ void AkonadiServer::incomingConnection( quintptr socketDescriptor )
     if ( mAlreadyShutdown ) {
         return;
     }
+    if ( mConnectionPool ) {
+        mConnectionPool->addConnection( socketDescriptor );
+        return;
+    }
     QPointer<ConnectionThread> thread = new ConnectionThread( socketDescriptor, this );
     connect( thread, SIGNAL(finished()), thread, SLOT(deleteLater()) );
     mConnections.append( thread );
@@ -31,7 +31,9 @@ namespace Akonadi {
 namespace Server {
 
 class ConnectionThread;
+class ConnectionWorkerPool;
 class CacheCleaner;
+class AccessTimeTracker;
 class SearchManagerThread;
 class ItemRetrievalThread;
 class SearchTaskManagerThread;
@@ -82,12 +84,14 @@ class AkonadiServer : public QLocalServer
     AkonadiServer( QObject *parent = 0 );
 
     CacheCleaner *mCacheCleaner;
+    AccessTimeTracker *mAccessTimeTracker;
     IntervalCheck *mIntervalChecker;
     StorageJanitorThread *mStorageJanitor;
     ItemRetrievalThread *mItemRetrievalThread;
     SearchTaskManagerThread *mAgentSearchManagerThread;
     QProcess *mDatabaseProcess;
     QVector< QPointer<ConnectionThread> > mConnections;
+    ConnectionWorkerPool *mConnectionPool;
     SearchManagerThread *mSearchManager;
     bool mAlreadyShutdown;
 
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "asynctracer.h"
+#include "filetracer.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+using namespace Akonadi::Server;
+
+namespace Akonadi
+{
+namespace Server
+{
+
+/**
+ * Owned by the QThreadStorage of the producer thread. The buffer itself is
+ * shared with the AsyncTracer, which forwards the remaining records after the
+ * thread has finished.
+ */
+class TraceBufferHolder
+{
+public:
+    TraceBufferHolder(TraceBuffer *buffer)
+        : mBuffer(buffer)
+    {
+    }
+
+    ~TraceBufferHolder()
+    {
+        mBuffer->mDetached.fetchAndStoreRelease(1);
+        if (mBuffer->release()) {
+            delete mBuffer;
+        }
+    }
+
+    TraceBuffer *mBuffer;
+};
+
+}
+}
+
+static bool timestampLessThan(const TraceRecord &a, const TraceRecord &b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+TraceBuffer::TraceBuffer()
+    : mRecords(Capacity)
+    , mHead(0)
+    , mTail(0)
+    , mDropped(0)
+    , mRefCount(2)  // the producer thread and the AsyncTracer
+    , mDetached(0)
+    , mFilterGeneration(-1)
+    , mLastMatches(true)
+{
+}
+
+int TraceBuffer::push(const TraceRecord &record)
+{
+    // mHead is only written by this thread
+    const int head = mHead.fetchAndAddRelaxed(0);
+    const int next = (head + 1) % Capacity;
+    const int tail = mTail.fetchAndAddAcquire(0);
+    if (next == tail) {
+        mDropped.ref();
+        return -1;
+    }
+
+    mRecords[head] = record;
+    mHead.fetchAndStoreRelease(next);
+    return (next - tail + Capacity) % Capacity;
+}
+
+int TraceBuffer::takeAll(QVector<TraceRecord> &records)
+{
+    // mTail is only written by the consumer
+    int tail = mTail.fetchAndAddRelaxed(0);
+    const int head = mHead.fetchAndAddAcquire(0);
+    int count = 0;
+    while (tail != head) {
+        records.append(mRecords[tail]);
+        // don't keep the payloads alive until the slot is reused
+        mRecords[tail] = TraceRecord();
+        tail = (tail + 1) % Capacity;
+        ++count;
+    }
+    mTail.fetchAndStoreRelease(tail);
+    return count;
+}
+
+int TraceBuffer::takeDropped()
+{
+    return mDropped.fetchAndStoreRelaxed(0);
+}
+
+bool TraceBuffer::release()
+{
+    return !mRefCount.deref();
+}
+
+
+AsyncTracer::AsyncTracer(QObject *parent)
+    : QThread(parent)
+    , mBackend(0)
+    , mFileBackend(0)
+    , mFilterGeneration(0)
+    , mSampling(1)
+    , mDroppedTotal(0)
+    , mQuit(false)
+{
+}
+
+AsyncTracer::~AsyncTracer()
+{
+    stop();
+
+    QMutexLocker locker(&mBuffersLock);
+    Q_FOREACH (TraceBuffer *buffer, mBuffers) {
+        if (buffer->release()) {
+            delete buffer;
+        }
+    }
+    mBuffers.clear();
+
+    delete mBackend;
+}
+
+void AsyncTracer::setBackend(TracerInterface *backend)
+{
+    // Forward what has been recorded so far to the old backend
+    flush();
+
+    QMutexLocker locker(&mDrainLock);
+    delete mBackend;
+    mBackend = backend;
+    mFileBackend = dynamic_cast<FileTracer *>(backend);
+}
+
+void AsyncTracer::setSampling(int sampling)
+{
+    mSampling.fetchAndStoreRelaxed(qMax(1, sampling));
+}
+
+int AsyncTracer::sampling() const
+{
+    return const_cast<QAtomicInt &>(mSampling).fetchAndAddRelaxed(0);
+}
+
+void AsyncTracer::setFilter(const QStringList &filter)
+{
+    QWriteLocker locker(&mFilterLock);
+    mFilter = filter;
+    mFilter.removeAll(QString());
+    mFilterGeneration.ref();
+}
+
+QStringList AsyncTracer::filter() const
+{
+    QReadLocker locker(&mFilterLock);
+    return mFilter;
+}
+
+int AsyncTracer::droppedRecords() const
+{
+    return const_cast<QAtomicInt &>(mDroppedTotal).fetchAndAddRelaxed(0);
+}
+
+void AsyncTracer::stop()
+{
+    if (isRunning()) {
+        mWaitLock.lock();
+        mQuit = true;
+        mWaitCondition.wakeOne();
+        mWaitLock.unlock();
+        wait();
+    }
+    flush();
+}
+
+void AsyncTracer::run()
+{
+    mWaitLock.lock();
+    while (!mQuit) {
+        mWaitCondition.wait(&mWaitLock, DrainInterval);
+        mWaitLock.unlock();
+        flush();
+        mWaitLock.lock();
+    }
+    mWaitLock.unlock();
+}
+
+void AsyncTracer::flush()
+{
+    // Only one consumer may take from the buffers at a time
+    QMutexLocker locker(&mDrainLock);
+
+    QVector<TraceBuffer *> buffers;
+    {
+        QMutexLocker buffersLocker(&mBuffersLock);
+        buffers = mBuffers;
+    }
+
+    int dropped = 0;
+    Q_FOREACH (TraceBuffer *buffer, buffers) {
+        // The thread can't push anymore once it has detached, so check that
+        // before taking its records
+        const bool detached = buffer->mDetached.fetchAndAddAcquire(0);
+        buffer->takeAll(mPending);
+        dropped += buffer->takeDropped();
+        if (detached) {
+            QMutexLocker buffersLocker(&mBuffersLock);
+            mBuffers.remove(mBuffers.indexOf(buffer));
+            if (buffer->release()) {
+                delete buffer;
+            }
+        }
+    }
+
+    if (dropped > 0) {
+        mDroppedTotal.fetchAndAddRelaxed(dropped);
+    }
+    if (!mBackend) {
+        mPending.clear();
+        return;
+    }
+    if (mPending.isEmpty() && dropped == 0) {
+        return;
+    }
+
+    if (dropped > 0) {
+        mBackend->warning(QLatin1String("Tracer"),
+                          QString::fromLatin1("%1 trace records dropped, the tracer can't keep up").arg(dropped));
+    }
+
+    // Merge the records of all threads into one timeline
+    std::stable_sort(mPending.begin(), mPending.end(), timestampLessThan);
+    Q_FOREACH (const TraceRecord &record, mPending) {
+        dispatch(record);
+    }
+    mPending.clear();
+
+    if (mFileBackend) {
+        mFileBackend->flush();
+    }
+}
+
+void AsyncTracer::dispatch(const TraceRecord &record)
+{
+    if (mFileBackend) {
+        // keeps the time the record was taken
+        mFileBackend->writeRecord(record);
+        return;
+    }
+
+    switch (record.type) {
+    case TraceRecord::BeginConnection:
+        mBackend->beginConnection(record.identifier, record.text);
+        break;
+    case TraceRecord::EndConnection:
+        mBackend->endConnection(record.identifier, record.text);
+        break;
+    case TraceRecord::ConnectionInput:
+        mBackend->connectionInput(record.identifier, record.data);
+        break;
+    case TraceRecord::ConnectionOutput:
+        mBackend->connectionOutput(record.identifier, record.data);
+        break;
+    case TraceRecord::Signal:
+        mBackend->signal(record.identifier, record.text);
+        break;
+    case TraceRecord::Warning:
+        mBackend->warning(record.identifier, record.text);
+        break;
+    case TraceRecord::Error:
+        mBackend->error(record.identifier, record.text);
+        break;
+    }
+}
+
+TraceBuffer *AsyncTracer::localBuffer()
+{
+    if (!mLocalBuffer.hasLocalData()) {
+        TraceBuffer *buffer = new TraceBuffer;
+        mLocalBuffer.setLocalData(new TraceBufferHolder(buffer));
+        QMutexLocker locker(&mBuffersLock);
+        mBuffers.append(buffer);
+    }
+    return mLocalBuffer.localData()->mBuffer;
+}
+
+bool AsyncTracer::matchesFilter(const QString &identifier) const
+{
+    QReadLocker locker(&mFilterLock);
+    if (mFilter.isEmpty()) {
+        return true;
+    }
+    Q_FOREACH (const QString &filter, mFilter) {
+        if (identifier.contains(filter)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AsyncTracer::acceptConnectionRecord(TraceBuffer *buffer, const QString &identifier, TraceRecord::Type type)
+{
+    // A thread usually traces one connection after the other, so caching the
+    // decision for the last identifier avoids matching the filter on every line
+    const int generation = mFilterGeneration.fetchAndAddRelaxed(0);
+    if (generation != buffer->mFilterGeneration || identifier != buffer->mLastIdentifier) {
+        buffer->mFilterGeneration = generation;
+        buffer->mLastIdentifier = identifier;
+        buffer->mLastMatches = matchesFilter(identifier);
+    }
+    if (!buffer->mLastMatches) {
+        return false;
+    }
+
+    return acceptSample(identifier, type);
+}
+
+bool AsyncTracer::acceptSample(const QString &identifier, TraceRecord::Type type)
+{
+    const int sampling = mSampling.fetchAndAddRelaxed(0);
+    if (type == TraceRecord::EndConnection) {
+        QMutexLocker locker(&mSamplingLock);
+        mSamplingStates.remove(identifier);
+        return true;
+    }
+    if (sampling <= 1 || type == TraceRecord::BeginConnection) {
+        return true;
+    }
+
+    // Worker threads serve many connections and a connection may move between
+    // them, so the state can't live in the per-thread buffer
+    QMutexLocker locker(&mSamplingLock);
+    SamplingState &state = mSamplingStates[identifier];
+    // The responses to a command are recorded if the command was
+    if (type == TraceRecord::ConnectionInput) {
+        state.sampled = (state.counter++ % sampling) == 0;
+    }
+    return state.sampled;
+}
+
+void AsyncTracer::record(TraceRecord::Type type, const QString &identifier, const QString &text,
+                         const QByteArray &data)
+{
+    TraceBuffer *buffer = localBuffer();
+    if (type <= TraceRecord::ConnectionOutput && !acceptConnectionRecord(buffer, identifier, type)) {
+        return;
+    }
+
+    TraceRecord record;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+    record.type = type;
+    record.identifier = identifier;
+    record.text = text;
+    record.data = data;
+
+    if (buffer->push(record) >= TraceBuffer::Capacity / 2) {
+        mWaitCondition.wakeOne();
+    }
+}
+
+void AsyncTracer::beginConnection(const QString &identifier, const QString &msg)
+{
+    record(TraceRecord::BeginConnection, identifier, msg);
+}
+
+void AsyncTracer::endConnection(const QString &identifier, const QString &msg)
+{
+    record(TraceRecord::EndConnection, identifier, msg);
+}
+
+void AsyncTracer::connectionInput(const QString &identifier, const QByteArray &msg)
+{
+    record(TraceRecord::ConnectionInput, identifier, QString(), msg);
+}
+
+void AsyncTracer::connectionOutput(const QString &identifier, const QByteArray &msg)
+{
+    record(TraceRecord::ConnectionOutput, identifier, QString(), msg);
+}
+
+void AsyncTracer::signal(const QString &signalName, const QString &msg)
+{
+    record(TraceRecord::Signal, signalName, msg);
+}
+
+void AsyncTracer::warning(const QString &componentName, const QString &msg)
+{
+    record(TraceRecord::Warning, componentName, msg);
+}
+
+void AsyncTracer::error(const QString &componentName, const QString &msg)
+{
+    record(TraceRecord::Error, componentName, msg);
+}
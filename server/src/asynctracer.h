@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_ASYNCTRACER_H
+#define AKONADI_SERVER_ASYNCTRACER_H
+
+#include "tracerinterface.h"
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace Akonadi
+{
+namespace Server
+{
+
+class FileTracer;
+class TraceBufferHolder;
+
+/**
+ * A single line of the trace.
+ *
+ * The payloads are implicitly shared with the caller, recording a line does
+ * neither format nor convert the message.
+ */
+struct TraceRecord
+{
+    enum Type {
+        BeginConnection,
+        EndConnection,
+        ConnectionInput,
+        ConnectionOutput,
+        Signal,
+        Warning,
+        Error
+    };
+
+    TraceRecord()
+        : timestamp(0)
+        , type(BeginConnection)
+    {
+    }
+
+    qint64 timestamp;       ///< milliseconds since the epoch
+    Type type;
+    QString identifier;     ///< connection identifier, signal or component name
+    QString text;           ///< message of all records but connection input and output
+    QByteArray data;        ///< connection input or output
+};
+
+/**
+ * Single-producer single-consumer ring buffer of trace records.
+ *
+ * Each thread that traces owns one buffer and is the only one to push to it,
+ * the AsyncTracer drain thread is the only one to take from it, so neither
+ * side needs a lock. Records are dropped (and counted) when the buffer is full
+ * rather than blocking the producer.
+ */
+class TraceBuffer
+{
+public:
+    enum {
+        Capacity = 1024
+    };
+
+    TraceBuffer();
+
+    /**
+     * Appends @p record. Returns the number of records now in the buffer, or
+     * -1 if the buffer was full and the record has been dropped.
+     */
+    int push(const TraceRecord &record);
+
+    /**
+     * Moves all records to @p records and returns their number.
+     */
+    int takeAll(QVector<TraceRecord> &records);
+
+    /**
+     * Returns the number of dropped records since the last call.
+     */
+    int takeDropped();
+
+private:
+    friend class AsyncTracer;
+    friend class TraceBufferHolder;
+
+    // Returns true when the last reference is gone
+    bool release();
+
+    QVector<TraceRecord> mRecords;
+    QAtomicInt mHead;
+    QAtomicInt mTail;
+    QAtomicInt mDropped;
+    QAtomicInt mRefCount;
+    QAtomicInt mDetached;
+
+    // Filter state of the producer thread
+    QString mLastIdentifier;
+    int mFilterGeneration;
+    bool mLastMatches;
+};
+
+/**
+ * A tracer that records trace lines into per-thread TraceBuffers and forwards
+ * them to the actual backend (FileTracer, DBusTracer) from a background
+ * thread, so that connection threads never format, convert or write trace
+ * output themselves.
+ *
+ * Connection input and output can be sampled (only every n-th command of a
+ * connection is recorded, together with its responses) and filtered (only
+ * connections whose identifier contains one of the filter strings are
+ * recorded). Signals, warnings and errors are always recorded.
+ */
+class AsyncTracer : public QThread, public TracerInterface
+{
+public:
+    /**
+     * Interval in milliseconds in which the buffers are drained.
+     */
+    enum {
+        DrainInterval = 50
+    };
+
+    explicit AsyncTracer(QObject *parent = 0);
+    virtual ~AsyncTracer();
+
+    /**
+     * Sets the backend all records are forwarded to and takes ownership of it.
+     * When @p backend is 0, records are discarded.
+     */
+    void setBackend(TracerInterface *backend);
+
+    /**
+     * Records only every @p sampling th command of each connection. Values
+     * lower than 2 record all commands. The sampling state is kept per
+     * connection, as connections share the threads of the worker pool.
+     */
+    void setSampling(int sampling);
+    int sampling() const;
+
+    /**
+     * Records only connections whose identifier (the session id) contains
+     * one of the strings in @p filter. An empty filter records all connections.
+     */
+    void setFilter(const QStringList &filter);
+    QStringList filter() const;
+
+    /**
+     * Total number of records dropped because a buffer was full.
+     */
+    int droppedRecords() const;
+
+    /**
+     * Forwards all buffered records to the backend right away.
+     */
+    void flush();
+
+    /**
+     * Stops the drain thread after forwarding all buffered records.
+     */
+    void stop();
+
+    virtual void beginConnection(const QString &identifier, const QString &msg);
+    virtual void endConnection(const QString &identifier, const QString &msg);
+    virtual void connectionInput(const QString &identifier, const QByteArray &msg);
+    virtual void connectionOutput(const QString &identifier, const QByteArray &msg);
+    virtual void signal(const QString &signalName, const QString &msg);
+    virtual void warning(const QString &componentName, const QString &msg);
+    virtual void error(const QString &componentName, const QString &msg);
+
+protected:
+    virtual void run();
+
+private:
+    TraceBuffer *localBuffer();
+    bool acceptConnectionRecord(TraceBuffer *buffer, const QString &identifier, TraceRecord::Type type);
+    bool matchesFilter(const QString &identifier) const;
+    bool acceptSample(const QString &identifier, TraceRecord::Type type);
+    void record(TraceRecord::Type type, const QString &identifier, const QString &text,
+                const QByteArray &data = QByteArray());
+    void dispatch(const TraceRecord &record);
+
+    QThreadStorage<TraceBufferHolder *> mLocalBuffer;
+    QMutex mBuffersLock;
+    QVector<TraceBuffer *> mBuffers;
+
+    QMutex mDrainLock;
+    QVector<TraceRecord> mPending;
+    TracerInterface *mBackend;
+    FileTracer *mFileBackend;
+
+    mutable QReadWriteLock mFilterLock;
+    QStringList mFilter;
+    QAtomicInt mFilterGeneration;
+    QAtomicInt mSampling;
+    QAtomicInt mDroppedTotal;
+
+    struct SamplingState
+    {
+        SamplingState()
+            : counter(0)
+            , sampled(true)
+        {
+        }
+
+        uint counter;
+        bool sampled;
+    };
+    QMutex mSamplingLock;
+    QHash<QString, SamplingState> mSamplingStates;
+
+    QMutex mWaitLock;
+    QWaitCondition mWaitCondition;
+    bool mQuit;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_ASYNCTRACER_H
@@ -21,6 +21,7 @@
 #include "cachecleaner.h"
 #include "akdebug.h"
 #include "storage/parthelper.h"
+#include "storage/accesstimetracker.h"
 #include "storage/datastore.h"
 #include "storage/selectquerybuilder.h"
 #include "storage/entity.h"
@@ -136,8 +137,13 @@ void CacheCleaner::collectionExpired( const Collection &collection )
     const Part::List parts = qb.result();
     if ( !parts.isEmpty() ) {
       akDebug() << "found" << parts.count() << "item parts to expire in collection" << collection.name();
+      AccessTimeTracker *tracker = AccessTimeTracker::instance();
       // clear data field
       Q_FOREACH ( Part part, parts ) {
+        // accessed since the access times have last been written
+        if ( tracker && tracker->isPending( part.pimItemId() ) ) {
+          continue;
+        }
         try {
           if ( !PartHelper::truncate( part ) ) {
             akDebug() << "failed to update item part" << part.id();
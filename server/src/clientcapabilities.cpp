@@ -23,6 +23,7 @@ using namespace Akonadi::Server;
 
 ClientCapabilities::ClientCapabilities()
   : m_notificationMessageVersion( 0 )
+  , m_retrievalPriority( -1 )
   , m_noPayloadPath( false )
   , m_serverSideSearch( false )
   , m_akAppendStreaming( false )
@@ -88,3 +89,13 @@ void ClientCapabilities::setDirectStreaming(bool directStreaming)
   m_directStreaming = directStreaming;
 }
 
+
+int ClientCapabilities::retrievalPriority() const
+{
+  return m_retrievalPriority;
+}
+
+void ClientCapabilities::setRetrievalPriority( int priority )
+{
+  m_retrievalPriority = priority;
+}
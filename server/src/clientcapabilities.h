@@ -54,8 +54,15 @@ public:
   bool directStreaming() const;
   void setDirectStreaming( bool directStreaming );
 
+  /** Returns the ItemRetrievalRequest::Priority the client asked for its
+   *  item retrievals, or -1 if it didn't ask for one.
+   */
+  int retrievalPriority() const;
+  void setRetrievalPriority( int priority );
+
 private:
   int m_notificationMessageVersion;
+  int m_retrievalPriority;
   int m_noPayloadPath : 1;
   int m_serverSideSearch : 1;
   int m_akAppendStreaming : 1;
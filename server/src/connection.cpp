@@ -25,13 +25,17 @@
 #include <QSettings>
 
 #include "storage/datastore.h"
+#include "storage/storagedebugger.h"
 #include "handler.h"
 #include "response.h"
 #include "tracer.h"
 #include "clientcapabilityaggregator.h"
 #include "collectionreferencemanager.h"
+#include "connectionworkerpool.h"
+#include "handler/fetchhelper.h"
 
 #include "imapstreamparser.h"
+#include "libs/protocol_p.h"
 #include "shared/akdebug.h"
 #include "shared/akcrash.h"
 
@@ -53,8 +57,11 @@ Connection::Connection( QObject *parent )
     , m_streamParser( 0 )
     , m_verifyCacheOnRetrieval( false )
     , m_totalTime( 0 )
+    , m_worker( 0 )
+    , m_slot( 0 )
     , m_reportTime( false )
 {
+    m_time.invalidate();
 }
 
 
@@ -68,15 +75,19 @@ Connection::Connection( quintptr socketDescriptor, QObject *parent )
     , m_streamParser( 0 )
     , m_verifyCacheOnRetrieval( false )
     , m_totalTime( 0 )
+    , m_worker( 0 )
+    , m_slot( 0 )
     , m_reportTime( false )
 {
+    m_time.invalidate();
     m_identifier.sprintf( "%p", static_cast<void *>( this ) );
     ClientCapabilityAggregator::addSession( m_clientCapabilities );
 
     const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
     m_verifyCacheOnRetrieval = settings.value( QLatin1String( "Cache/VerifyOnRetrieval" ), m_verifyCacheOnRetrieval ).toBool();
 
-    QLocalSocket *socket = new QLocalSocket();
+    // parented, so that it follows the connection when moved to another thread
+    QLocalSocket *socket = new QLocalSocket( this );
 
     if ( !socket->setSocketDescriptor( m_socketDescriptor ) ) {
         qWarning() << "Connection(" << m_identifier
@@ -156,8 +167,33 @@ void Connection::slotNewData()
     return;
   }
 
+  if ( m_worker ) {
+    if ( !m_worker->acquireStorage( this ) ) {
+      return; // resumed by the worker once the other connection's transaction is finished
+    }
+    // the storage backend is shared by all connections of the worker
+    storageBackend()->setSessionId( m_sessionId );
+    storageBackend()->notificationCollector()->setSessionId( m_sessionId );
+  }
+
   QString currentCommand;
+  bool blockingCommandPending = false;
   while ( m_socket->bytesAvailable() > 0 || !m_streamParser->readRemainingData().isEmpty() ) {
+    if ( m_worker ) {
+      // Waiting for the rest of a command, for a literal or for a resource
+      // would stall all other connections of the worker
+      const PendingCommand pending = pendingCommand();
+      if ( pending == NoCommand ) {
+        break; // continued on the next readyRead()
+      }
+      // Within a transaction the other connections of the worker are suspended
+      // anyway, and the transaction can't leave the worker's database connection
+      if ( pending == BlockingCommand && !storageBackend()->inTransaction() ) {
+        blockingCommandPending = true;
+        break;
+      }
+    }
+
     try {
       const QByteArray tag = m_streamParser->readString();
       // deal with stray newlines
@@ -170,12 +206,12 @@ void Connection::slotNewData()
       }
       context()->setTag( -1 );
       context()->setCollection( Collection() );
-      Tracer::self()->connectionInput( m_identifier, ( tag + ' ' + command + ' ' + m_streamParser->readRemainingData() ) );
+      if ( Tracer::self()->isEnabled() ) {
+        Tracer::self()->connectionInput( m_identifier, ( tag + ' ' + command + ' ' + m_streamParser->readRemainingData() ) );
+      }
       m_currentHandler = findHandlerForCommand( command );
       currentCommand = QString::fromLatin1(command);
-      if (m_reportTime) {
-        startTime();
-      }
+      startTime();
       assert( m_currentHandler );
       connect( m_currentHandler, SIGNAL(responseAvailable(Akonadi::Server::Response)),
                this, SLOT(slotResponseAvailable(Akonadi::Server::Response)), Qt::DirectConnection );
@@ -209,9 +245,7 @@ void Connection::slotNewData()
         m_streamParser->skipCurrentCommand();
       } catch ( ... ) {}
     }
-    if (m_reportTime) {
-      stopTime(currentCommand);
-    }
+    stopTime(currentCommand);
     delete m_currentHandler;
     m_currentHandler = 0;
 
@@ -221,13 +255,76 @@ void Connection::slotNewData()
       } catch ( ... ) {}
     }
   }
+
+  if ( m_worker ) {
+    m_worker->releaseStorage( this, blockingCommandPending );
+  } else if ( m_slot ) {
+    m_slot->commandsProcessed( this );
+  }
+}
+
+Connection::PendingCommand Connection::pendingCommand() const
+{
+  QByteArray data = m_streamParser->readRemainingData();
+  if ( m_socket->bytesAvailable() > 0 ) {
+    data += m_socket->peek( m_socket->bytesAvailable() );
+  }
+
+  int start = 0;
+  while ( start < data.size() && ( data[start] == ' ' || data[start] == '\r' || data[start] == '\n' ) ) {
+    ++start;
+  }
+  const int end = data.indexOf( '\n', start );
+  if ( end < 0 ) {
+    return NoCommand;
+  }
+
+  const QByteArray line = data.mid( start, end - start ).trimmed();
+  if ( line.endsWith( '}' ) ) {
+    return BlockingCommand; // a literal follows once we asked for it
+  }
+
+  const QList<QByteArray> words = line.split( ' ' );
+  int commandIndex = 1;
+  const QByteArray scope = words.value( commandIndex ).toUpper();
+  if ( scope == AKONADI_CMD_UID || scope == AKONADI_CMD_RID || scope == AKONADI_CMD_HRID || scope == AKONADI_CMD_GID ) {
+    ++commandIndex;
+  }
+  const QByteArray command = words.value( commandIndex ).toUpper();
+
+  if ( command == AKONADI_CMD_ITEMFETCH ) {
+    // Only the fetch scope parameters before the part list can be CACHEONLY,
+    // quoted remote identifiers in the part list don't count
+    for ( int i = commandIndex + 1; i < words.count() && !words.at( i ).startsWith( '(' ); ++i ) {
+      if ( words.at( i ).toUpper() == AKONADI_PARAM_CACHEONLY ) {
+        return FetchHelper::mayOverrideCacheOnly( this ) ? BlockingCommand : Command;
+      }
+    }
+    return BlockingCommand;
+  }
+  if ( command == AKONADI_CMD_ITEMCOPY || command == AKONADI_CMD_ITEMMOVE
+       || command == AKONADI_CMD_COLLECTIONCOPY || command == AKONADI_CMD_COLLECTIONMOVE
+       || command == AKONADI_CMD_COLLECTIONMODIFY || command == AKONADI_CMD_MERGE
+       || command == AKONADI_CMD_SEARCH || command == AKONADI_CMD_SEARCH_STORE ) {
+    return BlockingCommand;
+  }
+  return Command;
 }
 
 void Connection::writeOut( const QByteArray &data )
 {
     QByteArray block = data + "\r\n";
     m_socket->write( block );
-    m_socket->waitForBytesWritten( 30 * 1000 );
+    if ( m_worker ) {
+      // A slow reader must not stall the other connections of the worker, the
+      // worker's event loop writes what the socket doesn't take right away
+      QLocalSocket *socket = qobject_cast<QLocalSocket*>( m_socket );
+      if ( socket ) {
+        socket->flush();
+      }
+    } else {
+      m_socket->waitForBytesWritten( 30 * 1000 );
+    }
 
     Tracer::self()->connectionOutput( m_identifier, block );
 }
@@ -367,6 +464,41 @@ bool Connection::verifyCacheOnRetrieval() const
   return m_verifyCacheOnRetrieval;
 }
 
+void Connection::setWorker( ConnectionWorker *worker )
+{
+  m_worker = worker;
+}
+
+void Connection::setBlockingSlot( BlockingSlot *slot )
+{
+  m_slot = slot;
+}
+
+bool Connection::isBusy() const
+{
+  return m_currentHandler != 0;
+}
+
+bool Connection::isBlockingCommandPending() const
+{
+  return pendingCommand() == BlockingCommand;
+}
+
+bool Connection::isConnected() const
+{
+  const QLocalSocket *socket = qobject_cast<QLocalSocket*>( m_socket );
+  return socket && socket->state() == QLocalSocket::ConnectedState;
+}
+
+void Connection::resetStorageBackend()
+{
+  m_backend = 0;
+  if ( !m_sessionId.isEmpty() ) {
+    storageBackend()->setSessionId( m_sessionId );
+    storageBackend()->notificationCollector()->setSessionId( m_sessionId );
+  }
+}
+
 void Connection::startTime()
 {
     m_time.start();
@@ -374,7 +506,18 @@ void Connection::startTime()
 
 void Connection::stopTime(const QString &identifier)
 {
-    int elapsed = m_time.elapsed();
+    // the command could not be parsed
+    if (!m_time.isValid()) {
+        return;
+    }
+    const qint64 usecs = m_time.nsecsElapsed() / 1000;
+    m_time.invalidate();
+    StorageDebugger::instance()->recordCommand(identifier, usecs);
+    if (!m_reportTime) {
+        return;
+    }
+
+    const int elapsed = usecs / 1000;
     m_totalTime += elapsed;
     m_totalTimeByHandler[identifier] += elapsed;
     m_executionsByHandler[identifier]++;
@@ -20,6 +20,7 @@
 #ifndef AKONADI_CONNECTION_H
 #define AKONADI_CONNECTION_H
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QPointer>
 #include <QtCore/QThread>
 #include <QtNetwork/QLocalSocket>
@@ -38,6 +39,8 @@ class DataStore;
 class Collection;
 class ImapStreamParser;
 class CollectionReferenceManager;
+class ConnectionWorker;
+class BlockingSlot;
 
 /**
     An Connection represents one connection of a client to the server.
@@ -75,6 +78,36 @@ public:
     /** Returns @c true if permanent cache verification is enabled. */
     bool verifyCacheOnRetrieval() const;
 
+    /**
+      Sets the pool worker serving this connection, or @c 0 if the connection
+      runs in its own thread.
+    */
+    void setWorker( ConnectionWorker *worker );
+
+    /**
+      Sets the pool slot serving this connection for commands that may block,
+      or @c 0 if the connection is not served by one.
+    */
+    void setBlockingSlot( BlockingSlot *slot );
+
+    /** Returns @c true while a command is being processed. */
+    bool isBusy() const;
+
+    /**
+      Returns @c true if the next buffered command may block the thread
+      processing it, see pendingCommand().
+    */
+    bool isBlockingCommandPending() const;
+
+    /** Returns @c true while the client is connected. */
+    bool isConnected() const;
+
+    /**
+      Drops the cached storage backend after the connection has been moved
+      to another thread and applies the session to the new one.
+    */
+    void resetStorageBackend();
+
 Q_SIGNALS:
     void disconnected();
 
@@ -106,13 +139,27 @@ protected:
     ClientCapabilities m_clientCapabilities;
     bool m_verifyCacheOnRetrieval;
     CommandContext m_context;
-    QTime m_time;
+    QElapsedTimer m_time;
     qint64 m_totalTime;
     QHash<QString, qint64> m_totalTimeByHandler;
     QHash<QString, qint64> m_executionsByHandler;
+    ConnectionWorker *m_worker;
+    BlockingSlot *m_slot;
 
 private:
-    /** For debugging */
+    enum PendingCommand {
+      NoCommand,        ///< the first line of the next command has not fully arrived yet
+      Command,
+      BlockingCommand   ///< reads literals or might wait for a resource or search agent
+    };
+
+    /**
+     * Inspects the buffered input without consuming it, so that a pool worker
+     * never starts a command that would block its thread.
+     */
+    PendingCommand pendingCommand() const;
+
+    /** Command timing, always recorded in the StorageDebugger statistics */
     void startTime();
     void stopTime(const QString &identifier);
     void reportTime() const;
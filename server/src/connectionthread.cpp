@@ -27,6 +27,14 @@ using namespace Akonadi::Server;
 ConnectionThread::ConnectionThread(quintptr socketDescriptor, QObject* parent)
   : QThread(parent)
   , mSocketDescriptor(socketDescriptor)
+  , mConnection(0)
+{
+}
+
+ConnectionThread::ConnectionThread(Connection *connection, QObject *parent)
+  : QThread(parent)
+  , mSocketDescriptor(0)
+  , mConnection(connection)
 {
 }
 
@@ -38,17 +46,20 @@ void ConnectionThread::run()
 {
     DataStore::self();
 
-    Connection *connection = new Connection(mSocketDescriptor);
-    connect(connection, SIGNAL(disconnected()),
+    if (mConnection) {
+        mConnection->resetStorageBackend();
+        // Process commands that arrived while the connection was being moved
+        QMetaObject::invokeMethod(mConnection, "slotNewData", Qt::QueuedConnection);
+    } else {
+        mConnection = new Connection(mSocketDescriptor);
+    }
+    connect(mConnection, SIGNAL(disconnected()),
             this, SLOT(quit()));
 
     exec();
 
-    delete connection;
+    delete mConnection;
+    mConnection = 0;
 
     DataStore::self()->close();
 }
-
-
-
-
@@ -27,18 +27,27 @@ namespace Akonadi
 namespace Server
 {
 
+class Connection;
+
 class ConnectionThread : public QThread
 {
     Q_OBJECT
 
 public:
     explicit ConnectionThread(quintptr socketDescriptor, QObject* parent = 0);
+
+    /**
+     * Takes over an already established @p connection, which has to be moved
+     * to this thread before it is started.
+     */
+    explicit ConnectionThread(Connection *connection, QObject *parent = 0);
     virtual ~ConnectionThread();
 
     void run();
 
 private:
     quintptr mSocketDescriptor;
+    Connection *mConnection;
 };
 
 }
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "connectionworkerpool.h"
+#include "connection.h"
+#include "connectionthread.h"
+#include "storage/datastore.h"
+
+#include <akdebug.h>
+
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
+
+using namespace Akonadi::Server;
+
+namespace {
+
+class WorkerThread : public QThread
+{
+public:
+    WorkerThread(ConnectionWorker *worker)
+        : QThread()
+        , mWorker(worker)
+    {
+    }
+
+protected:
+    void run()
+    {
+        DataStore::self();
+
+        exec();
+
+        mWorker->closeConnections();
+        DataStore::self()->close();
+    }
+
+private:
+    ConnectionWorker *mWorker;
+};
+
+class SlotThread : public QThread
+{
+public:
+    SlotThread(BlockingSlot *slot)
+        : QThread()
+        , mSlot(slot)
+    {
+    }
+
+protected:
+    void run()
+    {
+        DataStore::self();
+
+        exec();
+
+        mSlot->closeConnection();
+        DataStore::self()->close();
+    }
+
+private:
+    BlockingSlot *mSlot;
+};
+
+}
+
+ConnectionWorker::ConnectionWorker(ConnectionWorkerPool *pool)
+    : QObject()
+    , mPool(pool)
+    , mConnectionCount(0)
+    , mTransactionOwner(0)
+{
+}
+
+ConnectionWorker::~ConnectionWorker()
+{
+}
+
+int ConnectionWorker::connectionCount() const
+{
+    return const_cast<QAtomicInt&>(mConnectionCount).fetchAndAddRelaxed(0);
+}
+
+void ConnectionWorker::addConnection(quintptr socketDescriptor)
+{
+    Connection *connection = new Connection(socketDescriptor);
+    connection->setWorker(this);
+    connect(connection, SIGNAL(disconnected()),
+            this, SLOT(connectionDisconnected()));
+    mConnections.append(connection);
+}
+
+void ConnectionWorker::closeConnections()
+{
+    qDeleteAll(mConnections);
+    mConnections.clear();
+    mWaitingConnections.clear();
+    mTransactionOwner = 0;
+}
+
+bool ConnectionWorker::acquireStorage(Connection *connection)
+{
+    if (mTransactionOwner && mTransactionOwner != connection) {
+        if (!mWaitingConnections.contains(connection)) {
+            mWaitingConnections.append(connection);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+void ConnectionWorker::releaseStorage(Connection *connection, bool blockingCommandPending)
+{
+    DataStore *store = connection->storageBackend();
+
+    // The connection disconnected while processing its commands
+    if (!mConnections.contains(connection)) {
+        while (store->inTransaction()) {
+            if (!store->rollbackTransaction()) {
+                break;
+            }
+        }
+        if (mTransactionOwner == connection || mTransactionOwner == 0) {
+            mTransactionOwner = 0;
+            resumeWaitingConnections();
+        }
+        return;
+    }
+
+    if (store->inTransaction()) {
+        mTransactionOwner = connection;
+        return;
+    }
+
+    if (mTransactionOwner == connection) {
+        mTransactionOwner = 0;
+        resumeWaitingConnections();
+    }
+
+    if (connection->context()->resource().isValid()) {
+        detachConnection(connection);
+    } else if (blockingCommandPending) {
+        mPool->requestSlot(this, connection);
+    }
+}
+
+void ConnectionWorker::resumeWaitingConnections()
+{
+    const QList<QPointer<Connection> > waiting = mWaitingConnections;
+    mWaitingConnections.clear();
+    Q_FOREACH (const QPointer<Connection> &connection, waiting) {
+        if (connection) {
+            QMetaObject::invokeMethod(connection, "slotNewData", Qt::QueuedConnection);
+        }
+    }
+}
+
+void ConnectionWorker::connectionDisconnected()
+{
+    Connection *connection = qobject_cast<Connection*>(sender());
+    if (!connection || !mConnections.removeOne(connection)) {
+        return;
+    }
+    mConnectionCount.deref();
+    mPool->cancelSlotRequest(connection);
+
+    if (mTransactionOwner == connection) {
+        // Same as what DataStore::close() does when a dedicated thread exits
+        DataStore *store = connection->storageBackend();
+        while (store->inTransaction()) {
+            if (!store->rollbackTransaction()) {
+                break;
+            }
+        }
+        mTransactionOwner = 0;
+        resumeWaitingConnections();
+    }
+
+    connection->deleteLater();
+}
+
+void ConnectionWorker::detachConnection(Connection *connection)
+{
+    mConnections.removeOne(connection);
+    mConnectionCount.deref();
+    disconnect(connection, 0, this, 0);
+    connection->setWorker(0);
+
+    akDebug() << "Moving resource connection" << connection->sessionId() << "to a dedicated thread";
+
+    ConnectionThread *thread = new ConnectionThread(connection);
+    thread->moveToThread(QCoreApplication::instance()->thread());
+    connection->moveToThread(thread);
+    mPool->addDedicatedThread(thread);
+}
+
+void ConnectionWorker::moveToSlot(QObject *object, QObject *slotObject)
+{
+    Connection *connection = static_cast<Connection *>(object);
+    BlockingSlot *slot = static_cast<BlockingSlot *>(slotObject);
+
+    // Disconnected in the meantime, or its next command was run within a
+    // transaction, which can't leave the worker's database connection
+    if (!mConnections.contains(connection) || mTransactionOwner == connection
+        || !connection->isBlockingCommandPending()) {
+        mPool->slotReleased(slot);
+        return;
+    }
+
+    mConnections.removeOne(connection);
+    mConnectionCount.deref();
+    disconnect(connection, 0, this, 0);
+    connection->setWorker(0);
+    connection->moveToThread(slot->thread());
+    QMetaObject::invokeMethod(slot, "serve", Qt::QueuedConnection,
+                              Q_ARG(QObject *, connection),
+                              Q_ARG(QObject *, this));
+}
+
+void ConnectionWorker::reattachConnection(QObject *object)
+{
+    Connection *connection = static_cast<Connection *>(object);
+    if (!connection->isConnected()) {
+        // disconnected while it was moved
+        connection->deleteLater();
+        return;
+    }
+
+    connection->setWorker(this);
+    connection->resetStorageBackend();
+    connect(connection, SIGNAL(disconnected()),
+            this, SLOT(connectionDisconnected()));
+    mConnections.append(connection);
+    mConnectionCount.ref();
+
+    // Process commands that arrived while the connection was being moved
+    QMetaObject::invokeMethod(connection, "slotNewData", Qt::QueuedConnection);
+}
+
+
+BlockingSlot::BlockingSlot(ConnectionWorkerPool *pool)
+    : QObject()
+    , mPool(pool)
+    , mConnection(0)
+    , mWorker(0)
+{
+}
+
+BlockingSlot::~BlockingSlot()
+{
+}
+
+void BlockingSlot::serve(QObject *object, QObject *worker)
+{
+    Connection *connection = static_cast<Connection *>(object);
+    mWorker = static_cast<ConnectionWorker *>(worker);
+    if (!connection->isConnected()) {
+        connection->deleteLater();
+        release();
+        return;
+    }
+
+    mConnection = connection;
+    connection->setBlockingSlot(this);
+    connection->resetStorageBackend();
+    connect(connection, SIGNAL(disconnected()),
+            this, SLOT(connectionDisconnected()));
+
+    // Process the command that made the connection leave its worker
+    QMetaObject::invokeMethod(connection, "slotNewData", Qt::QueuedConnection);
+}
+
+void BlockingSlot::commandsProcessed(Connection *connection)
+{
+    if (connection != mConnection || connection->storageBackend()->inTransaction()) {
+        return;
+    }
+
+    if (connection->context()->resource().isValid()) {
+        akDebug() << "Moving resource connection" << connection->sessionId() << "to a dedicated thread";
+        disconnect(connection, 0, this, 0);
+        connection->setBlockingSlot(0);
+        mConnection = 0;
+
+        ConnectionThread *thread = new ConnectionThread(connection);
+        thread->moveToThread(QCoreApplication::instance()->thread());
+        connection->moveToThread(thread);
+        mPool->addDedicatedThread(thread);
+        release();
+        return;
+    }
+
+    // Keep the connection while nobody else needs the slot
+    if (mPool->hasWaitingConnections()) {
+        returnConnection();
+    }
+}
+
+void BlockingSlot::releaseIfIdle()
+{
+    if (mConnection && !mConnection->isBusy() && !mConnection->storageBackend()->inTransaction()) {
+        returnConnection();
+    }
+}
+
+void BlockingSlot::returnConnection()
+{
+    if (mPool->isQuitting()) {
+        return; // the workers are stopped, the connection is deleted with the slot
+    }
+
+    Connection *connection = mConnection;
+    mConnection = 0;
+    disconnect(connection, 0, this, 0);
+    connection->setBlockingSlot(0);
+    connection->moveToThread(mWorker->thread());
+    QMetaObject::invokeMethod(mWorker, "reattachConnection", Qt::QueuedConnection,
+                              Q_ARG(QObject *, connection));
+    release();
+}
+
+void BlockingSlot::connectionDisconnected()
+{
+    Connection *connection = qobject_cast<Connection*>(sender());
+    if (!connection || connection != mConnection) {
+        return;
+    }
+
+    // Same as what DataStore::close() does when a dedicated thread exits
+    DataStore *store = connection->storageBackend();
+    while (store->inTransaction()) {
+        if (!store->rollbackTransaction()) {
+            break;
+        }
+    }
+
+    mConnection = 0;
+    connection->deleteLater();
+    release();
+}
+
+void BlockingSlot::closeConnection()
+{
+    delete mConnection;
+    mConnection = 0;
+}
+
+void BlockingSlot::release()
+{
+    mWorker = 0;
+    mPool->slotReleased(this);
+}
+
+
+ConnectionWorkerPool::ConnectionWorkerPool(int workerCount, int blockingSlotCount, QObject *parent)
+    : QObject(parent)
+    , mQuitting(0)
+{
+    qRegisterMetaType<quintptr>("quintptr");
+
+    for (int i = 0; i < workerCount; ++i) {
+        ConnectionWorker *worker = new ConnectionWorker(this);
+        QThread *thread = new WorkerThread(worker);
+        worker->moveToThread(thread);
+        thread->start();
+
+        mWorkers.append(worker);
+        mThreads.append(thread);
+    }
+
+    if (blockingSlotCount <= 0) {
+        blockingSlotCount = workerCount;
+    }
+    for (int i = 0; i < blockingSlotCount; ++i) {
+        BlockingSlot *slot = new BlockingSlot(this);
+        QThread *thread = new SlotThread(slot);
+        slot->moveToThread(thread);
+        thread->start();
+
+        mSlots.append(slot);
+        mSlotThreads.append(thread);
+        mFreeSlots.append(slot);
+    }
+}
+
+ConnectionWorkerPool::~ConnectionWorkerPool()
+{
+    quit();
+}
+
+int ConnectionWorkerPool::workerCount() const
+{
+    return mWorkers.count();
+}
+
+int ConnectionWorkerPool::blockingSlotCount() const
+{
+    return mSlots.count();
+}
+
+void ConnectionWorkerPool::addConnection(quintptr socketDescriptor)
+{
+    if (mWorkers.isEmpty()) {
+        return;
+    }
+
+    ConnectionWorker *worker = mWorkers.first();
+    int count = worker->connectionCount();
+    for (int i = 1; i < mWorkers.count(); ++i) {
+        const int c = mWorkers[i]->connectionCount();
+        if (c < count) {
+            worker = mWorkers[i];
+            count = c;
+        }
+    }
+
+    // Account for the connection right away so that a burst of new connections
+    // is spread over all workers
+    worker->mConnectionCount.ref();
+    QMetaObject::invokeMethod(worker, "addConnection", Qt::QueuedConnection,
+                              Q_ARG(quintptr, socketDescriptor));
+}
+
+void ConnectionWorkerPool::requestSlot(ConnectionWorker *worker, Connection *connection)
+{
+    QMutexLocker locker(&mSlotLock);
+    for (int i = 0; i < mWaitingForSlot.count(); ++i) {
+        if (mWaitingForSlot[i].first == connection) {
+            return; // still waiting since its last readyRead()
+        }
+    }
+
+    if (!mFreeSlots.isEmpty()) {
+        BlockingSlot *slot = mFreeSlots.takeFirst();
+        QMetaObject::invokeMethod(worker, "moveToSlot", Qt::QueuedConnection,
+                                  Q_ARG(QObject *, connection),
+                                  Q_ARG(QObject *, slot));
+        return;
+    }
+
+    mWaitingForSlot.append(qMakePair(connection, worker));
+    locker.unlock();
+
+    // Slots keep serving their connection until someone else needs them
+    Q_FOREACH (BlockingSlot *slot, mSlots) {
+        QMetaObject::invokeMethod(slot, "releaseIfIdle", Qt::QueuedConnection);
+    }
+}
+
+void ConnectionWorkerPool::cancelSlotRequest(Connection *connection)
+{
+    QMutexLocker locker(&mSlotLock);
+    for (int i = mWaitingForSlot.count() - 1; i >= 0; --i) {
+        if (mWaitingForSlot[i].first == connection) {
+            mWaitingForSlot.removeAt(i);
+        }
+    }
+}
+
+void ConnectionWorkerPool::slotReleased(BlockingSlot *slot)
+{
+    QMutexLocker locker(&mSlotLock);
+    if (mWaitingForSlot.isEmpty()) {
+        mFreeSlots.append(slot);
+        return;
+    }
+
+    const QPair<Connection*, ConnectionWorker*> waiting = mWaitingForSlot.takeFirst();
+    QMetaObject::invokeMethod(waiting.second, "moveToSlot", Qt::QueuedConnection,
+                              Q_ARG(QObject *, waiting.first),
+                              Q_ARG(QObject *, slot));
+}
+
+bool ConnectionWorkerPool::hasWaitingConnections()
+{
+    QMutexLocker locker(&mSlotLock);
+    return !mWaitingForSlot.isEmpty();
+}
+
+bool ConnectionWorkerPool::isQuitting() const
+{
+    return const_cast<QAtomicInt&>(mQuitting).fetchAndAddAcquire(0);
+}
+
+void ConnectionWorkerPool::addDedicatedThread(ConnectionThread *thread)
+{
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    QMutexLocker locker(&mDedicatedLock);
+    for (int i = mDedicatedThreads.count() - 1; i >= 0; --i) {
+        if (!mDedicatedThreads[i]) {
+            mDedicatedThreads.remove(i);
+        }
+    }
+    mDedicatedThreads.append(thread);
+    thread->start();
+}
+
+void ConnectionWorkerPool::quit()
+{
+    // Connections in blocking slots don't return to their worker anymore
+    mQuitting.fetchAndStoreRelease(1);
+
+    // Stop the workers first, so that no connection is handed to a slot anymore
+    for (int i = 0; i < mThreads.count(); ++i) {
+        mThreads[i]->quit();
+        mThreads[i]->wait();
+    }
+    qDeleteAll(mThreads);
+    mThreads.clear();
+
+    for (int i = 0; i < mSlotThreads.count(); ++i) {
+        mSlotThreads[i]->quit();
+        mSlotThreads[i]->wait();
+    }
+    qDeleteAll(mSlotThreads);
+    mSlotThreads.clear();
+
+    QMutexLocker locker(&mDedicatedLock);
+    for (int i = 0; i < mDedicatedThreads.count(); ++i) {
+        QPointer<ConnectionThread> thread = mDedicatedThreads[i];
+        if (!thread) {
+            continue;
+        }
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    mDedicatedThreads.clear();
+    locker.unlock();
+
+    qDeleteAll(mSlots);
+    mSlots.clear();
+    mFreeSlots.clear();
+    mWaitingForSlot.clear();
+    qDeleteAll(mWorkers);
+    mWorkers.clear();
+}
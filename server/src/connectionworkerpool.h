@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_CONNECTIONWORKERPOOL_H
+#define AKONADI_SERVER_CONNECTIONWORKERPOOL_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QPair>
+#include <QPointer>
+#include <QVector>
+
+class QThread;
+
+namespace Akonadi
+{
+namespace Server
+{
+
+class Connection;
+class ConnectionThread;
+class ConnectionWorkerPool;
+
+/**
+ * A ConnectionWorker lives in one of the threads of the ConnectionWorkerPool
+ * and serves any number of client connections from that thread's event loop.
+ *
+ * All connections of a worker share the single DataStore (and thus the single
+ * database connection) of the worker thread. Because a client-side transaction
+ * spans several commands, the worker hands the DataStore exclusively to the
+ * connection that opened a transaction until it is committed or rolled back;
+ * other connections of the worker are suspended and resumed afterwards.
+ */
+class ConnectionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionWorker(ConnectionWorkerPool *pool);
+    virtual ~ConnectionWorker();
+
+    /**
+     * Number of connections currently served by this worker. Thread-safe.
+     */
+    int connectionCount() const;
+
+    /**
+     * Called by @p connection before it starts processing commands. Returns
+     * @c false when another connection of this worker has a transaction in
+     * progress, in which case @p connection will be resumed once the
+     * transaction is finished.
+     */
+    bool acquireStorage(Connection *connection);
+
+    /**
+     * Called by @p connection after it processed all available commands.
+     * When @p blockingCommandPending is @c true, the next command of
+     * @p connection could block the worker thread, so the connection waits
+     * for a BlockingSlot to process it.
+     */
+    void releaseStorage(Connection *connection, bool blockingCommandPending = false);
+
+public Q_SLOTS:
+    void addConnection(quintptr socketDescriptor);
+
+    /**
+     * Deletes all connections. Must be called from the worker thread after its
+     * event loop has finished.
+     */
+    void closeConnections();
+
+private Q_SLOTS:
+    void connectionDisconnected();
+    void reattachConnection(QObject *connection);
+    void moveToSlot(QObject *connection, QObject *slot);
+
+private:
+    friend class ConnectionWorkerPool;
+    friend class BlockingSlot;
+
+    void resumeWaitingConnections();
+    void detachConnection(Connection *connection);
+
+    ConnectionWorkerPool *mPool;
+    QList<Connection*> mConnections;
+    QAtomicInt mConnectionCount;
+    Connection *mTransactionOwner;
+    QList<QPointer<Connection> > mWaitingConnections;
+};
+
+/**
+ * A BlockingSlot lives in a thread of its own and serves one connection at a
+ * time, for commands that may block the thread: reading literals, or waiting
+ * for a resource to deliver an item or for a search agent.
+ *
+ * The thread and its DataStore are reused for all connections the slot serves.
+ * A connection stays with the slot until another connection is waiting for a
+ * slot, so a client sending one FETCH after the other is not moved back and
+ * forth for every command.
+ */
+class BlockingSlot : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BlockingSlot(ConnectionWorkerPool *pool);
+    virtual ~BlockingSlot();
+
+    /**
+     * Called by the served @p connection after it processed all available
+     * commands.
+     */
+    void commandsProcessed(Connection *connection);
+
+    /**
+     * Deletes the served connection. Must be called from the slot thread after
+     * its event loop has finished.
+     */
+    void closeConnection();
+
+private Q_SLOTS:
+    void serve(QObject *connection, QObject *worker);
+    void releaseIfIdle();
+    void connectionDisconnected();
+
+private:
+    friend class ConnectionWorkerPool;
+
+    void returnConnection();
+    void release();
+
+    ConnectionWorkerPool *mPool;
+    Connection *mConnection;
+    ConnectionWorker *mWorker;
+};
+
+/**
+ * Multiplexes client connections onto a fixed number of worker threads.
+ *
+ * This replaces the one-thread-per-connection model of AkonadiServer when
+ * Connection/WorkerThreads is set to a positive value in akonadiserverrc.
+ * Each worker thread owns one DataStore.
+ *
+ * Nothing may block a worker thread. A worker only starts a command once its
+ * first line has arrived, and a connection whose next command reads literals
+ * or might wait for a resource or a search agent is handed to one of the
+ * Connection/BlockingThreads BlockingSlots (as many as there are workers by
+ * default). When all slots are busy, the connection waits until one is free.
+ * Together the number of database connections used for clients is bounded.
+ *
+ * Connections of resources (i.e. sessions that issued RESSELECT) are moved to
+ * a dedicated ConnectionThread: item retrieval blocks the requesting thread
+ * until the resource has delivered the item, so a resource must never share
+ * a thread with a client that could be waiting for it.
+ */
+class ConnectionWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionWorkerPool(int workerCount, int blockingSlotCount = 0, QObject *parent = 0);
+    virtual ~ConnectionWorkerPool();
+
+    int workerCount() const;
+    int blockingSlotCount() const;
+
+    /**
+     * Assigns the new connection to the least busy worker.
+     */
+    void addConnection(quintptr socketDescriptor);
+
+    /**
+     * Terminates all worker, blocking slot and dedicated connection threads.
+     */
+    void quit();
+
+private:
+    friend class ConnectionWorker;
+    friend class BlockingSlot;
+
+    void addDedicatedThread(ConnectionThread *thread);
+    void requestSlot(ConnectionWorker *worker, Connection *connection);
+    void cancelSlotRequest(Connection *connection);
+    void slotReleased(BlockingSlot *slot);
+    bool hasWaitingConnections();
+    bool isQuitting() const;
+
+    QVector<QThread*> mThreads;
+    QVector<ConnectionWorker*> mWorkers;
+
+    QVector<QThread*> mSlotThreads;
+    QVector<BlockingSlot*> mSlots;
+
+    QMutex mSlotLock;
+    QList<BlockingSlot*> mFreeSlots;
+    // validated by the worker, which owns the connection, before it is moved
+    QList<QPair<Connection*, ConnectionWorker*> > mWaitingForSlot;
+
+    QMutex mDedicatedLock;
+    QVector<QPointer<ConnectionThread> > mDedicatedThreads;
+    QAtomicInt mQuitting;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_CONNECTIONWORKERPOOL_H
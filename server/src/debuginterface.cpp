@@ -41,3 +41,23 @@ void DebugInterface::setTracer( const QString &tracer )
 {
   Tracer::self()->activateTracer( tracer );
 }
+
+int DebugInterface::traceSampling() const
+{
+  return Tracer::self()->sampling();
+}
+
+void DebugInterface::setTraceSampling( int sampling )
+{
+  Tracer::self()->setSampling( sampling );
+}
+
+QStringList DebugInterface::traceFilter() const
+{
+  return Tracer::self()->filter();
+}
+
+void DebugInterface::setTraceFilter( const QStringList &filter )
+{
+  Tracer::self()->setFilter( filter );
+}
@@ -21,6 +21,7 @@
 #define AKONADI_DEBUGINTERFACE_H
 
 #include <QObject>
+#include <QStringList>
 
 namespace Akonadi {
 namespace Server {
@@ -40,6 +41,12 @@ class DebugInterface : public QObject
     Q_SCRIPTABLE QString tracer() const;
     Q_SCRIPTABLE void setTracer( const QString &tracer );
 
+    Q_SCRIPTABLE int traceSampling() const;
+    Q_SCRIPTABLE void setTraceSampling( int sampling );
+
+    Q_SCRIPTABLE QStringList traceFilter() const;
+    Q_SCRIPTABLE void setTraceFilter( const QStringList &filter );
+
 };
 
 } // namespace Server
@@ -17,16 +17,27 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.         *
  ***************************************************************************/
 #include "filetracer.h"
+#include "asynctracer.h"
 
+#include <QtCore/QDateTime>
 #include <QtCore/QFile>
-#include <QtCore/QTime>
 
 using namespace Akonadi::Server;
 
+static TraceRecord makeRecord( TraceRecord::Type type, const QString &identifier, const QString &text )
+{
+  TraceRecord record;
+  record.timestamp = QDateTime::currentMSecsSinceEpoch();
+  record.type = type;
+  record.identifier = identifier;
+  record.text = text;
+  return record;
+}
+
 FileTracer::FileTracer( const QString &fileName )
 {
   m_file = new QFile( fileName );
-  m_file->open( QIODevice::WriteOnly | QIODevice::Unbuffered );
+  m_file->open( QIODevice::WriteOnly );
 }
 
 FileTracer::~FileTracer()
@@ -36,41 +47,91 @@ FileTracer::~FileTracer()
 
 void FileTracer::beginConnection( const QString &identifier, const QString &msg )
 {
-  output( identifier, QString::fromLatin1( "begin_connection: %1" ).arg( msg ) );
+  writeRecord( makeRecord( TraceRecord::BeginConnection, identifier, msg ) );
 }
 
 void FileTracer::endConnection( const QString &identifier, const QString &msg )
 {
-  output( identifier, QString::fromLatin1( "end_connection: %1" ).arg( msg ) );
+  writeRecord( makeRecord( TraceRecord::EndConnection, identifier, msg ) );
 }
 
 void FileTracer::connectionInput( const QString &identifier, const QByteArray &msg )
 {
-  output( identifier, QString::fromLatin1( "input: %1" ).arg( QString::fromUtf8( msg ) ) );
+  TraceRecord record = makeRecord( TraceRecord::ConnectionInput, identifier, QString() );
+  record.data = msg;
+  writeRecord( record );
 }
 
 void FileTracer::connectionOutput( const QString &identifier, const QByteArray &msg )
 {
-  output( identifier, QString::fromLatin1( "output: %1" ).arg( QString::fromUtf8( msg ) ) );
+  TraceRecord record = makeRecord( TraceRecord::ConnectionOutput, identifier, QString() );
+  record.data = msg;
+  writeRecord( record );
 }
 
 void FileTracer::signal( const QString &signalName, const QString &msg )
 {
-  output( QLatin1String( "signal" ), QString::fromLatin1( "<%1> %2" ).arg( signalName, msg ) );
+  writeRecord( makeRecord( TraceRecord::Signal, signalName, msg ) );
 }
 
 void FileTracer::warning( const QString &componentName, const QString &msg )
 {
-  output( QLatin1String( "warning" ), QString::fromLatin1( "<%1> %2" ).arg( componentName, msg ) );
+  writeRecord( makeRecord( TraceRecord::Warning, componentName, msg ) );
 }
 
 void FileTracer::error( const QString &componentName, const QString &msg )
 {
-  output( QLatin1String( "error" ), QString::fromLatin1( "<%1> %2" ).arg( componentName, msg ) );
+  writeRecord( makeRecord( TraceRecord::Error, componentName, msg ) );
+}
+
+QByteArray FileTracer::truncated( const QByteArray &data )
+{
+  // Only the first line goes into the file, literals would just bloat it;
+  // left() shares the data if it is a single line already
+  const int newLine = data.indexOf( '\n' );
+  return data.left( qMin( newLine < 0 ? data.size() : newLine, static_cast<int>( MaxDataSize ) ) );
+}
+
+void FileTracer::writeRecord( const TraceRecord &record )
+{
+  switch ( record.type ) {
+    case TraceRecord::BeginConnection:
+      output( record.timestamp, record.identifier, "begin_connection: " + record.text.toUtf8() );
+      break;
+    case TraceRecord::EndConnection:
+      output( record.timestamp, record.identifier, "end_connection: " + record.text.toUtf8() );
+      break;
+    case TraceRecord::ConnectionInput:
+      output( record.timestamp, record.identifier, "input: " + truncated( record.data ) );
+      break;
+    case TraceRecord::ConnectionOutput:
+      output( record.timestamp, record.identifier, "output: " + truncated( record.data ) );
+      break;
+    case TraceRecord::Signal:
+      output( record.timestamp, QLatin1String( "signal" ), '<' + record.identifier.toUtf8() + "> " + record.text.toUtf8() );
+      break;
+    case TraceRecord::Warning:
+      output( record.timestamp, QLatin1String( "warning" ), '<' + record.identifier.toUtf8() + "> " + record.text.toUtf8() );
+      break;
+    case TraceRecord::Error:
+      output( record.timestamp, QLatin1String( "error" ), '<' + record.identifier.toUtf8() + "> " + record.text.toUtf8() );
+      break;
+  }
+}
+
+void FileTracer::flush()
+{
+  m_file->flush();
 }
 
-void FileTracer::output( const QString &id, const QString &msg )
+void FileTracer::output( qint64 timestamp, const QString &id, const QByteArray &msg )
 {
-  QString output = QString::fromLatin1( "%1: %2: %3\r\n" ).arg( QTime::currentTime().toString( QLatin1String( "HH:mm:ss.zzz" ) ), id, msg.left( msg.indexOf( QLatin1String( "\n" ) ) ) );
-  m_file->write( output.toUtf8() );
+  const int newLine = msg.indexOf( '\n' );
+  QByteArray line = QDateTime::fromMSecsSinceEpoch( timestamp ).time().toString( QLatin1String( "HH:mm:ss.zzz" ) ).toLatin1();
+  line += ": ";
+  line += id.toUtf8();
+  line += ": ";
+  line += newLine < 0 ? msg : msg.left( newLine );
+  line += "\r\n";
+  m_file->write( line );
 }
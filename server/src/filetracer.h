@@ -22,18 +22,32 @@
 
 #include "tracerinterface.h"
 
+#include <QtCore/QtGlobal>
+
 class QFile;
 
 namespace Akonadi {
 namespace Server {
 
+struct TraceRecord;
+
 /**
  * A tracer which forwards all tracing information to a
  * log file.
+ *
+ * Writes are buffered, call flush() to write them to the file.
  */
 class FileTracer : public TracerInterface
 {
   public:
+    /**
+     * Maximum size of the written connection input and output, longer lines
+     * are truncated. Only the first line of each is written.
+     */
+    enum {
+      MaxDataSize = 4096
+    };
+
     FileTracer( const QString &fileName );
     virtual ~FileTracer();
 
@@ -45,8 +59,16 @@ class FileTracer : public TracerInterface
     virtual void warning( const QString &componentName, const QString &msg );
     virtual void error( const QString &componentName, const QString &msg );
 
+    /**
+     * Writes @p record with the time it has been taken.
+     */
+    void writeRecord( const TraceRecord &record );
+
+    void flush();
+
   private:
-    void output( const QString &id, const QString &msg );
+    static QByteArray truncated( const QByteArray &data );
+    void output( qint64 timestamp, const QString &id, const QByteArray &msg );
 
     QFile *m_file;
 };
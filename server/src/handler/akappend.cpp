@@ -329,6 +329,10 @@ bool AkAppend::insertItem( PimItem &item, const Collection &parentCol,
     PartHelper::insert( &hiddenAttribute );
   }
 
+  if ( !DataStore::self()->updateItemsModSeq( PimItem::List() << item ) ) {
+    return failureResponse( "Unable to update the modification sequence of the item" );
+  }
+
   return true;
 }
 
@@ -23,6 +23,7 @@
 #include "imapstreamparser.h"
 #include "clientcapabilities.h"
 #include "connection.h"
+#include "storage/itemretrievalrequest.h"
 
 #include <libs/protocol_p.h>
 
@@ -59,6 +60,17 @@ bool Capability::parseStream()
       capabilities.setAkAppendStreaming( true );
     } else if ( capability == AKONADI_PARAM_CAPABILITY_DIRECTSTREAMING ) {
       capabilities.setDirectStreaming( true );
+    } else if ( capability == AKONADI_PARAM_CAPABILITY_RETRIEVALPRIORITY ) {
+      const QByteArray priority = m_streamParser->readString();
+      if ( priority == "INTERACTIVE" ) {
+        capabilities.setRetrievalPriority( ItemRetrievalRequest::Interactive );
+      } else if ( priority == "NORMAL" ) {
+        capabilities.setRetrievalPriority( ItemRetrievalRequest::Normal );
+      } else if ( priority == "BULK" ) {
+        capabilities.setRetrievalPriority( ItemRetrievalRequest::Bulk );
+      } else {
+        qDebug() << Q_FUNC_INFO << "Unknown retrieval priority:" << priority;
+      }
     } else {
       qDebug() << Q_FUNC_INFO << "Unknown client capability:" << capability;
     }
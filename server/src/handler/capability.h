@@ -45,6 +45,8 @@ namespace Server {
   <h4>Client Capabilities</h4>
   - @c NOTIFY version - version of the notification message format
   - @c NOPAYLOADPATH - only filename of external payload file is expected
+  - @c RETRIEVALPRIORITY priority - priority of the item retrievals of this
+    session, one of @c INTERACTIVE, @c NORMAL or @c BULK
 
   <h4>Server Capabilities</h4>
   None defined yet.
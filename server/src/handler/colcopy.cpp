@@ -76,10 +76,8 @@ bool ColCopy::copyCollection( const Collection &source, const Collection &target
   }
 
   // copy items
-  Q_FOREACH ( const PimItem &item, source.items() ) {
-    if ( !copyItem( item, col ) ) {
-      return false;
-    }
+  if ( !copyItems( source.items(), col ) ) {
+    return false;
   }
 
   return true;
@@ -33,37 +33,145 @@
 #include "libs/imapset_p.h"
 #include "imapstreamparser.h"
 
+#include <akdebug.h>
+
+#include <QSqlError>
+#include <QSqlQuery>
+
 using namespace Akonadi;
 using namespace Akonadi::Server;
 
-bool Copy::copyItem( const PimItem &item, const Collection &target )
+// Number of items whose parts and flags are copied by one statement
+static const int CopyChunkSize = 500;
+
+// Maps the ids of the original items in @p ids to the ids of their copies in a
+// CASE expression, so that all rows of a chunk can be copied by one INSERT ... SELECT
+static QString copyIdExpression( const QString &column, const QVector<qint64> &ids, const QHash<qint64, qint64> &copies )
 {
-//  akDebug() << "Copy::copyItem";
-
-  PimItem newItem = item;
-  newItem.setId( -1 );
-  newItem.setRev( 0 );
-  newItem.setDatetime( QDateTime::currentDateTime() );
-  newItem.setAtime( QDateTime::currentDateTime() );
-  newItem.setRemoteId( QString() );
-  newItem.setRemoteRevision( QString() );
-  newItem.setCollectionId( target.id() );
-  Part::List parts;
-  Q_FOREACH ( const Part &part, item.parts() ) {
-    Part newPart( part );
-    newPart.setData( PartHelper::translateData( newPart.data(), part.external() ) );
-    newPart.setPimItemId( -1 );
-    parts << newPart;
+  QString expression = QLatin1String( "CASE " ) + column;
+  Q_FOREACH ( qint64 id, ids ) {
+    expression += QLatin1String( " WHEN " ) + QString::number( id ) + QLatin1String( " THEN " ) + QString::number( copies.value( id ) );
   }
+  return expression + QLatin1String( " END" );
+}
 
-  DataStore *store = connection()->storageBackend();
-  if ( !store->appendPimItem( parts, item.mimeType(), target, QDateTime::currentDateTime(), QString(), QString(), item.gid(), newItem ) ) {
+static QString idList( const QVector<qint64> &ids )
+{
+  QStringList list;
+  list.reserve( ids.count() );
+  Q_FOREACH ( qint64 id, ids ) {
+    list << QString::number( id );
+  }
+  return list.join( QLatin1String( ", " ) );
+}
+
+static bool execCopyQuery( DataStore *store, const QString &statement )
+{
+  QSqlQuery query( store->database() );
+  if ( !query.exec( statement ) ) {
+    akError() << "Failed to copy items:" << query.lastError().text();
+    akError() << "Query:" << statement;
     return false;
   }
-  Q_FOREACH ( const Flag &flag, item.flags() ) {
-    if ( !newItem.addFlag( flag ) ) {
+  return true;
+}
+
+bool Copy::copyItems( const PimItem::List &items, const Collection &target )
+{
+//  akDebug() << "Copy::copyItems";
+
+  if ( items.isEmpty() ) {
+    return true;
+  }
+
+  // The copies need ids of their own to reference their parts and flags, so
+  // the item rows are inserted one by one. Parts and flags are then copied
+  // inside the database, the payloads are neither loaded nor rewritten.
+  DataStore *store = connection()->storageBackend();
+  const QDateTime now = QDateTime::currentDateTime();
+  QHash<qint64, qint64> copies;
+  PimItem::List newItems;
+  newItems.reserve( items.count() );
+  Q_FOREACH ( const PimItem &item, items ) {
+    PimItem newItem = item;
+    newItem.setId( -1 );
+    newItem.setRev( 0 );
+    newItem.setDatetime( now );
+    newItem.setAtime( now );
+    newItem.setRemoteId( QString() );
+    newItem.setRemoteRevision( QString() );
+    newItem.setCollectionId( target.id() );
+    newItem.setDirty( true );
+    if ( !newItem.insert() ) {
       return false;
     }
+    copies.insert( item.id(), newItem.id() );
+    newItems << newItem;
+  }
+
+  for ( int offset = 0; offset < items.count(); offset += CopyChunkSize ) {
+    QVector<qint64> ids;
+    QVariantList newIds;
+    for ( int i = offset; i < qMin( offset + CopyChunkSize, items.count() ); ++i ) {
+      ids << items.at( i ).id();
+      newIds << newItems.at( i ).id();
+    }
+
+    const QString partColumns = ( QStringList() << Part::partTypeIdColumn() << Part::dataColumn() << Part::datasizeColumn()
+                                                << Part::versionColumn() << Part::externalColumn() << Part::compressedColumn() ).join( QLatin1String( ", " ) );
+    if ( !execCopyQuery( store, QLatin1String( "INSERT INTO " ) + Part::tableName()
+                         + QLatin1String( " (" ) + Part::pimItemIdColumn() + QLatin1String( ", " ) + partColumns + QLatin1String( ") SELECT " )
+                         + copyIdExpression( Part::pimItemIdColumn(), ids, copies ) + QLatin1String( ", " ) + partColumns
+                         + QLatin1String( " FROM " ) + Part::tableName()
+                         + QLatin1String( " WHERE " ) + Part::pimItemIdColumn() + QLatin1String( " IN (" ) + idList( ids ) + QLatin1Char( ')' ) ) ) {
+      return false;
+    }
+
+    if ( !execCopyQuery( store, QLatin1String( "INSERT INTO " ) + PimItemFlagRelation::tableName()
+                         + QLatin1String( " (" ) + PimItemFlagRelation::leftColumn() + QLatin1String( ", " ) + PimItemFlagRelation::rightColumn()
+                         + QLatin1String( ") SELECT " ) + copyIdExpression( PimItemFlagRelation::leftColumn(), ids, copies )
+                         + QLatin1String( ", " ) + PimItemFlagRelation::rightColumn()
+                         + QLatin1String( " FROM " ) + PimItemFlagRelation::tableName()
+                         + QLatin1String( " WHERE " ) + PimItemFlagRelation::leftColumn() + QLatin1String( " IN (" ) + idList( ids ) + QLatin1Char( ')' ) ) ) {
+      return false;
+    }
+
+    // The copied parts still reference the payload files of the originals
+    SelectQueryBuilder<Part> qb;
+    qb.addValueCondition( Part::pimItemIdColumn(), Query::In, newIds );
+    qb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+    qb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
+    if ( !qb.exec() ) {
+      return false;
+    }
+    QHash<QByteArray, int> sharedFiles;
+    Q_FOREACH ( Part part, qb.result() ) {
+      if ( PartHelper::isSharedFile( part.data() ) ) {
+        ++sharedFiles[part.data()];
+        continue;
+      }
+      try {
+        part.setData( PartHelper::linkFile( &part ) );
+      } catch ( const PartHelperException &e ) {
+        akError() << e.what();
+        return false;
+      }
+      if ( !part.update() ) {
+        return false;
+      }
+    }
+    for ( QHash<QByteArray, int>::ConstIterator it = sharedFiles.constBegin(); it != sharedFiles.constEnd(); ++it ) {
+      if ( !PartHelper::addSharedFileReference( it.key(), it.value() ) ) {
+        return false;
+      }
+    }
+  }
+
+  if ( !store->updateItemsModSeq( newItems ) ) {
+    return false;
+  }
+  Q_FOREACH ( const PimItem &newItem, newItems ) {
+    store->notificationCollector()->itemAdded( newItem, target );
   }
   return true;
 }
@@ -104,10 +212,8 @@ bool Copy::parseStream()
   DataStore *store = connection()->storageBackend();
   Transaction transaction( store );
 
-  Q_FOREACH ( const PimItem &item, items ) {
-    if ( !copyItem( item, targetCollection ) ) {
-      return failureResponse( "Unable to copy item" );
-    }
+  if ( !copyItems( items, targetCollection ) ) {
+    return failureResponse( "Unable to copy item" );
   }
 
   if ( !transaction.commit() ) {
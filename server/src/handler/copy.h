@@ -58,10 +58,11 @@ class Copy : public Handler
 
   protected:
     /**
-      Copy the given item and all its parts into the @p target.
-      The changes mentioned above are applied.
+      Copy the given items and all their parts and flags into the @p target.
+      The changes mentioned above are applied. Payloads are copied within the
+      database, external payload files are shared with the originals.
     */
-    bool copyItem( const PimItem &item, const Collection &target );
+    bool copyItems( const PimItem::List &items, const Collection &target );
 };
 
 } // namespace Server
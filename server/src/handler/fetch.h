@@ -36,7 +36,7 @@ namespace Server {
   @verbatim
   fetch-request = tag " " [scope-selector " "] "FETCH " scope " " fetch-parameters " " part-list
   scope-selector = [ "UID" / "RID" ]
-  fetch-parameters = [ "FULLPAYLOAD" / "CACHEONLY" / "CACHEONLY" / "EXTERNALPAYLOAD" / "ANCESTORS " depth ]
+  fetch-parameters = [ "FULLPAYLOAD" / "CACHEONLY" / "CACHEONLY" / "EXTERNALPAYLOAD" / "ANCESTORS " depth / "CHANGEDSINCE MODSEQ " modseq / "VANISHED" ]
   part-list = "(" *(part-id) ")"
   depth = "0" / "1" / "INF"
   @endverbatim
@@ -46,6 +46,10 @@ namespace Server {
   - @c CACHEONLY: Restrict retrieval to parts already in the cache, even if more parts have been requested.
   - @c EXTERNALPAYLOAD: Indicate the capability to retrieve parts via the filesystem instead over the socket
   - @c ANCESTORS: Indicate the desired ancestor collection depth (0 is the default)
+  - @c CHANGEDSINCE: Restrict the result to items whose modification sequence is greater than @c modseq
+  - @c VANISHED: Together with @c CHANGEDSINCE and a collection, report the items removed from the collection
+    since @c modseq in an untagged "VANISHED" response with their ids as sequence set before the items.
+    Fails if the expunge log has been pruned beyond @c modseq, in that case a full resync is needed.
  */
 class Fetch : public Handler
 {
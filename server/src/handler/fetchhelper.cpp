@@ -27,19 +27,21 @@
 #include "handlerhelper.h"
 #include "imapstreamparser.h"
 #include "libs/imapparser_p.h"
+#include "libs/imapset_p.h"
 #include "libs/protocol_p.h"
 #include "response.h"
 #include "storage/selectquerybuilder.h"
+#include "storage/accesstimetracker.h"
 #include "storage/itemqueryhelper.h"
 #include "storage/itemretrievalmanager.h"
 #include "storage/itemretrievalrequest.h"
 #include "storage/parthelper.h"
+#include "storage/columnreader.h"
 #include <storage/parttypehelper.h>
 #include "storage/transaction.h"
 #include "utils.h"
 #include "intervalcheck.h"
-#include "agentmanagerinterface.h"
-#include "dbusconnectionpool.h"
+#include "agentinfocache.h"
 #include "tagfetchhelper.h"
 #include "relationfetch.h"
 
@@ -70,7 +72,8 @@ enum PartQueryColumns {
   PartQueryTypeNameColumn,
   PartQueryDataColumn,
   PartQueryExternalColumn,
-  PartQueryVersionColumn
+  PartQueryVersionColumn,
+  PartQueryCompressedColumn
 };
 
 QSqlQuery FetchHelper::buildPartQuery( const QVector<QByteArray> &partList, bool allPayload, bool allAttrs )
@@ -89,6 +92,7 @@ QSqlQuery FetchHelper::buildPartQuery( const QVector<QByteArray> &partList, bool
     partQuery.addColumn( Part::externalFullColumnName() );
 
     partQuery.addColumn( Part::versionFullColumnName() );
+    partQuery.addColumn( Part::compressedFullColumnName() );
 
     partQuery.addSortColumn( PimItem::idFullColumnName(), Query::Descending );
 
@@ -158,6 +162,9 @@ QSqlQuery FetchHelper::buildItemQuery()
   if ( mFetchScope.gidRequested() ) {
     ADD_COLUMN( PimItem::gidFullColumnName(), ItemQueryPimItemGidColumn )
   }
+  if ( mFetchScope.modSeqRequested() ) {
+    ADD_COLUMN( PimItem::modSeqFullColumnName(), ItemQueryModSeqColumn )
+  }
   #undef ADD_COLUMN
 
   itemQuery.addSortColumn( PimItem::idFullColumnName(), Query::Descending );
@@ -169,6 +176,10 @@ QSqlQuery FetchHelper::buildItemQuery()
   if ( mFetchScope.changedSince().isValid() ) {
     itemQuery.addValueCondition( PimItem::datetimeFullColumnName(), Query::GreaterOrEqual, mFetchScope.changedSince().toUTC() );
   }
+  // Uses the collectionId,modSeq index for collection scopes
+  if ( mFetchScope.changedSinceModSeq() >= 0 ) {
+    itemQuery.addValueCondition( PimItem::modSeqFullColumnName(), Query::Greater, mFetchScope.changedSinceModSeq() );
+  }
 
   if ( !itemQuery.exec() ) {
     throw HandlerException( "Unable to list items" );
@@ -187,6 +198,7 @@ enum FlagQueryColumns {
 QSqlQuery FetchHelper::buildFlagQuery()
 {
   QueryBuilder flagQuery( PimItem::tableName() );
+  flagQuery.setForwardOnly( true );
   flagQuery.addJoin( QueryBuilder::InnerJoin, PimItemFlagRelation::tableName(),
                      PimItem::idFullColumnName(), PimItemFlagRelation::leftFullColumnName() );
   flagQuery.addJoin( QueryBuilder::InnerJoin, Flag::tableName(),
@@ -213,6 +225,7 @@ enum TagQueryColumns {
 QSqlQuery FetchHelper::buildTagQuery()
 {
   QueryBuilder tagQuery( PimItem::tableName() );
+  tagQuery.setForwardOnly( true );
   tagQuery.addJoin( QueryBuilder::InnerJoin, PimItemTagRelation::tableName(),
                      PimItem::idFullColumnName(), PimItemTagRelation::leftFullColumnName() );
   tagQuery.addJoin( QueryBuilder::InnerJoin, Tag::tableName(),
@@ -240,6 +253,7 @@ enum VRefQueryColumns {
 QSqlQuery FetchHelper::buildVRefQuery()
 {
   QueryBuilder vRefQuery( PimItem::tableName() );
+  vRefQuery.setForwardOnly( true );
   vRefQuery.addJoin( QueryBuilder::LeftJoin, CollectionPimItemRelation::tableName(),
                      CollectionPimItemRelation::rightFullColumnName(),
                      PimItem::idFullColumnName() );
@@ -258,10 +272,15 @@ QSqlQuery FetchHelper::buildVRefQuery()
 }
 
 
-bool FetchHelper::isScopeLocal( const Scope &scope )
+bool FetchHelper::mayOverrideCacheOnly( const Connection *connection )
 {
   // The only agent allowed to override local scope is the Baloo Indexer
-  if ( !mConnection->sessionId().startsWith( "akonadi_baloo_indexer" ) ) {
+  return connection->sessionId().startsWith( "akonadi_baloo_indexer" );
+}
+
+bool FetchHelper::isScopeLocal( const Scope &scope )
+{
+  if ( !mayOverrideCacheOnly( mConnection ) ) {
     return false;
   }
 
@@ -293,12 +312,11 @@ bool FetchHelper::isScopeLocal( const Scope &scope )
   query.next();
   const QString resourceName = query.value( 0 ).toString();
 
-  org::freedesktop::Akonadi::AgentManager manager( AkDBus::serviceName( AkDBus::Control ),
-                                                   QLatin1String( "/AgentManager" ),
-                                                   DBusConnectionPool::threadConnection() );
-  const QString typeIdentifier = manager.agentInstanceType( resourceName );
-  const QVariantMap properties = manager.agentCustomProperties( typeIdentifier );
-  return properties.value( QLatin1String( "HasLocalStorage" ), false ).toBool();
+  const AgentInfoCache *agentInfoCache = AgentInfoCache::instance();
+  if ( !agentInfoCache ) {
+    return false;
+  }
+  return agentInfoCache->agentInfo( resourceName ).hasLocalStorage;
 }
 
 QByteArray FetchHelper::tagsToByteArray( const Tag::List &tags )
@@ -331,6 +349,46 @@ QByteArray FetchHelper::relationsToByteArray(const Relation::List &relations)
     return b;
 }
 
+void FetchHelper::reportVanishedItems()
+{
+  const qint64 modSeq = mFetchScope.changedSinceModSeq();
+  const Collection::Id collectionId = mConnection->context()->collectionId();
+  if ( modSeq < 0 || collectionId <= 0 ) {
+    throw HandlerException( "VANISHED requires CHANGEDSINCE MODSEQ and a collection" );
+  }
+
+  // The expunge log is complete only above the sequence it has been pruned to
+  const ModificationSequence::List sequences = ModificationSequence::retrieveAll();
+  if ( sequences.isEmpty() || modSeq < sequences.first().prunedModSeq() ) {
+    throw HandlerException( "The expunge log does not reach back to the requested modification sequence, a full resync is required" );
+  }
+
+  QueryBuilder qb( ItemTombstone::tableName(), QueryBuilder::Select );
+  qb.addColumn( ItemTombstone::pimItemIdColumn() );
+  qb.addValueCondition( ItemTombstone::collectionIdColumn(), Query::Equals, collectionId );
+  qb.addValueCondition( ItemTombstone::modSeqColumn(), Query::Greater, modSeq );
+  if ( !qb.exec() ) {
+    throw HandlerException( "Unable to retrieve removed items" );
+  }
+
+  QVector<ImapSet::Id> ids;
+  QSqlQuery query = qb.query();
+  while ( query.next() ) {
+    ids << query.value( 0 ).toLongLong();
+  }
+  query.finish();
+  if ( ids.isEmpty() ) {
+    return;
+  }
+
+  ImapSet set;
+  set.add( ids );
+  Response response;
+  response.setUntagged();
+  response.setString( AKONADI_PARAM_VANISHED " " + set.toImapSequenceSet() );
+  Q_EMIT responseAvailable( response );
+}
+
 bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
 {
   // retrieve missing parts
@@ -351,6 +409,7 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     retriever.setRetrieveParts( mFetchScope.requestedPayloads() );
     retriever.setRetrieveFullPayload( mFetchScope.fullPayload() );
     retriever.setChangedSince( mFetchScope.changedSince() );
+    retriever.setChangedSinceModSeq( mFetchScope.changedSinceModSeq() );
     if ( !retriever.exec() && !mFetchScope.ignoreErrors() ) { // There we go, retrieve the missing parts from the resource.
       if ( mConnection->context()->resource().isValid() ) {
         throw HandlerException( QString::fromLatin1( "Unable to fetch item from backend (collection %1, resource %2) : %3" )
@@ -365,6 +424,17 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     }
   }
 
+  // Sequences are committed out of order, so a reported sequence must not be
+  // newer than the oldest one still in use, otherwise a client continuing from
+  // it would miss the changes committed later under older sequences
+  const qint64 committedModSeq = mFetchScope.modSeqRequested() ? mConnection->storageBackend()->committedModSeq() : -1;
+
+  // Report the removed items first, an item that was moved away and back
+  // again is listed in both
+  if ( mFetchScope.vanishedRequested() ) {
+    reportVanishedItems();
+  }
+
   QSqlQuery itemQuery = buildItemQuery();
 
   // error if query did not find any item and scope is not listing items but
@@ -407,25 +477,37 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     vRefQuery = buildVRefQuery();
   }
 
+  // read the hot columns without going through QVariant where the driver supports it
+  const ColumnReader itemColumns( itemQuery );
+  const ColumnReader partColumns( partQuery );
+  const ColumnReader flagColumns( flagQuery );
+
+  // update atime (only if the payload was actually requested, otherwise a simple resource sync prevents cache clearing)
+  const bool updateAccessTime = needsAccessTimeUpdate( mFetchScope.requestedParts() ) || mFetchScope.fullPayload();
+  QVector<qint64> accessedItems;
+
   // build responses
   Response response;
   response.setUntagged();
   while ( itemQuery.isValid() ) {
-    const qint64 pimItemId = extractQueryResult( itemQuery, ItemQueryPimItemIdColumn ).toLongLong();
-    const int pimItemRev = extractQueryResult( itemQuery, ItemQueryRevColumn ).toInt();
+    const qint64 pimItemId = itemColumns.toLongLong( mItemQueryColumnMap[ItemQueryPimItemIdColumn] );
+    if ( updateAccessTime ) {
+      accessedItems << pimItemId;
+    }
+    const int pimItemRev = itemColumns.toInt( mItemQueryColumnMap[ItemQueryRevColumn] );
 
     QList<QByteArray> attributes;
     attributes.append( AKONADI_PARAM_UID " " + QByteArray::number( pimItemId ) );
     attributes.append( AKONADI_PARAM_REVISION " " + QByteArray::number( pimItemRev ) );
     if ( mFetchScope.remoteIdRequested() ) {
-      attributes.append( AKONADI_PARAM_REMOTEID " " + ImapParser::quote( Utils::variantToByteArray( extractQueryResult( itemQuery, ItemQueryPimItemRidColumn ) ) ) );
+      attributes.append( AKONADI_PARAM_REMOTEID " " + ImapParser::quote( itemColumns.toByteArray( mItemQueryColumnMap[ItemQueryPimItemRidColumn] ) ) );
     }
-    attributes.append( AKONADI_PARAM_MIMETYPE " " + ImapParser::quote( Utils::variantToByteArray( extractQueryResult( itemQuery, ItemQueryMimeTypeColumn ) ) ) );
-    Collection::Id parentCollectionId = extractQueryResult( itemQuery, ItemQueryCollectionIdColumn ).toLongLong();
+    attributes.append( AKONADI_PARAM_MIMETYPE " " + ImapParser::quote( itemColumns.toByteArray( mItemQueryColumnMap[ItemQueryMimeTypeColumn] ) ) );
+    Collection::Id parentCollectionId = itemColumns.toLongLong( mItemQueryColumnMap[ItemQueryCollectionIdColumn] );
     attributes.append( AKONADI_PARAM_COLLECTIONID " " + QByteArray::number( parentCollectionId ) );
 
     if ( mFetchScope.sizeRequested() ) {
-      const qint64 pimItemSize = extractQueryResult( itemQuery, ItemQuerySizeColumn ).toLongLong();
+      const qint64 pimItemSize = itemColumns.toLongLong( mItemQueryColumnMap[ItemQuerySizeColumn] );
       attributes.append( AKONADI_PARAM_SIZE " " + QByteArray::number( pimItemSize ) );
     }
     if ( mFetchScope.mTimeRequested() ) {
@@ -434,14 +516,18 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
       QString datetime = QLocale::c().toString( pimItemDatetime, QLatin1String( "dd-MMM-yyyy hh:mm:ss +0000" ) );
       attributes.append( AKONADI_PARAM_MTIME " " + ImapParser::quote( datetime.toUtf8() ) );
     }
+    if ( mFetchScope.modSeqRequested() ) {
+      const qint64 modSeq = itemColumns.toLongLong( mItemQueryColumnMap[ItemQueryModSeqColumn] );
+      attributes.append( AKONADI_PARAM_MODSEQ " " + QByteArray::number( qMin( modSeq, committedModSeq ) ) );
+    }
     if ( mFetchScope.remoteRevisionRequested() ) {
-      const QByteArray rrev = Utils::variantToByteArray( extractQueryResult( itemQuery, ItemQueryRemoteRevisionColumn ) );
+      const QByteArray rrev = itemColumns.toByteArray( mItemQueryColumnMap[ItemQueryRemoteRevisionColumn] );
       if ( !rrev.isEmpty() ) {
         attributes.append( AKONADI_PARAM_REMOTEREVISION " " + ImapParser::quote( rrev ) );
       }
     }
     if ( mFetchScope.gidRequested() ) {
-      const QByteArray gid = Utils::variantToByteArray( extractQueryResult( itemQuery, ItemQueryPimItemGidColumn ) );
+      const QByteArray gid = itemColumns.toByteArray( mItemQueryColumnMap[ItemQueryPimItemGidColumn] );
       if ( !gid.isEmpty() ) {
         attributes.append( AKONADI_PARAM_GID " " + ImapParser::quote( gid ) );
       }
@@ -450,14 +536,14 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     if ( mFetchScope.flagsRequested() ) {
       QList<QByteArray> flags;
       while ( flagQuery.isValid() ) {
-        const qint64 id = flagQuery.value( FlagQueryIdColumn ).toLongLong();
+        const qint64 id = flagColumns.toLongLong( FlagQueryIdColumn );
         if ( id > pimItemId ) {
           flagQuery.next();
           continue;
         } else if ( id < pimItemId ) {
           break;
         }
-        flags << Utils::variantToByteArray( flagQuery.value( FlagQueryNameColumn ) );
+        flags << flagColumns.toByteArray( FlagQueryNameColumn );
         flagQuery.next();
       }
       attributes.append( AKONADI_PARAM_FLAGS " (" + ImapParser::join( flags, " " ) + ')' );
@@ -538,17 +624,17 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     QList<QByteArray> cachedParts;
 
     while ( partQuery.isValid() ) {
-      const qint64 id = partQuery.value( PartQueryPimIdColumn ).toLongLong();
+      const qint64 id = partColumns.toLongLong( PartQueryPimIdColumn );
       if ( id > pimItemId ) {
         partQuery.next();
         continue;
       } else if ( id < pimItemId ) {
         break;
       }
-      const QByteArray partName = Utils::variantToByteArray( partQuery.value( PartQueryTypeNamespaceColumn ) ) + ':' +
-          Utils::variantToByteArray( partQuery.value( PartQueryTypeNameColumn ) );
+      const QByteArray partName = partColumns.toByteArray( PartQueryTypeNamespaceColumn ) + ':' +
+          partColumns.toByteArray( PartQueryTypeNameColumn );
       QByteArray part = partName;
-      QByteArray data = Utils::variantToByteArray( partQuery.value( PartQueryDataColumn ) );
+      QByteArray data = partColumns.toByteArray( PartQueryDataColumn );
 
       if ( mFetchScope.checkCachedPayloadPartsOnly() ) {
         if ( !data.isEmpty() ) {
@@ -563,11 +649,20 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
           skipItem = true;
           break;
         }
-        const bool partIsExternal = partQuery.value( PartQueryExternalColumn ).toBool();
+        // only decompress parts that will actually be sent
+        const bool partRequested = mFetchScope.requestedParts().contains( partName ) || mFetchScope.fullPayload() || mFetchScope.allAttributes();
+        if ( !partRequested ) {
+          partQuery.next();
+          continue;
+        }
+
+        const bool partIsExternal = partColumns.toBool( PartQueryExternalColumn );
         if ( !mFetchScope.externalPayloadSupported() && partIsExternal ) { //external payload not supported by the client, translate the data
           data = PartHelper::translateData( data, partIsExternal );
+        } else if ( !partIsExternal && partColumns.toBool( PartQueryCompressedColumn ) ) {
+          data = PartHelper::translateData( data, false, true );
         }
-        int version = partQuery.value( PartQueryVersionColumn ).toInt();
+        int version = partColumns.toInt( PartQueryVersionColumn );
         if ( version != 0 ) { // '0' is the default, so don't send it
           part += '[' + QByteArray::number( version ) + ']';
         }
@@ -589,9 +684,7 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
           part += data;
         }
 
-        if ( mFetchScope.requestedParts().contains( partName ) || mFetchScope.fullPayload() || mFetchScope.allAttributes() ) {
-          attributes << part;
-        }
+        attributes << part;
 
         partQuery.next();
       }
@@ -616,9 +709,8 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     itemQuery.next();
   }
 
-  // update atime (only if the payload was actually requested, otherwise a simple resource sync prevents cache clearing)
-  if ( needsAccessTimeUpdate( mFetchScope.requestedParts() ) || mFetchScope.fullPayload() ) {
-    updateItemAccessTime();
+  if ( updateAccessTime ) {
+    updateItemAccessTime( accessedItems );
   }
 
   return true;
@@ -633,8 +725,13 @@ bool FetchHelper::needsAccessTimeUpdate( const QVector<QByteArray> &parts )
   return parts.contains( AKONADI_PARAM_PLD_RFC822 );
 }
 
-void FetchHelper::updateItemAccessTime()
+void FetchHelper::updateItemAccessTime( const QVector<qint64> &items )
 {
+  if ( AccessTimeTracker::instance() ) {
+    AccessTimeTracker::instance()->recordAccess( items );
+    return;
+  }
+
   Transaction transaction( mConnection->storageBackend() );
   QueryBuilder qb( PimItem::tableName(), QueryBuilder::Update );
   qb.setColumnValue( PimItem::atimeColumn(), QDateTime::currentDateTime() );
@@ -48,6 +48,12 @@ class FetchHelper : public QObject
 
     bool fetchItems( const QByteArray &responseIdentifier );
 
+    /**
+      Returns @c true if a CACHEONLY fetch of @p connection may still retrieve
+      items from their resource, see isScopeLocal().
+    */
+    static bool mayOverrideCacheOnly( const Connection *connection );
+
   Q_SIGNALS:
     void responseAvailable( const Akonadi::Server::Response &response );
 
@@ -62,11 +68,21 @@ class FetchHelper : public QObject
       ItemQueryDatetimeColumn,
       ItemQueryCollectionIdColumn,
       ItemQueryPimItemGidColumn,
+      ItemQueryModSeqColumn,
       ItemQueryColumnCount
     };
 
-    void updateItemAccessTime();
+    /**
+      Records the access to @p items with the AccessTimeTracker, or updates the
+      access time of all items in the scope right away if there is none.
+    */
+    void updateItemAccessTime( const QVector<qint64> &items );
     void triggerOnDemandFetch();
+    /**
+      Sends the ids of the items removed from the collection since the
+      requested modification sequence, taken from the expunge log.
+    */
+    void reportVanishedItems();
     QSqlQuery buildItemQuery();
     QSqlQuery buildPartQuery( const QVector<QByteArray> &partList, bool allPayload, bool allAttrs );
     QSqlQuery buildFlagQuery();
@@ -39,6 +39,7 @@ class FetchScope::Private : public QSharedData
     QVector<QByteArray> mRequestedParts;
     QStringList mRequestedPayloads;
     QDateTime mChangedSince;
+    qint64 mChangedSinceModSeq;
 
     int mAncestorDepth;
     uint mCacheOnly : 1;
@@ -56,12 +57,15 @@ class FetchScope::Private : public QSharedData
     uint mTagsRequested : 1;
     uint mRelationsRequested : 1;
     uint mVirtRefRequested: 1;
+    uint mModSeqRequested : 1;
+    uint mVanishedRequested : 1;
     QVector<QByteArray> mTagFetchScope;
 };
 
 FetchScope::Private::Private()
   : QSharedData()
   , mStreamParser( 0 )
+  , mChangedSinceModSeq( -1 )
   , mAncestorDepth( 0 )
   , mCacheOnly( false )
   , mCheckCachedPayloadPartsOnly( false )
@@ -78,6 +82,8 @@ FetchScope::Private::Private()
   , mTagsRequested( false )
     , mRelationsRequested(false)
   , mVirtRefRequested( false )
+  , mModSeqRequested( false )
+  , mVanishedRequested( false )
 {
 }
 
@@ -87,6 +93,7 @@ FetchScope::Private::Private( const Private &other )
   , mRequestedParts( other.mRequestedParts )
   , mRequestedPayloads( other.mRequestedPayloads )
   , mChangedSince( other.mChangedSince )
+  , mChangedSinceModSeq( other.mChangedSinceModSeq )
   , mAncestorDepth( other.mAncestorDepth )
   , mCacheOnly( other.mCacheOnly )
   , mCheckCachedPayloadPartsOnly( other.mCheckCachedPayloadPartsOnly )
@@ -103,6 +110,8 @@ FetchScope::Private::Private( const Private &other )
   , mTagsRequested( other.mTagsRequested )
     , mRelationsRequested(other.mRelationsRequested)
   , mVirtRefRequested( other.mVirtRefRequested )
+  , mModSeqRequested( other.mModSeqRequested )
+  , mVanishedRequested( other.mVanishedRequested )
   , mTagFetchScope( other.mTagFetchScope )
 {
 }
@@ -137,11 +146,23 @@ void FetchScope::Private::parseCommandStream()
         mAncestorDepth = HandlerHelper::parseDepth( mStreamParser->readString() );
       } else if ( buffer == AKONADI_PARAM_IGNOREERRORS ) {
         mIgnoreErrors = true;
+      } else if ( buffer == AKONADI_PARAM_VANISHED ) {
+        mVanishedRequested = true;
       } else if ( buffer == AKONADI_PARAM_CHANGEDSINCE ) {
         bool ok = false;
-        mChangedSince = QDateTime::fromTime_t( mStreamParser->readNumber( &ok ) );
-        if ( !ok ) {
-          throw HandlerException( "Invalid CHANGEDSINCE timestamp" );
+        // CHANGEDSINCE MODSEQ <modseq> or the legacy CHANGEDSINCE <time_t>
+        if ( mStreamParser->peekString() == AKONADI_PARAM_MODSEQ ) {
+          mStreamParser->readString();
+          mChangedSinceModSeq = mStreamParser->readNumber( &ok );
+          if ( !ok || mChangedSinceModSeq < 0 ) {
+            throw HandlerException( "Invalid CHANGEDSINCE modification sequence" );
+          }
+          mModSeqRequested = true;
+        } else {
+          mChangedSince = QDateTime::fromTime_t( mStreamParser->readNumber( &ok ) );
+          if ( !ok ) {
+            throw HandlerException( "Invalid CHANGEDSINCE timestamp" );
+          }
         }
       } else {
         throw HandlerException( "Invalid command argument" );
@@ -166,6 +187,8 @@ void FetchScope::Private::parsePartList()
       mSizeRequested = true;
     } else if ( b == AKONADI_PARAM_MTIME ) {
       mMTimeRequested = true;
+    } else if ( b == AKONADI_PARAM_MODSEQ ) {
+      mModSeqRequested = true;
     } else if ( b == AKONADI_PARAM_REMOTEREVISION ) {
       mRemoteRevisionRequested = true;
     } else if ( b == AKONADI_PARAM_GID ) {
@@ -264,6 +287,16 @@ QDateTime FetchScope::changedSince() const
   return d->mChangedSince;
 }
 
+void FetchScope::setChangedSinceModSeq( qint64 modSeq )
+{
+  d->mChangedSinceModSeq = modSeq;
+}
+
+qint64 FetchScope::changedSinceModSeq() const
+{
+  return d->mChangedSinceModSeq;
+}
+
 void FetchScope::setAncestorDepth( int depth )
 {
   d->mAncestorDepth = depth;
@@ -428,3 +461,23 @@ bool FetchScope::virtualReferencesRequested() const
 {
   return d->mVirtRefRequested;
 }
+
+void FetchScope::setModSeqRequested( bool modSeqRequested )
+{
+  d->mModSeqRequested = modSeqRequested;
+}
+
+bool FetchScope::modSeqRequested() const
+{
+  return d->mModSeqRequested;
+}
+
+void FetchScope::setVanishedRequested( bool vanishedRequested )
+{
+  d->mVanishedRequested = vanishedRequested;
+}
+
+bool FetchScope::vanishedRequested() const
+{
+  return d->mVanishedRequested;
+}
@@ -50,6 +50,12 @@ class FetchScope
     QStringList requestedPayloads() const;
     void setChangedSince( const QDateTime &dt );
     QDateTime changedSince() const;
+    /**
+     * Only items with a modification sequence greater than @p modSeq are
+     * fetched, -1 (the default) disables the filter.
+     */
+    void setChangedSinceModSeq( qint64 modSeq );
+    qint64 changedSinceModSeq() const;
     void setAncestorDepth( int depth );
     int ancestorDepth() const;
     void setCacheOnly( bool cacheOnly );
@@ -83,6 +89,14 @@ class FetchScope
     bool relationsRequested() const;
     void setVirtualReferencesRequested( bool vRefRequested );
     bool virtualReferencesRequested() const;
+    void setModSeqRequested( bool modSeqRequested );
+    bool modSeqRequested() const;
+    /**
+     * Whether the ids of the items removed from the collection since
+     * changedSinceModSeq() are reported before the items.
+     */
+    void setVanishedRequested( bool vanishedRequested );
+    bool vanishedRequested() const;
 
   private:
     class Private;
@@ -96,6 +96,10 @@ bool Link::parseStream()
     }
   }
 
+  if ( !store->updateItemsModSeq( toLink + toUnlink ) ) {
+    return failureResponse( "Failed to update the modification sequence of the items" );
+  }
+
   if ( !toLink.isEmpty() ) {
     store->notificationCollector()->itemsLinked( toLink, collection );
   } else if ( !toUnlink.isEmpty() ) {
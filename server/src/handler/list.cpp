@@ -53,6 +53,9 @@ List::List(Scope::SelectionScope scope, bool onlySubscribed)
     , mAncestorDepth(0)
     , mOnlySubscribed(onlySubscribed)
     , mIncludeStatistics(false)
+    , mIncludeModSeq(false)
+    , mChangedSinceModSeq(-1)
+    , mCommittedModSeq(-1)
     , mEnabledCollections(false)
     , mCollectionsToDisplay(false)
     , mCollectionsToSynchronize(false)
@@ -131,7 +134,10 @@ void List::listCollection(const Collection &root, const QStack<Collection> &ance
     Collection dummy = root;
     DataStore *db = connection()->storageBackend();
     db->activeCachePolicy(dummy);
-    const QByteArray b = HandlerHelper::collectionToByteArray(dummy, attributes, mIncludeStatistics, mAncestorDepth, ancestors, ancestorAttributes, isReferencedFromSession || resourceIsSynchronizing, mimeTypes);
+    if (mIncludeModSeq) {
+        dummy.setModSeq(qMin(dummy.modSeq(), mCommittedModSeq));
+    }
+    const QByteArray b = HandlerHelper::collectionToByteArray(dummy, attributes, mIncludeStatistics, mAncestorDepth, ancestors, ancestorAttributes, isReferencedFromSession || resourceIsSynchronizing, mimeTypes, mIncludeModSeq);
 
     Response response;
     response.setUntagged();
@@ -276,6 +282,10 @@ void List::retrieveCollections(const Collection &topParent, int depth)
             }
         }
 
+        if (mChangedSinceModSeq >= 0) {
+            qb.addValueCondition(Collection::modSeqFullColumnName(), Query::Greater, mChangedSinceModSeq);
+        }
+
         //Base listings should succeed always
         if (depth != 0) {
             if (mCollectionsToSynchronize) {
@@ -390,8 +400,9 @@ void List::retrieveCollections(const Collection &topParent, int depth)
         }
     }
 
+    // A delta listing only contains the changed collections, the client already knows the rest of the tree
     QSet<qint64> missingCollections;
-    if (depth > 0) {
+    if (depth > 0 && mChangedSinceModSeq < 0) {
         Q_FOREACH (const Collection &col, mCollections) {
             if (col.parentId() != parentId && !mCollections.contains(col.parentId())) {
                 missingCollections.insert(col.parentId());
@@ -559,6 +570,13 @@ bool List::parseStream()
             mCollectionsToDisplay = true;
         } else if (filter == AKONADI_PARAM_INDEX) {
             mCollectionsToIndex = true;
+        } else if (filter == AKONADI_PARAM_CHANGEDSINCE) {
+            bool ok = false;
+            mChangedSinceModSeq = m_streamParser->readNumber(&ok);
+            if (!ok || mChangedSinceModSeq < 0) {
+                return failureResponse("Invalid CHANGEDSINCE modification sequence");
+            }
+            mIncludeModSeq = true;
         }
     }
 
@@ -574,6 +592,11 @@ bool List::parseStream()
                     mIncludeStatistics = true;
                 }
             }
+            if (option == AKONADI_PARAM_MODSEQ) {
+                if (m_streamParser->readString() == "true") {
+                    mIncludeModSeq = true;
+                }
+            }
             if (option == AKONADI_PARAM_ANCESTORS) {
                 const QByteArray argument = m_streamParser->readString();
                 if (m_streamParser->hasList()) {
@@ -593,6 +616,12 @@ bool List::parseStream()
         }
     }
 
+    // Never report a sequence that is followed by changes still to be committed,
+    // see FetchHelper::fetchItems()
+    if (mIncludeModSeq) {
+        mCommittedModSeq = connection()->storageBackend()->committedModSeq();
+    }
+
     if (baseCollection != 0) { // not root
         Collection col;
         if (mScope.scope() == Scope::None || mScope.scope() == Scope::Uid) {
@@ -45,9 +45,9 @@ namespace Server {
   command = "LIST" | "LSUB" | "RID LIST" | "RID LSUB"
   depth = number | "INF"
   filter-list = *(filter-key " " filter-value)
-  filter-key = "RESOURCE" | "MIMETYPE" | "ENABLED" | "SYNC" | "DISPLAY" | "INDEX"
+  filter-key = "RESOURCE" | "MIMETYPE" | "ENABLED" | "SYNC" | "DISPLAY" | "INDEX" | "CHANGEDSINCE"
   option-list = *(option-key " " option-value)
-  option-key = "STATISTICS"
+  option-key = "STATISTICS" | "ANCESTORS" | "MODSEQ"
   @endverbatim
 
   @c LIST will include all known collections, @c LSUB only those that are
@@ -61,7 +61,9 @@ namespace Server {
   base collection) listing, 0 indicates the root collection.
 
   The @c filter-list is used to restrict the listing to collection of a specific
-  resource or content type.
+  resource or content type. @c CHANGEDSINCE (numeric) lists only collections
+  whose modification sequence is greater than the given one, without completing
+  the tree with their unchanged ancestors.
 
   The @c option-list allows to specify the response content to some extend:
   - @c STATISTICS (boolean) allows to include the collection statistics (see Status)
@@ -69,12 +71,14 @@ namespace Server {
     should be included additionally to the @c parent-id included anyway.
     Possible values are @c 0 (the default), @c 1 for the direct parent node and @c INF for all,
     terminating with the root collection.
+  - @c MODSEQ (boolean) includes the modification sequence of the collection, implied
+    by the @c CHANGEDSINCE filter.
 
   Response:
   @verbatim
   response = "*" collection-id " " parent-id " ("attribute-list")"
   attribute-list = *(attribute-identifier " " attribute-value)
-  attribute-identifier = "NAME" | "MIMETYPE" | "REMOTEID" | "REMOTEREVISION" | "RESOURCE" | "VIRTUAL" | "MESSAGES" | "UNSEEN" | "SIZE" | "ANCESTORS" | "custom-attr-identifier
+  attribute-identifier = "NAME" | "MIMETYPE" | "REMOTEID" | "REMOTEREVISION" | "RESOURCE" | "VIRTUAL" | "MODSEQ" | "MESSAGES" | "UNSEEN" | "SIZE" | "ANCESTORS" | "custom-attr-identifier
   @endverbatim
 
   The name is encoded as an quoted UTF-8 string. There is no order defined for the
@@ -109,6 +113,9 @@ class List : public Handler
     int mAncestorDepth;
     bool mOnlySubscribed;
     bool mIncludeStatistics;
+    bool mIncludeModSeq;
+    qint64 mChangedSinceModSeq;
+    qint64 mCommittedModSeq;
     bool mEnabledCollections;
     bool mCollectionsToDisplay;
     bool mCollectionsToSynchronize;
@@ -226,6 +226,10 @@ bool Merge::mergeItem( PimItem &newItem, PimItem &currentItem,
       return failureResponse( "Failed to store merged item" );
     }
 
+    if ( !mChangedParts.isEmpty() && !DataStore::self()->updateItemsModSeq( PimItem::List() << currentItem ) ) {
+      return failureResponse( "Unable to update the modification sequence of the merged item" );
+    }
+
     return true;
 }
 
@@ -326,6 +326,9 @@ bool Modify::parseStream()
     if ( AkonadiServer::instance()->intervalChecker() && collection.referenced() && referencedChanged ) {
         AkonadiServer::instance()->intervalChecker()->requestCollectionSync( collection );
     }
+    if ( !db->updateCollectionModSeq( collection ) ) {
+      return failureResponse( "Unable to update the modification sequence of the collection" );
+    }
     db->notificationCollector()->collectionChanged( collection, changes );
     //For backwards compatibility. Must be after the changed notification (otherwise the compression removes it).
     if ( changes.contains( AKONADI_PARAM_ENABLED ) ) {
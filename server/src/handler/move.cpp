@@ -19,20 +19,42 @@
 
 #include "move.h"
 
+#include <agentinfocache.h>
 #include <connection.h>
 #include <entities.h>
 #include <imapstreamparser.h>
 #include <handlerhelper.h>
 #include <cachecleaner.h>
 #include <storage/datastore.h>
+#include <storage/dbconfig.h>
 #include <storage/itemretriever.h>
 #include <storage/itemqueryhelper.h>
 #include <storage/selectquerybuilder.h>
 #include <storage/transaction.h>
 #include <storage/collectionqueryhelper.h>
+#include <libs/imapset_p.h>
 
 using namespace Akonadi::Server;
 
+/**
+ * Returns whether the payload of the items in @p source has to be in the cache
+ * before they can be moved to @p destination. This is the case unless the move
+ * stays within a resource whose agent type declares that it moves items in its
+ * backend (see AgentInfo::movesWithoutPayload).
+ */
+static bool needsPayload( const Collection &source, const Collection &destination )
+{
+  if ( source.resourceId() != destination.resourceId() ) {
+    return true;
+  }
+
+  const AgentInfoCache *agentInfoCache = AgentInfoCache::instance();
+  if ( !agentInfoCache ) {
+    return true;
+  }
+  return !agentInfoCache->agentInfo( source.resource().name() ).movesWithoutPayload;
+}
+
 Move::Move( Scope::SelectionScope scope )
   : mScope( scope )
 {
@@ -65,12 +87,48 @@ bool Move::parseStream()
 
   CacheCleanerInhibitor inhibitor;
 
-  // make sure all the items we want to move are in the cache
-  ItemRetriever retriever( connection() );
-  retriever.setScope( mScope );
-  retriever.setRetrieveFullPayload( true );
-  if ( !retriever.exec() ) {
-    return failureResponse( retriever.lastError() );
+  // decide per source collection whether the items have to be in the cache
+  QueryBuilder sourcesQb( PimItem::tableName(), QueryBuilder::Select );
+  sourcesQb.addColumn( PimItem::idFullColumnName() );
+  sourcesQb.addColumn( PimItem::collectionIdFullColumnName() );
+  ItemQueryHelper::scopeToQuery( mScope, connection()->context(), sourcesQb );
+  sourcesQb.addValueCondition( PimItem::collectionIdFullColumnName(), Query::NotEquals, destination.id() );
+  if ( !sourcesQb.exec() ) {
+    throw HandlerException( "Unable to execute query" );
+  }
+
+  QHash<Entity::Id /* collection */, bool> sourceNeedsPayload;
+  QVector<Entity::Id> toRetrieve;
+  bool retrieveAll = true;
+  QSqlQuery sourcesQuery = sourcesQb.query();
+  while ( sourcesQuery.next() ) {
+    const Entity::Id sourceId = sourcesQuery.value( 1 ).toLongLong();
+    QHash<Entity::Id, bool>::const_iterator it = sourceNeedsPayload.constFind( sourceId );
+    if ( it == sourceNeedsPayload.constEnd() ) {
+      it = sourceNeedsPayload.insert( sourceId, needsPayload( Collection::retrieveById( sourceId ), destination ) );
+    }
+    if ( it.value() ) {
+      toRetrieve << sourcesQuery.value( 0 ).toLongLong();
+    } else {
+      retrieveAll = false;
+    }
+  }
+  sourcesQuery.finish();
+
+  // make sure all the items that need it are in the cache
+  if ( !toRetrieve.isEmpty() ) {
+    ItemRetriever retriever( connection() );
+    if ( retrieveAll ) {
+      retriever.setScope( mScope );
+    } else {
+      ImapSet set;
+      set.add( toRetrieve );
+      retriever.setItemSet( set );
+    }
+    retriever.setRetrieveFullPayload( true );
+    if ( !retriever.exec() ) {
+      return failureResponse( retriever.lastError() );
+    }
   }
 
   DataStore *store = connection()->storageBackend();
@@ -90,21 +148,14 @@ bool Move::parseStream()
 
     // Split the list by source collection
     QMap<Entity::Id /* collection */, PimItem> toMove;
-    QMap<Entity::Id /* collection */, Collection> sources;
     Q_FOREACH ( /*sic!*/ PimItem item, items ) {
-      const Collection source = items.first().collection();
-      if ( !source.isValid() ) {
-        throw HandlerException( "Item without collection found!?" );
-      }
-      if ( !sources.contains( source.id() ) ) {
-        sources.insert( source.id(), source );
-      }
-
       if ( !item.isValid() ) {
         throw HandlerException( "Invalid item in result set!?" );
       }
       Q_ASSERT( item.collectionId() != destination.id() );
 
+      const Entity::Id sourceId = item.collectionId();
+      // the notifications carry the new state of the items
       item.setCollectionId( destination.id() );
       item.setAtime( mtime );
       item.setDatetime( mtime );
@@ -113,26 +164,55 @@ bool Move::parseStream()
         item.setDirty( true );
       }
 
-      toMove.insertMulti( source.id(), item );
+      toMove.insertMulti( sourceId, item );
+    }
+
+    // Leave room for the values of the SET clause
+    const int chunkSize = qMax( 1, DbConfig::configuredDatabase()->maximumBindValues() - 8 );
+    const qint64 modSeq = store->nextModSeq();
+    if ( modSeq < 0 ) {
+      throw HandlerException( "Unable to allocate a modification sequence" );
     }
 
-    // Emit notification for each source collection separately
+    // Emit notification and update the items for each source collection separately
     Q_FOREACH ( const Entity::Id &sourceId, toMove.uniqueKeys() ) {
-      const PimItem::List &itemsToMove = toMove.values( sourceId ).toVector();
-      const Collection &source = sources.value( sourceId );
+      const Collection source = Collection::retrieveById( sourceId );
+      if ( !source.isValid() ) {
+        throw HandlerException( "Item without collection found!?" );
+      }
+
+      const PimItem::List itemsToMove = toMove.values( sourceId ).toVector();
       store->notificationCollector()->itemsMoved( itemsToMove, source, destination );
+      // the items vanish from the source collection
+      if ( !store->recordItemTombstones( itemsToMove ) ) {
+        throw HandlerException( "Unable to record the moved items" );
+      }
 
-      Q_FOREACH ( PimItem moved, toMove.values( sourceId ) ) {
-        // reset RID on inter-resource moves, but only after generating the change notification
-        // so that this still contains the old one for the source resource
-        const bool isInterResourceMove = moved.collection().resource().id() != source.resource().id();
-        if ( isInterResourceMove ) {
-          moved.setRemoteId( QString() );
+      // reset RID on inter-resource moves, but only after generating the change notification
+      // so that this still contains the old one for the source resource
+      const bool isInterResourceMove = source.resourceId() != destination.resourceId();
+
+      for ( int start = 0; start < itemsToMove.count(); start += chunkSize ) {
+        QVariantList ids;
+        const int end = qMin( start + chunkSize, itemsToMove.count() );
+        for ( int i = start; i < end; ++i ) {
+          ids << itemsToMove[i].id();
         }
 
-        // FIXME Could we aggregate the changes to a single SQL query?
-        if ( !moved.update() ) {
-          throw HandlerException( "Unable to update item" );
+        QueryBuilder qb( PimItem::tableName(), QueryBuilder::Update );
+        qb.setColumnValue( PimItem::collectionIdColumn(), destination.id() );
+        qb.setColumnValue( PimItem::atimeColumn(), mtime );
+        qb.setColumnValue( PimItem::datetimeColumn(), mtime );
+        qb.setColumnValue( PimItem::modSeqColumn(), modSeq );
+        if ( connection()->context()->resource().id() != destResource.id() ) {
+          qb.setColumnValue( PimItem::dirtyColumn(), true );
+        }
+        if ( isInterResourceMove ) {
+          qb.setColumnValue( PimItem::remoteIdColumn(), QString() );
+        }
+        qb.addValueCondition( PimItem::idColumn(), Query::In, ids );
+        if ( !qb.exec() ) {
+          throw HandlerException( "Unable to update items" );
         }
       }
     }
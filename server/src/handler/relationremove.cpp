@@ -103,6 +103,9 @@ bool RelationRemove::parseStream()
     const PimItem::List items = itemsQuery.result();
 
     if (!items.isEmpty()) {
+        if (!DataStore::self()->updateItemsModSeq(items)) {
+            throw HandlerException("Unable to update the modification sequence of the items");
+        }
         DataStore::self()->notificationCollector()->itemsRelationsChanged(items, Relation::List(), relations);
     }
 
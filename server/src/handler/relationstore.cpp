@@ -130,6 +130,10 @@ bool RelationStore::parseStream()
         throw HandlerException("Relations can only be created for items within the same resource");
     }
 
+    if (!DataStore::self()->updateItemsModSeq(items)) {
+        throw HandlerException("Unable to update the modification sequence of the items");
+    }
+
     DataStore::self()->notificationCollector()->relationAdded(insertedRelation);
     DataStore::self()->notificationCollector()->itemsRelationsChanged(items, Relation::List() << insertedRelation, Relation::List());
 
@@ -399,6 +399,9 @@ bool Store::parseStream()
       if ( notify && !changes.isEmpty() && !onlyFlagsChanged && !onlyGIDChanged ) {
         // Don't send FLAGS notification in itemChanged
         changes.remove( AKONADI_PARAM_FLAGS );
+        if ( !store->updateItemsModSeq( PimItem::List() << item ) ) {
+          throw HandlerException( "Unable to update the modification sequence of the item" );
+        }
         store->notificationCollector()->itemChanged( item, changes );
       }
 
@@ -53,7 +53,7 @@ bool Subscribe::parseStream()
     }
     // TODO do all changes in one db operation
     col.setEnabled( mSubscribe );
-    if ( !col.update() ) {
+    if ( !col.update() || !store->updateCollectionModSeq( col ) ) {
       return failureResponse( "Unable to change subscription" );
     }
     store->notificationCollector()->collectionChanged( col, QList<QByteArray>() << AKONADI_PARAM_ENABLED );
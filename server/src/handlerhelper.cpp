@@ -222,7 +222,7 @@ QByteArray HandlerHelper::collectionToByteArray(const Collection &col)
 
 QByteArray HandlerHelper::collectionToByteArray( const Collection &col, const CollectionAttribute::List &attrs, bool includeStatistics,
                                                  int ancestorDepth, const QStack<Collection> &ancestors, const QStack<CollectionAttribute::List> &ancestorAttributes,
-                                                bool isReferenced, const QList<QByteArray> &mimeTypes )
+                                                bool isReferenced, const QList<QByteArray> &mimeTypes, bool includeModSeq )
 {
   QByteArray b = QByteArray::number( col.id() ) + ' '
                + QByteArray::number( col.parentId() ) + " (";
@@ -233,6 +233,9 @@ QByteArray HandlerHelper::collectionToByteArray( const Collection &col, const Co
   b += " " AKONADI_PARAM_REMOTEREVISION " " + ImapParser::quote( col.remoteRevision().toUtf8() );
   b += " " AKONADI_PARAM_RESOURCE " " + ImapParser::quote( col.resource().name().toUtf8() );
   b += " " AKONADI_PARAM_VIRTUAL " " + QByteArray::number( col.isVirtual() ) + ' ';
+  if ( includeModSeq ) {
+    b += AKONADI_PARAM_MODSEQ " " + QByteArray::number( col.modSeq() ) + ' ';
+  }
 
   if ( includeStatistics ) {
     qint64 itemCount, itemSize;
@@ -102,7 +102,8 @@ public:
       the effective cache policy
     */
     static QByteArray collectionToByteArray(const Collection &col, const CollectionAttribute::List &attributeList, bool includeStatistics = false,
-                                            int ancestorDepth = 0, const QStack<Collection> &ancestors = QStack<Collection>(), const QStack<CollectionAttribute::List> &ancestorAttributes = QStack<CollectionAttribute::List>(), bool isReferenced = false, const QList<QByteArray> &mimeTypes = QList<QByteArray>());
+                                            int ancestorDepth = 0, const QStack<Collection> &ancestors = QStack<Collection>(), const QStack<CollectionAttribute::List> &ancestorAttributes = QStack<CollectionAttribute::List>(), bool isReferenced = false, const QList<QByteArray> &mimeTypes = QList<QByteArray>(),
+                                            bool includeModSeq = false);
 
     /**
       Returns the protocol representation of a collection ancestor chain.
@@ -98,7 +98,9 @@ void NotificationManager::emitPendingNotifications()
 
   NotificationMessage::List legacyNotifications;
   Q_FOREACH ( const NotificationMessageV3 &notification, mNotifications ) {
-    Tracer::self()->signal( "NotificationManager::notify", notification.toString() );
+    if ( Tracer::self()->isEnabled() ) {
+      Tracer::self()->signal( "NotificationManager::notify", notification.toString() );
+    }
 
     if ( ClientCapabilityAggregator::minimumNotificationMessageVersion() < 2 ) {
       const NotificationMessage::List tmp = notification.toNotificationV1().toList();
@@ -36,14 +36,26 @@
 
 #include <akdbus.h>
 
+#include <QtCore/QRegExp>
 #include <QtCore/QTimer>
 
 using namespace Akonadi::Server;
 
+static QString typeFromInstanceId( const QString &id )
+{
+  // Instances of non-unique agents are named <agent type>_<number>
+  const QRegExp instanceNumber( QLatin1String( "_\\d+$" ) );
+
+  QString type = id;
+  type.remove( instanceNumber );
+  return type;
+}
+
 PreprocessorInstance::PreprocessorInstance( const QString &id )
   : QObject()
   , mBusy( false )
   , mId( id )
+  , mType( typeFromInstanceId( id ) )
   , mInterface( 0 )
 {
   Q_ASSERT( !id.isEmpty() );
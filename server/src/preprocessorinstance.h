@@ -97,6 +97,11 @@ private:
    */
   QString mId;
 
+  /**
+   * The preprocessor type of this instance, see type().
+   */
+  QString mType;
+
   /**
    * The preprocessor D-Bus interface. Owned.
    */
@@ -138,6 +143,16 @@ protected:
     return mId;
   }
 
+  /**
+   * Returns the preprocessor type of this instance. This is the
+   * AgentInstance identifier without the instance number, so that
+   * all the instances of the same agent type share the same type.
+   */
+  const QString &type() const
+  {
+    return mType;
+  }
+
   /**
    * Returns a pointer to the internal preprocessor instance
    * item queue. Don't mess with it unless you *really* know
@@ -27,12 +27,15 @@
 
 #include "entities.h" // Akonadi::Server::PimItem
 #include "storage/datastore.h"
+#include "storage/selectquerybuilder.h"
 #include "tracer.h"
 #include "collectionreferencemanager.h"
 
 #include "preprocessormanageradaptor.h"
 
+#include <QtCore/QDateTime>
 #include <QtCore/QDebug>
+#include <QtCore/QTimer>
 
 namespace Akonadi {
 namespace Server {
@@ -50,6 +53,27 @@ const int gMaximumItemProcessingTimeInSecs = 180;
 // we assume it's dead and just drop it's interface.
 const int gDeadlineItemProcessingTimeInSecs = 240;
 
+// Processed items are collected for this long and then unhidden
+// with a single query...
+const int gUnhideIntervalInMSecs = 100;
+// ...unless there are more of them than this.
+const int gMaximumUnhideBatchSize = 100;
+
+void PreprocessorManager::Statistics::record( qint64 latency )
+{
+  ++processedItems;
+  totalLatency += latency;
+  maximumLatency = qMax( maximumLatency, latency );
+}
+
+int PreprocessorManager::Statistics::averageLatency() const
+{
+  if ( processedItems == 0 ) {
+    return 0;
+  }
+  return totalLatency / processedItems;
+}
+
 } // namespace Server
 } // namespace Akonadi
 
@@ -77,12 +101,22 @@ PreprocessorManager::PreprocessorManager()
   QObject::connect( mHeartbeatTimer, SIGNAL(timeout()), this, SLOT(heartbeat()) );
 
   mHeartbeatTimer->start( gHeartbeatTimeoutInMSecs );
+
+  mUnhideTimer = new QTimer( this );
+  mUnhideTimer->setSingleShot( true );
+  mUnhideTimer->setInterval( gUnhideIntervalInMSecs );
+
+  QObject::connect( mUnhideTimer, SIGNAL(timeout()), this, SLOT(unhideItems()) );
 }
 
 PreprocessorManager::~PreprocessorManager()
 {
   mHeartbeatTimer->stop();
 
+  // done() already flushed the queue while the database was open. Whatever
+  // is left here is unhidden by DataStore::unhideAllPimItems() at the next start.
+  mUnhideQueue.clear();
+
   // FIXME: Explicitly interrupt pre-processing here ?
   //        Pre-Processors should auto-protect themselves from re-processing an item:
   //        they are "closer to the DB" from this point of view.
@@ -107,6 +141,10 @@ void PreprocessorManager::done()
   if ( !mSelf ) {
     return;
   }
+
+  // Don't leave the already processed items hidden until the next server start
+  mSelf->unhideItems();
+
   delete mSelf;
   mSelf = NULL;
 }
@@ -132,6 +170,22 @@ PreprocessorInstance *PreprocessorManager::lockedFindInstance( const QString &id
   return NULL;
 }
 
+PreprocessorInstance *PreprocessorManager::lockedFindLeastBusyInstance( const QString &type )
+{
+  PreprocessorInstance *leastBusy = NULL;
+
+  Q_FOREACH ( PreprocessorInstance *instance, mPreprocessorChain ) {
+    if ( instance->type() != type ) {
+      continue;
+    }
+    if ( !leastBusy || instance->itemQueue()->size() < leastBusy->itemQueue()->size() ) {
+      leastBusy = instance;
+    }
+  }
+
+  return leastBusy;
+}
+
 void PreprocessorManager::registerInstance( const QString &id )
 {
   QMutexLocker locker( mMutex );
@@ -143,7 +197,8 @@ void PreprocessorManager::registerInstance( const QString &id )
     return; // already registered
   }
 
-  // The PreprocessorInstance objects are actually always added at the end of the queue
+  // The first instance of a preprocessor type adds a stage at the end of the chain,
+  // further instances of that type share the work of the existing stage.
   // TODO: Maybe we need some kind of ordering here ?
   //       In that case we'll need to fiddle with the items that are currently enqueued for processing...
 
@@ -160,6 +215,9 @@ void PreprocessorManager::registerInstance( const QString &id )
   akDebug() << "Registering preprocessor instance " << id;
 
   mPreprocessorChain.append( instance );
+  if ( !mStageTypes.contains( instance->type() ) ) {
+    mStageTypes.append( instance->type() );
+  }
 }
 
 void PreprocessorManager::unregisterInstance( const QString &id )
@@ -171,6 +229,69 @@ void PreprocessorManager::unregisterInstance( const QString &id )
   lockedUnregisterInstance( id );
 }
 
+QStringList PreprocessorManager::stages()
+{
+  QMutexLocker locker( mMutex );
+
+  return mStageTypes;
+}
+
+int PreprocessorManager::queueDepth( const QString &type )
+{
+  QMutexLocker locker( mMutex );
+
+  int depth = 0;
+  Q_FOREACH ( PreprocessorInstance *instance, mPreprocessorChain ) {
+    if ( instance->type() == type ) {
+      depth += instance->itemQueue()->size();
+    }
+  }
+
+  return depth;
+}
+
+qint64 PreprocessorManager::processedItems( const QString &type )
+{
+  QMutexLocker locker( mMutex );
+
+  return mStageStatistics.value( type ).processedItems;
+}
+
+int PreprocessorManager::averageLatency( const QString &type )
+{
+  QMutexLocker locker( mMutex );
+
+  return mStageStatistics.value( type ).averageLatency();
+}
+
+int PreprocessorManager::maximumLatency( const QString &type )
+{
+  QMutexLocker locker( mMutex );
+
+  return mStageStatistics.value( type ).maximumLatency;
+}
+
+int PreprocessorManager::pendingItems()
+{
+  QMutexLocker locker( mMutex );
+
+  return mChainEnterTimes.count() + mUnhideQueue.count();
+}
+
+int PreprocessorManager::averageHiddenTime()
+{
+  QMutexLocker locker( mMutex );
+
+  return mChainStatistics.averageLatency();
+}
+
+int PreprocessorManager::maximumHiddenTime()
+{
+  QMutexLocker locker( mMutex );
+
+  return mChainStatistics.maximumLatency;
+}
+
 void PreprocessorManager::lockedUnregisterInstance( const QString &id )
 {
   PreprocessorInstance *instance = lockedFindInstance( id );
@@ -178,32 +299,27 @@ void PreprocessorManager::lockedUnregisterInstance( const QString &id )
     return; // not our instance: don't complain (as we might be called for non-preprocessor agents too)
   }
 
-  // All of the preprocessor's waiting items must be queued to the next preprocessor (if there is one)
+  // All of the preprocessor's waiting items must be queued to another instance of the
+  // same type or, if this was the last one, to the next preprocessor (if there is one)
 
-  std::deque< qint64 > *itemList = instance->itemQueue();
-  Q_ASSERT( itemList );
+  const std::deque< qint64 > itemList = *instance->itemQueue();
+  const QString type = instance->type();
 
-  int idx = mPreprocessorChain.indexOf( instance );
-  Q_ASSERT( idx >= 0 ); // must be there!
+  int stage = mStageTypes.indexOf( type );
+  Q_ASSERT( stage >= 0 ); // must be there!
 
-  if ( idx < ( mPreprocessorChain.count() - 1 ) ) {
-    // This wasn't the last preprocessor: trigger the next one.
-    PreprocessorInstance *nextPreprocessor = mPreprocessorChain[idx + 1];
-    Q_ASSERT( nextPreprocessor );
-    Q_ASSERT( nextPreprocessor != instance );
+  mPreprocessorChain.removeOne( instance );
+  delete instance;
 
-    Q_FOREACH ( qint64 itemId, *itemList ) {
-      nextPreprocessor->enqueueItem( itemId );
-    }
-  } else {
-    // This was the last preprocessor: end handling the items
-    Q_FOREACH ( qint64 itemId, *itemList ) {
-      lockedEndHandleItem( itemId );
-    }
+  if ( !lockedFindLeastBusyInstance( type ) ) {
+    // The next stage takes this stage's index, or the items reach the end of the chain
+    mStageTypes.removeAt( stage );
+    mStageStatistics.remove( type );
   }
 
-  mPreprocessorChain.removeOne( instance );
-  delete instance;
+  Q_FOREACH ( qint64 itemId, itemList ) {
+    lockedEnqueueToStage( stage, itemId );
+  }
 }
 
 void PreprocessorManager::beginHandleItem( const PimItem &item, const DataStore *dataStore )
@@ -268,10 +384,27 @@ void PreprocessorManager::beginHandleItem( const PimItem &item, const DataStore
 
 void PreprocessorManager::lockedActivateFirstPreprocessor( qint64 itemId )
 {
+  Q_ASSERT( !mStageTypes.isEmpty() );
+
+  mChainEnterTimes.insert( itemId, QDateTime::currentMSecsSinceEpoch() );
+
   // Activate the first preprocessor.
-  PreprocessorInstance *preProcessor = mPreprocessorChain.first();
+  lockedEnqueueToStage( 0, itemId );
+}
+
+void PreprocessorManager::lockedEnqueueToStage( int stage, qint64 itemId )
+{
+  if ( stage >= mStageTypes.count() ) {
+    // The item went through all the preprocessors
+    lockedQueueUnhideItem( itemId );
+    return;
+  }
+
+  PreprocessorInstance *preProcessor = lockedFindLeastBusyInstance( mStageTypes[stage] );
   Q_ASSERT( preProcessor );
 
+  mStageEnterTimes.insert( itemId, QDateTime::currentMSecsSinceEpoch() );
+
   preProcessor->enqueueItem( itemId );
   // The preprocessor will call our "preProcessorFinishedHandlingItem() method"
   // when done with the item.
@@ -369,25 +502,70 @@ void PreprocessorManager::preProcessorFinishedHandlingItem( PreprocessorInstance
 {
   QMutexLocker locker( mMutex );
 
-  int idx = mPreprocessorChain.indexOf( preProcessor );
-  Q_ASSERT( idx >= 0 ); // must be there!
+  const int stage = mStageTypes.indexOf( preProcessor->type() );
+  Q_ASSERT( stage >= 0 ); // must be there!
 
-  if ( idx < ( mPreprocessorChain.count() - 1 ) ) {
-    // This wasn't the last preprocessor: trigger the next one.
-    PreprocessorInstance *nextPreprocessor = mPreprocessorChain[idx + 1];
-    Q_ASSERT( nextPreprocessor );
-    Q_ASSERT( nextPreprocessor != preProcessor );
+  const qint64 enterTime = mStageEnterTimes.take( itemId );
+  if ( enterTime > 0 ) {
+    mStageStatistics[preProcessor->type()].record( QDateTime::currentMSecsSinceEpoch() - enterTime );
+  }
 
-    nextPreprocessor->enqueueItem( itemId );
-  } else {
-    // This was the last preprocessor: end handling the item.
-    lockedEndHandleItem( itemId );
+  // Trigger the next stage, or end handling the item if this was the last one.
+  lockedEnqueueToStage( stage + 1, itemId );
+}
+
+void PreprocessorManager::lockedQueueUnhideItem( qint64 itemId )
+{
+  // The exit point of the pre-processing chain for items that went through it.
+
+  const qint64 enterTime = mChainEnterTimes.take( itemId );
+  if ( enterTime > 0 ) {
+    mChainStatistics.record( QDateTime::currentMSecsSinceEpoch() - enterTime );
+  }
+
+  mUnhideQueue.append( itemId );
+
+  // We might be called from an *Append handler thread, so the timer is started
+  // in our own thread.
+  if ( mUnhideQueue.count() == 1 ) {
+    QMetaObject::invokeMethod( mUnhideTimer, "start", Qt::QueuedConnection );
+  } else if ( mUnhideQueue.count() == gMaximumUnhideBatchSize ) {
+    QMetaObject::invokeMethod( this, "unhideItems", Qt::QueuedConnection );
+  }
+}
+
+void PreprocessorManager::unhideItems()
+{
+  QVariantList itemIds;
+  {
+    QMutexLocker locker( mMutex );
+
+    mUnhideTimer->stop();
+    Q_FOREACH ( qint64 itemId, mUnhideQueue ) {
+      itemIds << itemId;
+    }
+    mUnhideQueue.clear();
+  }
+
+  if ( itemIds.isEmpty() ) {
+    return;
+  }
+
+  // Refetch the items now: preprocessing might have changed them.
+  // Items that are gone have been deleted by a preprocessor, which might be OK (spam?).
+  SelectQueryBuilder<PimItem> qb;
+  qb.addValueCondition( PimItem::idFullColumnName(), Query::In, itemIds );
+  if ( !qb.exec() || !DataStore::self()->unhidePimItems( qb.result() ) ) {
+    Tracer::self()->warning(
+        QLatin1String( "PreprocessorManager" ),
+        QString::fromLatin1( "Failed to unhide %1 PIM items: data is not lost but a server restart is required in order to unhide them" )
+          .arg( itemIds.count() ) );
   }
 }
 
 void PreprocessorManager::lockedEndHandleItem( qint64 itemId )
 {
-  // The exit point of the pre-processing chain.
+  // The exit point of the pre-processing chain for items that bypass it.
 
   // Refetch the PimItem, the Collection and the MimeType now: preprocessing might have changed them.
   PimItem item = PimItem::retrieveById( itemId );
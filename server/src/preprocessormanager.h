@@ -28,6 +28,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QList>
 #include <QtCore/QHash>
+#include <QtCore/QStringList>
 
 #include <deque>
 
@@ -65,6 +66,14 @@ class DataStore;
  * from the preprocessor instances (which are separate processes).
  * This class, then, takes care of holding the newly arrived items
  * in a wait queue until their transaction is committed (or rolled back).
+ *
+ * The chain is made of one stage per preprocessor type. Multiple instances
+ * of the same preprocessor type share the work of their stage: each item
+ * is handed to the instance with the shortest queue. Since every instance
+ * has its own queue the stages work as a pipeline, an item can be processed
+ * by the first stage while the previous one is in the second stage.
+ *
+ * Items that went through the whole chain are unhidden in batches.
  */
 class PreprocessorManager : public QObject
 {
@@ -108,6 +117,55 @@ protected:
    */
   QList< PreprocessorInstance *> mPreprocessorChain;
 
+  /**
+   * The preprocessor types in chain order, that is one entry per stage.
+   * A type is added when its first instance registers and removed
+   * when its last instance unregisters.
+   */
+  QStringList mStageTypes;
+
+  /**
+   * The statistics of a single stage of the chain, or of the whole chain.
+   */
+  struct Statistics
+  {
+    Statistics()
+      : processedItems( 0 )
+      , totalLatency( 0 )
+      , maximumLatency( 0 )
+    {
+    }
+
+    void record( qint64 latency );
+    int averageLatency() const;
+
+    qint64 processedItems;
+    qint64 totalLatency;   ///< in milliseconds
+    qint64 maximumLatency; ///< in milliseconds
+  };
+
+  /**
+   * The statistics of each stage, by preprocessor type.
+   */
+  QHash< QString, Statistics > mStageStatistics;
+
+  /**
+   * The statistics of the whole chain, that is how long the items stayed hidden.
+   */
+  Statistics mChainStatistics;
+
+  /**
+   * The time (in msecs since epoch) the items in the chain entered the chain
+   * and their current stage.
+   */
+  QHash< qint64, qint64 > mChainEnterTimes;
+  QHash< qint64, qint64 > mStageEnterTimes;
+
+  /**
+   * The items that went through the whole chain and wait to be unhidden.
+   */
+  QList< qint64 > mUnhideQueue;
+
   /**
    * Is preprocessing enabled at all in ths Akonad server instance ?
    * This is true by default and can be set via setEnabled().
@@ -126,6 +184,11 @@ protected:
    */
   QTimer *mHeartbeatTimer;
 
+  /**
+   * Collects the processed items for a short time before unhiding them.
+   */
+  QTimer *mUnhideTimer;
+
 public:
 
   /**
@@ -156,6 +219,9 @@ public:
    * Deinitializes this class singleton (if it was initialized at all).
    * This is actually called in the AkonadiServer::quit() method.
    *
+   * Unhides the items still waiting in the unhide queue, so it must be
+   * called while the DataStore is still open.
+   *
    * \sa init()
    */
   static void done();
@@ -232,6 +298,43 @@ public:
    */
   void unregisterInstance( const QString &id );
 
+  /**
+   * Returns the preprocessor types in chain order.
+   *
+   * This function is thread-safe, as are all the statistics functions below.
+   */
+  QStringList stages();
+
+  /**
+   * Returns the number of items queued to (or being processed by) all
+   * the instances of the preprocessor @p type.
+   */
+  int queueDepth( const QString &type );
+
+  /**
+   * Returns the number of items the preprocessor @p type has finished.
+   */
+  qint64 processedItems( const QString &type );
+
+  /**
+   * Returns the average and maximum time in milliseconds the items spent in
+   * the stage of the preprocessor @p type, including the time they were queued.
+   */
+  int averageLatency( const QString &type );
+  int maximumLatency( const QString &type );
+
+  /**
+   * Returns the number of items currently in the chain.
+   */
+  int pendingItems();
+
+  /**
+   * Returns the average and maximum time in milliseconds the items
+   * stayed hidden while they were in the chain.
+   */
+  int averageHiddenTime();
+  int maximumHiddenTime();
+
 protected:
 
   /**
@@ -251,12 +354,28 @@ private:
    */
   PreprocessorInstance *lockedFindInstance( const QString &id );
 
+  /**
+   * Finds the instance of the preprocessor @p type with the shortest queue.
+   *
+   * This must be called with mMutex locked.
+   */
+  PreprocessorInstance *lockedFindLeastBusyInstance( const QString &type );
+
   /**
    * Pushes the specified item to the first preprocessor.
    * The caller *MUST* make sure that there is at least one preprocessor in the chain.
    */
   void lockedActivateFirstPreprocessor( qint64 itemId );
 
+  /**
+   * Pushes the specified item to an instance of the given stage. If there
+   * is no such stage the item has been through the whole chain and is queued
+   * for unhiding.
+   *
+   * This must be called with mMutex locked.
+   */
+  void lockedEnqueueToStage( int stage, qint64 itemId );
+
   /**
    * This is called internally to terminate the pre-processing
    * chain for the specified Item. All the preprocessors have
@@ -266,6 +385,14 @@ private:
    */
   void lockedEndHandleItem( qint64 itemId );
 
+  /**
+   * Same as lockedEndHandleItem() but only queues the item for unhiding
+   * in the next batch.
+   *
+   * This must be called with mMutex locked.
+   */
+  void lockedQueueUnhideItem( qint64 itemId );
+
   /**
    * This is the unprotected core of the unregisterInstance() function above.
    */
@@ -284,6 +411,11 @@ private Q_SLOTS:
    */
   void heartbeat();
 
+  /**
+   * Unhides the items in the unhide queue with a single query.
+   */
+  void unhideItems();
+
   /**
    * This is used to handle database transactions and wait queues.
    * The call to this slot usually comes from a queued signal/slot connection
@@ -357,6 +357,9 @@ void SearchManager::updateSearchImpl( const Collection &collection, QWaitConditi
     }
 
     const QVector<PimItem> removedItems = qb.result();
+    if ( !DataStore::self()->updateItemsModSeq( removedItems ) ) {
+      akError() << "Failed to update the modification sequence of the items removed from search collection" << collection.id();
+    }
     DataStore::self()->notificationCollector()->itemsUnlinked( removedItems, collection );
   }
 
@@ -419,6 +422,9 @@ void SearchManager::searchUpdateResultsAvailable( const QSet<qint64> &results )
       return ;
     }
     const QVector<PimItem> newItems = qb.result();
+    if ( !DataStore::self()->updateItemsModSeq( newItems ) ) {
+      akError() << "Failed to update the modification sequence of the items added to search collection" << collection.id();
+    }
     DataStore::self()->notificationCollector()->itemsLinked( newItems, collection );
     // Force collector to dispatch the notification now
     DataStore::self()->notificationCollector()->dispatchNotifications();
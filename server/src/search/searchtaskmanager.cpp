@@ -19,11 +19,11 @@
 
 #include "searchtaskmanager.h"
 #include "agentsearchinstance.h"
+#include "agentinfocache.h"
 #include "akdebug.h"
 #include "akdbus.h"
 #include "connection.h"
 #include "storage/selectquerybuilder.h"
-#include "dbusconnectionpool.h"
 #include <entities.h>
 
 #include <QSqlError>
@@ -124,15 +124,15 @@ void SearchTaskManager::addTask( SearchTask *task )
 
   mInstancesLock.lock();
 
-  org::freedesktop::Akonadi::AgentManager agentManager( AkDBus::serviceName( AkDBus::Control ), QLatin1String( "/AgentManager" ),
-                                                        DBusConnectionPool::threadConnection() );
+  const AgentInfoCache *agentInfoCache = AgentInfoCache::instance();
   do {
     const QString resourceId = query.value( 1 ).toString();
+    const AgentInfo agentInfo = agentInfoCache ? agentInfoCache->agentInfo( resourceId ) : AgentInfo();
     if ( !mInstances.contains( resourceId ) ) {
       akDebug() << "Resource" << resourceId << "does not implement Search interface, skipping";
-    } else if ( !agentManager.agentInstanceOnline( resourceId ) ) {
+    } else if ( !agentInfo.online ) {
       akDebug() << "Agent" << resourceId << "is offline, skipping";
-    } else if ( agentManager.agentInstanceStatus( resourceId ) > 2 ) { // 2 == Broken, 3 == Not Configured
+    } else if ( agentInfo.status >= AgentInfo::NotConfigured ) {
       akDebug() << "Agent" << resourceId << "is broken or not configured";
     } else {
       const qint64 collectionId = query.value( 0 ).toLongLong();
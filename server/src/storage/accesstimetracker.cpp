@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "accesstimetracker.h"
+#include "datastore.h"
+#include "dbconfig.h"
+#include "entities.h"
+#include "querybuilder.h"
+#include "transaction.h"
+
+#include <akdebug.h>
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QTimer>
+
+using namespace Akonadi::Server;
+
+AccessTimeTracker *AccessTimeTracker::sInstance = 0;
+
+AccessTimeTracker::AccessTimeTracker(int flushInterval, QObject *parent)
+    : QThread(parent)
+    , mFlushInterval(qMax(1, flushInterval))
+    , mWriteTransactions(0)
+    , mWrittenItems(0)
+{
+    Q_ASSERT(!sInstance);
+    sInstance = this;
+}
+
+AccessTimeTracker::~AccessTimeTracker()
+{
+    sInstance = 0;
+}
+
+AccessTimeTracker *AccessTimeTracker::instance()
+{
+    return sInstance;
+}
+
+void AccessTimeTracker::recordAccess(const QVector<qint64> &items)
+{
+    QMutexLocker locker(&mLock);
+    Q_FOREACH (qint64 item, items) {
+        mPending.insert(item);
+    }
+}
+
+bool AccessTimeTracker::isPending(qint64 item) const
+{
+    QMutexLocker locker(&mLock);
+    return mPending.contains(item) || mFlushing.contains(item);
+}
+
+int AccessTimeTracker::pendingCount() const
+{
+    QMutexLocker locker(&mLock);
+    return mPending.count() + (mFlushing - mPending).count();
+}
+
+int AccessTimeTracker::writeTransactions() const
+{
+    return const_cast<QAtomicInt &>(mWriteTransactions).fetchAndAddRelaxed(0);
+}
+
+int AccessTimeTracker::writtenItems() const
+{
+    return const_cast<QAtomicInt &>(mWrittenItems).fetchAndAddRelaxed(0);
+}
+
+bool AccessTimeTracker::flush()
+{
+    // Accesses recorded while the flush runs go into a fresh pending set. The
+    // items being written stay visible to isPending() until the transaction
+    // is committed, so that the CacheCleaner doesn't expire them meanwhile.
+    QList<qint64> items;
+    {
+        QMutexLocker locker(&mLock);
+        mFlushing.swap(mPending);
+        items = mFlushing.toList();
+    }
+    if (items.isEmpty()) {
+        return true;
+    }
+
+    const int chunkSize = qBound(1, DbConfig::configuredDatabase()->maximumBindValues() - 1, 1000);
+    const QDateTime now = QDateTime::currentDateTime();
+    Transaction transaction(DataStore::self());
+    for (int offset = 0; offset < items.count(); offset += chunkSize) {
+        QVariantList ids;
+        ids.reserve(qMin(chunkSize, items.count() - offset));
+        for (int i = offset; i < qMin(offset + chunkSize, items.count()); ++i) {
+            ids << items.at(i);
+        }
+
+        QueryBuilder qb(PimItem::tableName(), QueryBuilder::Update);
+        qb.setColumnValue(PimItem::atimeColumn(), now);
+        qb.addValueCondition(PimItem::idColumn(), Query::In, ids);
+        if (!qb.exec()) {
+            akError() << "Unable to update the access time of" << items.count() << "items";
+            restorePending();
+            return false;
+        }
+    }
+    if (!transaction.commit()) {
+        akError() << "Unable to commit the access time of" << items.count() << "items";
+        restorePending();
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&mLock);
+        mFlushing.clear();
+    }
+    mWriteTransactions.ref();
+    mWrittenItems.fetchAndAddRelaxed(items.count());
+    return true;
+}
+
+void AccessTimeTracker::restorePending()
+{
+    QMutexLocker locker(&mLock);
+    mPending.unite(mFlushing);
+    mFlushing.clear();
+}
+
+void AccessTimeTracker::run()
+{
+    QTimer timer;
+    timer.setInterval(mFlushInterval * 1000);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(flush()), Qt::DirectConnection);
+    timer.start();
+
+    exec();
+
+    timer.stop();
+    flush();
+    DataStore::self()->close();
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_ACCESSTIMETRACKER_H
+#define AKONADI_SERVER_ACCESSTIMETRACKER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+
+namespace Akonadi
+{
+namespace Server
+{
+
+/**
+ * Collects the items whose payload has been fetched and writes their access
+ * time from a background thread once per flush interval, so that fetching
+ * doesn't turn into a write transaction for every FETCH command.
+ *
+ * The access time written is the time of the flush, so it is accurate only to
+ * the flush interval, and never older than the actual access. The CacheCleaner
+ * asks isPending() before expiring an item, so an item that was accessed
+ * since the last flush is kept.
+ */
+class AccessTimeTracker : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Creates the tracker, which writes the access times every
+     * @p flushInterval seconds once started.
+     */
+    explicit AccessTimeTracker(int flushInterval = 60, QObject *parent = 0);
+    virtual ~AccessTimeTracker();
+
+    /**
+     * Returns the tracker while it is running, or 0 when access times have to
+     * be written directly.
+     */
+    static AccessTimeTracker *instance();
+
+    /**
+     * Records an access to @p items. Thread-safe.
+     */
+    void recordAccess(const QVector<qint64> &items);
+
+    /**
+     * Returns whether an access to @p item has not been written yet. Thread-safe.
+     */
+    bool isPending(qint64 item) const;
+
+    /**
+     * Returns the number of items whose access has not been written yet.
+     */
+    int pendingCount() const;
+
+    /**
+     * Number of write transactions and of items updated by all flushes.
+     */
+    int writeTransactions() const;
+    int writtenItems() const;
+
+public Q_SLOTS:
+    /**
+     * Writes the pending access times in batched UPDATEs within a single
+     * transaction, using the DataStore of the calling thread.
+     * Returns false if that failed, the items are kept pending for the next
+     * flush then.
+     */
+    bool flush();
+
+protected:
+    virtual void run();
+
+private:
+    // Merges the items of a failed flush back into the pending ones
+    void restorePending();
+
+    static AccessTimeTracker *sInstance;
+
+    int mFlushInterval;
+    mutable QMutex mLock;
+    QSet<qint64> mPending;
+    // taken out of mPending by a running flush, still reported as pending
+    QSet<qint64> mFlushing;
+    QAtomicInt mWriteTransactions;
+    QAtomicInt mWrittenItems;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_ACCESSTIMETRACKER_H
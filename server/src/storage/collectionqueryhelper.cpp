@@ -21,6 +21,8 @@
 
 #include "connection.h"
 #include "entities.h"
+#include "storage/collectionridcache.h"
+#include "storage/datastore.h"
 #include "storage/querybuilder.h"
 #include "storage/selectquerybuilder.h"
 #include "libs/imapset_p.h"
@@ -28,6 +30,8 @@
 #include "handler.h"
 #include "queryhelper.h"
 
+#include <QtSql/QSqlQuery>
+
 using namespace Akonadi::Server;
 
 void CollectionQueryHelper::remoteIdToQuery( const QStringList &rids, Connection *connection, QueryBuilder &qb )
@@ -103,6 +107,63 @@ bool CollectionQueryHelper::canBeMovedTo ( const Collection &collection, const C
   return hasAllowedName( collection, collection.name(), _parent.id() );
 }
 
+/**
+  Resolves the @p levels remote identifiers of @p ridChain ending at index
+  @p first below the collection @p parentId with a single query joining
+  the collection table once per level. Returns the ids top-down.
+*/
+static QVector<Collection::Id> resolveRidLevels( const QStringList &ridChain, int first, int levels,
+                                                 Collection::Id parentId, Resource::Id resId )
+{
+  const QString table = Collection::tableName();
+  QStringList columns;
+  QStringList conditions;
+  QVariantList values;
+  QString from = table + QLatin1String( " c0" );
+
+  if ( parentId > 0 ) {
+    conditions << QString::fromLatin1( "c0.%1 = ?" ).arg( Collection::parentIdColumn() );
+    values << parentId;
+  } else {
+    conditions << QString::fromLatin1( "c0.%1 IS NULL" ).arg( Collection::parentIdColumn() );
+  }
+  for ( int level = 0; level < levels; ++level ) {
+    const QString alias = QString::fromLatin1( "c%1" ).arg( level );
+    if ( level > 0 ) {
+      from += QString::fromLatin1( " INNER JOIN %1 %2 ON %2.%3 = c%4.%5" )
+                .arg( table, alias, Collection::parentIdColumn() ).arg( level - 1 ).arg( Collection::idColumn() );
+    }
+    columns << alias + QLatin1Char( '.' ) + Collection::idColumn();
+    conditions << alias + QLatin1Char( '.' ) + Collection::resourceIdColumn() + QLatin1String( " = ?" );
+    values << resId;
+    conditions << alias + QLatin1Char( '.' ) + Collection::remoteIdColumn() + QLatin1String( " = ?" );
+    values << ridChain.at( first - level );
+  }
+
+  QSqlQuery query( DataStore::self()->database() );
+  query.prepare( QString::fromLatin1( "SELECT %1 FROM %2 WHERE %3" )
+                   .arg( columns.join( QLatin1String( ", " ) ), from, conditions.join( QLatin1String( " AND " ) ) ) );
+  Q_FOREACH ( const QVariant &value, values ) {
+    query.addBindValue( value );
+  }
+  if ( !query.exec() ) {
+    throw HandlerException( "Unable to execute query" );
+  }
+
+  if ( !query.next() ) {
+    throw HandlerException( "Hierarchical RID does not specify a unique collection" );
+  }
+  QVector<Collection::Id> ids;
+  ids.reserve( levels );
+  for ( int level = 0; level < levels; ++level ) {
+    ids << query.value( level ).toLongLong();
+  }
+  if ( query.next() ) {
+    throw HandlerException( "Hierarchical RID does not specify a unique collection" );
+  }
+  return ids;
+}
+
 Collection CollectionQueryHelper::resolveHierarchicalRID( const QStringList &ridChain, Resource::Id resId )
 {
   if ( ridChain.size() < 2 ) {
@@ -111,26 +172,48 @@ Collection CollectionQueryHelper::resolveHierarchicalRID( const QStringList &rid
   if ( !ridChain.last().isEmpty() ) {
     throw HandlerException( "Hierarchical RID chain is not root-terminated" );
   }
+
+  // Walk down the chain as far as the cache knows it
+  CollectionRidCache *cache = CollectionRidCache::instance();
   Collection::Id parentId = 0;
-  Collection result;
-  for ( int i = ridChain.size() - 2; i >= 0; --i ) {
-    SelectQueryBuilder<Collection> qb;
-    if ( parentId > 0 ) {
-      qb.addValueCondition( Collection::parentIdColumn(), Query::Equals, parentId );
-    } else {
-      qb.addValueCondition( Collection::parentIdColumn(), Query::Is, QVariant() );
+  Collection::Id grandParentId = 0;
+  int i = ridChain.size() - 2;
+  for ( ; i >= 0; --i ) {
+    const Collection::Id id = cache->lookup( resId, parentId, ridChain.at( i ) );
+    if ( id < 0 ) {
+      break;
     }
-    qb.addValueCondition( Collection::remoteIdColumn(), Query::Equals, ridChain.at( i ) );
-    qb.addValueCondition( Collection::resourceIdColumn(), Query::Equals, resId );
-    if ( !qb.exec() ) {
-      throw HandlerException( "Unable to execute query" );
+    grandParentId = parentId;
+    parentId = id;
+  }
+
+  if ( i < 0 ) {
+    const Collection result = Collection::retrieveById( parentId );
+    if ( result.isValid() && result.resourceId() == resId && result.parentId() == grandParentId
+         && result.remoteId() == ridChain.first() ) {
+      return result;
     }
-    Collection::List results = qb.result();
-    if ( results.size() != 1 ) {
-      throw HandlerException( "Hierarchical RID does not specify a unique collection" );
+    // stale, start over
+    cache->clear();
+    parentId = 0;
+    i = ridChain.size() - 2;
+  }
+
+  // Resolve the remaining levels with as few queries as the join limits of the databases allow
+  static const int MaxJoinedLevels = 32;
+  while ( i >= 0 ) {
+    const int levels = qMin( i + 1, MaxJoinedLevels );
+    const QVector<Collection::Id> ids = resolveRidLevels( ridChain, i, levels, parentId, resId );
+    for ( int level = 0; level < levels; ++level ) {
+      cache->insert( resId, parentId, ridChain.at( i - level ), ids.at( level ) );
+      parentId = ids.at( level );
     }
-    result = results.first();
-    parentId = result.id();
+    i -= levels;
+  }
+
+  const Collection result = Collection::retrieveById( parentId );
+  if ( !result.isValid() ) {
+    throw HandlerException( "Hierarchical RID does not specify a unique collection" );
   }
   return result;
 }
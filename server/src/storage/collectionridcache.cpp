@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "collectionridcache.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+using namespace Akonadi::Server;
+
+CollectionRidCache::CollectionRidCache()
+{
+}
+
+CollectionRidCache *CollectionRidCache::instance()
+{
+    static QMutex s_instanceLock;
+    static CollectionRidCache *s_instance = 0;
+    QMutexLocker locker(&s_instanceLock);
+    if (!s_instance) {
+        s_instance = new CollectionRidCache();
+    }
+    return s_instance;
+}
+
+Collection::Id CollectionRidCache::lookup(Resource::Id resourceId, Collection::Id parentId, const QString &remoteId) const
+{
+    QReadLocker locker(&mLock);
+    const QHash<Resource::Id, QHash<Key, Collection::Id> >::const_iterator it = mResources.constFind(resourceId);
+    if (it == mResources.constEnd()) {
+        return -1;
+    }
+    return it->value(qMakePair(parentId, remoteId), -1);
+}
+
+void CollectionRidCache::insert(Resource::Id resourceId, Collection::Id parentId, const QString &remoteId, Collection::Id id)
+{
+    QWriteLocker locker(&mLock);
+    if (mKeys.count() >= MaxEntries && !mKeys.contains(id)) {
+        mResources.clear();
+        mKeys.clear();
+    }
+
+    // the collection might have been cached under its old key
+    const QHash<Collection::Id, QPair<Resource::Id, Key> >::iterator old = mKeys.find(id);
+    if (old != mKeys.end()) {
+        mResources[old->first].remove(old->second);
+    }
+
+    const Key key = qMakePair(parentId, remoteId);
+    mResources[resourceId].insert(key, id);
+    mKeys.insert(id, qMakePair(resourceId, key));
+}
+
+void CollectionRidCache::invalidate(Collection::Id id)
+{
+    QWriteLocker locker(&mLock);
+    const QHash<Collection::Id, QPair<Resource::Id, Key> >::iterator it = mKeys.find(id);
+    if (it == mKeys.end()) {
+        return;
+    }
+    mResources[it->first].remove(it->second);
+    mKeys.erase(it);
+}
+
+void CollectionRidCache::clear()
+{
+    QWriteLocker locker(&mLock);
+    mResources.clear();
+    mKeys.clear();
+}
+
+int CollectionRidCache::count() const
+{
+    QReadLocker locker(&mLock);
+    return mKeys.count();
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_COLLECTIONRIDCACHE_H
+#define AKONADI_SERVER_COLLECTIONRIDCACHE_H
+
+#include "entities.h"
+
+#include <QHash>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QString>
+
+namespace Akonadi
+{
+namespace Server
+{
+
+/**
+ * Maps the remote identifier of a collection within its parent to the
+ * collection id, separately for each resource, so that hierarchical remote
+ * identifiers can be resolved without querying the database for every level.
+ *
+ * Only collections that exist are cached. The NotificationCollector drops
+ * the entry of every collection that is changed or removed, and everything
+ * when a collection is moved, as that can change the resource and remote
+ * identifiers of a whole subtree.
+ */
+class CollectionRidCache
+{
+public:
+    /**
+     * Maximum number of cached collections, the cache is cleared when
+     * exceeding it.
+     */
+    enum {
+        MaxEntries = 50000
+    };
+
+    static CollectionRidCache *instance();
+
+    /**
+     * Returns the id of the collection with the remote identifier @p remoteId
+     * in the collection @p parentId (0 for top-level collections) of the
+     * resource @p resourceId, or -1 if it is not cached.
+     */
+    Collection::Id lookup(Resource::Id resourceId, Collection::Id parentId, const QString &remoteId) const;
+
+    void insert(Resource::Id resourceId, Collection::Id parentId, const QString &remoteId, Collection::Id id);
+
+    /**
+     * Drops the entry of collection @p id.
+     */
+    void invalidate(Collection::Id id);
+
+    void clear();
+
+    int count() const;
+
+private:
+    CollectionRidCache();
+
+    typedef QPair<Collection::Id, QString> Key;
+
+    mutable QReadWriteLock mLock;
+    QHash<Resource::Id, QHash<Key, Collection::Id> > mResources;
+    QHash<Collection::Id, QPair<Resource::Id, Key> > mKeys;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_COLLECTIONRIDCACHE_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "columnreader.h"
+#include "utils.h"
+
+#include <aksqlcolumn.h>
+
+#include <QSqlQuery>
+#include <QSqlResult>
+#include <QVariant>
+
+using namespace Akonadi::Server;
+
+namespace {
+
+// QSqlResult::virtual_hook() is protected, but can be reached through a
+// member pointer obtained in a subclass
+class ResultHook : public QSqlResult
+{
+public:
+    static bool readColumn(QSqlResult *result, AkSqlColumn *column)
+    {
+        typedef void (QSqlResult::*Hook)(int, void *);
+        const Hook hook = &ResultHook::virtual_hook;
+        (result->*hook)(AkSqlColumn::Hook, column);
+        return column->type != AkSqlColumn::Invalid;
+    }
+};
+
+}
+
+ColumnReader::ColumnReader(const QSqlQuery &query)
+    : mQuery(query)
+{
+}
+
+QVariant ColumnReader::value(int column) const
+{
+    return mQuery.value(column);
+}
+
+bool ColumnReader::readColumn(AkSqlColumn *column) const
+{
+    QSqlResult *result = const_cast<QSqlResult *>(mQuery.result());
+    if (!result || !mQuery.isValid()) {
+        return false;
+    }
+    return ResultHook::readColumn(result, column);
+}
+
+bool ColumnReader::isNull(int column) const
+{
+    AkSqlColumn col(column);
+    if (readColumn(&col)) {
+        return col.type == AkSqlColumn::Null;
+    }
+    return mQuery.isNull(column);
+}
+
+qint64 ColumnReader::toLongLong(int column) const
+{
+    AkSqlColumn col(column);
+    if (readColumn(&col)) {
+        switch (col.type) {
+        case AkSqlColumn::Integer:
+            return col.integer;
+        case AkSqlColumn::Null:
+            return 0;
+        default:
+            break;
+        }
+    }
+    return value(column).toLongLong();
+}
+
+int ColumnReader::toInt(int column) const
+{
+    return static_cast<int>(toLongLong(column));
+}
+
+bool ColumnReader::toBool(int column) const
+{
+    return toLongLong(column) != 0;
+}
+
+QByteArray ColumnReader::toByteArray(int column) const
+{
+    AkSqlColumn col(column);
+    if (readColumn(&col)) {
+        switch (col.type) {
+        case AkSqlColumn::Text:
+        case AkSqlColumn::Blob:
+            return QByteArray(col.data, col.size);
+        case AkSqlColumn::Null:
+            return QByteArray();
+        default:
+            break;
+        }
+    }
+    return Utils::variantToByteArray(value(column));
+}
+
+QString ColumnReader::toString(int column) const
+{
+    AkSqlColumn col(column);
+    if (readColumn(&col)) {
+        switch (col.type) {
+        case AkSqlColumn::Text:
+        case AkSqlColumn::Blob:
+            return QString::fromUtf8(col.data, col.size);
+        case AkSqlColumn::Null:
+            return QString();
+        default:
+            break;
+        }
+    }
+    return Utils::variantToString(value(column));
+}
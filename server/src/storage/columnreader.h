@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_COLUMNREADER_H
+#define AKONADI_SERVER_COLUMNREADER_H
+
+#include <QByteArray>
+#include <QString>
+
+class QSqlQuery;
+class QVariant;
+struct AkSqlColumn;
+
+namespace Akonadi {
+namespace Server {
+
+/**
+ * Typed access to the columns of the current row of a query.
+ *
+ * With the QSQLITE3 driver and a forward-only query the values are read
+ * directly from the statement, without creating a QVariant and, for text
+ * columns returned as QByteArray, without converting from UTF-8 to QString
+ * and back. For any other driver this falls back to QSqlQuery::value().
+ *
+ * The reader references @p query, so it can be used for the whole lifetime of
+ * the query and always returns the values of the current row.
+ */
+class ColumnReader
+{
+public:
+    explicit ColumnReader(const QSqlQuery &query);
+
+    bool isNull(int column) const;
+    qint64 toLongLong(int column) const;
+    int toInt(int column) const;
+    bool toBool(int column) const;
+
+    /**
+     * Returns text columns UTF-8 encoded and blobs as they are, like
+     * Utils::variantToByteArray().
+     */
+    QByteArray toByteArray(int column) const;
+    QString toString(int column) const;
+
+private:
+    QVariant value(int column) const;
+    bool readColumn(AkSqlColumn *column) const;
+
+    const QSqlQuery &mQuery;
+};
+
+} // namespace Server
+} // namespace Akonadi
+
+#endif // AKONADI_SERVER_COLUMNREADER_H
@@ -40,9 +40,12 @@
 #include "querycache.h"
 #include "queryhelper.h"
 
+#include <akstandarddirs.h>
+
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
 #include <QtCore/QEventLoop>
+#include <QtCore/QSet>
 #include <QtCore/QSettings>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
@@ -60,6 +63,12 @@
 using namespace Akonadi::Server;
 
 static QMutex sTransactionMutex;
+
+// Modification sequences of the transactions that are still running, and the
+// highest one handed out (or found in the database on first use)
+static QMutex sModSeqLock;
+static QSet<qint64> sPendingModSeqs;
+static qint64 sLastModSeq = -1;
 bool DataStore::s_hasForeignKeyConstraints = false;
 
 QThreadStorage<DataStore*> DataStore::sInstances;
@@ -81,6 +90,7 @@ DataStore::DataStore()
   : QObject()
   , m_dbOpened( false )
   , m_transactionLevel( 0 )
+  , m_modSeq( -1 )
   , mNotificationCollector( 0 )
   , m_keepAliveTimer( 0 )
 {
@@ -159,24 +169,40 @@ bool DataStore::init()
 
   AkonadiSchema schema;
   DbInitializer::Ptr initializer = DbInitializer::createInstance( m_database, &schema );
-  if ( !initializer->run() ) {
-    akError() << initializer->errorMsg();
-    return false;
-  }
-  s_hasForeignKeyConstraints = initializer->hasForeignKeyConstraints();
 
-  if ( QFile::exists( QLatin1String( ":dbupdate.xml" ) ) ) {
-    DbUpdater updater( m_database, QLatin1String( ":dbupdate.xml" ) );
-    if ( !updater.run() ) {
+  // Introspecting every table, index and foreign key takes several seconds on
+  // MySQL and PostgreSQL, so skip it when neither the schema nor the updates
+  // changed since the last successful verification.
+  const QStringList schemaDescriptions = QStringList() << QLatin1String( ":akonadidb.xml" )
+                                                       << QLatin1String( ":dbupdate.xml" );
+  const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  const bool forceCheck = settings.value( QLatin1String( "General/ForceSchemaCheck" ), false ).toBool();
+  if ( !forceCheck && initializer->isSchemaUpToDate( initializer->schemaFingerprint( schemaDescriptions ) ) ) {
+    akDebug() << "Database schema unchanged since last verification, skipping schema check";
+    s_hasForeignKeyConstraints = initializer->hasForeignKeyConstraints();
+  } else {
+    if ( !initializer->run() ) {
+      akError() << initializer->errorMsg();
       return false;
     }
-  } else {
-    qWarning() << "Warning: dbupdate.xml not found, skipping updates";
-  }
+    s_hasForeignKeyConstraints = initializer->hasForeignKeyConstraints();
 
-  if ( !initializer->updateIndexesAndConstraints() ) {
-    akError() << initializer->errorMsg();
-    return false;
+    if ( QFile::exists( QLatin1String( ":dbupdate.xml" ) ) ) {
+      DbUpdater updater( m_database, QLatin1String( ":dbupdate.xml" ) );
+      if ( !updater.run() ) {
+        return false;
+      }
+    } else {
+      qWarning() << "Warning: dbupdate.xml not found, skipping updates";
+    }
+
+    if ( !initializer->updateIndexesAndConstraints() ) {
+      akError() << initializer->errorMsg();
+      return false;
+    }
+
+    // computed after the updates, the fingerprint includes the new schema version
+    initializer->storeSchemaFingerprint( initializer->schemaFingerprint( schemaDescriptions ) );
   }
 
   // enable caching for some tables
@@ -213,55 +239,106 @@ bool DataStore::setItemsFlags( const PimItem::List &items, const QVector<Flag> &
 {
   QSet<QByteArray> removedFlags;
   QSet<QByteArray> addedFlags;
-  QVariantList insIds;
-  QVariantList insFlags;
-  Query::Condition delConds( Query::Or );
+  QSet<Flag::Id> removedFlagIds;
 
   setBoolPtr( flagsChanged, false );
 
-  Q_FOREACH ( const PimItem &item, items ) {
-    Q_FOREACH ( const Flag &flag, item.flags() ) {
-      if ( !flags.contains( flag ) ) {
-        removedFlags << flag.name().toLatin1();
-        Query::Condition cond;
-        cond.addValueCondition( PimItemFlagRelation::leftFullColumnName(), Query::Equals, item.id() );
-        cond.addValueCondition( PimItemFlagRelation::rightFullColumnName(), Query::Equals, flag.id() );
-        delConds.addCondition(cond);
-      }
+  QVector<Flag> newFlags;
+  QSet<Flag::Id> newFlagIds;
+  Q_FOREACH ( const Flag &flag, flags ) {
+    if ( !newFlagIds.contains( flag.id() ) ) {
+      newFlags << flag;
+      newFlagIds << flag.id();
     }
+  }
 
-    Q_FOREACH ( const Flag &flag, flags ) {
-      if ( !item.flags().contains( flag ) ) {
-        addedFlags << flag.name().toLatin1();
-        insIds << item.id();
-        insFlags << flag.id();
-      }
+  // The items are processed in chunks, so that neither the IN lists exceed the
+  // bind value limit of the database nor the statements get too long for the
+  // query planner. Half of the bind values are left for the flags.
+  const int chunkSize = qBound( 1, DbConfig::configuredDatabase()->maximumBindValues() / 2, 1000 );
+
+  for ( int start = 0; start < items.count(); start += chunkSize ) {
+    const PimItem::List chunk = items.mid( start, chunkSize );
+    QVariantList itemsIds;
+    itemsIds.reserve( chunk.count() );
+    Q_FOREACH ( const PimItem &item, chunk ) {
+      itemsIds << item.id();
     }
-  }
 
-  if ( !removedFlags.empty() ) {
-    QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Delete );
-    qb.addCondition( delConds );
+    // Load the current flags of all items of the chunk at once
+    QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Select );
+    qb.addColumn( PimItemFlagRelation::leftColumn() );
+    qb.addColumn( PimItemFlagRelation::rightColumn() );
+    qb.addValueCondition( PimItemFlagRelation::leftColumn(), Query::In, itemsIds );
     if ( !qb.exec() ) {
       return false;
     }
-  }
 
-  if ( !addedFlags.empty() ) {
-    QueryBuilder qb2( PimItemFlagRelation::tableName(), QueryBuilder::Insert );
-    qb2.setColumnValue( PimItemFlagRelation::leftColumn(), insIds );
-    qb2.setColumnValue( PimItemFlagRelation::rightColumn(), insFlags );
-    qb2.setIdentificationColumn( QString() );
-    if ( !qb2.exec() ) {
-      return false;
+    QHash<PimItem::Id, QSet<Flag::Id> > currentFlags;
+    QSet<Flag::Id> chunkRemovedFlagIds;
+    QSqlQuery query = qb.query();
+    while ( query.next() ) {
+      const PimItem::Id itemId = query.value( 0 ).value<PimItem::Id>();
+      const Flag::Id flagId = query.value( 1 ).value<Flag::Id>();
+      currentFlags[itemId].insert( flagId );
+      if ( !newFlagIds.contains( flagId ) ) {
+        chunkRemovedFlagIds << flagId;
+      }
+    }
+    query.finish();
+
+    if ( !chunkRemovedFlagIds.isEmpty() ) {
+      // Every relation of these flags to the items of the chunk has to go
+      QVariantList flagsIds;
+      Q_FOREACH ( Flag::Id flagId, chunkRemovedFlagIds ) {
+        flagsIds << flagId;
+      }
+
+      QueryBuilder delQb( PimItemFlagRelation::tableName(), QueryBuilder::Delete );
+      delQb.addValueCondition( PimItemFlagRelation::leftColumn(), Query::In, itemsIds );
+      delQb.addValueCondition( PimItemFlagRelation::rightColumn(), Query::In, flagsIds );
+      if ( !delQb.exec() ) {
+        return false;
+      }
+      removedFlagIds.unite( chunkRemovedFlagIds );
+    }
+
+    QVariantList insIds;
+    QVariantList insFlags;
+    Q_FOREACH ( const PimItem &item, chunk ) {
+      const QSet<Flag::Id> itemFlags = currentFlags.value( item.id() );
+      Q_FOREACH ( const Flag &flag, newFlags ) {
+        if ( !itemFlags.contains( flag.id() ) ) {
+          addedFlags << flag.name().toLatin1();
+          insIds << item.id();
+          insFlags << flag.id();
+        }
+      }
+    }
+
+    if ( !insIds.isEmpty() ) {
+      QueryBuilder insQb( PimItemFlagRelation::tableName(), QueryBuilder::Insert );
+      insQb.setColumnValue( PimItemFlagRelation::leftColumn(), insIds );
+      insQb.setColumnValue( PimItemFlagRelation::rightColumn(), insFlags );
+      insQb.setIdentificationColumn( QString() );
+      if ( !insQb.exec() ) {
+        return false;
+      }
     }
   }
 
+  Q_FOREACH ( Flag::Id flagId, removedFlagIds ) {
+    removedFlags << Flag::retrieveById( flagId ).name().toLatin1();
+  }
+
   if ( !silent && ( !addedFlags.isEmpty() || !removedFlags.isEmpty() ) ) {
+    if ( !updateItemsModSeq( items ) ) {
+      return false;
+    }
     mNotificationCollector->itemsFlagsChanged( items, addedFlags, removedFlags );
   }
 
-  setBoolPtr( flagsChanged, ( addedFlags != removedFlags ) );
+  setBoolPtr( flagsChanged, !addedFlags.isEmpty() || !removedFlags.isEmpty() );
 
   return true;
 }
@@ -297,6 +374,9 @@ bool DataStore::doAppendItemsFlag( const PimItem::List &items, const Flag &flag,
   }
 
   if ( !silent ) {
+    if ( !updateItemsModSeq( appendItems ) ) {
+      return false;
+    }
     mNotificationCollector->itemsFlagsChanged( appendItems, QSet<QByteArray>() << flag.name().toLatin1(),
                                                QSet<QByteArray>(), col );
   }
@@ -393,6 +473,9 @@ bool DataStore::removeItemsFlags( const PimItem::List &items, const QVector<Flag
   if ( qb.query().numRowsAffected() != 0 ) {
     setBoolPtr( flagsChanged, true );
     if ( !silent ) {
+      if ( !updateItemsModSeq( items ) ) {
+        return false;
+      }
       mNotificationCollector->itemsFlagsChanged( items, QSet<QByteArray>(), removedFlags );
     }
   }
@@ -454,6 +537,9 @@ bool DataStore::setItemsTags( const PimItem::List &items, const Tag::List &tags,
   }
 
   if ( !silent && ( !addedTags.empty() || !removedTags.empty() ) ) {
+    if ( !updateItemsModSeq( items ) ) {
+      return false;
+    }
     mNotificationCollector->itemsTagsChanged( items, addedTags, removedTags );
   }
 
@@ -493,6 +579,9 @@ bool DataStore::doAppendItemsTag( const PimItem::List &items, const Tag &tag,
   }
 
   if ( !silent ) {
+    if ( !updateItemsModSeq( appendItems ) ) {
+      return false;
+    }
     mNotificationCollector->itemsTagsChanged( appendItems, QSet<qint64>() << tag.id(),
                                                QSet<qint64>(), col );
   }
@@ -580,6 +669,9 @@ bool DataStore::removeItemsTags( const PimItem::List &items, const Tag::List &ta
   if ( qb.query().numRowsAffected() != 0 ) {
     setBoolPtr( tagsChanged, true );
     if ( !silent ) {
+      if ( !updateItemsModSeq( items ) ) {
+        return false;
+      }
       mNotificationCollector->itemsTagsChanged( items, QSet<qint64>(), removedTags );
     }
   }
@@ -608,6 +700,9 @@ bool DataStore::removeTags(const Tag::List &tags, bool silent)
     const PimItem::List items = itemsQuery.result();
 
     if ( !items.isEmpty() ) {
+        if ( !updateItemsModSeq( items ) ) {
+            return false;
+        }
         DataStore::self()->notificationCollector()->itemsTagsChanged( items, QSet<qint64>(), removedTags );
     }
 
@@ -666,6 +761,9 @@ bool DataStore::removeItemParts( const PimItem &item, const QList<QByteArray> &p
     }
   }
 
+  if ( !updateItemsModSeq( PimItem::List() << item ) ) {
+    return false;
+  }
   mNotificationCollector->itemChanged( item, parts.toSet() );
   return true;
 }
@@ -701,7 +799,7 @@ bool DataStore::appendCollection( Collection &collection )
 {
   // no need to check for already existing collection with the same name,
   // a unique index on parent + name prevents that in the database
-  if ( !collection.insert() ) {
+  if ( !collection.insert() || !updateCollectionModSeq( collection ) ) {
     return false;
   }
 
@@ -726,6 +824,10 @@ bool DataStore::cleanupCollection( Collection &collection )
   // TODO: we should try to get rid of this, requires client side changes to resources and Monitor though
   mNotificationCollector->itemsRemoved( items, collection, resource );
 
+  if ( !recordCollectionTombstones( collection ) ) {
+    return false;
+  }
+
   // remove all external payload parts
   QueryBuilder qb( Part::tableName(), QueryBuilder::Select );
   qb.addColumn( Part::dataFullColumnName() );
@@ -740,7 +842,7 @@ bool DataStore::cleanupCollection( Collection &collection )
 
   try {
     while ( qb.query().next() ) {
-      PartHelper::removeFile( PartHelper::resolveAbsolutePath( qb.query().value( 0 ).value<QByteArray>() ) );
+      PartHelper::releaseFile( qb.query().value( 0 ).value<QByteArray>() );
     }
   } catch ( const PartHelperException &e ) {
     akDebug() << e.what();
@@ -761,6 +863,10 @@ bool DataStore::cleanupCollection_slow( Collection &collection )
   const QByteArray resource = collection.resource().name().toLatin1();
   mNotificationCollector->itemsRemoved( items, collection, resource );
 
+  if ( !recordCollectionTombstones( collection ) ) {
+    return false;
+  }
+
   Q_FOREACH ( const PimItem &item, items ) {
     if ( !item.clearFlags() ) { // TODO: move out of loop and use only a single query
       return false;
@@ -862,7 +968,7 @@ bool DataStore::moveCollection( Collection &collection, const Collection &newPar
     }
   }
 
-  if ( !collection.update() ) {
+  if ( !collection.update() || !updateCollectionModSeq( collection ) ) {
     return false;
   }
 
@@ -1060,6 +1166,9 @@ bool DataStore::appendPimItem( QVector<Part> &parts,
 
 //   akDebug() << "appendPimItem: " << pimItem;
 
+  if ( !updateItemsModSeq( PimItem::List() << pimItem ) ) {
+    return false;
+  }
   mNotificationCollector->itemAdded( pimItem, collection );
   return true;
 }
@@ -1079,6 +1188,48 @@ bool DataStore::unhidePimItem( PimItem &pimItem )
   return removeItemParts( pimItem, parts );
 }
 
+bool DataStore::unhidePimItems( const PimItem::List &items )
+{
+  if ( !m_dbOpened ) {
+    return false;
+  }
+
+  if ( items.isEmpty() ) {
+    return true;
+  }
+
+  akDebug() << "DataStore::unhidePimItems(" << items.count() << "items )";
+
+  QVariantList itemIds;
+  itemIds.reserve( items.count() );
+  Q_FOREACH ( const PimItem &item, items ) {
+    itemIds << item.id();
+  }
+
+  // The hidden attribute is never stored externally, so there are no files to release
+  QueryBuilder qb( Part::tableName(), QueryBuilder::Delete );
+  try {
+    qb.addValueCondition( Part::partTypeIdColumn(), Query::Equals,
+                          PartTypeHelper::fromFqName( QByteArray( AKONADI_ATTRIBUTE_HIDDEN ) ).id() );
+  } catch ( const PartTypeException & ) {
+    return false;
+  }
+  qb.addValueCondition( Part::pimItemIdColumn(), Query::In, itemIds );
+  if ( !qb.exec() ) {
+    return false;
+  }
+
+  if ( !updateItemsModSeq( items ) ) {
+    return false;
+  }
+
+  const QSet<QByteArray> parts = QSet<QByteArray>() << AKONADI_ATTRIBUTE_HIDDEN;
+  Q_FOREACH ( const PimItem &item, items ) {
+    mNotificationCollector->itemChanged( item, parts );
+  }
+  return true;
+}
+
 bool DataStore::unhideAllPimItems()
 {
   if ( !m_dbOpened ) {
@@ -1115,6 +1266,10 @@ bool DataStore::cleanupPimItems( const PimItem::List &items )
   // generate the notification before actually removing the data
   mNotificationCollector->itemsRemoved( items );
 
+  if ( !recordItemTombstones( items ) ) {
+    return false;
+  }
+
   // FIXME: Create a single query to do this
   Q_FOREACH ( const PimItem &item, items ) {
     if ( !item.clearFlags() ) {
@@ -1135,6 +1290,172 @@ bool DataStore::cleanupPimItems( const PimItem::List &items )
   return true;
 }
 
+qint64 DataStore::nextModSeq()
+{
+  if ( m_modSeq >= 0 && inTransaction() ) {
+    return m_modSeq;
+  }
+
+  // A sequence taken outside of a transaction is released again with the
+  // commit of its log entry
+  Transaction transaction( this );
+  {
+    // Inserting and registering the sequence under the lock makes sure that
+    // committedModSeq() never misses a sequence that is still in use
+    QMutexLocker locker( &sModSeqLock );
+    QueryBuilder qb( ModificationSequenceLog::tableName(), QueryBuilder::Insert );
+    qb.setColumnValue( ModificationSequenceLog::datetimeColumn(), QDateTime::currentDateTime() );
+    if ( !qb.exec() ) {
+      return -1;
+    }
+    const qint64 modSeq = qb.insertId();
+    if ( modSeq < 0 ) {
+      return -1;
+    }
+    // A transaction replayed after a deadlock inserts another log entry, but
+    // keeps stamping this sequence, which stays registered until it ends
+    m_modSeq = modSeq;
+    sPendingModSeqs.insert( modSeq );
+    sLastModSeq = qMax( sLastModSeq, modSeq );
+  }
+
+  const qint64 modSeq = m_modSeq;
+  if ( !transaction.commit() ) {
+    return -1;
+  }
+  return modSeq;
+}
+
+qint64 DataStore::committedModSeq()
+{
+  QMutexLocker locker( &sModSeqLock );
+  if ( sLastModSeq < 0 ) {
+    QueryBuilder qb( ModificationSequenceLog::tableName(), QueryBuilder::Select );
+    qb.addAggregation( ModificationSequenceLog::idColumn(), QLatin1String( "max" ) );
+    if ( !qb.exec() || !qb.query().next() ) {
+      // nothing can be missed when reporting no changes at all
+      return 0;
+    }
+    sLastModSeq = qb.query().value( 0 ).toLongLong();
+    qb.query().finish();
+  }
+
+  qint64 committed = sLastModSeq;
+  Q_FOREACH ( qint64 modSeq, sPendingModSeqs ) {
+    committed = qMin( committed, modSeq - 1 );
+  }
+  return committed;
+}
+
+void DataStore::releaseModSeq()
+{
+  if ( m_modSeq < 0 ) {
+    return;
+  }
+
+  QMutexLocker locker( &sModSeqLock );
+  sPendingModSeqs.remove( m_modSeq );
+  m_modSeq = -1;
+}
+
+bool DataStore::updateItemsModSeq( const PimItem::List &items )
+{
+  if ( items.isEmpty() ) {
+    return true;
+  }
+
+  Transaction transaction( this );
+  const qint64 modSeq = nextModSeq();
+  if ( modSeq < 0 ) {
+    return false;
+  }
+
+  const int chunkSize = qBound( 1, DbConfig::configuredDatabase()->maximumBindValues() - 1, 1000 );
+  for ( int start = 0; start < items.count(); start += chunkSize ) {
+    QVariantList ids;
+    const int end = qMin( start + chunkSize, items.count() );
+    ids.reserve( end - start );
+    for ( int i = start; i < end; ++i ) {
+      ids << items.at( i ).id();
+    }
+
+    QueryBuilder qb( PimItem::tableName(), QueryBuilder::Update );
+    qb.setColumnValue( PimItem::modSeqColumn(), modSeq );
+    qb.addValueCondition( PimItem::idColumn(), Query::In, ids );
+    if ( !qb.exec() ) {
+      return false;
+    }
+  }
+
+  return transaction.commit();
+}
+
+bool DataStore::updateCollectionModSeq( const Collection &collection )
+{
+  Transaction transaction( this );
+  const qint64 modSeq = nextModSeq();
+  if ( modSeq < 0 ) {
+    return false;
+  }
+
+  QueryBuilder qb( Collection::tableName(), QueryBuilder::Update );
+  qb.setColumnValue( Collection::modSeqColumn(), modSeq );
+  qb.addValueCondition( Collection::idColumn(), Query::Equals, collection.id() );
+  if ( !qb.exec() ) {
+    return false;
+  }
+
+  return transaction.commit();
+}
+
+bool DataStore::insertTombstones( const QString &condition )
+{
+  Transaction transaction( this );
+  const qint64 modSeq = nextModSeq();
+  if ( modSeq < 0 ) {
+    return false;
+  }
+
+  const QString statement = QString::fromLatin1( "INSERT INTO %1 (%2, %3, %4) SELECT %5, %6, %7 FROM %8 WHERE %9" )
+                              .arg( ItemTombstone::tableName(), ItemTombstone::collectionIdColumn(),
+                                    ItemTombstone::pimItemIdColumn(), ItemTombstone::modSeqColumn(),
+                                    PimItem::collectionIdColumn(), PimItem::idColumn(), QString::number( modSeq ),
+                                    PimItem::tableName(), condition );
+  QSqlQuery query( m_database );
+  if ( !query.exec( statement ) ) {
+    debugLastQueryError( query, "DataStore::insertTombstones" );
+    return false;
+  }
+  addQueryToTransaction( query, false );
+
+  return transaction.commit();
+}
+
+bool DataStore::recordItemTombstones( const PimItem::List &items )
+{
+  if ( items.isEmpty() ) {
+    return true;
+  }
+
+  for ( int start = 0; start < items.count(); start += 1000 ) {
+    QStringList ids;
+    const int end = qMin( start + 1000, items.count() );
+    for ( int i = start; i < end; ++i ) {
+      ids << QString::number( items.at( i ).id() );
+    }
+    if ( !insertTombstones( QString::fromLatin1( "%1 IN (%2)" ).arg( PimItem::idColumn(), ids.join( QLatin1String( "," ) ) ) ) ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DataStore::recordCollectionTombstones( const Collection &collection )
+{
+  return insertTombstones( QString::fromLatin1( "%1 = %2" ).arg( PimItem::collectionIdColumn() ).arg( collection.id() ) );
+}
+
 bool DataStore::addCollectionAttribute( const Collection &col, const QByteArray &key, const QByteArray &value )
 {
   SelectQueryBuilder<CollectionAttribute> qb;
@@ -1154,7 +1475,7 @@ bool DataStore::addCollectionAttribute( const Collection &col, const QByteArray
   attr.setType( key );
   attr.setValue( value );
 
-  if ( !attr.insert() ) {
+  if ( !attr.insert() || !updateCollectionModSeq( col ) ) {
     return false;
   }
 
@@ -1179,6 +1500,9 @@ bool DataStore::removeCollectionAttribute( const Collection &col, const QByteArr
   }
 
   if ( !result.isEmpty() ) {
+    if ( !updateCollectionModSeq( col ) ) {
+      throw HandlerException( "Unable to update the modification sequence of the collection" );
+    }
     mNotificationCollector->collectionChanged( col, QList<QByteArray>() << key );
     return true;
   }
@@ -1353,16 +1677,18 @@ bool DataStore::rollbackTransaction()
   --m_transactionLevel;
 
   if ( m_transactionLevel == 0 ) {
-    QSqlDriver *driver = m_database.driver();
     Q_EMIT transactionRolledBack();
+    m_transactionQueries.clear();
+    m_pendingFileRemovals.clear();
+    releaseModSeq();
+
+    QSqlDriver *driver = m_database.driver();
     if ( !driver->rollbackTransaction() ) {
       TRANSACTION_MUTEX_UNLOCK;
       debugLastDbError( "DataStore::rollbackTransaction" );
       return false;
     }
     TRANSACTION_MUTEX_UNLOCK;
-
-    m_transactionQueries.clear();
   }
 
   return true;
@@ -1387,16 +1713,40 @@ bool DataStore::commitTransaction()
       return false;
     } else {
       TRANSACTION_MUTEX_UNLOCK;
+      // before the notifications go out, so that clients can fetch the changes
+      releaseModSeq();
       Q_EMIT transactionCommitted();
     }
 
     m_transactionQueries.clear();
+    removePendingFiles();
   }
 
   m_transactionLevel--;
   return true;
 }
 
+void DataStore::removeSharedFileOnCommit( const QByteArray &data )
+{
+  m_pendingFileRemovals.append( data );
+  if ( m_transactionLevel == 0 ) {
+    removePendingFiles();
+  }
+}
+
+void DataStore::removePendingFiles()
+{
+  const QList<QByteArray> files = m_pendingFileRemovals;
+  m_pendingFileRemovals.clear();
+  Q_FOREACH ( const QByteArray &data, files ) {
+    try {
+      PartHelper::removeUnreferencedSharedFile( data );
+    } catch ( const PartHelperException &e ) {
+      akError() << "Failed to remove shared payload file" << data << ":" << e.what();
+    }
+  }
+}
+
 bool DataStore::inTransaction() const
 {
   return m_transactionLevel > 0;
@@ -194,6 +194,12 @@ class DataStore : public QObject
      */
     virtual bool unhidePimItem( PimItem &pimItem );
 
+    /**
+     * Unhides all the specified PimItems at once. Same as unhidePimItem()
+     * but removes the hidden attribute of all items with a single query.
+     */
+    virtual bool unhidePimItems( const PimItem::List &items );
+
     /**
      * Unhides all the items which have the "hidden" flag set.
      * This function doesn't emit any notification about the items
@@ -203,6 +209,53 @@ class DataStore : public QObject
      */
     virtual bool unhideAllPimItems();
 
+    /* --- Modification sequences ----------------------------------------- */
+    /**
+      Returns the modification sequence of the current transaction. The first
+      call within a transaction inserts a row into ModificationSequenceLog and
+      uses its id, all further calls return the same value. Outside of a
+      transaction every call returns a new value.
+
+      The auto-increment counter doesn't block concurrent transactions, so
+      sequences are not handed out in commit order. See committedModSeq().
+      @return the sequence, or -1 on database errors
+    */
+    virtual qint64 nextModSeq();
+
+    /**
+      Returns the highest modification sequence for which all transactions
+      with this or a lower sequence have ended. Sequences reported to clients
+      must be capped to this value, taken before the query that reads them.
+      A client that has seen sequence n then sees all later changes when
+      asking for everything above n, even though a transaction with a lower
+      sequence may commit after one with a higher sequence.
+    */
+    qint64 committedModSeq();
+
+    /**
+      Stores the modification sequence of the current transaction in all
+      @p items. Must be called for every change of items that clients are
+      notified about, except for their removal.
+    */
+    virtual bool updateItemsModSeq( const PimItem::List &items );
+
+    /**
+      Stores the modification sequence of the current transaction in @p collection.
+      Must be called for every change of a collection except for its removal.
+    */
+    virtual bool updateCollectionModSeq( const Collection &collection );
+
+    /**
+      Records in the expunge log that @p items are removed from the collection
+      they are currently in. Must be called before the items are removed or moved.
+    */
+    virtual bool recordItemTombstones( const PimItem::List &items );
+
+    /**
+      Records in the expunge log that all items of @p collection are removed.
+    */
+    virtual bool recordCollectionTombstones( const Collection &collection );
+
     /* --- Collection attributes ------------------------------------------ */
     virtual bool addCollectionAttribute( const Collection &col, const QByteArray &key, const QByteArray &value );
     /**
@@ -217,6 +270,10 @@ class DataStore : public QObject
     /**
       Begins a transaction. No changes will be written to the database and
       no notification signal will be emitted unless you call commitTransaction().
+
+      On SQLite, which allows only a single writer, this takes the writer lock
+      (BEGIN IMMEDIATE), so that reads done before the first write see no
+      concurrent changes.
       @return @c true if successful.
     */
     virtual bool beginTransaction();
@@ -238,6 +295,14 @@ class DataStore : public QObject
     */
     virtual bool inTransaction() const;
 
+    /**
+      Removes the shared payload file @p data once the current transaction has
+      been committed, unless it has been referenced again by then. Outside of
+      a transaction the file is removed right away.
+      A rollback restores the references, so the file is kept in that case.
+    */
+    void removeSharedFileOnCommit( const QByteArray &data );
+
     /**
       Returns the notification collector of this DataStore object.
       Use this to listen to change notification signals.
@@ -274,6 +339,15 @@ protected:
     void debugLastQueryError( const QSqlQuery &query, const char *actionDescription ) const;
 
   private:
+    // Removes the files queued by removeSharedFileOnCommit()
+    void removePendingFiles();
+
+    // Inserts a tombstone for every item matching the SQL @p condition on PimItemTable
+    bool insertTombstones( const QString &condition );
+
+    // Ends the use of the modification sequence of the current transaction
+    void releaseModSeq();
+
     bool doAppendItemsFlag( const PimItem::List &items, const Flag &flag,
                             const QSet<PimItem::Id> &existing, const Collection &col,
                             bool silent );
@@ -333,7 +407,9 @@ protected:
     QSqlDatabase m_database;
     bool m_dbOpened;
     uint m_transactionLevel;
+    qint64 m_modSeq;
     QVector<QPair<QSqlQuery,bool /* isBatch */> > m_transactionQueries;
+    QList<QByteArray> m_pendingFileRemovals;
     QByteArray mSessionId;
     NotificationCollector *mNotificationCollector;
     QTimer *m_keepAliveTimer;
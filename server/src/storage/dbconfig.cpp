@@ -54,6 +54,9 @@ DbConfig::DbConfig()
   if ( mSizeThreshold < 0 ) {
     mSizeThreshold = 0;
   }
+
+  mUseDeduplication = settings.value( QLatin1String( "General/PayloadDeduplication" ), false ).toBool();
+  mUseCompression = settings.value( QLatin1String( "General/PayloadCompression" ), false ).toBool();
 }
 
 DbConfig::~DbConfig()
@@ -115,6 +118,21 @@ qint64 DbConfig::sizeThreshold() const
   return mSizeThreshold;
 }
 
+bool DbConfig::useDeduplication() const
+{
+  return mUseDeduplication;
+}
+
+bool DbConfig::useCompression() const
+{
+  return mUseCompression;
+}
+
+int DbConfig::maximumBindValues() const
+{
+  return 32767;
+}
+
 QString DbConfig::defaultDatabaseName()
 {
   if ( !AkApplication::hasInstanceIdentifier() ) {
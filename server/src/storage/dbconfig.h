@@ -96,6 +96,30 @@ class DbConfig
      */
     virtual qint64 sizeThreshold() const;
 
+    /**
+     * Whether external payloads are stored content-addressed, so that parts
+     * with identical data (e.g. copies) share a single file.
+     *
+     * @return @c true if General/PayloadDeduplication is set, defaults to @c false.
+     */
+    bool useDeduplication() const;
+
+    /**
+     * Whether payloads stored in the database are compressed.
+     *
+     * @return @c true if General/PayloadCompression is set, defaults to @c false.
+     */
+    bool useCompression() const;
+
+    /**
+     * The maximum number of values that can be bound to a single statement.
+     * Statements with long IN lists have to be split accordingly.
+     *
+     * @return the limit of the database, defaults to 32767 (PostgreSQL's limit,
+     *         MySQL allows more).
+     */
+    virtual int maximumBindValues() const;
+
     /**
      * This method is called to setup initial database settings after a connection is established.
      */
@@ -113,6 +137,8 @@ class DbConfig
 
   private:
     qint64 mSizeThreshold;
+    bool mUseDeduplication;
+    bool mUseCompression;
 };
 
 } // namespace Server
@@ -128,6 +128,11 @@ bool DbConfigSqlite::useInternalServer() const
   return false;
 }
 
+int DbConfigSqlite::maximumBindValues() const
+{
+  return 999;
+}
+
 void DbConfigSqlite::setup()
 {
   const QLatin1String connectionName( "initConnection" );
@@ -72,6 +72,12 @@ class DbConfigSqlite : public DbConfig
      * Sets sqlite journal mode to WAL and synchronous mode to NORMAL
      */
     virtual void setup();
+
+    /**
+     * Returns the default SQLITE_MAX_VARIABLE_NUMBER of SQLite.
+     */
+    virtual int maximumBindValues() const;
+
   private:
     Version mDriverVersion;
     QString mDatabaseName;
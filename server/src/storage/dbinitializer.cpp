@@ -26,6 +26,7 @@
 #include "schema.h"
 #include "entity.h"
 
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
 #include <QtCore/QFile>
 #include <QtCore/QPair>
@@ -284,6 +285,63 @@ bool DbInitializer::updateIndexesAndConstraints()
   return true;
 }
 
+QByteArray DbInitializer::schemaFingerprint( const QStringList &files ) const
+{
+  QCryptographicHash hash( QCryptographicHash::Sha1 );
+  Q_FOREACH ( const QString &fileName, files ) {
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) ) {
+      akDebug() << "Unable to read" << fileName << "for the schema fingerprint";
+      return QByteArray();
+    }
+    hash.addData( file.readAll() );
+  }
+
+  hash.addData( mDatabase.driverName().toLatin1() );
+
+  // the version reflects the applied updates
+  QSqlQuery query( mDatabase );
+  if ( query.exec( QLatin1String( "SELECT version FROM SchemaVersionTable" ) ) && query.next() ) {
+    hash.addData( query.value( 0 ).toByteArray() );
+  }
+
+  return hash.result().toHex();
+}
+
+bool DbInitializer::isSchemaUpToDate( const QByteArray &fingerprint )
+{
+  if ( fingerprint.isEmpty() ) {
+    return false;
+  }
+
+  // fails on databases created before the fingerprint columns were introduced
+  QSqlQuery query( mDatabase );
+  if ( !query.exec( QLatin1String( "SELECT fingerprint, hasForeignKeys FROM SchemaVersionTable" ) ) || !query.next() ) {
+    return false;
+  }
+
+  if ( query.value( 0 ).toByteArray() != fingerprint ) {
+    return false;
+  }
+
+  m_noForeignKeyContraints = !query.value( 1 ).toBool();
+  return true;
+}
+
+bool DbInitializer::storeSchemaFingerprint( const QByteArray &fingerprint )
+{
+  QSqlQuery query( mDatabase );
+  query.prepare( QLatin1String( "UPDATE SchemaVersionTable SET fingerprint = :fingerprint, hasForeignKeys = :hasForeignKeys" ) );
+  query.bindValue( QLatin1String( ":fingerprint" ), fingerprint.isEmpty() ? QVariant() : QString::fromLatin1( fingerprint ) );
+  query.bindValue( QLatin1String( ":hasForeignKeys" ), hasForeignKeyConstraints() );
+  if ( !query.exec() ) {
+    akError() << "Failed to store schema fingerprint:" << query.lastError().text();
+    return false;
+  }
+
+  return true;
+}
+
 void DbInitializer::execPendingQueries( const QStringList &queries )
 {
   Q_FOREACH( const QString &statement, queries ) {
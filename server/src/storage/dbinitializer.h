@@ -96,6 +96,30 @@ class DbInitializer
      */
     bool updateIndexesAndConstraints();
 
+    /**
+     * Returns a hash over the content of the schema and update description
+     * @p files, the database backend and the current schema version.
+     *
+     * When it matches the stored fingerprint, the database has already been
+     * fully verified against exactly this schema and run(), DbUpdater and
+     * updateIndexesAndConstraints() can be skipped.
+     */
+    QByteArray schemaFingerprint( const QStringList &files ) const;
+
+    /**
+     * Returns @c true if @p fingerprint matches the fingerprint stored by the
+     * last successful verification. In that case hasForeignKeyConstraints()
+     * returns the stored result of that verification.
+     */
+    bool isSchemaUpToDate( const QByteArray &fingerprint );
+
+    /**
+     * Stores @p fingerprint together with the current result of
+     * hasForeignKeyConstraints(). Store an empty fingerprint to enforce a full
+     * verification on next startup.
+     */
+    bool storeSchemaFingerprint( const QByteArray &fingerprint );
+
     /**
      * Returns a backend-specific CREATE TABLE SQL query describing given table
      */
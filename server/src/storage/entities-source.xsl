@@ -533,7 +533,7 @@ bool <xsl:value-of select="$className"/>::update()
 
   QueryBuilder qb( tableName(), QueryBuilder::Update );
 
-  <xsl:for-each select="column[@name != 'id']">
+  <xsl:for-each select="column[@name != 'id' and not(@excludeFromUpdate = 'true')]">
     <xsl:variable name="refColumn"><xsl:value-of select="@refColumn"/></xsl:variable>
     if ( d-&gt;<xsl:value-of select="@name"/>_changed ) {
       <xsl:if test="$refColumn = 'id'">
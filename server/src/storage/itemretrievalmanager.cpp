@@ -26,9 +26,12 @@
 
 #include <akdbus.h>
 #include <akdebug.h>
+#include <akstandarddirs.h>
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QReadWriteLock>
+#include <QSettings>
 #include <QWaitCondition>
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
@@ -51,6 +54,9 @@ ItemRetrievalManager::ItemRetrievalManager( QObject *parent )
   mLock = new QReadWriteLock();
   mWaitCondition = new QWaitCondition();
 
+  const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  setAgingInterval( settings.value( QLatin1String( "ItemRetrieval/AgingInterval" ), 2000 ).toInt() );
+
   connect( mDBusConnection.interface(), SIGNAL(serviceOwnerChanged(QString,QString,QString)),
            this, SLOT(serviceOwnerChanged(QString,QString,QString)) );
   connect( this, SIGNAL(requestAdded()), this, SLOT(processRequest()), Qt::QueuedConnection );
@@ -68,6 +74,80 @@ ItemRetrievalManager *ItemRetrievalManager::instance()
   return sInstance;
 }
 
+void ItemRetrievalManager::setAgingInterval( int msecs )
+{
+  mAgingInterval.fetchAndStoreRelaxed( qMax( 1, msecs ) );
+}
+
+int ItemRetrievalManager::agingInterval() const
+{
+  return const_cast<QAtomicInt &>( mAgingInterval ).fetchAndAddRelaxed( 0 );
+}
+
+ItemRetrievalManager::PriorityStatistics ItemRetrievalManager::statistics( ItemRetrievalRequest::Priority priority ) const
+{
+  Q_ASSERT( priority >= 0 && priority < ItemRetrievalRequest::PriorityCount );
+  QReadLocker locker( mLock );
+  PriorityStatistics statistics = mStatistics[priority];
+  for ( QHash<QString, RequestQueue>::ConstIterator it = mPendingRequests.constBegin(); it != mPendingRequests.constEnd(); ++it ) {
+    statistics.queued += it.value().requests[priority].count();
+  }
+  return statistics;
+}
+
+bool ItemRetrievalManager::RequestQueue::isEmpty() const
+{
+  for ( int i = 0; i < ItemRetrievalRequest::PriorityCount; ++i ) {
+    if ( !requests[i].isEmpty() ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int ItemRetrievalManager::RequestQueue::count() const
+{
+  int count = 0;
+  for ( int i = 0; i < ItemRetrievalRequest::PriorityCount; ++i ) {
+    count += requests[i].count();
+  }
+  return count;
+}
+
+bool ItemRetrievalManager::RequestQueue::contains( ItemRetrievalRequest *request ) const
+{
+  return requests[request->priority].contains( request );
+}
+
+// called within the retrieval thread with mLock locked for writing
+ItemRetrievalRequest *ItemRetrievalManager::takeNextRequest( RequestQueue &queue, qint64 now )
+{
+  // The oldest request of each priority competes with its priority raised by
+  // the time it has been waiting, ties go to the higher base priority
+  const int aging = agingInterval();
+  int best = -1;
+  qint64 bestPriority = -1;
+  for ( int i = ItemRetrievalRequest::PriorityCount - 1; i >= 0; --i ) {
+    if ( queue.requests[i].isEmpty() ) {
+      continue;
+    }
+    const qint64 effectivePriority = i + ( now - queue.requests[i].first()->queuedAt ) / aging;
+    if ( effectivePriority > bestPriority ) {
+      best = i;
+      bestPriority = effectivePriority;
+    }
+  }
+  Q_ASSERT( best >= 0 );
+
+  ItemRetrievalRequest *req = queue.requests[best].takeFirst();
+  PriorityStatistics &statistics = mStatistics[best];
+  const qint64 waitTime = now - req->queuedAt;
+  ++statistics.processed;
+  statistics.totalWaitTime += waitTime;
+  statistics.maxWaitTime = qMax( statistics.maxWaitTime, waitTime );
+  return req;
+}
+
 // called within the retrieval thread
 void ItemRetrievalManager::serviceOwnerChanged( const QString &serviceName, const QString &oldOwner, const QString &newOwner )
 {
@@ -130,10 +210,12 @@ void ItemRetrievalManager::requestItemDelivery( qint64 uid, const QByteArray &re
 void ItemRetrievalManager::requestItemDelivery( ItemRetrievalRequest *req )
 {
   mLock->lockForWrite();
-  akDebug() << "posting retrieval request for item" << req->id << " there are "
-            << mPendingRequests.size() << " queues and "
-            << mPendingRequests[req->resourceId].size() << " items in mine";
-  mPendingRequests[req->resourceId].append( req );
+  RequestQueue &queue = mPendingRequests[req->resourceId];
+  akDebug() << "posting retrieval request for item" << req->id << "with priority" << req->priority
+            << " there are " << mPendingRequests.size() << " queues and "
+            << queue.count() << " items in mine";
+  req->queuedAt = QDateTime::currentMSecsSinceEpoch();
+  queue.requests[req->priority].append( req );
   mLock->unlock();
 
   Q_EMIT requestAdded();
@@ -143,7 +225,7 @@ void ItemRetrievalManager::requestItemDelivery( ItemRetrievalRequest *req )
     //akDebug() << "checking if request for item" << req->id << "has been processed...";
     if ( req->processed ) {
       boost::scoped_ptr<ItemRetrievalRequest> reqDeleter( req );
-      Q_ASSERT( !mPendingRequests[req->resourceId].contains( req ) );
+      Q_ASSERT( !mPendingRequests.value( req->resourceId ).contains( req ) );
       const QString errorMsg = req->errorMsg;
       mLock->unlock();
       if ( errorMsg.isEmpty() ) {
@@ -169,15 +251,16 @@ void ItemRetrievalManager::processRequest()
   QVector<QPair<ItemRetrievalJob*, QString> > newJobs;
 
   mLock->lockForWrite();
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
   // look for idle resources
-  for ( QHash< QString, QList< ItemRetrievalRequest *> >::iterator it = mPendingRequests.begin(); it != mPendingRequests.end(); ) {
+  for ( QHash<QString, RequestQueue>::iterator it = mPendingRequests.begin(); it != mPendingRequests.end(); ) {
     if ( it.value().isEmpty() ) {
       it = mPendingRequests.erase( it );
       continue;
     }
     if ( !mCurrentJobs.contains( it.key() ) || mCurrentJobs.value( it.key() ) == 0 ) {
       // TODO: check if there is another one for the same uid with more parts requested
-      ItemRetrievalRequest *req = it.value().takeFirst();
+      ItemRetrievalRequest *req = takeNextRequest( it.value(), now );
       Q_ASSERT( req->resourceId == it.key() );
       ItemRetrievalJob *job = new ItemRetrievalJob( req, this );
       connect( job, SIGNAL(requestCompleted(ItemRetrievalRequest*,QString)), SLOT(retrievalJobFinished(ItemRetrievalRequest*,QString)) );
@@ -209,14 +292,17 @@ void ItemRetrievalManager::retrievalJobFinished( ItemRetrievalRequest *request,
   Q_ASSERT( mCurrentJobs.contains( request->resourceId ) );
   mCurrentJobs.remove( request->resourceId );
   // TODO check if (*it)->parts is a subset of currentRequest->parts
-  for ( QList<ItemRetrievalRequest *>::Iterator it = mPendingRequests[request->resourceId].begin(); it != mPendingRequests[request->resourceId].end(); ) {
-    if ( ( *it )->id == request->id ) {
-      akDebug() << "someone else requested item" << request->id << "as well, marking as processed";
-      ( *it )->errorMsg = errorMsg;
-      ( *it )->processed = true;
-      it = mPendingRequests[request->resourceId].erase( it );
-    } else {
-      ++it;
+  RequestQueue &queue = mPendingRequests[request->resourceId];
+  for ( int i = 0; i < ItemRetrievalRequest::PriorityCount; ++i ) {
+    for ( QList<ItemRetrievalRequest *>::Iterator it = queue.requests[i].begin(); it != queue.requests[i].end(); ) {
+      if ( ( *it )->id == request->id ) {
+        akDebug() << "someone else requested item" << request->id << "as well, marking as processed";
+        ( *it )->errorMsg = errorMsg;
+        ( *it )->processed = true;
+        it = queue.requests[i].erase( it );
+      } else {
+        ++it;
+      }
     }
   }
   mWaitCondition->wakeAll();
@@ -21,7 +21,9 @@
 #define AKONADI_ITEMRETRIEVALMANAGER_H
 
 #include "itemretriever.h"
+#include "itemretrievalrequest.h"
 
+#include <QAtomicInt>
 #include <QHash>
 #include <QStringList>
 #include <QObject>
@@ -36,9 +38,16 @@ namespace Server {
 
 class Collection;
 class ItemRetrievalJob;
-class ItemRetrievalRequest;
 
-/** Manages and processes item retrieval requests. */
+/**
+  Manages and processes item retrieval requests.
+
+  Each resource processes one request at a time. The pending requests of a
+  resource are queued by priority, so that an interactive request overtakes
+  the requests of an indexer or a large copy at the next request boundary.
+  Requests age while they are waiting: every aging interval raises their
+  priority by one level, so that bulk requests are never starved.
+*/
 class ItemRetrievalManager : public QObject
 {
   Q_OBJECT
@@ -57,11 +66,48 @@ class ItemRetrievalManager : public QObject
 
     static ItemRetrievalManager *instance();
 
+    /**
+     * Sets the time in milliseconds after which a waiting request is
+     * considered to be of the next higher priority.
+     */
+    void setAgingInterval( int msecs );
+    int agingInterval() const;
+
+    /** Queue metrics of one priority. */
+    struct PriorityStatistics
+    {
+      PriorityStatistics()
+        : queued( 0 ), processed( 0 ), totalWaitTime( 0 ), maxWaitTime( 0 )
+      {
+      }
+
+      int queued;           ///< requests currently waiting, over all resources
+      qint64 processed;     ///< requests handed to the resources so far
+      qint64 totalWaitTime; ///< milliseconds the processed requests waited in the queue
+      qint64 maxWaitTime;
+    };
+
+    /**
+     * Returns the queue metrics of requests of @p priority. Thread-safe.
+     */
+    PriorityStatistics statistics( ItemRetrievalRequest::Priority priority ) const;
+
   Q_SIGNALS:
     void requestAdded();
 
   private:
+    /// Pending requests of one resource, a FIFO queue per priority
+    struct RequestQueue
+    {
+      bool isEmpty() const;
+      int count() const;
+      bool contains( ItemRetrievalRequest *request ) const;
+
+      QList<ItemRetrievalRequest *> requests[ItemRetrievalRequest::PriorityCount];
+    };
+
     OrgFreedesktopAkonadiResourceInterface *resourceInterface( const QString &id );
+    ItemRetrievalRequest *takeNextRequest( RequestQueue &queue, qint64 now );
 
   private Q_SLOTS:
     void serviceOwnerChanged( const QString &serviceName, const QString &oldOwner, const QString &newOwner );
@@ -77,7 +123,10 @@ class ItemRetrievalManager : public QObject
     /// Used to let requesting threads wait until the request has been processed
     QWaitCondition *mWaitCondition;
     /// Pending requests queues, one per resource
-    QHash<QString, QList<ItemRetrievalRequest *> > mPendingRequests;
+    QHash<QString, RequestQueue> mPendingRequests;
+    /// Metrics of the requests taken from the queues, protected by mLock
+    PriorityStatistics mStatistics[ItemRetrievalRequest::PriorityCount];
+    QAtomicInt mAgingInterval;
     /// Currently running jobs, one per resource
     QHash<QString, ItemRetrievalJob *> mCurrentJobs;
 
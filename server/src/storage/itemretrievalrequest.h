@@ -30,8 +30,20 @@ namespace Server {
 class ItemRetrievalRequest
 {
   public:
+    /**
+     * Requests of a higher priority are handed to the resource first.
+     */
+    enum Priority {
+      Bulk,         ///< indexers, large copies and other background work
+      Normal,
+      Interactive,  ///< a user waiting for the item to show up
+      PriorityCount
+    };
+
     ItemRetrievalRequest()
       : processed( false )
+      , priority( Normal )
+      , queuedAt( 0 )
     {
     }
     qint64 id;
@@ -41,6 +53,8 @@ class ItemRetrievalRequest
     QStringList parts;
     QString errorMsg;
     bool processed;
+    Priority priority;
+    qint64 queuedAt;  ///< milliseconds since the epoch, set by the ItemRetrievalManager
   private:
     Q_DISABLE_COPY( ItemRetrievalRequest )
 };
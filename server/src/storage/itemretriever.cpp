@@ -22,6 +22,7 @@
 
 #include "akdebug.h"
 #include "connection.h"
+#include "storage/columnreader.h"
 #include "storage/datastore.h"
 #include "storage/itemqueryhelper.h"
 #include "storage/itemretrievalmanager.h"
@@ -30,7 +31,6 @@
 #include "storage/parttypehelper.h"
 #include "storage/querybuilder.h"
 #include "storage/selectquerybuilder.h"
-#include "utils.h"
 
 #include <libs/protocol_p.h>
 
@@ -44,6 +44,8 @@ ItemRetriever::ItemRetriever( Connection *connection )
   , mConnection( connection )
   , mFullPayload( false )
   , mRecursive( false )
+  , mChangedSinceModSeq( -1 )
+  , mPriority( -1 )
 {
 }
 
@@ -120,6 +122,11 @@ void ItemRetriever::setChangedSince( const QDateTime &changedSince )
   mChangedSince = changedSince;
 }
 
+void ItemRetriever::setChangedSinceModSeq( qint64 modSeq )
+{
+  mChangedSinceModSeq = modSeq;
+}
+
 QStringList ItemRetriever::retrieveParts() const
 {
   return mParts;
@@ -140,6 +147,7 @@ enum QueryColumns {
 QSqlQuery ItemRetriever::buildQuery() const
 {
   QueryBuilder qb( PimItem::tableName() );
+  qb.setForwardOnly( true );
 
   qb.addJoin( QueryBuilder::InnerJoin, MimeType::tableName(), PimItem::mimeTypeIdFullColumnName(), MimeType::idFullColumnName() );
 
@@ -180,6 +188,9 @@ QSqlQuery ItemRetriever::buildQuery() const
     qb.addValueCondition( PimItem::datetimeFullColumnName(), Query::GreaterOrEqual,
                           mChangedSince.toUTC() );
   }
+  if ( mChangedSinceModSeq >= 0 ) {
+    qb.addValueCondition( PimItem::modSeqFullColumnName(), Query::Greater, mChangedSinceModSeq );
+  }
 
   qb.addSortColumn( PimItem::idFullColumnName(), Query::Ascending );
 
@@ -193,6 +204,31 @@ QSqlQuery ItemRetriever::buildQuery() const
   return qb.query();
 }
 
+void ItemRetriever::setPriority( ItemRetrievalRequest::Priority priority )
+{
+  mPriority = priority;
+}
+
+ItemRetrievalRequest::Priority ItemRetriever::requestPriority( int requestCount ) const
+{
+  // Above this many items the client is not waiting for a single one to show up
+  static const int BulkRequestCount = 50;
+
+  if ( mPriority >= 0 ) {
+    return static_cast<ItemRetrievalRequest::Priority>( mPriority );
+  }
+  if ( mConnection ) {
+    const int declared = mConnection->capabilities().retrievalPriority();
+    if ( declared >= 0 ) {
+      return static_cast<ItemRetrievalRequest::Priority>( declared );
+    }
+  }
+  if ( requestCount > BulkRequestCount || ( mRecursive && mCollection.isValid() ) ) {
+    return ItemRetrievalRequest::Bulk;
+  }
+  return ItemRetrievalRequest::Normal;
+}
+
 bool ItemRetriever::exec()
 {
   if ( mParts.isEmpty() && !mFullPayload ) {
@@ -212,26 +248,27 @@ bool ItemRetriever::exec()
     }
   }
 
+  const ColumnReader columns( query );
   while ( query.isValid() ) {
-    const qint64 pimItemId = query.value( PimItemIdColumn ).toLongLong();
+    const qint64 pimItemId = columns.toLongLong( PimItemIdColumn );
     if ( !lastRequest || lastRequest->id != pimItemId ) {
       lastRequest = new ItemRetrievalRequest();
       lastRequest->id = pimItemId;
-      lastRequest->remoteId = Utils::variantToByteArray( query.value( PimItemRidColumn ) );
-      lastRequest->mimeType = Utils::variantToByteArray( query.value( MimeTypeColumn ) );
-      lastRequest->resourceId = Utils::variantToString( query.value( ResourceColumn ) );
+      lastRequest->remoteId = columns.toByteArray( PimItemRidColumn );
+      lastRequest->mimeType = columns.toByteArray( MimeTypeColumn );
+      lastRequest->resourceId = columns.toString( ResourceColumn );
       lastRequest->parts = parts;
       requests << lastRequest;
     }
 
-    if ( query.value( PartTypeNameColumn ).isNull() ) {
+    if ( columns.isNull( PartTypeNameColumn ) ) {
       // LEFT JOIN did not find anything, retrieve all parts
       query.next();
       continue;
     }
 
-    qint64 datasize = query.value( PartDatasizeColumn ).toLongLong();
-    const QString partName = Utils::variantToString( query.value( PartTypeNameColumn ) );
+    qint64 datasize = columns.toLongLong( PartDatasizeColumn );
+    const QString partName = columns.toString( PartTypeNameColumn );
     Q_ASSERT( !partName.startsWith( QLatin1String( AKONADI_PARAM_PLD ) ) );
 
     if ( datasize <= 0 ) {
@@ -250,11 +287,22 @@ bool ItemRetriever::exec()
 
   query.finish();
 
+  // The requests are posted one after the other, so requests of a higher
+  // priority get ahead of the remaining ones in between
+  int requestCount = 0;
+  Q_FOREACH ( ItemRetrievalRequest *request, requests ) {
+    if ( !request->parts.isEmpty() ) {
+      ++requestCount;
+    }
+  }
+  const ItemRetrievalRequest::Priority priority = requestPriority( requestCount );
+
   Q_FOREACH ( ItemRetrievalRequest *request, requests ) {
     if ( request->parts.isEmpty() ) {
         delete request;
         continue;
     }
+    request->priority = priority;
     // TODO: how should we handle retrieval errors here? so far they have been ignored,
     // which makes sense in some cases, do we need a command parameter for this?
     try {
@@ -274,6 +322,7 @@ bool ItemRetriever::exec()
       retriever.setCollection( col, mRecursive );
       retriever.setRetrieveParts( mParts );
       retriever.setRetrieveFullPayload( mFullPayload );
+      retriever.setPriority( priority );
       result = retriever.exec();
       if ( !result ) {
         break;
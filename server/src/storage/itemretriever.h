@@ -23,6 +23,7 @@
 #include "../exception.h"
 #include "entities.h"
 #include "handler/scope.h"
+#include "storage/itemretrievalrequest.h"
 
 #include "libs/imapset_p.h"
 
@@ -55,6 +56,7 @@ class ItemRetriever
     QStringList retrieveParts() const;
     void setRetrieveFullPayload( bool fullPayload );
     void setChangedSince( const QDateTime &changedSince );
+    void setChangedSinceModSeq( qint64 modSeq );
     void setItemSet( const ImapSet &set, const Collection &collection = Collection() );
     void setItemSet( const ImapSet &set, bool isUid );
     void setItem( const Entity::Id &id );
@@ -65,12 +67,20 @@ class ItemRetriever
     void setScope( const Scope &scope );
     Scope scope() const;
 
+    /**
+     * Sets the priority of the retrieval requests. By default the priority
+     * the client declared is used, and if it didn't declare one, retrievals of
+     * many items or of whole collection trees are bulk retrievals.
+     */
+    void setPriority( ItemRetrievalRequest::Priority priority );
+
     bool exec();
 
     QByteArray lastError() const;
 
   private:
     QSqlQuery buildQuery() const;
+    ItemRetrievalRequest::Priority requestPriority( int requestCount ) const;
 
     /**
      * Checks if external files are still present
@@ -86,6 +96,8 @@ class ItemRetriever
     bool mFullPayload;
     bool mRecursive;
     QDateTime mChangedSince;
+    qint64 mChangedSinceModSeq;
+    int mPriority;
     mutable QByteArray mLastError;
 };
 
@@ -20,6 +20,7 @@
 #include "notificationcollector.h"
 #include "storage/datastore.h"
 #include "storage/entity.h"
+#include "storage/collectionridcache.h"
 #include "handlerhelper.h"
 #include "cachecleaner.h"
 #include "intervalcheck.h"
@@ -36,12 +37,14 @@ using namespace Akonadi::Server;
 NotificationCollector::NotificationCollector( QObject *parent )
   : QObject( parent )
   , mDb( 0 )
+  , mClearRidCache( false )
 {
 }
 
 NotificationCollector::NotificationCollector( DataStore *db )
   : QObject( db )
   , mDb( db )
+  , mClearRidCache( false )
 {
   connect( db, SIGNAL(transactionCommitted()), SLOT(transactionCommitted()) );
   connect( db, SIGNAL(transactionRolledBack()), SLOT(transactionRolledBack()) );
@@ -223,14 +226,31 @@ void NotificationCollector::relationRemoved(const Relation &relation)
 
 void NotificationCollector::transactionCommitted()
 {
+  invalidateRidCache();
   dispatchNotifications();
 }
 
 void NotificationCollector::transactionRolledBack()
 {
+  mRidCacheInvalidations.clear();
+  mClearRidCache = false;
   clear();
 }
 
+void NotificationCollector::invalidateRidCache()
+{
+  CollectionRidCache *cache = CollectionRidCache::instance();
+  if ( mClearRidCache ) {
+    cache->clear();
+  } else {
+    Q_FOREACH ( Collection::Id id, mRidCacheInvalidations ) {
+      cache->invalidate( id );
+    }
+  }
+  mRidCacheInvalidations.clear();
+  mClearRidCache = false;
+}
+
 void NotificationCollector::clear()
 {
   mNotifications.clear();
@@ -346,6 +366,20 @@ void NotificationCollector::collectionNotification( NotificationMessageV2::Opera
                                                     const QSet<QByteArray> &changes,
                                                     const QByteArray &destResource )
 {
+  // Drop the cached remote identifier right away, and once more after the commit.
+  // A move can change the resource and remote identifiers of the whole subtree.
+  CollectionRidCache *ridCache = CollectionRidCache::instance();
+  const bool inTransaction = mDb && mDb->inTransaction();
+  if ( op == NotificationMessageV2::Move ) {
+    ridCache->clear();
+    mClearRidCache = mClearRidCache || inTransaction;
+  } else {
+    ridCache->invalidate( collection.id() );
+    if ( inTransaction ) {
+      mRidCacheInvalidations.insert( collection.id() );
+    }
+  }
+
   NotificationMessageV3 msg;
   msg.setType( NotificationMessageV2::Collections );
   msg.setOperation( op );
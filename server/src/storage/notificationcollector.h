@@ -27,6 +27,7 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QList>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 
 namespace Akonadi {
@@ -250,6 +251,7 @@ class NotificationCollector : public QObject
                                              const Relation &relation);
     void dispatchNotification( const NotificationMessageV3 &msg );
     void clear();
+    void invalidateRidCache();
 
   private Q_SLOTS:
     void transactionCommitted();
@@ -260,6 +262,11 @@ class NotificationCollector : public QObject
     QByteArray mSessionId;
 
     NotificationMessageV3::List mNotifications;
+
+    // CollectionRidCache entries dropped again after the commit, as concurrent
+    // lookups may have cached the old state meanwhile
+    QSet<Collection::Id> mRidCacheInvalidations;
+    bool mClearRidCache;
 };
 
 } // namespace Server
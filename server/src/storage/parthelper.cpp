@@ -22,28 +22,45 @@
 #include "akdebug.h"
 #include "entities.h"
 #include "selectquerybuilder.h"
+#include "countquerybuilder.h"
 #include "dbconfig.h"
 #include "parttypehelper.h"
 #include "imapstreamparser.h"
+#include "datastore.h"
 #include <akstandarddirs.h>
 #include <libs/xdgbasedirs_p.h>
 #include <libs/imapparser_p.h>
 #include <libs/protocol_p.h>
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
 #include <QDebug>
 #include <QFileInfo>
+#include <QTemporaryFile>
 
 #include <QSqlError>
+#include <QSqlQuery>
+
+#include <cstdio>
+
+#include <config-akonadi.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 using namespace Akonadi;
 using namespace Akonadi::Server;
 
+static const char SharedFilePrefix[] = "dedup/";
+
 QString PartHelper::fileNameForPart( Part *part )
 {
   Q_ASSERT( part->id() >= 0 );
-  return QString::number( part->id() );
+  const qint64 id = part->id();
+  return QString::fromLatin1( "%1/%2/%3" ).arg( id % 256, 2, 16, QLatin1Char( '0' ) )
+                                          .arg( ( id / 256 ) % 256, 2, 16, QLatin1Char( '0' ) )
+                                          .arg( id );
 }
 
 void PartHelper::update( Part *part, const QByteArray &data, qint64 dataSize )
@@ -53,23 +70,26 @@ void PartHelper::update( Part *part, const QByteArray &data, qint64 dataSize )
   }
 
   QString origFileName;
-  QString origFilePath;
+  QByteArray origData;
 
   // currently external, so recover the filename to delete it after the update succeeded
-  if ( part->external() ) {
-    origFileName = QString::fromUtf8( part->data() );
-    QFileInfo fi( origFileName );
-    if ( fi.isAbsolute() ) {
-      origFilePath = origFileName;
-      origFileName = fi.fileName();
-    } else if ( !origFileName.isEmpty() ) {
-      origFilePath = storagePath() + origFileName;
+  if ( part->external() && !part->data().isEmpty() ) {
+    origData = part->data();
+    // shared files are never modified, so the new revision gets a file of its own
+    if ( !isSharedFile( origData ) ) {
+      const QFileInfo fi( QString::fromUtf8( origData ) );
+      origFileName = fi.isAbsolute() ? fi.fileName() : QString::fromUtf8( origData );
     }
   }
 
   const bool storeExternal = dataSize > DbConfig::configuredDatabase()->sizeThreshold();
 
-  if ( storeExternal ) {
+  // only complete payloads can be stored content-addressed, streamed ones are appended to later
+  if ( storeExternal && data.size() == dataSize && DbConfig::configuredDatabase()->useDeduplication() ) {
+    part->setData( storeSharedFile( data ) );
+    part->setExternal( true );
+    part->setCompressed( false );
+  } else if ( storeExternal ) {
     QString fileName = origFileName;
     if ( fileName.isEmpty() ) {
       fileName = fileNameForPart( part );
@@ -77,11 +97,12 @@ void PartHelper::update( Part *part, const QByteArray &data, qint64 dataSize )
 
     fileName = updateFileNameRevision( fileName );
 
-    QFile file( storagePath() + fileName );
+    QFile file( resolveAbsolutePath( fileName.toLocal8Bit(), true ) );
     if ( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
       if ( file.write( data ) == data.size() ) {
         part->setData( fileName.toLocal8Bit() );
         part->setExternal( true );
+        part->setCompressed( false );
       } else {
         throw PartHelperException( QString::fromLatin1( "Failed to write into '%1', error was '%2'" ).arg( file.fileName() ).arg( file.errorString() ) );
       }
@@ -92,8 +113,10 @@ void PartHelper::update( Part *part, const QByteArray &data, qint64 dataSize )
 
   // internal storage
   } else {
-    part->setData( data );
+    bool compressed = false;
+    part->setData( data.size() == dataSize ? compress( data, &compressed ) : data );
     part->setExternal( false );
+    part->setCompressed( compressed );
   }
 
   part->setDatasize( dataSize );
@@ -102,8 +125,20 @@ void PartHelper::update( Part *part, const QByteArray &data, qint64 dataSize )
     throw PartHelperException( "Failed to update database record" );
   }
   // everything worked, remove the old file
-  if ( !origFilePath.isEmpty() ) {
-    removeFile( origFilePath );
+  if ( !origData.isEmpty() ) {
+    releaseFile( origData );
+  }
+}
+
+/**
+ * Drops the reference taken for a part that could not be inserted after all.
+ */
+static void releaseSharedFile( const QByteArray &data )
+{
+  try {
+    PartHelper::releaseFile( data );
+  } catch ( const PartHelperException &e ) {
+    akError() << "Failed to drop reference to shared payload file" << data << ":" << e.what();
   }
 }
 
@@ -113,8 +148,36 @@ bool PartHelper::insert( Part *part, qint64 *insertId )
     return false;
   }
 
+  // a copy of a part stored in a shared file
+  if ( part->external() && isSharedFile( part->data() ) ) {
+    if ( !addSharedFileReference( part->data() ) ) {
+      return false;
+    }
+    if ( !part->insert( insertId ) ) {
+      releaseSharedFile( part->data() );
+      return false;
+    }
+    return true;
+  }
+
   const bool storeInFile = part->datasize() > DbConfig::configuredDatabase()->sizeThreshold();
 
+  if ( storeInFile && part->data().size() == part->datasize() && DbConfig::configuredDatabase()->useDeduplication() ) {
+    try {
+      part->setData( storeSharedFile( part->data() ) );
+    } catch ( const PartHelperException &e ) {
+      akError() << "Insert:" << e.what();
+      return false;
+    }
+    part->setExternal( true );
+    part->setCompressed( false );
+    if ( !part->insert( insertId ) ) {
+      releaseSharedFile( part->data() );
+      return false;
+    }
+    return true;
+  }
+
   //it is needed to insert first the metadata so a new id is generated for the part,
   //and we need this id for the payload file name
   QByteArray data;
@@ -122,8 +185,14 @@ bool PartHelper::insert( Part *part, qint64 *insertId )
     data = part->data();
     part->setData( QByteArray() );
     part->setExternal( true );
+    part->setCompressed( false );
   } else {
+    bool compressed = false;
+    if ( part->data().size() == part->datasize() ) {
+      part->setData( compress( part->data(), &compressed ) );
+    }
     part->setExternal( false );
+    part->setCompressed( compressed );
   }
 
   bool result = part->insert( insertId );
@@ -131,7 +200,7 @@ bool PartHelper::insert( Part *part, qint64 *insertId )
   if ( storeInFile && result ) {
     QString fileName = fileNameForPart( part );
     fileName +=  QString::fromUtf8( "_r0" );
-    const QString filePath = storagePath() + QDir::separator() + fileName;
+    const QString filePath = resolveAbsolutePath( fileName.toLocal8Bit(), true );
 
     QFile file( filePath );
     if ( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
@@ -161,8 +230,7 @@ bool PartHelper::remove( Part *part )
 
   if ( part->external() ) {
     // akDebug() << "remove part file " << part->data();
-    const QString fileName = resolveAbsolutePath( part->data() );
-    removeFile( fileName );
+    releaseFile( part->data() );
   }
   return part->remove();
 }
@@ -182,9 +250,8 @@ bool PartHelper::remove( const QString &column, const QVariant &value )
   Part::List::ConstIterator it = parts.constBegin();
   Part::List::ConstIterator end = parts.constEnd();
   for ( ; it != end; ++it ) {
-    const QString fileName = resolveAbsolutePath( ( *it ).data() );
-    // akDebug() << "remove part file " << fileName;
-    removeFile( fileName );
+    // akDebug() << "remove part file " << ( *it ).data();
+    releaseFile( ( *it ).data() );
   }
   return Part::remove( column, value );
 }
@@ -197,6 +264,210 @@ void PartHelper::removeFile( const QString &fileName )
   QFile::remove( fileName );
 }
 
+bool PartHelper::isSharedFile( const QByteArray &data )
+{
+  return data.startsWith( SharedFilePrefix );
+}
+
+/**
+ * Returns whether the shared file at @p filePath holds the complete payload
+ * with the given @p hash. A file left behind by a crash or a failed write
+ * must not be referenced by further parts.
+ */
+static bool isValidSharedFile( const QString &filePath, const QByteArray &hash, qint64 size )
+{
+  QFile file( filePath );
+  if ( file.size() != size || !file.open( QIODevice::ReadOnly ) ) {
+    return false;
+  }
+  QCryptographicHash fileHash( QCryptographicHash::Sha1 );
+  while ( !file.atEnd() ) {
+    const QByteArray chunk = file.read( 64 * 1024 );
+    if ( chunk.isEmpty() ) {
+      return false;
+    }
+    fileHash.addData( chunk );
+  }
+  return fileHash.result().toHex() == hash;
+}
+
+/**
+ * Writes @p data into a temporary file next to @p filePath and renames it into
+ * place, so that other parts never see a partially written shared file.
+ */
+static void writeSharedFile( const QString &filePath, const QByteArray &data )
+{
+  QTemporaryFile file( filePath + QLatin1String( ".XXXXXX" ) );
+  if ( !file.open() ) {
+    throw PartHelperException( QString::fromLatin1( "Could not open '%1' for writing, error was '%2'" ).arg( file.fileName() ).arg( file.errorString() ) );
+  }
+  if ( file.write( data ) != data.size() || !file.flush() ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to write into '%1', error was '%2'" ).arg( file.fileName() ).arg( file.errorString() ) );
+  }
+#ifdef HAVE_UNISTD_H
+  if ( ::fsync( file.handle() ) != 0 ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to sync '%1'" ).arg( file.fileName() ) );
+  }
+#endif
+  if ( ::rename( QFile::encodeName( file.fileName() ).constData(), QFile::encodeName( filePath ).constData() ) != 0 ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to rename '%1' to '%2'" ).arg( file.fileName() ).arg( filePath ) );
+  }
+  file.setAutoRemove( false );
+}
+
+QByteArray PartHelper::storeSharedFile( const QByteArray &data )
+{
+  const QByteArray hash = QCryptographicHash::hash( data, QCryptographicHash::Sha1 ).toHex();
+  const QByteArray fileName = SharedFilePrefix + hash.left( 2 ) + '/' + hash.mid( 2, 2 ) + '/' + hash;
+  const QString filePath = resolveAbsolutePath( fileName, true );
+
+  // the reference is taken before the file is written, so that a concurrent
+  // releaseFile() can't remove it underneath us
+  if ( !addSharedFileReference( fileName ) ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to reference shared payload file '%1'" ).arg( QString::fromLatin1( fileName ) ) );
+  }
+
+  try {
+    if ( !isValidSharedFile( filePath, hash, data.size() ) ) {
+      try {
+        writeSharedFile( filePath, data );
+      } catch ( const PartHelperException & ) {
+        // a concurrent writer may have won the race (rename() can't replace
+        // existing files on all platforms)
+        if ( !isValidSharedFile( filePath, hash, data.size() ) ) {
+          throw;
+        }
+      }
+    }
+  } catch ( const PartHelperException & ) {
+    try {
+      releaseFile( fileName );
+    } catch ( const PartHelperException &e ) {
+      akError() << "Failed to drop reference to shared payload file" << fileName << ":" << e.what();
+    }
+    throw;
+  }
+
+  return fileName;
+}
+
+bool PartHelper::addSharedFileReference( const QByteArray &data, int count )
+{
+  const QString hash = QString::fromLatin1( data.mid( data.lastIndexOf( '/' ) + 1 ) );
+
+  QSqlQuery query( DataStore::self()->database() );
+  query.prepare( QLatin1String( "UPDATE " ) + PayloadFile::tableName()
+                 + QLatin1String( " SET " ) + PayloadFile::refCountColumn() + QLatin1String( " = " ) + PayloadFile::refCountColumn() + QLatin1String( " + :count" )
+                 + QLatin1String( " WHERE " ) + PayloadFile::hashColumn() + QLatin1String( " = :hash" ) );
+  query.bindValue( QLatin1String( ":count" ), count );
+  query.bindValue( QLatin1String( ":hash" ), hash );
+  if ( !query.exec() ) {
+    akError() << "Failed to reference shared payload file" << data << ":" << query.lastError().text();
+    return false;
+  }
+  if ( query.numRowsAffected() > 0 ) {
+    return true;
+  }
+
+  // A concurrent transaction may insert the same hash between our UPDATE and
+  // INSERT. The unique violation aborts the whole transaction on PostgreSQL,
+  // so the INSERT runs in a savepoint and the UPDATE is retried if it fails.
+  const bool inTransaction = DataStore::self()->inTransaction();
+  QSqlQuery savepoint( DataStore::self()->database() );
+  if ( inTransaction && !savepoint.exec( QLatin1String( "SAVEPOINT payloadfile_ref" ) ) ) {
+    akError() << "Failed to reference shared payload file" << data << ":" << savepoint.lastError().text();
+    return false;
+  }
+
+  PayloadFile file;
+  file.setHash( hash );
+  file.setRefCount( count );
+  if ( file.insert() ) {
+    if ( inTransaction ) {
+      savepoint.exec( QLatin1String( "RELEASE SAVEPOINT payloadfile_ref" ) );
+    }
+    return true;
+  }
+
+  if ( inTransaction && !savepoint.exec( QLatin1String( "ROLLBACK TO SAVEPOINT payloadfile_ref" ) ) ) {
+    akError() << "Failed to reference shared payload file" << data << ":" << savepoint.lastError().text();
+    return false;
+  }
+  if ( !query.exec() ) {
+    akError() << "Failed to reference shared payload file" << data << ":" << query.lastError().text();
+    return false;
+  }
+  return query.numRowsAffected() > 0;
+}
+
+QByteArray PartHelper::linkFile( Part *part )
+{
+  Q_ASSERT( part->external() && !isSharedFile( part->data() ) );
+
+  const QString source = resolveAbsolutePath( part->data() );
+  const QByteArray fileName = ( fileNameForPart( part ) + QLatin1String( "_r0" ) ).toLocal8Bit();
+  const QString target = resolveAbsolutePath( fileName, true );
+  // left over from a part that had this id before
+  QFile::remove( target );
+
+#ifdef HAVE_UNISTD_H
+  if ( ::link( QFile::encodeName( source ).constData(), QFile::encodeName( target ).constData() ) == 0 ) {
+    return fileName;
+  }
+#endif
+
+  // no hard links on this file system
+  if ( !QFile::copy( source, target ) ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to copy '%1' to '%2'" ).arg( source ).arg( target ) );
+  }
+  return fileName;
+}
+
+void PartHelper::releaseFile( const QByteArray &data )
+{
+  if ( !isSharedFile( data ) ) {
+    removeFile( resolveAbsolutePath( data ) );
+    return;
+  }
+
+  const QString hash = QString::fromLatin1( data.mid( data.lastIndexOf( '/' ) + 1 ) );
+  QSqlQuery query( DataStore::self()->database() );
+  query.prepare( QLatin1String( "UPDATE " ) + PayloadFile::tableName()
+                 + QLatin1String( " SET " ) + PayloadFile::refCountColumn() + QLatin1String( " = " ) + PayloadFile::refCountColumn() + QLatin1String( " - 1" )
+                 + QLatin1String( " WHERE " ) + PayloadFile::hashColumn() + QLatin1String( " = :hash" ) );
+  query.bindValue( QLatin1String( ":hash" ), hash );
+  if ( !query.exec() ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to release shared payload file '%1': %2" ).arg( QString::fromLatin1( data ) ).arg( query.lastError().text() ) );
+  }
+
+  query.prepare( QLatin1String( "DELETE FROM " ) + PayloadFile::tableName()
+                 + QLatin1String( " WHERE " ) + PayloadFile::hashColumn() + QLatin1String( " = :hash AND " )
+                 + PayloadFile::refCountColumn() + QLatin1String( " <= 0" ) );
+  query.bindValue( QLatin1String( ":hash" ), hash );
+  if ( !query.exec() ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to release shared payload file '%1': %2" ).arg( QString::fromLatin1( data ) ).arg( query.lastError().text() ) );
+  }
+  if ( query.numRowsAffected() > 0 ) {
+    // the file must survive a rollback of the current transaction
+    DataStore::self()->removeSharedFileOnCommit( data );
+  }
+}
+
+void PartHelper::removeUnreferencedSharedFile( const QByteArray &data )
+{
+  const QString hash = QString::fromLatin1( data.mid( data.lastIndexOf( '/' ) + 1 ) );
+  CountQueryBuilder builder( PayloadFile::tableName() );
+  builder.addValueCondition( PayloadFile::hashColumn(), Query::Equals, hash );
+  if ( !builder.exec() ) {
+    throw PartHelperException( QString::fromLatin1( "Failed to look up shared payload file '%1'" ).arg( QString::fromLatin1( data ) ) );
+  }
+  // referenced again by a transaction committed in the meantime
+  if ( builder.result() > 0 ) {
+    return;
+  }
+  removeFile( resolveAbsolutePath( data ) );
+}
+
 bool PartHelper::streamToFile( ImapStreamParser* streamParser, QFile &file, QIODevice::OpenMode openMode )
 {
   Q_ASSERT( openMode & QIODevice::WriteOnly );
@@ -222,7 +493,7 @@ bool PartHelper::streamToFile( ImapStreamParser* streamParser, QFile &file, QIOD
 }
 
 
-QByteArray PartHelper::translateData( const QByteArray &data, bool isExternal )
+QByteArray PartHelper::translateData( const QByteArray &data, bool isExternal, bool isCompressed )
 {
   if ( isExternal ) {
     const QString fileName = resolveAbsolutePath( data );
@@ -237,6 +508,12 @@ QByteArray PartHelper::translateData( const QByteArray &data, bool isExternal )
       akError() << "Error: " << file.errorString();
       return QByteArray();
     }
+  } else if ( isCompressed ) {
+    const QByteArray payload = qUncompress( data );
+    if ( payload.isEmpty() && !data.isEmpty() ) {
+      akError() << "Failed to decompress payload data";
+    }
+    return payload;
   } else {
     // not external
     return data;
@@ -245,19 +522,39 @@ QByteArray PartHelper::translateData( const QByteArray &data, bool isExternal )
 
 QByteArray PartHelper::translateData( const Part &part )
 {
-  return translateData( part.data(), part.external() );
+  return translateData( part.data(), part.external(), part.compressed() );
+}
+
+QByteArray PartHelper::compress( const QByteArray &data, bool *compressed )
+{
+  // below this, the zlib overhead eats most of the savings
+  static const int MinimumSize = 256;
+
+  *compressed = false;
+  if ( data.size() < MinimumSize || !DbConfig::configuredDatabase()->useCompression() ) {
+    return data;
+  }
+
+  const QByteArray compressedData = qCompress( data );
+  // not worth the decompression cost on every access
+  if ( compressedData.size() > data.size() * 9 / 10 ) {
+    return data;
+  }
+
+  *compressed = true;
+  return compressedData;
 }
 
 bool PartHelper::truncate( Part &part )
 {
   if ( part.external() ) {
-    const QString fileName = resolveAbsolutePath( part.data() );
-    removeFile( fileName );
+    releaseFile( part.data() );
   }
 
   part.setData( QByteArray() );
   part.setDatasize( 0 );
   part.setExternal( false );
+  part.setCompressed( false );
   return part.update();
 }
 
@@ -277,13 +574,14 @@ bool PartHelper::verify( Part &part )
     part.setData( QByteArray() );
     part.setDatasize( 0 );
     part.setExternal( false );
+    part.setCompressed( false );
     return part.update();
   }
 
   return true;
 }
 
-QString PartHelper::resolveAbsolutePath( const QByteArray &data )
+QString PartHelper::resolveAbsolutePath( const QByteArray &data, bool createParentDirectory )
 {
     QString fileName = QString::fromUtf8( data );
     QFileInfo fi( fileName );
@@ -291,6 +589,13 @@ QString PartHelper::resolveAbsolutePath( const QByteArray &data )
       fileName = storagePath() + fileName;
     }
 
+    if ( createParentDirectory ) {
+      const QFileInfo file( fileName );
+      if ( !file.dir().exists() ) {
+        QDir().mkpath( file.absolutePath() );
+      }
+    }
+
     return fileName;
 }
 
@@ -70,6 +70,55 @@ namespace PartHelper
    */
   void removeFile( const QString &fileName );
 
+  /**
+   * Releases the external payload file referenced by @p data. Shared files are
+   * only deleted once no part references them anymore and the current
+   * transaction has been committed, all others right away.
+   * @throws PartHelperException if the file is not in our data directory or
+   * the reference count could not be updated.
+   */
+  void releaseFile( const QByteArray &data );
+
+  /**
+   * Deletes the shared file @p data unless a part references it again.
+   * Called by DataStore once the transaction that released it is committed.
+   * @throws PartHelperException if the file is not in our data directory.
+   */
+  void removeUnreferencedSharedFile( const QByteArray &data );
+
+  /**
+   * Returns whether @p data references a content-addressed payload file that
+   * may be shared by several parts (see DbConfig::useDeduplication()). Such
+   * files must never be modified in place.
+   */
+  bool isSharedFile( const QByteArray &data );
+
+  /**
+   * Stores @p data in the content-addressed file for its hash, unless a
+   * complete copy exists already, and adds a reference to it. The file is
+   * written to a temporary file and renamed into place, and the reference is
+   * dropped again if that fails.
+   * @returns the file name to be stored in the part
+   * @throws PartHelperException if the file could not be written
+   */
+  QByteArray storeSharedFile( const QByteArray &data );
+
+  /**
+   * Adds @p count references to the shared file @p data, e.g. for copied parts.
+   */
+  bool addSharedFileReference( const QByteArray &data, int count = 1 );
+
+  /**
+   * Creates the payload file of the copied @p part, which still references
+   * the file of the original part, without copying the data. Payload files
+   * are never modified in place (every update writes a new revision), so the
+   * file is hard linked where the file system supports it and only split by
+   * the next write to either part. Falls back to copying the file otherwise.
+   * @returns the file name to be stored in @p part
+   * @throws PartHelperException if the file could neither be linked nor copied
+   */
+  QByteArray linkFile( Part *part );
+
   /**
    * Reads data from @p streamParser as they arrive from client and writes them
    * to @p partFile. It will close the file when all data are read.
@@ -80,7 +129,7 @@ namespace PartHelper
   bool streamToFile( ImapStreamParser *streamParser, QFile &partFile, QIODevice::OpenMode = QIODevice::WriteOnly );
 
   /** Returns the payload data. */
-  QByteArray translateData( const QByteArray &data, bool isExternal );
+  QByteArray translateData( const QByteArray &data, bool isExternal, bool isCompressed = false );
   /** Convenience overload of the above. */
   QByteArray translateData( const Part &part );
   /** Truncate the payload of @p part and update filesystem/database accordingly.
@@ -91,9 +140,20 @@ namespace PartHelper
   /** Verifies and if necessary fixes the external reference of this part. */
   bool verify( Part &part );
 
+  /**
+   * Returns @p data compressed for storage in the database if payload
+   * compression is enabled and it actually saves space, @p data otherwise.
+   * @p compressed is set accordingly.
+   *
+   * External files are never compressed, as clients read them directly.
+   */
+  QByteArray compress( const QByteArray &data, bool *compressed );
+
 // private: for unit testing only
   /**
-   * Returns a file base name for storing the given item part.
+   * Returns a file base name for storing the given item part, relative to
+   * storagePath(). Files are spread over two levels of 256 directories
+   * derived from the part id, so that no directory grows too big.
    * This does not yet include the revision part.
    */
   QString fileNameForPart( Part *part );
@@ -104,9 +164,11 @@ namespace PartHelper
   QString storagePath();
 
   /**
-   * Read filename from @p data and returns absolute filepath
+   * Read filename from @p data and returns absolute filepath. If
+   * @p createParentDirectory is set, the directory the file goes into is
+   * created if necessary.
    */
-  QString resolveAbsolutePath( const QByteArray &data );
+  QString resolveAbsolutePath( const QByteArray &data, bool createParentDirectory = false );
 
   QString updateFileNameRevision( const QString &fileName );
 
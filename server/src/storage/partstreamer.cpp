@@ -122,7 +122,7 @@ bool PartStreamer::streamLiteral(Part& part, qint64& partSize, QByteArray& value
         } else {
             part.setData(value);
             part.setDatasize(value.size());
-            if (!part.insert()) {
+            if (!PartHelper::insert(&part)) {
               mError = "Failed to insert part to database";
               return false;
             }
@@ -190,8 +190,13 @@ bool PartStreamer::streamLiteralToFile(qint64 dataSize, Part &part, QByteArray &
 bool PartStreamer::streamLiteralToFileDirectly(qint64 dataSize, Part &part)
 {
     QString filename;
+    QByteArray sharedFile;
     if (part.isValid()) {
-        if (part.external()) {
+        if (part.external() && PartHelper::isSharedFile(part.data())) {
+            // Shared files must not be overwritten, the client gets a file of its own
+            sharedFile = part.data();
+            filename = PartHelper::fileNameForPart(&part);
+        } else if (part.external()) {
             // Part was external and is still external
             filename = QString::fromLatin1(part.data());
         } else {
@@ -208,6 +213,7 @@ bool PartStreamer::streamLiteralToFileDirectly(qint64 dataSize, Part &part)
     }
 
     part.setExternal(true);
+    part.setCompressed(false);
     part.setDatasize(dataSize);
     part.setData(filename.toLatin1());
 
@@ -227,6 +233,18 @@ bool PartStreamer::streamLiteralToFileDirectly(qint64 dataSize, Part &part)
         part.update();
     }
 
+    if (!sharedFile.isEmpty()) {
+        try {
+            PartHelper::releaseFile(sharedFile);
+        } catch (const PartHelperException &e) {
+            mError = e.what();
+            return false;
+        }
+    }
+
+    // The client writes the file itself, so the directory has to exist
+    PartHelper::resolveAbsolutePath(part.data(), true);
+
     Response response;
     response.setContinuation();
     response.setString("STREAM [FILE " + part.data() + "]");
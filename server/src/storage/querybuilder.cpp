@@ -28,6 +28,7 @@
 
 #include <QSqlRecord>
 #include <QSqlError>
+#include <QElapsedTimer>
 
 using namespace Akonadi::Server;
 
@@ -360,22 +361,20 @@ bool QueryBuilder::exec()
 
   bool ret;
 
-  if ( StorageDebugger::instance()->isSQLDebuggingEnabled() ) {
-    QTime t;
-    t.start();
-    if ( isBatch ) {
-      ret = mQuery.execBatch();
-    } else {
-      ret = mQuery.exec();
-    }
-    StorageDebugger::instance()->queryExecuted( mQuery, t.elapsed() );
+  StorageDebugger *debugger = StorageDebugger::instance();
+  QElapsedTimer t;
+  t.start();
+  if ( isBatch ) {
+    ret = mQuery.execBatch();
   } else {
-    StorageDebugger::instance()->incSequence();
-    if ( isBatch ) {
-      ret = mQuery.execBatch();
-    } else {
-      ret = mQuery.exec();
-    }
+    ret = mQuery.exec();
+  }
+  const qint64 usecs = t.nsecsElapsed() / 1000;
+  debugger->recordQuery( statement, mQuery, usecs );
+  if ( debugger->isSQLDebuggingEnabled() ) {
+    debugger->queryExecuted( mQuery, usecs / 1000 );
+  } else {
+    debugger->incSequence();
   }
 
   // Add the query to DataStore so that we can replay it in case transaction deadlocks.
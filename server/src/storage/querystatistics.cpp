@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "querystatistics.h"
+
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <climits>
+
+using namespace Akonadi::Server;
+
+static const int MaxStatements = 10000;
+
+LatencyHistogram::LatencyHistogram()
+{
+}
+
+int LatencyHistogram::bucketForValue(qint64 usecs)
+{
+    if (usecs < 4) {
+        return qMax<int>(0, usecs);
+    }
+    if (usecs > INT_MAX) {
+        return BucketCount - 1;
+    }
+
+    int exponent = 2;
+    while ((usecs >> (exponent + 1)) != 0) {
+        ++exponent;
+    }
+    const int sub = (usecs >> (exponent - 2)) & 3;
+    return qMin<int>(4 * (exponent - 1) + sub, BucketCount - 1);
+}
+
+qint64 LatencyHistogram::bucketLowerBound(int bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+    const int exponent = bucket / 4 + 1;
+    return qint64(4 + bucket % 4) << (exponent - 2);
+}
+
+void LatencyHistogram::record(qint64 usecs)
+{
+    mBuckets[bucketForValue(usecs)].fetchAndAddRelaxed(1);
+    mCount.fetchAndAddRelaxed(1);
+
+    const int value = qMin<qint64>(usecs, INT_MAX);
+    int max = mMax.fetchAndAddRelaxed(0);
+    while (value > max && !mMax.testAndSetRelaxed(max, value)) {
+        max = mMax.fetchAndAddRelaxed(0);
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        mBuckets[i].fetchAndStoreRelaxed(0);
+    }
+    mCount.fetchAndStoreRelaxed(0);
+    mMax.fetchAndStoreRelaxed(0);
+}
+
+int LatencyHistogram::count() const
+{
+    return const_cast<QAtomicInt &>(mCount).fetchAndAddRelaxed(0);
+}
+
+qint64 LatencyHistogram::max() const
+{
+    return const_cast<QAtomicInt &>(mMax).fetchAndAddRelaxed(0);
+}
+
+qint64 LatencyHistogram::total() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        const int count = const_cast<QAtomicInt &>(mBuckets[i]).fetchAndAddRelaxed(0);
+        if (count > 0) {
+            total += count * ((bucketLowerBound(i) + bucketLowerBound(i + 1)) / 2);
+        }
+    }
+    return total;
+}
+
+qint64 LatencyHistogram::percentile(double percentile) const
+{
+    int counts[BucketCount];
+    qint64 total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts[i] = const_cast<QAtomicInt &>(mBuckets[i]).fetchAndAddRelaxed(0);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const double rank = qBound(0.0, percentile, 100.0) / 100.0 * total;
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (seen + counts[i] >= rank) {
+            // interpolate within the bucket
+            const qint64 lower = bucketLowerBound(i);
+            const qint64 upper = qMin(bucketLowerBound(i + 1), qMax(lower + 1, max() + 1));
+            const double fraction = (rank - seen) / counts[i];
+            return lower + qint64(fraction * (upper - lower - 1));
+        }
+        seen += counts[i];
+    }
+    return max();
+}
+
+
+QueryStatistics::QueryStatistics()
+{
+}
+
+QueryStatistics::~QueryStatistics()
+{
+    qDeleteAll(mHistograms);
+}
+
+LatencyHistogram *QueryStatistics::histogram(const QString &key)
+{
+    {
+        QReadLocker locker(&mLock);
+        LatencyHistogram *histogram = mHistograms.value(key);
+        if (histogram) {
+            return histogram;
+        }
+    }
+
+    QWriteLocker locker(&mLock);
+    LatencyHistogram *&histogram = mHistograms[key];
+    if (!histogram) {
+        histogram = new LatencyHistogram;
+    }
+    return histogram;
+}
+
+void QueryStatistics::record(const QString &key, qint64 usecs)
+{
+    histogram(key)->record(usecs);
+}
+
+void QueryStatistics::recordStatement(const QString &statement, qint64 usecs)
+{
+    {
+        QReadLocker locker(&mLock);
+        LatencyHistogram *histogram = mStatements.value(statement);
+        if (histogram) {
+            histogram->record(usecs);
+            return;
+        }
+    }
+
+    LatencyHistogram *h = histogram(normalizeStatement(statement));
+    h->record(usecs);
+
+    QWriteLocker locker(&mLock);
+    // statements with inlined values would grow this without bounds
+    if (mStatements.count() < MaxStatements) {
+        mStatements.insert(statement, h);
+    }
+}
+
+void QueryStatistics::reset()
+{
+    QReadLocker locker(&mLock);
+    Q_FOREACH (LatencyHistogram *histogram, mHistograms) {
+        histogram->reset();
+    }
+}
+
+namespace {
+
+struct ReportRow
+{
+    QString key;
+    int count;
+    qint64 total;
+    qint64 p50;
+    qint64 p95;
+    qint64 p99;
+    qint64 max;
+
+    bool operator<(const ReportRow &other) const
+    {
+        return total > other.total;
+    }
+};
+
+QString msecs(qint64 usecs)
+{
+    return QString::number(usecs / 1000.0, 'f', 2);
+}
+
+}
+
+QString QueryStatistics::report(const QString &title, int limit) const
+{
+    QVector<ReportRow> rows;
+    {
+        QReadLocker locker(&mLock);
+        rows.reserve(mHistograms.count());
+        for (QHash<QString, LatencyHistogram *>::ConstIterator it = mHistograms.constBegin(), end = mHistograms.constEnd(); it != end; ++it) {
+            const LatencyHistogram *histogram = it.value();
+            if (histogram->count() == 0) {
+                continue;
+            }
+            ReportRow row;
+            row.key = it.key();
+            row.count = histogram->count();
+            row.total = histogram->total();
+            row.p50 = histogram->percentile(50);
+            row.p95 = histogram->percentile(95);
+            row.p99 = histogram->percentile(99);
+            row.max = histogram->max();
+            rows << row;
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+
+    QString report;
+    QTextStream stream(&report);
+    stream << title << " (" << rows.count() << " entries, times in ms)\n";
+    stream << qSetFieldWidth(10) << right << "count" << "total" << "p50" << "p95" << "p99" << "max"
+           << qSetFieldWidth(0) << "  " << "\n";
+    for (int i = 0; i < rows.count() && (limit <= 0 || i < limit); ++i) {
+        const ReportRow &row = rows[i];
+        stream << qSetFieldWidth(10) << right << row.count << msecs(row.total)
+               << msecs(row.p50) << msecs(row.p95) << msecs(row.p99) << msecs(row.max)
+               << qSetFieldWidth(0) << "  " << row.key << "\n";
+    }
+    stream.flush();
+    return report;
+}
+
+QString QueryStatistics::normalizeStatement(const QString &statement)
+{
+    QString result;
+    result.reserve(statement.size());
+
+    const QChar *data = statement.constData();
+    const int size = statement.size();
+    bool lastWasValue = false;  // the last token written was a '?'
+    int i = 0;
+    while (i < size) {
+        const QChar c = data[i];
+        bool value = false;
+        if (c == QLatin1Char('\'')) {
+            // string literal, '' is an escaped quote
+            ++i;
+            while (i < size) {
+                if (data[i] == QLatin1Char('\'')) {
+                    if (i + 1 < size && data[i + 1] == QLatin1Char('\'')) {
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                ++i;
+            }
+            value = true;
+        } else if (c == QLatin1Char('?')) {
+            ++i;
+            value = true;
+        } else if (c == QLatin1Char(':') && i + 1 < size && data[i + 1].isLetterOrNumber()) {
+            // named placeholder, like QueryBuilder's :0
+            ++i;
+            while (i < size && (data[i].isLetterOrNumber() || data[i] == QLatin1Char('_'))) {
+                ++i;
+            }
+            value = true;
+        } else if (c.isDigit() && (i == 0 || !(data[i - 1].isLetterOrNumber() || data[i - 1] == QLatin1Char('_')))) {
+            // numeric literal that is not part of an identifier
+            while (i < size && (data[i].isDigit() || data[i] == QLatin1Char('.'))) {
+                ++i;
+            }
+            value = true;
+        }
+
+        if (value) {
+            if (!lastWasValue) {
+                result += QLatin1Char('?');
+            }
+            lastWasValue = true;
+            continue;
+        }
+
+        // skip list separators between values, so that IN (?, ?, ?) becomes IN (?)
+        if (lastWasValue && (c == QLatin1Char(',') || c.isSpace())) {
+            int j = i;
+            while (j < size && (data[j] == QLatin1Char(',') || data[j].isSpace())) {
+                ++j;
+            }
+            bool hasComma = false;
+            for (int k = i; k < j; ++k) {
+                if (data[k] == QLatin1Char(',')) {
+                    hasComma = true;
+                    break;
+                }
+            }
+            if (hasComma && j < size && (data[j] == QLatin1Char('\'') || data[j] == QLatin1Char('?')
+                                          || data[j] == QLatin1Char(':') || data[j].isDigit())) {
+                i = j;
+                continue;
+            }
+        }
+
+        lastWasValue = false;
+        result += c;
+        ++i;
+    }
+    return result;
+}
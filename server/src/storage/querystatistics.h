@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015  Till Adam <adam@kde.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef AKONADI_SERVER_QUERYSTATISTICS_H
+#define AKONADI_SERVER_QUERYSTATISTICS_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+namespace Akonadi {
+namespace Server {
+
+/**
+ * Latency histogram that can be updated concurrently without locking.
+ *
+ * Values are in microseconds and are counted in buckets of a quarter of a
+ * power of two, so percentiles are accurate to within 25%.
+ */
+class LatencyHistogram
+{
+public:
+    enum {
+        BucketCount = 120
+    };
+
+    LatencyHistogram();
+
+    void record(qint64 usecs);
+    void reset();
+
+    int count() const;
+    qint64 max() const;
+
+    /**
+     * Returns the estimated sum of all recorded values in microseconds.
+     */
+    qint64 total() const;
+
+    /**
+     * Returns the estimated @p percentile (0-100) in microseconds.
+     */
+    qint64 percentile(double percentile) const;
+
+    static int bucketForValue(qint64 usecs);
+    static qint64 bucketLowerBound(int bucket);
+
+private:
+    QAtomicInt mBuckets[BucketCount];
+    QAtomicInt mCount;
+    QAtomicInt mMax;
+};
+
+/**
+ * Collection of latency histograms, keyed by a name such as a normalized
+ * SQL statement or a command.
+ *
+ * Histograms are created on first use and never deleted, so recording only
+ * takes a read lock once a key is known.
+ */
+class QueryStatistics
+{
+public:
+    QueryStatistics();
+    ~QueryStatistics();
+
+    void record(const QString &key, qint64 usecs);
+
+    /**
+     * Records @p usecs for the normalized form of @p statement. The
+     * normalization is remembered, so that it's done only once for each
+     * distinct statement.
+     */
+    void recordStatement(const QString &statement, qint64 usecs);
+
+    /**
+     * Resets all histograms.
+     */
+    void reset();
+
+    /**
+     * Returns a table of the @p limit keys with the largest total time.
+     */
+    QString report(const QString &title, int limit) const;
+
+    /**
+     * Replaces literal values and placeholders in @p statement by '?' and
+     * collapses lists of them, so that statements differing only in their
+     * values are counted together.
+     */
+    static QString normalizeStatement(const QString &statement);
+
+private:
+    LatencyHistogram *histogram(const QString &key);
+
+    mutable QReadWriteLock mLock;
+    QHash<QString, LatencyHistogram *> mHistograms;
+    QHash<QString, LatencyHistogram *> mStatements;
+};
+
+} // namespace Server
+} // namespace Akonadi
+
+#endif // AKONADI_SERVER_QUERYSTATISTICS_H
@@ -27,6 +27,13 @@
 #include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusMetaType>
 
+#include <QtCore/QDateTime>
+#include <QtCore/QSettings>
+#include <QtCore/QTextStream>
+
+#include <akdebug.h>
+#include <akstandarddirs.h>
+
 Akonadi::Server::StorageDebugger *Akonadi::Server::StorageDebugger::mSelf = 0;
 QMutex Akonadi::Server::StorageDebugger::mMutex;
 
@@ -46,10 +53,17 @@ StorageDebugger *StorageDebugger::instance()
 }
 
 StorageDebugger::StorageDebugger()
-  : mEnabled( false )
+  : mFile( 0 )
+  , mEnabled( false )
+  , mStatisticsEnabled( true )
+  , mSlowQueryThreshold( 1000 )
+  , mSlowLog( 0 )
   , mSequence( 0 )
-  , mFile( 0 )
 {
+  const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  mStatisticsEnabled = settings.value( QLatin1String( "Debug/QueryStatistics" ), true ).toBool();
+  setSlowQueryThreshold( settings.value( QLatin1String( "Debug/SlowQueryThreshold" ), 1000 ).toInt() );
+
   qDBusRegisterMetaType<QList< QList<QVariant> > >();
   new StorageDebuggerAdaptor( this );
   QDBusConnection::sessionBus().registerObject( QLatin1String( "/storageDebug" ),
@@ -62,6 +76,7 @@ StorageDebugger::~StorageDebugger()
     mFile->close();
     delete mFile;
   }
+  delete mSlowLog;
 }
 
 void StorageDebugger::enableSQLDebugging( bool enable )
@@ -130,3 +145,84 @@ void StorageDebugger::queryExecuted( const QSqlQuery &query, int duration )
   // Reset the query
   q.seek( -1, false );
 }
+
+void StorageDebugger::recordQuery( const QString &statement, const QSqlQuery &query, qint64 usecs )
+{
+  if ( mStatisticsEnabled ) {
+    mQueryStatistics.recordStatement( statement, usecs );
+  }
+
+  const int threshold = mSlowQueryThreshold.fetchAndAddRelaxed( 0 );
+  if ( threshold > 0 && usecs >= threshold * 1000ll ) {
+    logSlowQuery( query, usecs );
+  }
+}
+
+void StorageDebugger::recordCommand( const QString &command, qint64 usecs )
+{
+  if ( mStatisticsEnabled ) {
+    mCommandStatistics.record( command, usecs );
+  }
+}
+
+void StorageDebugger::logSlowQuery( const QSqlQuery &query, qint64 usecs )
+{
+  QMutexLocker locker( &mSlowLogMutex );
+  if ( !mSlowLog ) {
+    mSlowLog = new QFile( AkStandardDirs::saveDir( "data" ) + QLatin1String( "/slow_queries.log" ) );
+    if ( !mSlowLog->open( QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text ) ) {
+      akError() << "Failed to open slow query log" << mSlowLog->fileName() << ":" << mSlowLog->errorString();
+    }
+  }
+  if ( !mSlowLog->isOpen() ) {
+    return;
+  }
+
+  QTextStream out( mSlowLog );
+  out << QDateTime::currentDateTime().toString( Qt::ISODate ) << " " << ( usecs / 1000 ) << "ms "
+      << query.executedQuery();
+  const QMap<QString, QVariant> values = query.boundValues();
+  if ( !values.isEmpty() ) {
+    out << " [";
+    for ( QMap<QString, QVariant>::ConstIterator it = values.constBegin(), end = values.constEnd(); it != end; ++it ) {
+      if ( it != values.constBegin() ) {
+        out << ", ";
+      }
+      // don't log whole payloads
+      out << it.key() << "=" << it.value().toString().left( 100 );
+    }
+    out << "]";
+  }
+  out << "\n";
+}
+
+QString StorageDebugger::statistics( int limit ) const
+{
+  if ( !mStatisticsEnabled ) {
+    return QLatin1String( "Statistics are disabled (Debug/QueryStatistics in akonadiserverrc)\n" );
+  }
+  return mCommandStatistics.report( QLatin1String( "Commands" ), 0 )
+         + QLatin1Char( '\n' )
+         + mQueryStatistics.report( QLatin1String( "Statements" ), limit );
+}
+
+QString StorageDebugger::statistics() const
+{
+  return statistics( 100 );
+}
+
+void StorageDebugger::resetStatistics()
+{
+  mQueryStatistics.reset();
+  mCommandStatistics.reset();
+}
+
+void StorageDebugger::setSlowQueryThreshold( int msecs )
+{
+  mSlowQueryThreshold.fetchAndStoreRelaxed( qMax( 0, msecs ) );
+}
+
+int StorageDebugger::slowQueryThreshold() const
+{
+  return const_cast<QAtomicInt&>( mSlowQueryThreshold ).fetchAndAddRelaxed( 0 );
+}
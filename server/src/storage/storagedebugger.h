@@ -26,6 +26,8 @@
 #include <QtCore/QVariant>
 #include <QFile>
 
+#include "querystatistics.h"
+
 #ifdef QT5_BUILD
 #include <QAtomicInteger>
 #else
@@ -56,6 +58,35 @@ class StorageDebugger : public QObject
 
     void writeToFile( const QString &file );
 
+    /**
+      Records the execution time of a query in the statistics and writes it to
+      the slow query log if it took longer than slowQueryThreshold().
+      @param statement The statement as it was prepared.
+    */
+    void recordQuery( const QString &statement, const QSqlQuery &query, qint64 usecs );
+
+    /**
+      Records the execution time of a client command in the statistics.
+    */
+    void recordCommand( const QString &command, qint64 usecs );
+
+    inline bool isStatisticsEnabled() const { return mStatisticsEnabled; }
+
+    /**
+      Returns a report of the latency statistics of statements and commands.
+      @param limit Maximum number of statements to include, 0 for all.
+    */
+    QString statistics( int limit ) const;
+    QString statistics() const;
+    void resetStatistics();
+
+    /**
+      Queries taking at least @p msecs are written to the slow query log,
+      0 disables the log.
+    */
+    void setSlowQueryThreshold( int msecs );
+    int slowQueryThreshold() const;
+
   Q_SIGNALS:
     void queryExecuted( double sequence, uint duration, const QString &query,
                         const QMap<QString,QVariant> &values,
@@ -69,9 +100,17 @@ class StorageDebugger : public QObject
     static StorageDebugger *mSelf;
     static QMutex mMutex;
 
+    void logSlowQuery( const QSqlQuery &query, qint64 usecs );
+
     QFile *mFile;
 
     bool mEnabled;
+    bool mStatisticsEnabled;
+    QueryStatistics mQueryStatistics;
+    QueryStatistics mCommandStatistics;
+    QAtomicInt mSlowQueryThreshold;
+    QMutex mSlowLogMutex;
+    QFile *mSlowLog;
 #ifdef Q_ATOMC_INT64_IS_SUPPORTED
     QAtomicInteger<qint64> mSequence;
 #else
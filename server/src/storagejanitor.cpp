@@ -23,8 +23,11 @@
 #include "storage/transaction.h"
 #include "storage/datastore.h"
 #include "storage/selectquerybuilder.h"
+#include "storage/countquerybuilder.h"
 #include "storage/parthelper.h"
 #include "storage/dbconfig.h"
+#include "storage/dbinitializer.h"
+#include "akonadischema.h"
 #include "resourcemanager.h"
 #include "entities.h"
 #include "dbusconnectionpool.h"
@@ -44,10 +47,14 @@
 #include <QtSql/QSqlError>
 #include <QtCore/QDir>
 #include <QtCore/qdiriterator.h>
+#include <QtCore/QSettings>
 #include <QDateTime>
+#include <QTime>
 
-#include <boost/bind.hpp>
-#include <algorithm>
+#include <config-akonadi.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 using namespace Akonadi::Server;
 
@@ -63,10 +70,83 @@ void StorageJanitorThread::run()
   delete janitor;
 }
 
+/** Number of rows or files processed at once by the consistency check passes. */
+static const int BatchSize = 1000;
+
+class StorageJanitor::ExternalFilesScanner : public QThread
+{
+  public:
+    ExternalFilesScanner( StorageJanitor *janitor, const QDateTime &checkStarted )
+      : QThread()
+      , mJanitor( janitor )
+      , mCheckStarted( checkStarted )
+    {
+    }
+
+  protected:
+    void run()
+    {
+      mJanitor->findUnreferencedExternalFiles( mCheckStarted );
+      mJanitor->setPassDone( QLatin1String( "unreferencedExternalFiles" ) );
+      DataStore::self()->close();
+    }
+
+  private:
+    StorageJanitor *mJanitor;
+    QDateTime mCheckStarted;
+};
+
+/**
+ * Reports the progress of a pass and an estimate of the remaining time,
+ * at most every few seconds.
+ */
+class StorageJanitor::Progress
+{
+  public:
+    Progress( StorageJanitor *janitor, const QString &pass, qint64 total )
+      : mJanitor( janitor )
+      , mPass( pass )
+      , mTotal( total )
+      , mDone( 0 )
+      , mLastReport( 0 )
+    {
+      mTimer.start();
+    }
+
+    void advance( qint64 count )
+    {
+      mDone += count;
+      const int elapsed = mTimer.elapsed();
+      if ( elapsed - mLastReport < 5000 ) {
+        return;
+      }
+      mLastReport = elapsed;
+
+      if ( mTotal <= 0 || mDone >= mTotal ) {
+        mJanitor->inform( QString::fromLatin1( "%1: %2 processed" ).arg( mPass ).arg( mDone ) );
+        return;
+      }
+
+      const qint64 remaining = ( mTotal - mDone ) * elapsed / mDone / 1000;
+      mJanitor->inform( QString::fromLatin1( "%1: %2 of %3 (%4%), about %5 remaining" )
+                        .arg( mPass ).arg( mDone ).arg( mTotal ).arg( mDone * 100 / mTotal )
+                        .arg( QTime( 0, 0 ).addSecs( remaining ).toString( QLatin1String( "hh:mm:ss" ) ) ) );
+    }
+
+  private:
+    StorageJanitor *mJanitor;
+    QString mPass;
+    qint64 mTotal;
+    qint64 mDone;
+    int mLastReport;
+    QTime mTimer;
+};
+
 StorageJanitor::StorageJanitor( QObject *parent )
   : QObject( parent )
   , m_connection( DBusConnectionPool::threadConnection() )
   , m_lostFoundCollectionId( -1 )
+  , m_checkpointFile( AkStandardDirs::saveDir( "data" ) + QLatin1String( "/fsck_checkpoint" ) )
 {
   DataStore::self();
   m_connection.registerService( AkDBus::serviceName( AkDBus::StorageJanitor ) );
@@ -86,39 +166,50 @@ void StorageJanitor::check() // implementation of `akonadictl fsck`
 {
   m_lostFoundCollectionId = -1; // start with a fresh one each time
 
-  inform( "Looking for resources in the DB not matching a configured resource..." );
-  findOrphanedResources();
-
-  inform( "Looking for collections not belonging to a valid resource..." );
-  findOrphanedCollections();
-
-  inform( "Checking collection tree consistency..." );
-  const Collection::List cols = Collection::retrieveAll();
-  std::for_each( cols.begin(), cols.end(), boost::bind( &StorageJanitor::checkPathToRoot, this, _1 ) );
-
-  inform( "Looking for items not belonging to a valid collection..." );
-  findOrphanedItems();
-
-  inform( "Looking for item parts not belonging to a valid item..." );
-  findOrphanedParts();
-
-  inform( "Looking for item flags not belonging to a valid item..." );
-  findOrphanedPimItemFlags();
-
-  inform( "Looking for overlapping external parts..." );
-  findOverlappingParts();
+  if ( QFile::exists( m_checkpointFile ) ) {
+    // The database has changed too much since a check that was interrupted
+    // more than one janitor interval ago for its progress to be of use
+    const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+    const int interval = settings.value( QLatin1String( "Janitor/Interval" ), 24 ).toInt();
+    const QDateTime started = checkStarted();
+    if ( !started.isValid() || started.secsTo( QDateTime::currentDateTime() ) > interval * 3600 ) {
+      inform( "Discarding the progress of an outdated consistency check..." );
+      clearCheckpoints();
+    } else {
+      inform( "Resuming interrupted consistency check..." );
+    }
+  }
+  if ( !checkStarted().isValid() ) {
+    setCheckStarted( QDateTime::currentDateTime() );
+  }
 
-  inform( "Verifying external parts..." );
-  verifyExternalParts();
+  // Must be done before the directory scan starts, as that would consider
+  // files whose new location is not committed yet as unreferenced
+  runPass( "migrateExternalFiles", "Migrating external files to the sharded directory layout...", &StorageJanitor::migrateExternalFiles );
 
-  inform( "Checking size treshold changes..." );
-  checkSizeTreshold();
+  // The directory scan is I/O bound and does not depend on the database
+  // passes, so run it concurrently
+  ExternalFilesScanner scanner( this, QDateTime::currentDateTime() );
+  if ( !isPassDone( QLatin1String( "unreferencedExternalFiles" ) ) ) {
+    inform( "Looking for unreferenced external files..." );
+    scanner.start();
+  }
 
-  inform( "Looking for dirty objects..." );
-  findDirtyObjects();
+  runPass( "schema", "Verifying database schema...", &StorageJanitor::verifySchema );
+  runPass( "orphanedResources", "Looking for resources in the DB not matching a configured resource...", &StorageJanitor::findOrphanedResources );
+  runPass( "orphanedCollections", "Looking for collections not belonging to a valid resource...", &StorageJanitor::findOrphanedCollections );
+  runPass( "collectionTree", "Checking collection tree consistency...", &StorageJanitor::checkCollectionTree );
+  runPass( "orphanedItems", "Looking for items not belonging to a valid collection...", &StorageJanitor::findOrphanedItems );
+  runPass( "orphanedParts", "Looking for item parts not belonging to a valid item...", &StorageJanitor::findOrphanedParts );
+  runPass( "orphanedPimItemFlags", "Looking for item flags not belonging to a valid item...", &StorageJanitor::findOrphanedPimItemFlags );
+  runPass( "overlappingParts", "Looking for overlapping external parts...", &StorageJanitor::findOverlappingParts );
+  runPass( "externalParts", "Verifying external parts...", &StorageJanitor::verifyExternalParts );
+  runPass( "sizeTreshold", "Checking size treshold changes...", &StorageJanitor::checkSizeTreshold );
+  runPass( "dirtyObjects", "Looking for dirty objects...", &StorageJanitor::findDirtyObjects );
+  runPass( "tombstones", "Pruning the expunge log...", &StorageJanitor::pruneTombstones );
+  runPass( "modSeqLog", "Pruning the modification sequence log...", &StorageJanitor::pruneModificationSequenceLog );
 
   /* TODO some ideas for further checks:
-   * the collection tree is non-cyclic
    * content type constraints of collections are not violated
    * find unused flags
    * find unused mimetypes
@@ -126,9 +217,73 @@ void StorageJanitor::check() // implementation of `akonadictl fsck`
    * check if part size matches file size
    */
 
+  scanner.wait();
+  flushInformation();
+  clearCheckpoints();
+
   inform( "Consistency check done." );
 }
 
+void StorageJanitor::runPass( const char *name, const char *msg, Pass pass )
+{
+  const QString passName = QLatin1String( name );
+  if ( isPassDone( passName ) ) {
+    return;
+  }
+
+  inform( msg );
+  ( this->*pass )();
+  setPassDone( passName );
+}
+
+qint64 StorageJanitor::checkpoint( const QString &name ) const
+{
+  QMutexLocker locker( &m_checkpointLock );
+  const QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  return settings.value( QLatin1String( "Checkpoints/" ) + name, 0 ).toLongLong();
+}
+
+void StorageJanitor::setCheckpoint( const QString &name, qint64 id )
+{
+  QMutexLocker locker( &m_checkpointLock );
+  QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  settings.setValue( QLatin1String( "Checkpoints/" ) + name, id );
+}
+
+bool StorageJanitor::isPassDone( const QString &name ) const
+{
+  QMutexLocker locker( &m_checkpointLock );
+  const QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  return settings.value( QLatin1String( "Done/" ) + name, false ).toBool();
+}
+
+void StorageJanitor::setPassDone( const QString &name )
+{
+  QMutexLocker locker( &m_checkpointLock );
+  QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  settings.setValue( QLatin1String( "Done/" ) + name, true );
+}
+
+QDateTime StorageJanitor::checkStarted() const
+{
+  QMutexLocker locker( &m_checkpointLock );
+  const QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  return settings.value( QLatin1String( "Started" ) ).toDateTime();
+}
+
+void StorageJanitor::setCheckStarted( const QDateTime &started )
+{
+  QMutexLocker locker( &m_checkpointLock );
+  QSettings settings( m_checkpointFile, QSettings::IniFormat );
+  settings.setValue( QLatin1String( "Started" ), started );
+}
+
+void StorageJanitor::clearCheckpoints()
+{
+  QMutexLocker locker( &m_checkpointLock );
+  QFile::remove( m_checkpointFile );
+}
+
 qint64 StorageJanitor::lostAndFoundCollection()
 {
   if ( m_lostFoundCollectionId > 0 ) {
@@ -160,7 +315,7 @@ qint64 StorageJanitor::lostAndFoundCollection()
     lfRoot.setCachePolicyLocalParts( QLatin1String( "ALL" ) );
     lfRoot.setCachePolicyCacheTimeout( -1 );
     lfRoot.setCachePolicyInherit( false );
-    if ( !lfRoot.insert() ) {
+    if ( !lfRoot.insert() || !DataStore::self()->updateCollectionModSeq( lfRoot ) ) {
       akFatal() << "Failed to create lost+found root.";
     }
     DataStore::self()->notificationCollector()->collectionAdded( lfRoot, lfRes.name().toUtf8() );
@@ -170,7 +325,7 @@ qint64 StorageJanitor::lostAndFoundCollection()
   lfCol.setName( QDateTime::currentDateTime().toString( QLatin1String( "yyyy-MM-dd hh:mm:ss" ) ) );
   lfCol.setResourceId( lfRes.id() );
   lfCol.setParentId( lfRoot.id() );
-  if ( !lfCol.insert() ) {
+  if ( !lfCol.insert() || !DataStore::self()->updateCollectionModSeq( lfCol ) ) {
     akFatal() << "Failed to create lost+found collection!";
   }
 
@@ -235,89 +390,159 @@ void StorageJanitor::findOrphanedCollections()
   }
 }
 
-void StorageJanitor::checkPathToRoot( const Collection &col )
+void StorageJanitor::checkCollectionTree()
 {
-  if ( col.parentId() == 0 ) {
+  // Only the structure of the tree is kept in memory, names are retrieved when reporting
+  QHash<qint64, QPair<qint64, qint64> > tree; // id -> (parent id, resource id)
+  QueryBuilder qb( Collection::tableName(), QueryBuilder::Select );
+  qb.addColumn( Collection::idColumn() );
+  qb.addColumn( Collection::parentIdColumn() );
+  qb.addColumn( Collection::resourceIdColumn() );
+  if ( !qb.exec() ) {
+    inform( QLatin1Literal( "Failed to query collections: " ) + qb.query().lastError().text() );
     return;
   }
-  const Collection parent = col.parent();
-  if ( !parent.isValid() ) {
-    inform( QLatin1Literal( "Collection \"" ) + col.name() + QLatin1Literal( "\" (id: " ) + QString::number( col.id() )
-          + QLatin1Literal( ") has no valid parent." ) );
-    // TODO fix that by attaching to a top-level lost+found folder
-    return;
+  while ( qb.query().next() ) {
+    tree.insert( qb.query().value( 0 ).toLongLong(),
+                 qMakePair( qb.query().value( 1 ).toLongLong(), qb.query().value( 2 ).toLongLong() ) );
   }
+  qb.query().finish();
+
+  Progress progress( this, QLatin1String( "Collection tree" ), tree.size() );
+  QSet<qint64> connectedToRoot;
+  QSet<qint64> disconnected; // leads into a cycle or to a collection without valid parent
+  QHash<qint64, QPair<qint64, qint64> >::ConstIterator it = tree.constBegin();
+  for ( ; it != tree.constEnd(); ++it ) {
+    progress.advance( 1 );
+
+    const qint64 parentId = it.value().first;
+    if ( parentId == 0 ) {
+      continue;
+    }
+    if ( !tree.contains( parentId ) ) {
+      const Collection col = Collection::retrieveById( it.key() );
+      inform( QLatin1Literal( "Collection \"" ) + col.name() + QLatin1Literal( "\" (id: " ) + QString::number( col.id() )
+            + QLatin1Literal( ") has no valid parent." ) );
+      // TODO fix that by attaching to a top-level lost+found folder
+      continue;
+    }
+    if ( tree.value( parentId ).second != it.value().second ) {
+      const Collection col = Collection::retrieveById( it.key() );
+      inform( QLatin1Literal( "Collection \"" ) + col.name() + QLatin1Literal( "\" (id: " ) + QString::number( col.id() )
+            + QLatin1Literal( ") belongs to a different resource than its parent." ) );
+      // can/should we actually fix that?
+    }
 
-  if ( col.resourceId() != parent.resourceId() ) {
-    inform( QLatin1Literal( "Collection \"" ) + col.name() + QLatin1Literal( "\" (id: " ) + QString::number( col.id() )
-          + QLatin1Literal( ") belongs to a different resource than its parent." ) );
-    // can/should we actually fix that?
+    // walk up until we reach the root or a collection whose path is already known
+    QSet<qint64> path;
+    qint64 current = it.key();
+    while ( current != 0 && !connectedToRoot.contains( current ) && !disconnected.contains( current )
+            && tree.contains( current ) ) {
+      if ( path.contains( current ) ) {
+        // report the collections on the cycle, not the ones leading into it
+        qint64 member = current;
+        do {
+          const Collection col = Collection::retrieveById( member );
+          inform( QLatin1Literal( "Collection \"" ) + col.name() + QLatin1Literal( "\" (id: " ) + QString::number( col.id() )
+                + QLatin1Literal( ") is part of a cycle in the collection tree." ) );
+          member = tree.value( member ).first;
+        } while ( member != current );
+        break;
+      }
+      path.insert( current );
+      current = tree.value( current ).first;
+    }
+    if ( current == 0 || connectedToRoot.contains( current ) ) {
+      connectedToRoot.unite( path );
+    } else {
+      disconnected.unite( path );
+    }
   }
-
-  checkPathToRoot( parent );
 }
 
 void StorageJanitor::findOrphanedItems()
 {
-  SelectQueryBuilder<PimItem> qb;
-  qb.addJoin( QueryBuilder::LeftJoin, Collection::tableName(), PimItem::collectionIdFullColumnName(), Collection::idFullColumnName() );
-  qb.addValueCondition( Collection::idFullColumnName(), Query::Is, QVariant() );
-  qb.exec();
-  const PimItem::List orphans = qb.result();
-  if ( orphans.size() > 0 ) {
-    inform( QLatin1Literal( "Found " ) + QString::number( orphans.size() ) + QLatin1Literal( " orphan items." ) );
+  // the orphans are moved away batch by batch, so each query returns the next batch
+  qint64 count = 0;
+  Q_FOREVER {
+    QueryBuilder sqb( PimItem::tableName(), QueryBuilder::Select );
+    sqb.addColumn( PimItem::idFullColumnName() );
+    sqb.addJoin( QueryBuilder::LeftJoin, Collection::tableName(), PimItem::collectionIdFullColumnName(), Collection::idFullColumnName() );
+    sqb.addValueCondition( Collection::idFullColumnName(), Query::Is, QVariant() );
+    sqb.setLimit( BatchSize );
+    if ( !sqb.exec() ) {
+      inform( QLatin1Literal( "Failed to query orphan items: " ) + sqb.query().lastError().text() );
+      return;
+    }
+    QVector<ImapSet::Id> imapIds;
+    while ( sqb.query().next() ) {
+      imapIds.append( sqb.query().value( 0 ).toLongLong() );
+    }
+    sqb.query().finish();
+    if ( imapIds.isEmpty() ) {
+      break;
+    }
+
     // Attach to lost+found collection
     Transaction transaction( DataStore::self() );
     QueryBuilder qb( PimItem::tableName(), QueryBuilder::Update );
     qint64 col = lostAndFoundCollection();
     qb.setColumnValue( PimItem::collectionIdFullColumnName(), col );
-    QVector<ImapSet::Id> imapIds;
-    Q_FOREACH ( const PimItem &item, orphans ) {
-      imapIds.append( item.id() );
-    }
     ImapSet set;
     set.add( imapIds );
     QueryHelper::setToQuery( set, PimItem::idFullColumnName(), qb );
-    if ( qb.exec() && transaction.commit() ) {
-      inform( QLatin1Literal( "Moved orphan items to collection " ) + QString::number( col ) );
-    } else {
+    if ( !qb.exec() || !transaction.commit() ) {
       inform( QLatin1Literal( "Error moving orphan items to collection " ) + QString::number( col ) + QLatin1Literal( " : " ) + qb.query().lastError().text() );
+      return;
     }
+    count += imapIds.size();
+    inform( QLatin1Literal( "Moved " ) + QString::number( imapIds.size() ) + QLatin1Literal( " orphan items to collection " ) + QString::number( col ) );
+  }
+
+  if ( count > 0 ) {
+    inform( QLatin1Literal( "Found " ) + QString::number( count ) + QLatin1Literal( " orphan items." ) );
   }
 }
 
 void StorageJanitor::findOrphanedParts()
 {
-  SelectQueryBuilder<Part> qb;
+  CountQueryBuilder qb( Part::tableName() );
   qb.addJoin( QueryBuilder::LeftJoin, PimItem::tableName(), Part::pimItemIdFullColumnName(), PimItem::idFullColumnName() );
   qb.addValueCondition( PimItem::idFullColumnName(), Query::Is, QVariant() );
+  if ( !qb.exec() ) {
+    inform( QLatin1Literal( "Failed to query orphan parts: " ) + qb.query().lastError().text() );
+    return;
+  }
 
-  qb.exec();
-  const Part::List orphans = qb.result();
-  if ( orphans.size() > 0 ) {
-    inform( QLatin1Literal( "Found " ) + QString::number( orphans.size() ) + QLatin1Literal( " orphan parts." ) );
+  const int orphans = qb.result();
+  if ( orphans > 0 ) {
+    inform( QLatin1Literal( "Found " ) + QString::number( orphans ) + QLatin1Literal( " orphan parts." ) );
     // TODO: create lost+found items for those? delete?
   }
 }
 
 void StorageJanitor::findOrphanedPimItemFlags()
 {
-  QueryBuilder sqb( PimItemFlagRelation::tableName(), QueryBuilder::Select );
-  sqb.addColumn( PimItemFlagRelation::leftFullColumnName() );
-  sqb.addJoin( QueryBuilder::LeftJoin, PimItem::tableName(), PimItemFlagRelation::leftFullColumnName(), PimItem::idFullColumnName() );
-  sqb.addValueCondition( PimItem::idFullColumnName(), Query::Is, QVariant() );
-  if ( !sqb.exec() ) {
+  qint64 count = 0;
+  Q_FOREVER {
+    QueryBuilder sqb( PimItemFlagRelation::tableName(), QueryBuilder::Select );
+    sqb.addColumn( PimItemFlagRelation::leftFullColumnName() );
+    sqb.addJoin( QueryBuilder::LeftJoin, PimItem::tableName(), PimItemFlagRelation::leftFullColumnName(), PimItem::idFullColumnName() );
+    sqb.addValueCondition( PimItem::idFullColumnName(), Query::Is, QVariant() );
+    sqb.setLimit( BatchSize );
+    if ( !sqb.exec() ) {
       akError() << "Error:" << sqb.query().lastError().text();
       return;
-  }
-  QVector<ImapSet::Id> imapIds;
-  int count = 0;
-  while ( sqb.query().next() ) {
-    ++count;
-    imapIds.append( sqb.query().value( 0 ).toInt() );
-  }
+    }
+    QVector<ImapSet::Id> imapIds;
+    while ( sqb.query().next() ) {
+      imapIds.append( sqb.query().value( 0 ).toLongLong() );
+    }
+    sqb.query().finish();
+    if ( imapIds.isEmpty() ) {
+      break;
+    }
 
-  if ( count > 0 ) {
     ImapSet set;
     set.add( imapIds );
     QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Delete );
@@ -326,7 +551,10 @@ void StorageJanitor::findOrphanedPimItemFlags()
       akError() << "Error:" << qb.query().lastError().text();
       return;
     }
+    count += imapIds.size();
+  }
 
+  if ( count > 0 ) {
     inform( QLatin1Literal( "Found and deleted " ) + QString::number( count ) + QLatin1Literal( " orphan pim item flags." ) );
   }
 }
@@ -344,6 +572,10 @@ void StorageJanitor::findOverlappingParts()
 
   int count = 0;
   while ( qb.query().next() ) {
+    // shared payload files are referenced by several parts on purpose
+    if ( PartHelper::isSharedFile( qb.query().value( 0 ).toByteArray() ) ) {
+      continue;
+    }
     ++count;
     inform( QLatin1Literal( "Found overlapping part data: " ) + qb.query().value( 0 ).toString() );
     // TODO: uh oh, this is bad, how do we recover from that?
@@ -354,64 +586,290 @@ void StorageJanitor::findOverlappingParts()
   }
 }
 
-void StorageJanitor::verifyExternalParts()
+void StorageJanitor::migrateExternalFiles()
 {
-  QSet<QString> existingFiles;
-  QSet<QString> usedFiles;
+  const QString passName = QLatin1String( "migrateExternalFiles" );
+  qint64 lastId = checkpoint( passName );
+  const QString dataDir = PartHelper::storagePath();
+
+  CountQueryBuilder cqb( Part::tableName() );
+  cqb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+  cqb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
+  cqb.addValueCondition( Part::idColumn(), Query::Greater, lastId );
+  Progress progress( this, QLatin1String( "External file migration" ), cqb.exec() ? cqb.result() : -1 );
+
+  qint64 migrated = 0;
+  Q_FOREVER {
+    QueryBuilder qb( Part::tableName(), QueryBuilder::Select );
+    qb.addColumn( Part::idColumn() );
+    qb.addColumn( Part::dataColumn() );
+    qb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+    qb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
+    qb.addValueCondition( Part::idColumn(), Query::Greater, lastId );
+    qb.addSortColumn( Part::idColumn() );
+    qb.setLimit( BatchSize );
+    if ( !qb.exec() ) {
+      inform( QLatin1Literal( "Failed to query external parts: " ) + qb.query().lastError().text() );
+      return;
+    }
 
-  // list all files
-  const QString dataDir = AkStandardDirs::saveDir( "data", QLatin1String( "file_db_data" ) );
-  QDirIterator it( dataDir );
-  while ( it.hasNext() ) {
-    existingFiles.insert( it.next() );
+    QVector<QPair<Entity::Id, QByteArray> > parts;
+    while ( qb.query().next() ) {
+      parts.append( qMakePair( qb.query().value( 0 ).value<Entity::Id>(), qb.query().value( 1 ).toByteArray() ) );
+    }
+    qb.query().finish();
+    if ( parts.isEmpty() ) {
+      break;
+    }
+
+    for ( int i = 0; i < parts.size(); ++i ) {
+      lastId = parts[i].first;
+      const QByteArray oldName = parts[i].second;
+      const QFileInfo oldFile( PartHelper::resolveAbsolutePath( oldName ) );
+      if ( oldFile.absolutePath() + QDir::separator() != dataDir ) {
+        // already migrated, shared, or not one of ours
+        continue;
+      }
+
+      Part part;
+      part.setId( parts[i].first );
+      const QString shard = PartHelper::fileNameForPart( &part ).section( QLatin1Char( '/' ), 0, 1 );
+      const QByteArray newName = shard.toUtf8() + '/' + oldFile.fileName().toUtf8();
+      const QString newPath = PartHelper::resolveAbsolutePath( newName, true );
+
+      // Keep the file reachable under both names until the database is
+      // updated, so that concurrent readers never see it missing
+#ifdef HAVE_UNISTD_H
+      const bool linked = ::link( QFile::encodeName( oldFile.absoluteFilePath() ).constData(),
+                                  QFile::encodeName( newPath ).constData() ) == 0;
+#else
+      const bool linked = QFile::copy( oldFile.absoluteFilePath(), newPath );
+#endif
+      if ( !linked ) {
+        inform( QLatin1Literal( "Failed to migrate external file " ) + oldFile.absoluteFilePath() );
+        continue;
+      }
+
+      QueryBuilder uqb( Part::tableName(), QueryBuilder::Update );
+      uqb.setColumnValue( Part::dataColumn(), newName );
+      uqb.addValueCondition( Part::idColumn(), Query::Equals, parts[i].first );
+      // the part might have been modified meanwhile
+      uqb.addValueCondition( Part::dataColumn(), Query::Equals, oldName );
+      if ( !uqb.exec() || uqb.query().numRowsAffected() != 1 ) {
+        QFile::remove( newPath );
+        continue;
+      }
+      QFile::remove( oldFile.absoluteFilePath() );
+      ++migrated;
+    }
+
+    setCheckpoint( passName, lastId );
+    progress.advance( parts.size() );
   }
-  existingFiles.remove( dataDir + QDir::separator() + QLatin1String( "." ) );
-  existingFiles.remove( dataDir + QDir::separator() + QLatin1String( ".." ) );
-  inform( QLatin1Literal( "Found " ) + QString::number( existingFiles.size() ) + QLatin1Literal( " external files." ) );
 
-  // list all parts from the db which claim to have an associated file
-  QueryBuilder qb( Part::tableName(), QueryBuilder::Select );
-  qb.addColumn( Part::dataColumn() );
-  qb.addColumn( Part::pimItemIdColumn() );
-  qb.addColumn( Part::idColumn() );
-  qb.addValueCondition( Part::externalColumn(), Query::Equals, true );
-  qb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
-  qb.exec();
-  while ( qb.query().next() ) {
-    QString partPath = PartHelper::resolveAbsolutePath( qb.query().value( 0 ).toByteArray() );
-    const Entity::Id pimItemId = qb.query().value( 1 ).value<Entity::Id>();
-    const Entity::Id id = qb.query().value( 2 ).value<Entity::Id>();
-    if ( existingFiles.contains( partPath ) ) {
-      usedFiles.insert( partPath );
-    } else {
-      inform( QLatin1Literal( "Cleaning up missing external file: " ) + partPath + QLatin1Literal( " for item: " ) + QString::number( pimItemId ) + QLatin1Literal( " on part: " ) + QString::number( id ) );
+  if ( migrated > 0 ) {
+    inform( QString::fromLatin1( "Migrated %1 external files to the sharded directory layout." ).arg( migrated ) );
+  }
+}
+
+void StorageJanitor::verifyExternalParts()
+{
+  const QString passName = QLatin1String( "externalParts" );
+  qint64 lastId = checkpoint( passName );
+
+  CountQueryBuilder cqb( Part::tableName() );
+  cqb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+  cqb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
+  cqb.addValueCondition( Part::idColumn(), Query::Greater, lastId );
+  Progress progress( this, QLatin1String( "External parts" ), cqb.exec() ? cqb.result() : -1 );
+
+  // list the parts from the db which claim to have an associated file, in batches
+  qint64 existing = 0;
+  Q_FOREVER {
+    QueryBuilder qb( Part::tableName(), QueryBuilder::Select );
+    qb.addColumn( Part::idColumn() );
+    qb.addColumn( Part::pimItemIdColumn() );
+    qb.addColumn( Part::dataColumn() );
+    qb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+    qb.addValueCondition( Part::dataColumn(), Query::IsNot, QVariant() );
+    qb.addValueCondition( Part::idColumn(), Query::Greater, lastId );
+    qb.addSortColumn( Part::idColumn() );
+    qb.setLimit( BatchSize );
+    if ( !qb.exec() ) {
+      inform( QLatin1Literal( "Failed to query external parts: " ) + qb.query().lastError().text() );
+      return;
+    }
 
+    int count = 0;
+    QVector<QPair<Entity::Id, Entity::Id> > missing;
+    while ( qb.query().next() ) {
+      ++count;
+      lastId = qb.query().value( 0 ).value<Entity::Id>();
+      const QString partPath = PartHelper::resolveAbsolutePath( qb.query().value( 2 ).toByteArray() );
+      if ( QFile::exists( partPath ) ) {
+        ++existing;
+        continue;
+      }
+      const Entity::Id pimItemId = qb.query().value( 1 ).value<Entity::Id>();
+      inform( QLatin1Literal( "Cleaning up missing external file: " ) + partPath + QLatin1Literal( " for item: " ) + QString::number( pimItemId ) + QLatin1Literal( " on part: " ) + QString::number( lastId ) );
+      missing.append( qMakePair( lastId, pimItemId ) );
+    }
+    qb.query().finish();
+    if ( count == 0 ) {
+      break;
+    }
+
+    for ( int i = 0; i < missing.size(); ++i ) {
       Part part;
-      part.setId( id );
-      part.setPimItemId( pimItemId );
+      part.setId( missing[i].first );
+      part.setPimItemId( missing[i].second );
       part.setData( QByteArray() );
       part.setDatasize( 0 );
       part.setExternal( false );
+      part.setCompressed( false );
       part.update();
     }
+
+    setCheckpoint( passName, lastId );
+    progress.advance( count );
   }
-  inform( QLatin1Literal( "Found " ) + QString::number( usedFiles.size() ) + QLatin1Literal( " external parts." ) );
+  inform( QLatin1Literal( "Found " ) + QString::number( existing ) + QLatin1Literal( " external parts." ) );
+}
 
-  // see what's left and move it to lost+found
-  const QSet<QString> unreferencedFiles = existingFiles - usedFiles;
-  if ( !unreferencedFiles.isEmpty() ) {
-    const QString lfDir = AkStandardDirs::saveDir( "data", QLatin1String( "file_lost+found" ) );
-    Q_FOREACH ( const QString &file, unreferencedFiles ) {
-      inform( QLatin1Literal( "Found unreferenced external file: " ) + file );
+void StorageJanitor::findUnreferencedExternalFiles( const QDateTime &checkStarted )
+{
+  const QString dataDir = PartHelper::storagePath();
+  const QString lfDir = AkStandardDirs::saveDir( "data", QLatin1String( "file_lost+found" ) );
+
+  // there is usually one file per external part, which is good enough for an estimate
+  CountQueryBuilder cqb( Part::tableName() );
+  cqb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+  Progress progress( this, QLatin1String( "External files" ), cqb.exec() ? cqb.result() : -1 );
+
+  qint64 fileCount = 0;
+  qint64 unreferencedCount = 0;
+  QDirIterator it( dataDir, QDir::Files, QDirIterator::Subdirectories );
+  while ( it.hasNext() ) {
+    // look up a batch of files at once; legacy parts store absolute paths
+    QStringList files;
+    QVariantList names;
+    while ( it.hasNext() && files.size() < BatchSize ) {
+      files.append( it.next() );
+      names.append( files.last().mid( dataDir.length() ).toUtf8() );
+      names.append( files.last().toUtf8() );
+    }
+
+    QueryBuilder qb( Part::tableName(), QueryBuilder::Select );
+    qb.addColumn( Part::dataColumn() );
+    qb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+    qb.addValueCondition( Part::dataColumn(), Query::In, names );
+    if ( !qb.exec() ) {
+      inform( QLatin1Literal( "Failed to query external parts: " ) + qb.query().lastError().text() );
+      return;
+    }
+    QSet<QString> usedFiles;
+    while ( qb.query().next() ) {
+      usedFiles.insert( PartHelper::resolveAbsolutePath( qb.query().value( 0 ).toByteArray() ) );
+    }
+    qb.query().finish();
+
+    // see what's left and move it to lost+found
+    Q_FOREACH ( const QString &file, files ) {
+      if ( usedFiles.contains( file ) ) {
+        continue;
+      }
       const QFileInfo f( file );
+      // the part referencing it might not have been committed yet
+      if ( f.lastModified() >= checkStarted ) {
+        continue;
+      }
+      inform( QLatin1Literal( "Found unreferenced external file: " ) + file );
       QFile::rename( file, lfDir + QDir::separator() + f.fileName() );
+      ++unreferencedCount;
     }
-    inform( QString::fromLatin1( "Moved %1 unreferenced files to lost+found." ).arg( unreferencedFiles.size() ) );
+
+    fileCount += files.size();
+    progress.advance( files.size() );
+  }
+
+  inform( QLatin1Literal( "Found " ) + QString::number( fileCount ) + QLatin1Literal( " external files." ) );
+  if ( unreferencedCount > 0 ) {
+    inform( QString::fromLatin1( "Moved %1 unreferenced files to lost+found." ).arg( unreferencedCount ) );
   } else {
     inform( "Found no unreferenced external files." );
   }
 }
 
+void StorageJanitor::pruneTombstones()
+{
+  const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  const int retentionDays = settings.value( QLatin1String( "Janitor/TombstoneRetentionDays" ), 30 ).toInt();
+  if ( retentionDays <= 0 ) {
+    return;
+  }
+
+  // Sequences grow with time, so everything up to the newest expired
+  // sequence is removed and the log stays complete above it
+  QueryBuilder qb( ItemTombstone::tableName(), QueryBuilder::Select );
+  qb.addAggregation( ItemTombstone::modSeqColumn(), QLatin1String( "max" ) );
+  qb.addValueCondition( ItemTombstone::datetimeColumn(), Query::Less,
+                        QDateTime::currentDateTime().toUTC().addDays( -retentionDays ) );
+  if ( !qb.exec() || !qb.query().next() ) {
+    inform( QLatin1Literal( "Failed to query expired tombstones: " ) + qb.query().lastError().text() );
+    return;
+  }
+  if ( qb.query().value( 0 ).isNull() ) {
+    return;
+  }
+  const qint64 prunedModSeq = qb.query().value( 0 ).toLongLong();
+  qb.query().finish();
+
+  Transaction transaction( DataStore::self() );
+  QueryBuilder dqb( ItemTombstone::tableName(), QueryBuilder::Delete );
+  dqb.addValueCondition( ItemTombstone::modSeqColumn(), Query::LessOrEqual, prunedModSeq );
+  if ( !dqb.exec() ) {
+    inform( QLatin1Literal( "Failed to remove expired tombstones: " ) + dqb.query().lastError().text() );
+    return;
+  }
+  const int removed = dqb.query().numRowsAffected();
+
+  QueryBuilder uqb( ModificationSequence::tableName(), QueryBuilder::Update );
+  uqb.setColumnValue( ModificationSequence::prunedModSeqColumn(), prunedModSeq );
+  uqb.addValueCondition( ModificationSequence::prunedModSeqColumn(), Query::Less, prunedModSeq );
+  if ( !uqb.exec() || !transaction.commit() ) {
+    inform( "Failed to update the pruned modification sequence" );
+    return;
+  }
+
+  inform( QString::fromLatin1( "Removed %1 tombstones up to modification sequence %2." ).arg( removed ).arg( prunedModSeq ) );
+}
+
+void StorageJanitor::pruneModificationSequenceLog()
+{
+  QueryBuilder qb( ModificationSequenceLog::tableName(), QueryBuilder::Select );
+  qb.addAggregation( ModificationSequenceLog::idColumn(), QLatin1String( "max" ) );
+  if ( !qb.exec() || !qb.query().next() ) {
+    inform( QLatin1Literal( "Failed to query the modification sequence log: " ) + qb.query().lastError().text() );
+    return;
+  }
+  if ( qb.query().value( 0 ).isNull() ) {
+    return;
+  }
+  const qint64 lastModSeq = qb.query().value( 0 ).toLongLong();
+  qb.query().finish();
+
+  // The newest entry is kept, so that the auto-increment counter can't restart
+  // from an empty table on databases that don't persist it
+  QueryBuilder dqb( ModificationSequenceLog::tableName(), QueryBuilder::Delete );
+  dqb.addValueCondition( ModificationSequenceLog::idColumn(), Query::Less, lastModSeq );
+  if ( !dqb.exec() ) {
+    inform( QLatin1Literal( "Failed to prune the modification sequence log: " ) + dqb.query().lastError().text() );
+    return;
+  }
+
+  inform( QString::fromLatin1( "Removed %1 entries of the modification sequence log." ).arg( dqb.query().numRowsAffected() ) );
+}
+
 void StorageJanitor::findDirtyObjects()
 {
   SelectQueryBuilder<Collection> cqb;
@@ -426,26 +884,34 @@ void StorageJanitor::findDirtyObjects()
   }
   inform( QLatin1Literal( "Found " ) + QString::number( ridLessCols.size() ) + QLatin1Literal( " collections without RID." ) );
 
-  SelectQueryBuilder<PimItem> iqb1;
+  // there can be a lot of those, so only stream the ids
+  QueryBuilder iqb1( PimItem::tableName(), QueryBuilder::Select );
+  iqb1.addColumn( PimItem::idColumn() );
   iqb1.setSubQueryMode( Query::Or );
   iqb1.addValueCondition( PimItem::remoteIdColumn(), Query::Is, QVariant() );
   iqb1.addValueCondition( PimItem::remoteIdColumn(), Query::Equals, QString() );
+  iqb1.setForwardOnly( true );
   iqb1.exec();
-  const PimItem::List ridLessItems = iqb1.result();
-  Q_FOREACH ( const PimItem &item, ridLessItems )
-    inform( QLatin1Literal( "Item \"" ) + QString::number( item.id() ) + QLatin1Literal( "\" has no RID." ) );
-  inform( QLatin1Literal( "Found " ) + QString::number( ridLessItems.size() ) + QLatin1Literal( " items without RID." ) );
+  int ridLessItems = 0;
+  while ( iqb1.query().next() ) {
+    ++ridLessItems;
+    inform( QLatin1Literal( "Item \"" ) + iqb1.query().value( 0 ).toString() + QLatin1Literal( "\" has no RID." ) );
+  }
+  inform( QLatin1Literal( "Found " ) + QString::number( ridLessItems ) + QLatin1Literal( " items without RID." ) );
 
-  SelectQueryBuilder<PimItem> iqb2;
+  QueryBuilder iqb2( PimItem::tableName(), QueryBuilder::Select );
+  iqb2.addColumn( PimItem::idColumn() );
   iqb2.addValueCondition( PimItem::dirtyColumn(), Query::Equals, true );
   iqb2.addValueCondition( PimItem::remoteIdColumn(), Query::IsNot, QVariant() );
   iqb2.addSortColumn( PimItem::idFullColumnName() );
+  iqb2.setForwardOnly( true );
   iqb2.exec();
-  const PimItem::List dirtyItems = iqb2.result();
-  Q_FOREACH ( const PimItem &item, dirtyItems ) {
-    inform( QLatin1Literal( "Item \"" ) + QString::number( item.id() ) + QLatin1Literal( "\" has RID and is dirty." ) );
+  int dirtyItems = 0;
+  while ( iqb2.query().next() ) {
+    ++dirtyItems;
+    inform( QLatin1Literal( "Item \"" ) + iqb2.query().value( 0 ).toString() + QLatin1Literal( "\" has RID and is dirty." ) );
   }
-  inform( QLatin1Literal( "Found " ) + QString::number( dirtyItems.size() ) + QLatin1Literal( " dirty items." ) );
+  inform( QLatin1Literal( "Found " ) + QString::number( dirtyItems ) + QLatin1Literal( " dirty items." ) );
 }
 
 void StorageJanitor::vacuum()
@@ -491,7 +957,7 @@ void StorageJanitor::checkSizeTreshold()
       Transaction transaction( DataStore::self() );
       Part part = Part::retrieveById( query.value( 0 ).toLongLong() );
       const QByteArray name = PartHelper::fileNameForPart( &part ).toUtf8() + "_r" + QByteArray::number( part.version() );
-      const QString partPath = PartHelper::resolveAbsolutePath( name );
+      const QString partPath = PartHelper::resolveAbsolutePath( name, true );
       QFile f( partPath );
       if ( f.exists() ) {
         akDebug() << "External payload file" << name << "already exists";
@@ -502,7 +968,7 @@ void StorageJanitor::checkSizeTreshold()
         akError() << "Failed to open file" << name << "for writing";
         continue;
       }
-      if ( f.write( part.data() ) != part.datasize() ) {
+      if ( f.write( PartHelper::translateData( part ) ) != part.datasize() ) {
         akError() << "Failed to write data to payload file" << name;
         f.remove();
         continue;
@@ -510,6 +976,7 @@ void StorageJanitor::checkSizeTreshold()
 
       part.setData( name );
       part.setExternal( true );
+      part.setCompressed( false );
       if ( !part.update() || !transaction.commit() ) {
         akError() << "Failed to update database entry of part" << part.id();
         f.remove();
@@ -533,7 +1000,8 @@ void StorageJanitor::checkSizeTreshold()
     while ( query.next() ) {
       Transaction transaction( DataStore::self() );
       Part part = Part::retrieveById( query.value( 0 ).toLongLong() );
-      const QString partPath = PartHelper::resolveAbsolutePath( part.data() );
+      const QByteArray fileName = part.data();
+      const QString partPath = PartHelper::resolveAbsolutePath( fileName );
       QFile f( partPath );
       if ( !f.exists() ) {
         akError() << "Part file" << part.data() << "does not exist";
@@ -544,24 +1012,48 @@ void StorageJanitor::checkSizeTreshold()
         continue;
       }
 
-      part.setExternal( false );
-      part.setData( f.readAll() );
-      if ( part.data().size() != part.datasize() ) {
+      const QByteArray data = f.readAll();
+      if ( data.size() != part.datasize() ) {
         akError() << "Sizes of" << part.id() << "data don't match";
         continue;
       }
+      bool compressed = false;
+      part.setData( PartHelper::compress( data, &compressed ) );
+      part.setCompressed( compressed );
+      part.setExternal( false );
       if ( !part.update() || !transaction.commit() ) {
         akError() << "Failed to update database entry of part" << part.id();
         continue;
       }
 
       f.close();
-      f.remove();
+      try {
+        PartHelper::releaseFile( fileName );
+      } catch ( const PartHelperException &e ) {
+        akError() << e.what();
+      }
       inform( QString::fromLatin1( "Moved part %1 from external file into database" ).arg( part.id() ) );
     }
   }
 }
 
+void StorageJanitor::verifySchema()
+{
+  AkonadiSchema schema;
+  DbInitializer::Ptr initializer = DbInitializer::createInstance( DataStore::self()->database(), &schema );
+  const QStringList schemaDescriptions = QStringList() << QLatin1String( ":akonadidb.xml" )
+                                                       << QLatin1String( ":dbupdate.xml" );
+
+  if ( !initializer->run() || !initializer->updateIndexesAndConstraints() ) {
+    inform( QLatin1String( "ERROR: Database schema verification failed: " ) + initializer->errorMsg() );
+    // make sure the next server start does not trust the cached fingerprint either
+    initializer->storeSchemaFingerprint( QByteArray() );
+    return;
+  }
+
+  initializer->storeSchemaFingerprint( initializer->schemaFingerprint( schemaDescriptions ) );
+}
+
 void StorageJanitor::inform( const char *msg )
 {
   inform( QLatin1String( msg ) );
@@ -570,5 +1062,26 @@ void StorageJanitor::inform( const char *msg )
 void StorageJanitor::inform( const QString &msg )
 {
   akDebug() << msg;
+  if ( QThread::currentThread() != thread() ) {
+    // information() is a D-Bus signal, so only emit it from the janitor thread
+    QMutexLocker locker( &m_informationLock );
+    m_pendingInformation.append( msg );
+    QMetaObject::invokeMethod( this, "flushInformation", Qt::QueuedConnection );
+    return;
+  }
+
+  flushInformation();
   Q_EMIT information( msg );
 }
+
+void StorageJanitor::flushInformation()
+{
+  QMutexLocker locker( &m_informationLock );
+  const QStringList messages = m_pendingInformation;
+  m_pendingInformation.clear();
+  locker.unlock();
+
+  Q_FOREACH ( const QString &msg, messages ) {
+    Q_EMIT information( msg );
+  }
+}
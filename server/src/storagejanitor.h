@@ -20,14 +20,20 @@
 #ifndef STORAGEJANITOR_H
 #define STORAGEJANITOR_H
 
+#include <QDateTime>
+#include <QMutex>
+#include <QStringList>
 #include <QThread>
 #include <qdbusmacros.h>
 #include <QtDBus/QDBusConnection>
 
+class QDateTime;
+
 namespace Akonadi {
 namespace Server {
 
 class Collection;
+class StorageJanitor;
 
 class StorageJanitorThread : public QThread
 {
@@ -40,6 +46,12 @@ class StorageJanitorThread : public QThread
 
 /**
  * Various database checking/maintenance features.
+ *
+ * The consistency check is split into independent passes. The scan of the
+ * external payload directory runs concurrently with the database passes,
+ * large tables are processed in batches keyed by id, and the progress of
+ * every pass is stored in a checkpoint file so that an interrupted check
+ * continues where it stopped the next time it is triggered.
  */
 class StorageJanitor : public QObject
 {
@@ -59,9 +71,38 @@ class StorageJanitor : public QObject
     /** Sends informational messages to a possible UI for this. */
     Q_SCRIPTABLE void information( const QString &msg );
 
+  private Q_SLOTS:
+    /** Emits the messages of other threads from the janitor thread. */
+    void flushInformation();
+
   private:
+    class Progress;
+    class ExternalFilesScanner;
+    friend class Progress;
+    friend class ExternalFilesScanner;
+    typedef void ( StorageJanitor::*Pass )();
+
     void inform( const char *msg );
     void inform( const QString &msg );
+
+    /**
+     * Runs @p pass unless it was already completed by an interrupted check.
+     */
+    void runPass( const char *name, const char *msg, Pass pass );
+
+    /** Returns the id up to which the pass @p name has processed its table, or 0. */
+    qint64 checkpoint( const QString &name ) const;
+    void setCheckpoint( const QString &name, qint64 id );
+    bool isPassDone( const QString &name ) const;
+    void setPassDone( const QString &name );
+    /**
+     * Time the check recorded in the checkpoint file was started. Checkpoints
+     * older than Janitor/Interval hours (24 by default) are discarded.
+     */
+    QDateTime checkStarted() const;
+    void setCheckStarted( const QDateTime &started );
+    void clearCheckpoints();
+
     /** Create a lost+found collection if necessary. */
     qint64 lostAndFoundCollection();
 
@@ -76,10 +117,10 @@ class StorageJanitor : public QObject
     void findOrphanedCollections();
 
     /**
-     * Verifies there is a path from @p col to the root of the collection tree
-     * and that that everything along that path belongs to the same resource.
+     * Verifies every collection has a valid parent belonging to the same
+     * resource and that there is a path from it to the root of the tree.
      */
-    void checkPathToRoot( const Collection &col );
+    void checkCollectionTree();
 
     /**
      * Look for items belonging to non-existing collections.
@@ -102,10 +143,23 @@ class StorageJanitor : public QObject
     void findOverlappingParts();
 
     /**
-     * Verify fs and db part state.
+     * Move external payload files from the flat layout of older versions
+     * into the directory hierarchy used by PartHelper::fileNameForPart().
+     */
+    void migrateExternalFiles();
+
+    /**
+     * Look for external parts whose file does not exist.
      */
     void verifyExternalParts();
 
+    /**
+     * Look for files in the external payload directory that are not
+     * referenced by any part and move them to lost+found. Files modified
+     * after @p checkStarted are skipped. Runs in its own thread.
+     */
+    void findUnreferencedExternalFiles( const QDateTime &checkStarted );
+
     /**
      * Look for dirty objects.
      */
@@ -119,9 +173,31 @@ class StorageJanitor : public QObject
      */
     void checkSizeTreshold();
 
+    /**
+     * Removes the entries of the expunge log that are older than
+     * Janitor/TombstoneRetentionDays (30 by default).
+     */
+    void pruneTombstones();
+
+    /**
+     * Removes all but the newest entry of the modification sequence log,
+     * the entries are only needed to allocate the sequences.
+     */
+    void pruneModificationSequenceLog();
+
+    /**
+     * Fully verifies the database schema, ignoring the cached schema
+     * fingerprint used at startup, and refreshes the fingerprint.
+     */
+    void verifySchema();
+
   private:
     QDBusConnection m_connection;
     qint64 m_lostFoundCollectionId;
+    QString m_checkpointFile;
+    mutable QMutex m_checkpointLock;
+    QMutex m_informationLock;
+    QStringList m_pendingInformation;
 };
 
 } // namespace Server
@@ -23,9 +23,9 @@
 
 #include "traceradaptor.h"
 
+#include "asynctracer.h"
 #include "dbustracer.h"
 #include "filetracer.h"
-#include "nulltracer.h"
 #include <libs/xdgbasedirs_p.h>
 #include <akstandarddirs.h>
 
@@ -37,8 +37,14 @@ using namespace Akonadi::Server;
 Tracer *Tracer::mSelf = 0;
 
 Tracer::Tracer()
-  : mTracerBackend( 0 )
+  : mTracer( new AsyncTracer )
+  , mEnabled( 0 )
 {
+  const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  mTracer->setSampling( settings.value( QLatin1String( "Debug/TraceSampling" ), 1 ).toInt() );
+  mTracer->setFilter( settings.value( QLatin1String( "Debug/TraceFilter" ) ).toStringList() );
+  mTracer->start( QThread::LowPriority );
+
   activateTracer( currentTracer() );
 
   new TracerAdaptor( this );
@@ -48,8 +54,11 @@ Tracer::Tracer()
 
 Tracer::~Tracer()
 {
-  delete mTracerBackend;
-  mTracerBackend = 0;
+  mEnabled.fetchAndStoreRelaxed( 0 );
+  // Other threads may have passed isEnabled() already and still record into
+  // mTracer, so it is only stopped and closes its backend, but never deleted
+  mTracer->stop();
+  mTracer->setBackend( 0 );
 }
 
 Tracer *Tracer::self()
@@ -61,39 +70,44 @@ Tracer *Tracer::self()
   return mSelf;
 }
 
+bool Tracer::isEnabled() const
+{
+  return const_cast<QAtomicInt &>( mEnabled ).fetchAndAddRelaxed( 0 );
+}
+
 void Tracer::beginConnection( const QString &identifier, const QString &msg )
 {
-  mMutex.lock();
-  mTracerBackend->beginConnection( identifier, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->beginConnection( identifier, msg );
+  }
 }
 
 void Tracer::endConnection( const QString &identifier, const QString &msg )
 {
-  mMutex.lock();
-  mTracerBackend->endConnection( identifier, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->endConnection( identifier, msg );
+  }
 }
 
 void Tracer::connectionInput( const QString &identifier, const QByteArray &msg )
 {
-  mMutex.lock();
-  mTracerBackend->connectionInput( identifier, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->connectionInput( identifier, msg );
+  }
 }
 
 void Tracer::connectionOutput( const QString &identifier, const QByteArray &msg )
 {
-  mMutex.lock();
-  mTracerBackend->connectionOutput( identifier, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->connectionOutput( identifier, msg );
+  }
 }
 
 void Tracer::signal( const QString &signalName, const QString &msg )
 {
-  mMutex.lock();
-  mTracerBackend->signal( signalName, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->signal( signalName, msg );
+  }
 }
 
 void Tracer::signal( const char *signalName, const QString &msg )
@@ -103,16 +117,16 @@ void Tracer::signal( const char *signalName, const QString &msg )
 
 void Tracer::warning( const QString &componentName, const QString &msg )
 {
-  mMutex.lock();
-  mTracerBackend->warning( componentName, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->warning( componentName, msg );
+  }
 }
 
 void Tracer::error( const QString &componentName, const QString &msg )
 {
-  mMutex.lock();
-  mTracerBackend->error( componentName, msg );
-  mMutex.unlock();
+  if ( isEnabled() ) {
+    mTracer->error( componentName, msg );
+  }
 }
 
 void Tracer::error( const char *componentName, const QString &msg )
@@ -130,21 +144,53 @@ QString Tracer::currentTracer() const
 void Tracer::activateTracer( const QString &type )
 {
   QMutexLocker locker( &mMutex );
-  delete mTracerBackend;
-  mTracerBackend = 0;
 
   QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
   settings.setValue( QLatin1String( "Debug/Tracer" ), type );
   settings.sync();
 
+  TracerInterface *backend = 0;
   if ( type == QLatin1String( "file" ) ) {
-    const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
     const QString file = settings.value( QLatin1String( "Debug/File" ), QLatin1String( "/dev/null" ) ).toString();
-    mTracerBackend = new FileTracer( file );
-  } else if ( type == QLatin1String( "null" ) ) {
-    mTracerBackend = new NullTracer();
-  } else {
-    mTracerBackend = new DBusTracer();
+    backend = new FileTracer( file );
+  } else if ( type != QLatin1String( "null" ) ) {
+    backend = new DBusTracer();
+  }
+
+  // Stop recording before the backend goes away, start after the new one is set
+  if ( !backend ) {
+    mEnabled.fetchAndStoreRelaxed( 0 );
+  }
+  mTracer->setBackend( backend );
+  if ( backend ) {
+    mEnabled.fetchAndStoreRelaxed( 1 );
   }
-  Q_ASSERT( mTracerBackend );
+}
+
+void Tracer::setSampling( int sampling )
+{
+  QMutexLocker locker( &mMutex );
+  mTracer->setSampling( sampling );
+
+  QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  settings.setValue( QLatin1String( "Debug/TraceSampling" ), mTracer->sampling() );
+}
+
+int Tracer::sampling() const
+{
+  return mTracer->sampling();
+}
+
+void Tracer::setFilter( const QStringList &filter )
+{
+  QMutexLocker locker( &mMutex );
+  mTracer->setFilter( filter );
+
+  QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+  settings.setValue( QLatin1String( "Debug/TraceFilter" ), filter );
+}
+
+QStringList Tracer::filter() const
+{
+  return mTracer->filter();
 }
@@ -21,18 +21,25 @@
 #define AKONADI_TRACER_H
 
 #include <QtCore/QObject>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
+#include <QtCore/QStringList>
 
 #include "tracerinterface.h"
 
 namespace Akonadi {
 namespace Server {
 
+class AsyncTracer;
+
 /**
  * The global tracer instance where all akonadi components can
  * send their tracing information to.
  *
  * The tracer will forward these information to the configured backends.
+ * Tracing information is buffered per thread and handed to the backend
+ * from a background thread (see AsyncTracer), so tracing does not block
+ * the calling thread.
  */
 class Tracer : public QObject, public TracerInterface
 {
@@ -127,12 +134,32 @@ class Tracer : public QObject, public TracerInterface
      */
     void activateTracer( const QString &type );
 
+    /**
+     * Returns whether a tracer other than the null tracer is active. Callers
+     * can use this to avoid assembling messages that would be discarded.
+     */
+    bool isEnabled() const;
+
+    /**
+     * Traces only every @p sampling th command of each connection.
+     */
+    void setSampling( int sampling );
+    int sampling() const;
+
+    /**
+     * Traces only connections whose session id contains one of the
+     * strings in @p filter. An empty filter traces all connections.
+     */
+    void setFilter( const QStringList &filter );
+    QStringList filter() const;
+
   private:
     Tracer();
 
     static Tracer *mSelf;
 
-    TracerInterface *mTracerBackend;
+    AsyncTracer *mTracer;
+    QAtomicInt mEnabled;
     mutable QMutex mMutex;
 };
 
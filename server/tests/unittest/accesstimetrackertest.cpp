@@ -0,0 +1,103 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <storage/accesstimetracker.h>
+#include <entities.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+class AccessTimeTrackerTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    AccessTimeTrackerTest()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~AccessTimeTrackerTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testFlush()
+    {
+        DbInitializer initializer;
+        initializer.createResource("akonadi_atime_resource_0");
+        const Collection collection = initializer.createCollection("atime");
+
+        const QDateTime old = QDateTime::currentDateTime().addDays(-1);
+        PimItem::List items;
+        for (int i = 0; i < 3; ++i) {
+            PimItem item = initializer.createItem(QByteArray("item" + QByteArray::number(i)).constData(), collection);
+            item.setAtime(old);
+            QVERIFY(item.update());
+            items << item;
+        }
+
+        QVERIFY(!AccessTimeTracker::instance());
+        AccessTimeTracker tracker;
+        QCOMPARE(AccessTimeTracker::instance(), &tracker);
+
+        tracker.recordAccess(QVector<qint64>() << items[0].id() << items[1].id());
+        tracker.recordAccess(QVector<qint64>() << items[0].id());
+        QCOMPARE(tracker.pendingCount(), 2);
+        QVERIFY(tracker.isPending(items[0].id()));
+        QVERIFY(tracker.isPending(items[1].id()));
+        QVERIFY(!tracker.isPending(items[2].id()));
+
+        // nothing is written before the flush
+        QVERIFY(PimItem::retrieveById(items[0].id()).atime() < old.addSecs(60));
+
+        QVERIFY(tracker.flush());
+        QCOMPARE(tracker.pendingCount(), 0);
+        QCOMPARE(tracker.writeTransactions(), 1);
+        QCOMPARE(tracker.writtenItems(), 2);
+
+        QVERIFY(PimItem::retrieveById(items[0].id()).atime() > old.addSecs(60));
+        QVERIFY(PimItem::retrieveById(items[1].id()).atime() > old.addSecs(60));
+        QVERIFY(PimItem::retrieveById(items[2].id()).atime() < old.addSecs(60));
+
+        // an empty flush doesn't write anything
+        QVERIFY(tracker.flush());
+        QCOMPARE(tracker.writeTransactions(), 1);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(AccessTimeTrackerTest)
+
+#include "accesstimetrackertest.moc"
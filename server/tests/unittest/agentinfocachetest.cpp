@@ -0,0 +1,280 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QVariantMap>
+
+#include <agentinfocache.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi::Server;
+
+#define FAKE_AGENTMANAGER_SERVICE "org.freedesktop.Akonadi.Test.FakeAgentManager"
+
+/**
+ * Serves the parts of the AgentManager interface of the control process
+ * that the AgentInfoCache uses, and counts the calls.
+ */
+class FakeAgentManager : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.Akonadi.AgentManager")
+
+public:
+    FakeAgentManager()
+        : calls(0)
+    {
+    }
+
+    void addInstance(const QString &identifier, const QString &type, bool online = true, int status = 0)
+    {
+        types.insert(identifier, type);
+        onlineStates.insert(identifier, online);
+        statuses.insert(identifier, status);
+    }
+
+    void removeInstance(const QString &identifier)
+    {
+        types.remove(identifier);
+        onlineStates.remove(identifier);
+        statuses.remove(identifier);
+    }
+
+    QHash<QString, QString> types;
+    QHash<QString, bool> onlineStates;
+    QHash<QString, int> statuses;
+    QSet<QString> localTypes;
+    QSet<QString> moveTypes;
+    int calls;
+
+public Q_SLOTS:
+    QStringList agentInstances()
+    {
+        ++calls;
+        return types.keys();
+    }
+
+    QString agentInstanceType(const QString &identifier)
+    {
+        ++calls;
+        return types.value(identifier);
+    }
+
+    QVariantMap agentCustomProperties(const QString &type)
+    {
+        ++calls;
+        QVariantMap properties;
+        if (localTypes.contains(type)) {
+            properties.insert(QLatin1String("HasLocalStorage"), true);
+        }
+        if (moveTypes.contains(type)) {
+            properties.insert(QLatin1String("MovesWithoutPayload"), true);
+        }
+        return properties;
+    }
+
+    bool agentInstanceOnline(const QString &identifier)
+    {
+        ++calls;
+        return onlineStates.value(identifier);
+    }
+
+    int agentInstanceStatus(const QString &identifier)
+    {
+        ++calls;
+        return statuses.value(identifier);
+    }
+
+Q_SIGNALS:
+    void agentTypeAdded(const QString &agentType);
+    void agentTypeRemoved(const QString &agentType);
+    void agentInstanceAdded(const QString &agentIdentifier);
+    void agentInstanceRemoved(const QString &agentIdentifier);
+    void agentInstanceStatusChanged(const QString &agentIdentifier, int status, const QString &message);
+    void agentInstanceOnlineChanged(const QString &agentIdentifier, bool state);
+};
+
+class AgentInfoCacheTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    FakeAgentManager mManager;
+    AgentInfoCache *mCache;
+
+    // The signals of the fake AgentManager take a round trip through the bus
+    template <typename Predicate>
+    bool waitFor(Predicate predicate)
+    {
+        for (int i = 0; i < 100 && !predicate(mCache); ++i) {
+            QTest::qWait(50);
+        }
+        return predicate(mCache);
+    }
+
+    struct IsOnline
+    {
+        IsOnline(const char *identifier, bool online)
+            : identifier(QLatin1String(identifier))
+            , online(online)
+        {
+        }
+        bool operator()(AgentInfoCache *cache) const
+        {
+            const AgentInfo info = cache->agentInfo(identifier);
+            return info.isValid() && info.online == online;
+        }
+        QString identifier;
+        bool online;
+    };
+
+    struct HasStatus
+    {
+        HasStatus(const char *identifier, int status)
+            : identifier(QLatin1String(identifier))
+            , status(status)
+        {
+        }
+        bool operator()(AgentInfoCache *cache) const
+        {
+            return cache->agentInfo(identifier).status == status;
+        }
+        QString identifier;
+        int status;
+    };
+
+    struct HasCount
+    {
+        HasCount(int count)
+            : count(count)
+        {
+        }
+        bool operator()(AgentInfoCache *cache) const
+        {
+            return cache->count() == count;
+        }
+        int count;
+    };
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mManager.localTypes.insert(QLatin1String("akonadi_maildir_resource"));
+        mManager.moveTypes.insert(QLatin1String("akonadi_imap_resource"));
+        mManager.addInstance(QLatin1String("akonadi_maildir_resource_0"), QLatin1String("akonadi_maildir_resource"));
+        mManager.addInstance(QLatin1String("akonadi_imap_resource_0"), QLatin1String("akonadi_imap_resource"), false);
+        mManager.addInstance(QLatin1String("akonadi_imap_resource_1"), QLatin1String("akonadi_imap_resource"), true,
+                             AgentInfo::NotConfigured);
+
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        QVERIFY(bus.registerObject(QLatin1String("/AgentManager"), &mManager,
+                                   QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals));
+        QVERIFY(bus.registerService(QLatin1String(FAKE_AGENTMANAGER_SERVICE)));
+
+        mCache = new AgentInfoCache(QLatin1String(FAKE_AGENTMANAGER_SERVICE), this);
+        QCOMPARE(AgentInfoCache::instance(), mCache);
+    }
+
+    void cleanupTestCase()
+    {
+        delete mCache;
+        QVERIFY(!AgentInfoCache::instance());
+        QDBusConnection::sessionBus().unregisterService(QLatin1String(FAKE_AGENTMANAGER_SERVICE));
+    }
+
+    void testPopulate()
+    {
+        QCOMPARE(mCache->count(), 3);
+
+        const AgentInfo maildir = mCache->agentInfo(QLatin1String("akonadi_maildir_resource_0"));
+        QVERIFY(maildir.isValid());
+        QCOMPARE(maildir.type, QLatin1String("akonadi_maildir_resource"));
+        QVERIFY(maildir.online);
+        QVERIFY(maildir.hasLocalStorage);
+        QVERIFY(!maildir.movesWithoutPayload);
+        QCOMPARE(maildir.status, static_cast<int>(AgentInfo::Idle));
+
+        const AgentInfo imap = mCache->agentInfo(QLatin1String("akonadi_imap_resource_0"));
+        QVERIFY(imap.isValid());
+        QVERIFY(!imap.online);
+        QVERIFY(!imap.hasLocalStorage);
+        QVERIFY(imap.movesWithoutPayload);
+
+        QCOMPARE(mCache->agentInfo(QLatin1String("akonadi_imap_resource_1")).status,
+                 static_cast<int>(AgentInfo::NotConfigured));
+    }
+
+    void testLookupsDontCallAgentManager()
+    {
+        const int calls = mManager.calls;
+        for (int i = 0; i < 1000; ++i) {
+            QVERIFY(mCache->agentInfo(QLatin1String("akonadi_maildir_resource_0")).hasLocalStorage);
+        }
+        QCOMPARE(mManager.calls, calls);
+    }
+
+    void testUnknownInstance()
+    {
+        QVERIFY(!mCache->agentInfo(QLatin1String("akonadi_search_resource")).isValid());
+        // the miss is looked up once in the background, but not again
+        QTest::qWait(100);
+        const int calls = mManager.calls;
+        QVERIFY(!mCache->agentInfo(QLatin1String("akonadi_search_resource")).isValid());
+        QTest::qWait(100);
+        QCOMPARE(mManager.calls, calls);
+    }
+
+    void testSignals()
+    {
+        mManager.agentInstanceOnlineChanged(QLatin1String("akonadi_imap_resource_0"), true);
+        QVERIFY(waitFor(IsOnline("akonadi_imap_resource_0", true)));
+
+        mManager.agentInstanceStatusChanged(QLatin1String("akonadi_imap_resource_0"), AgentInfo::Broken, QString());
+        QVERIFY(waitFor(HasStatus("akonadi_imap_resource_0", AgentInfo::Broken)));
+
+        mManager.addInstance(QLatin1String("akonadi_maildir_resource_1"), QLatin1String("akonadi_maildir_resource"));
+        mManager.agentInstanceAdded(QLatin1String("akonadi_maildir_resource_1"));
+        QVERIFY(waitFor(HasCount(4)));
+        QVERIFY(mCache->agentInfo(QLatin1String("akonadi_maildir_resource_1")).hasLocalStorage);
+
+        mManager.removeInstance(QLatin1String("akonadi_maildir_resource_1"));
+        mManager.agentInstanceRemoved(QLatin1String("akonadi_maildir_resource_1"));
+        QVERIFY(waitFor(HasCount(3)));
+        QVERIFY(!mCache->agentInfo(QLatin1String("akonadi_maildir_resource_1")).isValid());
+    }
+
+    void testInstanceAddedLater()
+    {
+        // An instance the cache missed the signal for is picked up by the lookup
+        mManager.addInstance(QLatin1String("akonadi_ical_resource_0"), QLatin1String("akonadi_ical_resource"));
+        QVERIFY(!mCache->agentInfo(QLatin1String("akonadi_ical_resource_0")).isValid());
+        QVERIFY(waitFor(IsOnline("akonadi_ical_resource_0", true)));
+    }
+};
+
+AKTEST_MAIN(AgentInfoCacheTest)
+
+#include "agentinfocachetest.moc"
@@ -0,0 +1,211 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QSettings>
+#include <QSignalSpy>
+
+#include "../../control/agentstartupscheduler.h"
+
+#include <akstandarddirs.h>
+#include <libs/xdgbasedirs_p.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+
+class FakeLauncher : public AgentLauncher
+{
+public:
+    bool startAgentInstance(const QString &identifier, const AgentType &type)
+    {
+        Q_UNUSED(type);
+        started << identifier;
+        return !failing.contains(identifier);
+    }
+
+    QStringList started;
+    QSet<QString> failing;
+};
+
+class AgentStartupSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static void configure(int maxConcurrent, int staggerInterval, int registrationTimeout = 30000,
+                          const QStringList &priorityAgents = QStringList())
+    {
+        QSettings settings(AkStandardDirs::agentConfigFile(XdgBaseDirs::WriteOnly), QSettings::IniFormat);
+        settings.beginGroup(QLatin1String("AgentStartup"));
+        settings.setValue(QLatin1String("MaxConcurrent"), maxConcurrent);
+        settings.setValue(QLatin1String("StaggerInterval"), staggerInterval);
+        settings.setValue(QLatin1String("RegistrationTimeout"), registrationTimeout);
+        settings.setValue(QLatin1String("PriorityAgents"), priorityAgents);
+        settings.endGroup();
+        settings.sync();
+    }
+
+    static AgentType agentType(const char *identifier, const QString &capability = QString())
+    {
+        AgentType type;
+        type.identifier = QLatin1String(identifier);
+        if (!capability.isEmpty()) {
+            type.capabilities << capability;
+        }
+        return type;
+    }
+
+    static void schedule(AgentStartupScheduler &scheduler, const AgentType &type, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            scheduler.schedule(QString::fromLatin1("%1_%2").arg(type.identifier).arg(i), type);
+        }
+    }
+
+private Q_SLOTS:
+    void testMaxConcurrent()
+    {
+        configure(2, 0);
+        FakeLauncher launcher;
+        AgentStartupScheduler scheduler(&launcher);
+        QSignalSpy finishedSpy(&scheduler, SIGNAL(startupFinished(qlonglong)));
+        QSignalSpy failedSpy(&scheduler, SIGNAL(startFailed(QString)));
+        QCOMPARE(scheduler.maximumConcurrentStarts(), 2);
+
+        launcher.failing << QLatin1String("agent_3");
+        schedule(scheduler, agentType("agent"), 5);
+        QCOMPARE(scheduler.pendingStarts(), 5);
+        QTest::qWait(0);
+        QCOMPARE(launcher.started, QStringList() << QLatin1String("agent_0") << QLatin1String("agent_1"));
+        QVERIFY(!scheduler.isQueued(QLatin1String("agent_0")));
+        QVERIFY(scheduler.isQueued(QLatin1String("agent_2")));
+        QCOMPARE(scheduler.pendingStarts(), 5);
+
+        // each registration frees a slot, a failed start doesn't take one
+        scheduler.agentRegistered(QLatin1String("agent_0"));
+        QCOMPARE(launcher.started.count(), 3);
+        scheduler.agentRegistered(QLatin1String("agent_1"));
+        QCOMPARE(launcher.started.count(), 5);
+        QCOMPARE(failedSpy.count(), 1);
+        QCOMPARE(failedSpy.first().first().toString(), QLatin1String("agent_3"));
+        QCOMPARE(scheduler.pendingStarts(), 2);
+        QCOMPARE(finishedSpy.count(), 0);
+
+        scheduler.agentRegistered(QLatin1String("agent_2"));
+        scheduler.agentRegistered(QLatin1String("agent_4"));
+        QCOMPARE(scheduler.pendingStarts(), 0);
+        QCOMPARE(finishedSpy.count(), 1);
+        QVERIFY(scheduler.startupDuration() >= 0);
+    }
+
+    void testPriorityOrder()
+    {
+        configure(1, 0, 30000, QStringList() << QLatin1String("res_2") << QLatin1String("special"));
+        FakeLauncher launcher;
+        AgentStartupScheduler scheduler(&launcher);
+
+        const AgentType resource = agentType("res", AgentType::CapabilityResource);
+        const AgentType agent = agentType("agent");
+        const AgentType preprocessor = agentType("preproc", AgentType::CapabilityPreprocessor);
+        const AgentType special = agentType("special", AgentType::CapabilityResource);
+        QCOMPARE(scheduler.priority(resource, QLatin1String("res_0")), AgentStartupScheduler::Low);
+        QCOMPARE(scheduler.priority(resource, QLatin1String("res_2")), AgentStartupScheduler::High);
+        QCOMPARE(scheduler.priority(agent, QLatin1String("agent_0")), AgentStartupScheduler::Normal);
+        QCOMPARE(scheduler.priority(preprocessor, QLatin1String("preproc_0")), AgentStartupScheduler::High);
+        QCOMPARE(scheduler.priority(special, QLatin1String("special_0")), AgentStartupScheduler::High);
+
+        schedule(scheduler, resource, 3);
+        schedule(scheduler, agent, 1);
+        schedule(scheduler, preprocessor, 1);
+        schedule(scheduler, special, 1);
+
+        QTest::qWait(0);
+        while (scheduler.pendingStarts() > 0) {
+            const int started = launcher.started.count();
+            scheduler.agentRegistered(launcher.started.last());
+            QCOMPARE(launcher.started.count(), started + (scheduler.pendingStarts() > 0 ? 1 : 0));
+        }
+
+        // within a priority, the instances keep the order they were scheduled in
+        QStringList expected;
+        expected << QLatin1String("res_2") << QLatin1String("preproc_0") << QLatin1String("special_0")
+                 << QLatin1String("agent_0")
+                 << QLatin1String("res_0") << QLatin1String("res_1");
+        QCOMPARE(launcher.started, expected);
+    }
+
+    void testStaggerInterval()
+    {
+        configure(10, 300);
+        FakeLauncher launcher;
+        AgentStartupScheduler scheduler(&launcher);
+        QCOMPARE(scheduler.staggerInterval(), 300);
+
+        QElapsedTimer time;
+        time.start();
+        schedule(scheduler, agentType("res", AgentType::CapabilityResource), 3);
+        schedule(scheduler, agentType("agent"), 2);
+        QTest::qWait(0);
+
+        // agents are not staggered, resources are launched one per interval
+        QCOMPARE(launcher.started, QStringList() << QLatin1String("agent_0") << QLatin1String("agent_1")
+                                                 << QLatin1String("res_0"));
+        QTRY_COMPARE(launcher.started.count(), 4);
+        QVERIFY(time.elapsed() >= 250);
+        QCOMPARE(launcher.started.last(), QLatin1String("res_1"));
+        QTRY_COMPARE(launcher.started.count(), 5);
+        QVERIFY(time.elapsed() >= 550);
+        QCOMPARE(launcher.started.last(), QLatin1String("res_2"));
+    }
+
+    void testRegistrationTimeout()
+    {
+        configure(1, 0, 1000);
+        FakeLauncher launcher;
+        AgentStartupScheduler scheduler(&launcher);
+        QCOMPARE(scheduler.registrationTimeout(), 1000);
+
+        schedule(scheduler, agentType("agent"), 2);
+        QTest::qWait(0);
+        QCOMPARE(launcher.started, QStringList() << QLatin1String("agent_0"));
+
+        // agent_0 never registers, it stops holding up agent_1 after the timeout
+        QElapsedTimer time;
+        time.start();
+        QTRY_COMPARE(launcher.started.count(), 2);
+        QVERIFY(time.elapsed() >= 900);
+
+        bool timedOut = false;
+        Q_FOREACH (const QString &line, scheduler.startupTimes()) {
+            if (line.startsWith(QLatin1String("agent_0 "))) {
+                timedOut = line.endsWith(QLatin1String(" timeout"));
+            }
+        }
+        QVERIFY(timedOut);
+    }
+};
+
+AKTEST_MAIN(AgentStartupSchedulerTest)
+
+#include "agentstartupschedulertest.moc"
@@ -0,0 +1,285 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QMutex>
+#include <QThread>
+
+#include <asynctracer.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi::Server;
+
+class RecordingTracer : public TracerInterface
+{
+public:
+    void beginConnection(const QString &identifier, const QString &msg)
+    {
+        add(QLatin1String("begin ") + identifier + QLatin1Char(' ') + msg);
+    }
+    void endConnection(const QString &identifier, const QString &msg)
+    {
+        add(QLatin1String("end ") + identifier + QLatin1Char(' ') + msg);
+    }
+    void connectionInput(const QString &identifier, const QByteArray &msg)
+    {
+        add(QLatin1String("input ") + identifier + QLatin1Char(' ') + QString::fromUtf8(msg));
+    }
+    void connectionOutput(const QString &identifier, const QByteArray &msg)
+    {
+        add(QLatin1String("output ") + identifier + QLatin1Char(' ') + QString::fromUtf8(msg));
+    }
+    void signal(const QString &signalName, const QString &msg)
+    {
+        add(QLatin1String("signal ") + signalName + QLatin1Char(' ') + msg);
+    }
+    void warning(const QString &componentName, const QString &msg)
+    {
+        add(QLatin1String("warning ") + componentName + QLatin1Char(' ') + msg);
+    }
+    void error(const QString &componentName, const QString &msg)
+    {
+        add(QLatin1String("error ") + componentName + QLatin1Char(' ') + msg);
+    }
+
+    QStringList lines()
+    {
+        QMutexLocker locker(&mLock);
+        return mLines;
+    }
+
+private:
+    void add(const QString &line)
+    {
+        QMutexLocker locker(&mLock);
+        mLines << line;
+    }
+
+    QMutex mLock;
+    QStringList mLines;
+};
+
+class TracingThread : public QThread
+{
+public:
+    TracingThread(AsyncTracer *tracer, const QString &identifier, int commands)
+        : QThread()
+        , mTracer(tracer)
+        , mIdentifier(identifier)
+        , mCommands(commands)
+    {
+    }
+
+protected:
+    void run()
+    {
+        for (int i = 0; i < mCommands; ++i) {
+            mTracer->connectionInput(mIdentifier, "1 NOOP");
+            mTracer->connectionOutput(mIdentifier, "1 OK NOOP completed");
+            if (i % 100 == 0) {
+                // let the drain thread catch up
+                msleep(1);
+            }
+        }
+    }
+
+private:
+    AsyncTracer *mTracer;
+    QString mIdentifier;
+    int mCommands;
+};
+
+class AsyncTracerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testBuffer()
+    {
+        TraceBuffer buffer;
+        TraceRecord record;
+        for (int i = 0; i < TraceBuffer::Capacity - 1; ++i) {
+            record.timestamp = i;
+            QCOMPARE(buffer.push(record), i + 1);
+        }
+        // one slot always stays free
+        QCOMPARE(buffer.push(record), -1);
+        QCOMPARE(buffer.takeDropped(), 1);
+        QCOMPARE(buffer.takeDropped(), 0);
+
+        QVector<TraceRecord> records;
+        QCOMPARE(buffer.takeAll(records), static_cast<int>(TraceBuffer::Capacity - 1));
+        QCOMPARE(records.first().timestamp, 0ll);
+        QCOMPARE(records.last().timestamp, static_cast<qint64>(TraceBuffer::Capacity - 2));
+
+        // wraps around
+        QCOMPARE(buffer.push(record), 1);
+        records.clear();
+        QCOMPARE(buffer.takeAll(records), 1);
+        QCOMPARE(buffer.takeAll(records), 0);
+    }
+
+    void testForwarding()
+    {
+        AsyncTracer tracer;
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+
+        tracer.beginConnection(QLatin1String("c1"), QString());
+        tracer.connectionInput(QLatin1String("c1"), "1 LOGIN foo\r\nliteral");
+        tracer.connectionOutput(QLatin1String("c1"), "1 OK User logged in");
+        tracer.warning(QLatin1String("Component"), QLatin1String("careful"));
+        tracer.endConnection(QLatin1String("c1"), QString());
+        // nothing is forwarded on the calling thread
+        QVERIFY(backend->lines().isEmpty());
+
+        tracer.flush();
+        QStringList expected;
+        expected << QLatin1String("begin c1 ")
+                 << QLatin1String("input c1 1 LOGIN foo\r\nliteral")
+                 << QLatin1String("output c1 1 OK User logged in")
+                 << QLatin1String("warning Component careful")
+                 << QLatin1String("end c1 ");
+        QCOMPARE(backend->lines(), expected);
+    }
+
+    void testSampling()
+    {
+        AsyncTracer tracer;
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+        tracer.setSampling(4);
+
+        for (int i = 0; i < 8; ++i) {
+            tracer.connectionInput(QLatin1String("c1"), QByteArray::number(i) + " NOOP");
+            tracer.connectionOutput(QLatin1String("c1"), QByteArray::number(i) + " OK");
+        }
+        tracer.error(QLatin1String("Component"), QLatin1String("failed"));
+        tracer.flush();
+
+        QStringList expected;
+        expected << QLatin1String("input c1 0 NOOP")
+                 << QLatin1String("output c1 0 OK")
+                 << QLatin1String("input c1 4 NOOP")
+                 << QLatin1String("output c1 4 OK")
+                 << QLatin1String("error Component failed");
+        QCOMPARE(backend->lines(), expected);
+    }
+
+    void testSamplingPerConnection()
+    {
+        AsyncTracer tracer;
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+        tracer.setSampling(2);
+
+        // connections served alternately by the same worker thread
+        for (int i = 0; i < 4; ++i) {
+            tracer.connectionInput(QLatin1String("c1"), QByteArray::number(i) + " NOOP");
+            tracer.connectionInput(QLatin1String("c2"), QByteArray::number(i) + " NOOP");
+            tracer.connectionOutput(QLatin1String("c1"), QByteArray::number(i) + " OK");
+            tracer.connectionOutput(QLatin1String("c2"), QByteArray::number(i) + " OK");
+        }
+        tracer.flush();
+
+        QStringList expected;
+        expected << QLatin1String("input c1 0 NOOP")
+                 << QLatin1String("input c2 0 NOOP")
+                 << QLatin1String("output c1 0 OK")
+                 << QLatin1String("output c2 0 OK")
+                 << QLatin1String("input c1 2 NOOP")
+                 << QLatin1String("input c2 2 NOOP")
+                 << QLatin1String("output c1 2 OK")
+                 << QLatin1String("output c2 2 OK");
+        QCOMPARE(backend->lines(), expected);
+    }
+
+    void testFilter()
+    {
+        AsyncTracer tracer;
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+        tracer.setFilter(QStringList() << QLatin1String("akonadi_imap_resource"));
+
+        tracer.connectionInput(QLatin1String("kmail (0x1)"), "1 NOOP");
+        tracer.connectionInput(QLatin1String("akonadi_imap_resource_0 (0x2)"), "2 NOOP");
+        tracer.signal(QLatin1String("notify"), QLatin1String("added"));
+        tracer.flush();
+
+        QStringList expected;
+        expected << QLatin1String("input akonadi_imap_resource_0 (0x2) 2 NOOP")
+                 << QLatin1String("signal notify added");
+        QCOMPARE(backend->lines(), expected);
+
+        tracer.setFilter(QStringList());
+        tracer.connectionInput(QLatin1String("kmail (0x1)"), "3 NOOP");
+        tracer.flush();
+        QCOMPARE(backend->lines().last(), QLatin1String("input kmail (0x1) 3 NOOP"));
+    }
+
+    void testThreads()
+    {
+        AsyncTracer tracer;
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+        tracer.start();
+
+        const int commands = 2000;
+        QList<TracingThread *> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads << new TracingThread(&tracer, QString::fromLatin1("c%1").arg(i), commands);
+        }
+        Q_FOREACH (TracingThread *thread, threads) {
+            thread->start();
+        }
+        Q_FOREACH (TracingThread *thread, threads) {
+            thread->wait();
+        }
+        qDeleteAll(threads);
+
+        tracer.stop();
+        int traced = 0;
+        Q_FOREACH (const QString &line, backend->lines()) {
+            if (!line.startsWith(QLatin1String("warning"))) {
+                ++traced;
+            }
+        }
+        QCOMPARE(traced + tracer.droppedRecords(), 4 * 2 * commands);
+    }
+
+    void testDisabled()
+    {
+        AsyncTracer tracer;
+        tracer.connectionInput(QLatin1String("c1"), "1 NOOP");
+        tracer.flush();
+
+        // records taken without a backend are discarded
+        RecordingTracer *backend = new RecordingTracer;
+        tracer.setBackend(backend);
+        tracer.flush();
+        QVERIFY(backend->lines().isEmpty());
+    }
+};
+
+AKTEST_MAIN(AsyncTracerTest)
+
+#include "asynctracertest.moc"
@@ -0,0 +1,171 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <aktest.h>
+#include <akdebug.h>
+#include <akstandarddirs.h>
+#include <libs/xdgbasedirs_p.h>
+#include "fakeakonadiserver.h"
+#include "storage/dbconfig.h"
+#include "storage/parthelper.h"
+
+#include <QObject>
+#include <QtTest/QTest>
+#include <QDebug>
+#include <QDirIterator>
+#include <QFile>
+#include <QSettings>
+#include <QTime>
+
+using namespace Akonadi::Server;
+
+/**
+ * Measures the throughput and the space saved by the payload compression
+ * used for parts stored in the database (General/PayloadCompression).
+ *
+ * Set AKONADI_ENRON_MAILDIR to the maildir created by
+ * tests/enron_email_dataset/run.sh to run it on real mails, otherwise a
+ * synthetic corpus is used.
+ */
+class CompressionBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    CompressionBenchmark()
+    {
+        // DbConfig reads the setting once, so it has to be in place before the server starts
+        qputenv("XDG_CONFIG_HOME", qPrintable(QString(FakeAkonadiServer::basePath() + QLatin1String("/config"))));
+        qputenv("AKONADI_INSTANCE", qPrintable(FakeAkonadiServer::instanceName()));
+        QSettings settings(AkStandardDirs::serverConfigFile(XdgBaseDirs::WriteOnly), QSettings::IniFormat);
+        settings.setValue(QLatin1String("General/PayloadCompression"), true);
+        settings.sync();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~CompressionBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    QList<QByteArray> mMails;
+    qint64 mTotalSize;
+
+    void loadMaildir(const QString &path, int maxMails)
+    {
+        QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext() && mMails.size() < maxMails) {
+            QFile file(it.next());
+            if (file.open(QIODevice::ReadOnly)) {
+                mMails << file.readAll();
+            }
+        }
+    }
+
+    void generateMails(int count)
+    {
+        const QByteArray header = "From: John Doe <john.doe@example.com>\r\n"
+                                  "To: Jane Doe <jane.doe@example.com>\r\n"
+                                  "Subject: Re: Quarterly figures\r\n"
+                                  "Content-Type: text/plain; charset=us-ascii\r\n\r\n";
+        const QByteArray words[] = { "energy ", "trading ", "contract ", "meeting ", "please ",
+                                     "forward ", "the ", "attached ", "report ", "thanks\r\n" };
+        qsrand(42);
+        for (int i = 0; i < count; ++i) {
+            QByteArray mail = header;
+            const int length = 200 + qrand() % 8000;
+            while (mail.size() < length) {
+                mail += words[qrand() % 10];
+            }
+            mMails << mail;
+        }
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const QByteArray maildir = qgetenv("AKONADI_ENRON_MAILDIR");
+        if (!maildir.isEmpty()) {
+            loadMaildir(QString::fromLocal8Bit(maildir), 10000);
+        }
+        if (mMails.isEmpty()) {
+            generateMails(200);
+        }
+        QVERIFY(DbConfig::configuredDatabase()->useCompression());
+
+        mTotalSize = 0;
+        Q_FOREACH (const QByteArray &mail, mMails) {
+            mTotalSize += mail.size();
+        }
+    }
+
+    void benchmarkCompress()
+    {
+        qint64 storedSize = 0;
+        int compressedCount = 0;
+        QTime time;
+        time.start();
+        QBENCHMARK_ONCE {
+            Q_FOREACH (const QByteArray &mail, mMails) {
+                bool compressed = false;
+                storedSize += PartHelper::compress(mail, &compressed).size();
+                compressedCount += compressed ? 1 : 0;
+            }
+        }
+        const int elapsed = qMax(1, time.elapsed());
+
+        qDebug() << mMails.size() << "mails," << compressedCount << "compressed," << mTotalSize / 1024 << "kB stored as"
+                 << storedSize / 1024 << "kB (" << storedSize * 100 / mTotalSize << "% ),"
+                 << mTotalSize * 1000 / elapsed / 1024 << "kB/s";
+        QVERIFY(storedSize < mTotalSize);
+    }
+
+    void benchmarkDecompress()
+    {
+        QList<QPair<QByteArray, bool> > stored;
+        Q_FOREACH (const QByteArray &mail, mMails) {
+            bool compressed = false;
+            const QByteArray data = PartHelper::compress(mail, &compressed);
+            stored << qMakePair(data, compressed);
+        }
+
+        QTime time;
+        time.start();
+        QBENCHMARK_ONCE {
+            for (int i = 0; i < stored.size(); ++i) {
+                QCOMPARE(PartHelper::translateData(stored[i].first, false, stored[i].second), mMails[i]);
+            }
+        }
+        const int elapsed = qMax(1, time.elapsed());
+
+        qDebug() << mTotalSize / 1024 << "kB decompressed at" << mTotalSize * 1000 / elapsed / 1024 << "kB/s";
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(CompressionBenchmark)
+
+#include "compressionbenchmark.moc"
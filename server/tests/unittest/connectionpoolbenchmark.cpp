@@ -0,0 +1,174 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QLocalServer>
+#include <QTime>
+
+#include <connectionthread.h>
+#include <connectionworkerpool.h>
+#include <response.h>
+
+#include "fakeakonadiserver.h"
+#include "fakeclient.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Serves the benchmark clients either with a thread per connection (like
+ * AkonadiServer does by default) or from a ConnectionWorkerPool.
+ */
+class BenchmarkServer : public QLocalServer
+{
+public:
+    BenchmarkServer(int workers)
+        : QLocalServer()
+        , mPool(workers > 0 ? new ConnectionWorkerPool(workers) : 0)
+    {
+    }
+
+    ~BenchmarkServer()
+    {
+        close();
+        if (mPool) {
+            mPool->quit();
+            delete mPool;
+        }
+        Q_FOREACH (const QPointer<ConnectionThread> &thread, mThreads) {
+            if (thread) {
+                thread->quit();
+                thread->wait();
+                delete thread;
+            }
+        }
+    }
+
+protected:
+    void incomingConnection(quintptr socketDescriptor)
+    {
+        if (mPool) {
+            mPool->addConnection(socketDescriptor);
+            return;
+        }
+
+        QPointer<ConnectionThread> thread = new ConnectionThread(socketDescriptor, this);
+        connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+        mThreads.append(thread);
+        thread->start();
+    }
+
+private:
+    ConnectionWorkerPool *mPool;
+    QVector<QPointer<ConnectionThread> > mThreads;
+};
+
+class ConnectionPoolBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConnectionPoolBenchmark()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~ConnectionPoolBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void benchmarkConnections_data()
+    {
+        QTest::addColumn<int>("workers");
+        QTest::addColumn<int>("clients");
+
+        // Set AKONADI_BENCHMARK_CLIENTS to a few hundred to see the difference
+        const int clients = qgetenv("AKONADI_BENCHMARK_CLIENTS").isEmpty() ? 20 : qgetenv("AKONADI_BENCHMARK_CLIENTS").toInt();
+        QTest::newRow("thread per connection") << 0 << clients;
+        QTest::newRow("4 workers") << 4 << clients;
+        QTest::newRow("8 workers") << 8 << clients;
+    }
+
+    void benchmarkConnections()
+    {
+        QFETCH(int, workers);
+        QFETCH(int, clients);
+
+        BenchmarkServer server(workers);
+        server.setMaxPendingConnections(clients);
+        QVERIFY(server.listen(FakeAkonadiServer::socketFile()));
+
+        QList<FakeClient*> fakeClients;
+        for (int i = 0; i < clients; ++i) {
+            FakeClient *client = new FakeClient;
+            client->setScenario(FakeAkonadiServer::defaultScenario());
+            fakeClients << client;
+        }
+
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            Q_FOREACH (FakeClient *client, fakeClients) {
+                client->start();
+            }
+
+            // BenchmarkServer accepts the connections from this thread's event
+            // loop before handing them to their threads, so keep it running
+            // instead of blocking in wait()
+            int finished = 0;
+            while (finished < clients && time.elapsed() < qMax(10 * 1000, clients * 100)) {
+                QTest::qWait(10);
+                finished = 0;
+                Q_FOREACH (FakeClient *client, fakeClients) {
+                    if (client->isFinished()) {
+                        ++finished;
+                    }
+                }
+            }
+            QCOMPARE(finished, clients);
+        }
+
+        qDebug() << clients << "clients served by"
+                 << (workers > 0 ? QString::number(workers) + QLatin1String(" workers") : QLatin1String("dedicated threads"))
+                 << "in" << time.elapsed() << "ms";
+
+        Q_FOREACH (FakeClient *client, fakeClients) {
+            QVERIFY(client->isScenarioDone());
+        }
+        qDeleteAll(fakeClients);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(ConnectionPoolBenchmark)
+
+#include "connectionpoolbenchmark.moc"
@@ -0,0 +1,178 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QFile>
+#include <QTime>
+
+#include <storage/countquerybuilder.h>
+#include <storage/dbconfig.h>
+#include <storage/parthelper.h>
+#include <storage/parttypehelper.h>
+#include <storage/selectquerybuilder.h>
+#include <response.h>
+#include <entities.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Copies items with internal and external payloads and checks that parts,
+ * flags and payload files of the copies match the originals.
+ */
+class CopyBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    CopyBenchmark()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~CopyBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    DbInitializer mResource;
+
+    static int countParts(const Collection &collection)
+    {
+        CountQueryBuilder qb(Part::tableName());
+        qb.addJoin(QueryBuilder::InnerJoin, PimItem::tableName(), Part::pimItemIdFullColumnName(), PimItem::idFullColumnName());
+        qb.addValueCondition(PimItem::collectionIdFullColumnName(), Query::Equals, collection.id());
+        return qb.exec() ? qb.result() : -1;
+    }
+
+    static int countFlags(const Collection &collection)
+    {
+        CountQueryBuilder qb(PimItemFlagRelation::tableName());
+        qb.addJoin(QueryBuilder::InnerJoin, PimItem::tableName(), PimItemFlagRelation::leftFullColumnName(), PimItem::idFullColumnName());
+        qb.addValueCondition(PimItem::collectionIdFullColumnName(), Query::Equals, collection.id());
+        return qb.exec() ? qb.result() : -1;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mResource.createResource("akonadi_copy_resource_0");
+    }
+
+    void benchmarkCopy_data()
+    {
+        QTest::addColumn<bool>("external");
+
+        QTest::newRow("internal payloads") << false;
+        QTest::newRow("external payloads") << true;
+    }
+
+    void benchmarkCopy()
+    {
+        QFETCH(bool, external);
+
+        const int itemCount = qgetenv("AKONADI_BENCHMARK_ITEMS").isEmpty() ? 100 : qgetenv("AKONADI_BENCHMARK_ITEMS").toInt();
+        const QByteArray name = QTest::currentDataTag();
+        const Collection source = mResource.createCollection(QByteArray(name + " source").constData());
+        const Collection destination = mResource.createCollection(QByteArray(name + " destination").constData());
+
+        const qint64 size = external ? DbConfig::configuredDatabase()->sizeThreshold() * 2 : 100;
+        const PartType partType = PartTypeHelper::fromFqName(QByteArray("PLD:RFC822"));
+        Flag flag = Flag::retrieveByName(QLatin1String("\\SEEN"));
+        if (!flag.isValid()) {
+            flag.setName(QLatin1String("\\SEEN"));
+            QVERIFY(flag.insert());
+        }
+
+        PimItem first, last;
+        for (int i = 0; i < itemCount; ++i) {
+            last = mResource.createItem(QByteArray(name + ' ' + QByteArray::number(i)).constData(), source);
+            if (i == 0) {
+                first = last;
+            }
+            Part part;
+            part.setPimItemId(last.id());
+            part.setPartType(partType);
+            part.setData(QByteArray(size, 'a' + i % 26));
+            part.setDatasize(size);
+            QVERIFY(PartHelper::insert(&part));
+            QCOMPARE(part.external(), external);
+            QVERIFY(last.addFlag(flag));
+        }
+
+        QList<QByteArray> scenario;
+        scenario << FakeAkonadiServer::defaultScenario()
+                 << "C: 2 COPY " + QByteArray::number(first.id()) + ':' + QByteArray::number(last.id())
+                    + ' ' + QByteArray::number(destination.id())
+                 << "S: 2 OK COPY complete";
+
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            FakeAkonadiServer::instance()->setScenario(scenario);
+            FakeAkonadiServer::instance()->runTest();
+        }
+
+        qDebug() << itemCount << "items with" << (external ? "external" : "internal") << "payloads copied in" << time.elapsed() << "ms";
+
+        QCOMPARE(countParts(destination), itemCount);
+        QCOMPARE(countFlags(destination), itemCount);
+
+        SelectQueryBuilder<PimItem> qb;
+        qb.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, destination.id());
+        QVERIFY(qb.exec());
+        const PimItem::List copies = qb.result();
+        QCOMPARE(copies.count(), itemCount);
+        Q_FOREACH (const PimItem &copy, copies) {
+            QVERIFY(copy.remoteId().isEmpty());
+            QVERIFY(copy.dirty());
+            const Part::List parts = copy.parts();
+            QCOMPARE(parts.count(), 1);
+            const Part part = parts.first();
+            QCOMPARE(part.external(), external);
+            QCOMPARE(part.datasize(), size);
+            QCOMPARE(PartHelper::translateData(part).size(), static_cast<int>(size));
+            if (external) {
+                // the copy has a file of its own
+                QVERIFY(part.data().contains(QByteArray::number(part.id())));
+                QVERIFY(QFile::exists(PartHelper::resolveAbsolutePath(part.data())));
+            }
+        }
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(CopyBenchmark)
+
+#include "copybenchmark.moc"
@@ -0,0 +1,343 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "datasetgenerator.h"
+
+#include <storage/datastore.h>
+#include <storage/notificationcollector.h>
+#include <storage/parttypehelper.h>
+
+#include <akdebug.h>
+
+#include <QDateTime>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Akonadi::Server;
+
+DatasetGenerator::Options::Options()
+    : resources(1)
+    , depth(3)
+    , childCollections(4)
+    , items(10000)
+    , mimeType(QLatin1String("message/rfc822"))
+    , tags(20)
+    , tagRatio(0.1)
+    , headerSize(512)
+    , payloadRatio(0.7)
+    , payloadSize(8192)
+    , maxPayloadSize(1024 * 1024)
+    , batchSize(5000)
+    , seed(1)
+{
+    flags << qMakePair(QString::fromLatin1("\\SEEN"), 0.85)
+          << qMakePair(QString::fromLatin1("\\ANSWERED"), 0.1)
+          << qMakePair(QString::fromLatin1("\\FLAGGED"), 0.03)
+          << qMakePair(QString::fromLatin1("$ATTACHMENT"), 0.2);
+}
+
+DatasetGenerator::DatasetGenerator(const Options &options)
+    : mOptions(options)
+    , mRandomState(options.seed ? options.seed : 1)
+    , mItemCount(0)
+    , mPartCount(0)
+    , mExternalPartCount(0)
+    , mPayloadBytes(0)
+{
+}
+
+Collection::List DatasetGenerator::collections() const
+{
+    return mCollections;
+}
+
+qint64 DatasetGenerator::itemCount() const
+{
+    return mItemCount;
+}
+
+qint64 DatasetGenerator::partCount() const
+{
+    return mPartCount;
+}
+
+qint64 DatasetGenerator::externalPartCount() const
+{
+    return mExternalPartCount;
+}
+
+qint64 DatasetGenerator::payloadBytes() const
+{
+    return mPayloadBytes;
+}
+
+quint32 DatasetGenerator::random()
+{
+    // xorshift32, so that the data does not depend on the platform's rand()
+    mRandomState ^= mRandomState << 13;
+    mRandomState ^= mRandomState >> 17;
+    mRandomState ^= mRandomState << 5;
+    return mRandomState;
+}
+
+double DatasetGenerator::randomReal()
+{
+    return random() / 4294967296.0;
+}
+
+int DatasetGenerator::pickCollection()
+{
+    const double value = randomReal() * mCollectionWeights.last();
+    const QVector<double>::const_iterator it = std::upper_bound(mCollectionWeights.constBegin(),
+                                                                mCollectionWeights.constEnd(), value);
+    return qMin<int>(it - mCollectionWeights.constBegin(), mCollections.count() - 1);
+}
+
+QByteArray DatasetGenerator::payload(qint64 item, int size) const
+{
+    // The headers make each payload unique, so external files are not deduplicated
+    QByteArray data = "Message-ID: <generated-" + QByteArray::number(item) + "@example.org>\n"
+                      "From: Sender " + QByteArray::number(item % 997) + " <sender@example.org>\n"
+                      "Subject: Generated message " + QByteArray::number(item) + "\n\n";
+    if (data.size() < size) {
+        data += mFiller.left(size - data.size());
+    }
+    return data;
+}
+
+bool DatasetGenerator::generate()
+{
+    if (!createCollections() || !createFlagsAndTags()) {
+        return false;
+    }
+    if (mCollections.isEmpty()) {
+        return true;
+    }
+
+    mHeaderType = PartTypeHelper::fromFqName(QLatin1String("PLD:ENVELOPE"));
+    mPayloadType = PartTypeHelper::fromFqName(QLatin1String("PLD:RFC822"));
+
+    const QByteArray line = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor.\n";
+    mFiller.reserve(qMax(mOptions.maxPayloadSize, mOptions.headerSize) + line.size());
+    while (mFiller.size() < qMax(mOptions.maxPayloadSize, mOptions.headerSize)) {
+        mFiller += line;
+    }
+
+    const int batchSize = qMax(1, mOptions.batchSize);
+    for (qint64 first = 0; first < mOptions.items; first += batchSize) {
+        if (!createItems(first, qMin<qint64>(batchSize, mOptions.items - first))) {
+            return false;
+        }
+        akDebug() << "Generated" << mItemCount << "of" << mOptions.items << "items";
+    }
+    return true;
+}
+
+bool DatasetGenerator::createCollections()
+{
+    DataStore *store = DataStore::self();
+
+    mMimeType = MimeType::retrieveByName(mOptions.mimeType);
+    if (!mMimeType.isValid()) {
+        qint64 id = -1;
+        if (!store->appendMimeType(mOptions.mimeType, &id)) {
+            return false;
+        }
+        mMimeType = MimeType::retrieveById(id);
+    }
+    const QStringList mimeTypes = QStringList() << QLatin1String("inode/directory") << mOptions.mimeType;
+
+    if (!store->beginTransaction()) {
+        return false;
+    }
+
+    // Numbered after the existing resources, so that a dataset can be added to
+    // an already populated database
+    const int firstResource = Resource::retrieveAll().count();
+    for (int r = 0; r < mOptions.resources; ++r) {
+        Resource resource;
+        resource.setName(QString::fromLatin1("akonadi_generated_resource_%1").arg(firstResource + r));
+        if (!resource.insert()) {
+            store->rollbackTransaction();
+            return false;
+        }
+
+        Collection root;
+        root.setName(resource.name());
+        root.setRemoteId(resource.name());
+        root.setResourceId(resource.id());
+        if (!store->appendCollection(root) || !store->appendMimeTypeForCollection(root.id(), mimeTypes)) {
+            store->rollbackTransaction();
+            return false;
+        }
+
+        Collection::List level;
+        level << root;
+        for (int d = 0; d < mOptions.depth; ++d) {
+            Collection::List nextLevel;
+            Q_FOREACH (const Collection &parent, level) {
+                for (int c = 0; c < mOptions.childCollections; ++c) {
+                    Collection collection;
+                    collection.setName(QString::fromLatin1("Folder %1").arg(c));
+                    collection.setRemoteId(parent.remoteId() + QLatin1Char('/') + collection.name());
+                    collection.setParentId(parent.id());
+                    collection.setResourceId(resource.id());
+                    if (!store->appendCollection(collection)
+                            || !store->appendMimeTypeForCollection(collection.id(), mimeTypes)) {
+                        store->rollbackTransaction();
+                        return false;
+                    }
+                    nextLevel << collection;
+                }
+            }
+            mCollections += nextLevel;
+            level = nextLevel;
+        }
+        // Items go into the root collection only if there are no others
+        if (mOptions.depth <= 0 || mOptions.childCollections <= 0) {
+            mCollections << root;
+        }
+    }
+
+    store->notificationCollector()->clear();
+    if (!store->commitTransaction()) {
+        return false;
+    }
+
+    // Zipf distribution: the n-th collection gets 1/n of the items of the first one
+    double sum = 0;
+    for (int i = 0; i < mCollections.count(); ++i) {
+        sum += 1.0 / (i + 1);
+        mCollectionWeights << sum;
+    }
+    return true;
+}
+
+bool DatasetGenerator::createFlagsAndTags()
+{
+    for (int i = 0; i < mOptions.flags.count(); ++i) {
+        Flag flag = Flag::retrieveByName(mOptions.flags.at(i).first);
+        if (!flag.isValid()) {
+            flag = Flag(mOptions.flags.at(i).first);
+            if (!flag.insert()) {
+                return false;
+            }
+        }
+        mFlags << flag;
+    }
+
+    const TagType tagType = TagType::retrieveByName(QLatin1String("PLAIN"));
+    for (int i = 0; i < mOptions.tags; ++i) {
+        Tag tag;
+        tag.setGid(QString::fromLatin1("generated-tag-%1").arg(i));
+        if (tagType.isValid()) {
+            tag.setTypeId(tagType.id());
+        }
+        if (!tag.insert()) {
+            return false;
+        }
+        mTags << tag;
+    }
+    return true;
+}
+
+bool DatasetGenerator::createItems(qint64 first, qint64 count)
+{
+    DataStore *store = DataStore::self();
+    if (!store->beginTransaction()) {
+        return false;
+    }
+
+    QVector<PimItem::List> flagged(mFlags.count());
+    QVector<PimItem::List> tagged(mTags.count());
+    const QDateTime now = QDateTime::currentDateTime();
+
+    for (qint64 i = first; i < first + count; ++i) {
+        const Collection &collection = mCollections.at(pickCollection());
+
+        QVector<Part> parts;
+        Part header;
+        header.setPartTypeId(mHeaderType.id());
+        header.setData(payload(i, mOptions.headerSize));
+        header.setDatasize(header.data().size());
+        parts << header;
+
+        if (randomReal() < mOptions.payloadRatio) {
+            const double size = -std::log(1.0 - randomReal()) * mOptions.payloadSize;
+            Part body;
+            body.setPartTypeId(mPayloadType.id());
+            body.setData(payload(i, qBound(256, static_cast<int>(size), mOptions.maxPayloadSize)));
+            body.setDatasize(body.data().size());
+            parts << body;
+        }
+
+        PimItem item;
+        qint64 size = 0;
+        Q_FOREACH (const Part &part, parts) {
+            size += part.datasize();
+        }
+        item.setSize(size);
+        // spread over the last five years
+        const QDateTime dateTime = now.addSecs(-static_cast<int>(random() % (5 * 365 * 24 * 3600)));
+        const QString remoteId = QString::number(i);
+        if (!store->appendPimItem(parts, mMimeType, collection, dateTime, remoteId, QString(), remoteId, item)) {
+            store->rollbackTransaction();
+            return false;
+        }
+
+        ++mItemCount;
+        Q_FOREACH (const Part &part, parts) {
+            ++mPartCount;
+            mPayloadBytes += part.datasize();
+            if (part.external()) {
+                ++mExternalPartCount;
+            }
+        }
+
+        for (int f = 0; f < mFlags.count(); ++f) {
+            if (randomReal() < mOptions.flags.at(f).second) {
+                flagged[f] << item;
+            }
+        }
+        if (!mTags.isEmpty() && randomReal() < mOptions.tagRatio) {
+            tagged[random() % mTags.count()] << item;
+        }
+    }
+
+    for (int f = 0; f < mFlags.count(); ++f) {
+        if (!flagged[f].isEmpty()
+                && !store->appendItemsFlags(flagged[f], QVector<Flag>() << mFlags[f], 0, false, Collection(), true)) {
+            store->rollbackTransaction();
+            return false;
+        }
+    }
+    for (int t = 0; t < mTags.count(); ++t) {
+        if (!tagged[t].isEmpty()
+                && !store->appendItemsTags(tagged[t], Tag::List() << mTags[t], 0, false, Collection(), true)) {
+            store->rollbackTransaction();
+            return false;
+        }
+    }
+
+    // Nobody listens to the generated changes
+    store->notificationCollector()->clear();
+    return store->commitTransaction();
+}
@@ -0,0 +1,116 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef AKONADI_SERVER_DATASETGENERATOR_H
+#define AKONADI_SERVER_DATASETGENERATOR_H
+
+#include <entities.h>
+
+#include <QPair>
+#include <QVector>
+
+namespace Akonadi
+{
+namespace Server
+{
+
+/**
+ * Fills the database with a synthetic, but realistically shaped store for
+ * benchmarking: a number of resources with a tree of collections each, items
+ * spread over the collections with a Zipf distribution (a few big folders,
+ * many small ones), flags and tags with configurable frequencies, and payloads
+ * of exponentially distributed size, so that both inline and external parts
+ * are created according to the configured size threshold.
+ *
+ * Everything is created through DataStore, in transactions of
+ * Options::batchSize items, without emitting change notifications. The output
+ * only depends on the options, so runs with the same seed are comparable.
+ */
+class DatasetGenerator
+{
+public:
+    struct Options
+    {
+        Options();
+
+        int resources;              ///< number of resources
+        int depth;                  ///< levels of collections below each resource's root collection
+        int childCollections;       ///< sub-collections of each collection
+        qint64 items;               ///< total number of items
+        QString mimeType;           ///< mimetype of the items
+        QVector<QPair<QString, double> > flags; ///< flags and the share of items that have them
+        int tags;                   ///< number of tags
+        double tagRatio;            ///< share of items with a tag
+        int headerSize;             ///< size of the PLD:ENVELOPE part every item has
+        double payloadRatio;        ///< share of items with a cached PLD:RFC822 part
+        int payloadSize;            ///< mean size of the PLD:RFC822 parts
+        int maxPayloadSize;         ///< maximum size of the PLD:RFC822 parts
+        int batchSize;              ///< items per transaction
+        quint32 seed;               ///< seed of the random numbers
+    };
+
+    explicit DatasetGenerator(const Options &options = Options());
+
+    /**
+     * Creates the dataset. Returns @c false if a database operation failed.
+     */
+    bool generate();
+
+    /**
+     * The generated collections that hold items.
+     */
+    Collection::List collections() const;
+
+    qint64 itemCount() const;
+    qint64 partCount() const;
+    qint64 externalPartCount() const;
+    qint64 payloadBytes() const;
+
+private:
+    bool createCollections();
+    bool createFlagsAndTags();
+    bool createItems(qint64 first, qint64 count);
+
+    quint32 random();
+    double randomReal();
+    int pickCollection();
+    QByteArray payload(qint64 item, int size) const;
+
+    Options mOptions;
+    quint32 mRandomState;
+
+    Collection::List mCollections;
+    QVector<double> mCollectionWeights;
+    QVector<Flag> mFlags;
+    Tag::List mTags;
+    MimeType mMimeType;
+    PartType mHeaderType;
+    PartType mPayloadType;
+    QByteArray mFiller;
+
+    qint64 mItemCount;
+    qint64 mPartCount;
+    qint64 mExternalPartCount;
+    qint64 mPayloadBytes;
+};
+
+}
+}
+
+#endif // AKONADI_SERVER_DATASETGENERATOR_H
@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "datasetgenerator.h"
+
+#include <storage/datastore.h>
+#include <storage/dbconfig.h>
+
+#include <akapplication.h>
+#include <akdebug.h>
+
+#include <QElapsedTimer>
+
+#include <iostream>
+
+using namespace Akonadi::Server;
+
+/*
+ * Fills the database of an Akonadi instance with a synthetic dataset, see
+ * DatasetGenerator. The Akonadi server of that instance must not be running.
+ */
+int main(int argc, char **argv)
+{
+    AkCoreApplication app(argc, argv);
+    app.setDescription(QLatin1String("Akonadi dataset generator\n"
+                                     "Fills the database of an Akonadi instance with synthetic data for benchmarking.\n"
+                                     "Stop the Akonadi server of the instance first.\n\n"
+                                     "Usage: akonadi-dataset-generator [options]"));
+
+    const DatasetGenerator::Options defaults;
+    boost::program_options::options_description options("Dataset options");
+    options.add_options()
+        ("resources", boost::program_options::value<int>()->default_value(defaults.resources), "number of resources")
+        ("depth", boost::program_options::value<int>()->default_value(defaults.depth), "levels of collections below each resource")
+        ("children", boost::program_options::value<int>()->default_value(defaults.childCollections), "sub-collections per collection")
+        ("items", boost::program_options::value<qint64>()->default_value(defaults.items), "total number of items")
+        ("tags", boost::program_options::value<int>()->default_value(defaults.tags), "number of tags")
+        ("tag-ratio", boost::program_options::value<double>()->default_value(defaults.tagRatio), "share of items with a tag")
+        ("seen-ratio", boost::program_options::value<double>()->default_value(defaults.flags.first().second), "share of items flagged as \\SEEN")
+        ("header-size", boost::program_options::value<int>()->default_value(defaults.headerSize), "size of the envelope part of each item")
+        ("payload-ratio", boost::program_options::value<double>()->default_value(defaults.payloadRatio), "share of items with a cached payload")
+        ("payload-size", boost::program_options::value<int>()->default_value(defaults.payloadSize), "mean payload size")
+        ("max-payload-size", boost::program_options::value<int>()->default_value(defaults.maxPayloadSize), "maximum payload size")
+        ("batch-size", boost::program_options::value<int>()->default_value(defaults.batchSize), "items per transaction")
+        ("seed", boost::program_options::value<quint32>()->default_value(defaults.seed), "seed of the random numbers");
+    app.addCommandLineOptions(options);
+    app.parseCommandLine();
+
+    const boost::program_options::variables_map &args = app.commandLineArguments();
+    DatasetGenerator::Options generatorOptions;
+    generatorOptions.resources = args["resources"].as<int>();
+    generatorOptions.depth = args["depth"].as<int>();
+    generatorOptions.childCollections = args["children"].as<int>();
+    generatorOptions.items = args["items"].as<qint64>();
+    generatorOptions.tags = args["tags"].as<int>();
+    generatorOptions.tagRatio = args["tag-ratio"].as<double>();
+    generatorOptions.flags.first().second = args["seen-ratio"].as<double>();
+    generatorOptions.headerSize = args["header-size"].as<int>();
+    generatorOptions.payloadRatio = args["payload-ratio"].as<double>();
+    generatorOptions.payloadSize = args["payload-size"].as<int>();
+    generatorOptions.maxPayloadSize = args["max-payload-size"].as<int>();
+    generatorOptions.batchSize = args["batch-size"].as<int>();
+    generatorOptions.seed = args["seed"].as<quint32>();
+
+    DbConfig *dbConfig = DbConfig::configuredDatabase();
+    if (dbConfig->useInternalServer()) {
+        dbConfig->startInternalServer();
+    }
+    dbConfig->setup();
+
+    int result = 0;
+    if (!DataStore::self()->init()) {
+        akError() << "Failed to initialize the database";
+        result = 1;
+    } else {
+        QElapsedTimer timer;
+        timer.start();
+        DatasetGenerator generator(generatorOptions);
+        if (!generator.generate()) {
+            akError() << "Failed to generate the dataset";
+            result = 1;
+        }
+        std::cout << generator.collections().count() << " collections, "
+                  << generator.itemCount() << " items, "
+                  << generator.partCount() << " parts ("
+                  << generator.externalPartCount() << " external), "
+                  << generator.payloadBytes() / 1024 / 1024 << " MiB of payload in "
+                  << timer.elapsed() / 1000 << " s" << std::endl;
+    }
+
+    DataStore::self()->close();
+    if (dbConfig->useInternalServer()) {
+        dbConfig->stopInternalServer();
+    }
+    return result;
+}
@@ -0,0 +1,126 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QSqlQuery>
+
+#include <storage/datastore.h>
+#include <storage/querybuilder.h>
+#include <storage/countquerybuilder.h>
+#include <entities.h>
+
+#include "datasetgenerator.h"
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+class DatasetGeneratorTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    DatasetGeneratorTest()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~DatasetGeneratorTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testGenerate()
+    {
+        DatasetGenerator::Options options;
+        options.resources = 2;
+        options.depth = 2;
+        options.childCollections = 3;
+        options.items = 500;
+        options.batchSize = 200;
+        options.payloadSize = 4096;
+
+        DatasetGenerator generator(options);
+        QVERIFY(generator.generate());
+
+        // two resources with 3 + 9 collections each
+        QCOMPARE(generator.collections().count(), 24);
+        QCOMPARE(generator.itemCount(), 500ll);
+
+        CountQueryBuilder items(PimItem::tableName());
+        QVERIFY(items.exec());
+        QCOMPARE(items.result(), 500);
+
+        CountQueryBuilder parts(Part::tableName());
+        QVERIFY(parts.exec());
+        QCOMPARE(static_cast<qint64>(parts.result()), generator.partCount());
+        // every item has a header, most have a payload, some of which exceed the size threshold
+        QVERIFY(generator.partCount() > 500);
+        QVERIFY(generator.externalPartCount() > 0);
+
+        // the first collections get most of the items
+        const Collection::List collections = generator.collections();
+        CountQueryBuilder first(PimItem::tableName());
+        first.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, collections.first().id());
+        QVERIFY(first.exec());
+        CountQueryBuilder last(PimItem::tableName());
+        last.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, collections.last().id());
+        QVERIFY(last.exec());
+        QVERIFY(first.result() > last.result());
+
+        const Flag seen = Flag::retrieveByName(QLatin1String("\\SEEN"));
+        QVERIFY(seen.isValid());
+        CountQueryBuilder flagged(PimItemFlagRelation::tableName());
+        flagged.addValueCondition(PimItemFlagRelation::rightColumn(), Query::Equals, seen.id());
+        QVERIFY(flagged.exec());
+        QVERIFY(flagged.result() > 350);
+        QVERIFY(flagged.result() < 500);
+    }
+
+    void testReproducible()
+    {
+        DatasetGenerator::Options options;
+        options.depth = 1;
+        options.items = 50;
+        options.tags = 0;
+
+        DatasetGenerator first(options);
+        QVERIFY(first.generate());
+        DatasetGenerator second(options);
+        QVERIFY(second.generate());
+
+        QCOMPARE(second.partCount(), first.partCount());
+        QCOMPARE(second.payloadBytes(), first.payloadBytes());
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(DatasetGeneratorTest)
+
+#include "datasetgeneratortest.moc"
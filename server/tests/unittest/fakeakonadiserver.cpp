@@ -223,6 +223,9 @@ bool FakeAkonadiServer::quit()
     // Stop listening for connections
     close();
 
+    // Flushes the pending unhides, so the database has to be still there
+    PreprocessorManager::done();
+
     const boost::program_options::variables_map options = AkApplication::instance()->commandLineArguments();
     if (!options.count("no-cleanup")) {
         deleteDirectory(basePath());
@@ -231,7 +234,6 @@ bool FakeAkonadiServer::quit()
         qDebug() << "Skipping clean up of" << basePath();
     }
 
-    PreprocessorManager::done();
     SearchManager::instance();
 
     if (mDataStore) {
@@ -275,12 +275,47 @@ bool FakeDataStore::unhidePimItem( PimItem &pimItem )
   return DataStore::unhidePimItem( pimItem );
 }
 
+bool FakeDataStore::unhidePimItems( const PimItem::List &items )
+{
+  mChanges.insert( QLatin1String( "unhidePimItems" ),
+                   QVariantList() << QVariant::fromValue( items ) );
+  return DataStore::unhidePimItems( items );
+}
+
 bool FakeDataStore::unhideAllPimItems()
 {
   mChanges.insert( QLatin1String( "unhideAllPimItems" ), QVariantList() );
   return DataStore::unhideAllPimItems();
 }
 
+bool FakeDataStore::updateItemsModSeq( const PimItem::List &items )
+{
+  mChanges.insert( QLatin1String( "updateItemsModSeq" ),
+                   QVariantList() << QVariant::fromValue( items ) );
+  return DataStore::updateItemsModSeq( items );
+}
+
+bool FakeDataStore::updateCollectionModSeq( const Collection &collection )
+{
+  mChanges.insert( QLatin1String( "updateCollectionModSeq" ),
+                   QVariantList() << QVariant::fromValue( collection ) );
+  return DataStore::updateCollectionModSeq( collection );
+}
+
+bool FakeDataStore::recordItemTombstones( const PimItem::List &items )
+{
+  mChanges.insert( QLatin1String( "recordItemTombstones" ),
+                   QVariantList() << QVariant::fromValue( items ) );
+  return DataStore::recordItemTombstones( items );
+}
+
+bool FakeDataStore::recordCollectionTombstones( const Collection &collection )
+{
+  mChanges.insert( QLatin1String( "recordCollectionTombstones" ),
+                   QVariantList() << QVariant::fromValue( collection ) );
+  return DataStore::recordCollectionTombstones( collection );
+}
+
 bool FakeDataStore::addCollectionAttribute( const Collection &col,
                                             const QByteArray &key,
                                             const QByteArray &value )
@@ -97,8 +97,14 @@ class FakeDataStore: public DataStore
     virtual bool cleanupPimItems( const PimItem::List &items );
 
     virtual bool unhidePimItem( PimItem &pimItem );
+    virtual bool unhidePimItems( const PimItem::List &items );
     virtual bool unhideAllPimItems();
 
+    virtual bool updateItemsModSeq( const PimItem::List &items );
+    virtual bool updateCollectionModSeq( const Collection &collection );
+    virtual bool recordItemTombstones( const PimItem::List &items );
+    virtual bool recordCollectionTombstones( const Collection &collection );
+
     virtual bool addCollectionAttribute( const Collection &col,
                                          const QByteArray &key,
                                          const QByteArray &value );
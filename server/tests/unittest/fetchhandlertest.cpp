@@ -27,6 +27,8 @@
 #include "akdebug.h"
 #include "entities.h"
 #include "dbinitializer.h"
+#include "storage/datastore.h"
+#include "storage/querybuilder.h"
 
 #include <QtTest/QTest>
 
@@ -64,6 +66,15 @@ public:
 
     QScopedPointer<DbInitializer> initializer;
 
+    // PimItem::update() never writes the modSeq column
+    static bool setModSeq(const PimItem &item, qint64 modSeq)
+    {
+        QueryBuilder qb(PimItem::tableName(), QueryBuilder::Update);
+        qb.setColumnValue(PimItem::modSeqColumn(), modSeq);
+        qb.addValueCondition(PimItem::idColumn(), Query::Equals, item.id());
+        return qb.exec();
+    }
+
 private Q_SLOTS:
     void testFetch_data()
     {
@@ -102,6 +113,145 @@ private Q_SLOTS:
         FakeAkonadiServer::instance()->runTest();
     }
 
+    void testFetchChangedSinceModSeq_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("root");
+        PimItem item1 = initializer->createItem("item1", col);
+        PimItem item2 = initializer->createItem("item2", col);
+        // Only allocated sequences are reported, higher ones are capped
+        const qint64 modSeq1 = DataStore::self()->nextModSeq();
+        const qint64 modSeq2 = DataStore::self()->nextModSeq();
+        QVERIFY(modSeq1 > 0);
+        QVERIFY(modSeq2 > modSeq1);
+        QVERIFY(setModSeq(item1, modSeq1));
+        QVERIFY(setModSeq(item2, modSeq2));
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        const QByteArray item1Response = "S: * " + QByteArray::number(item1.id()) + " FETCH (UID " + QByteArray::number(item1.id()) + " REV 0 MIMETYPE \"" + item1.mimeType().name().toLatin1() + "\" COLLECTIONID " + QByteArray::number(col.id()) + " MODSEQ " + QByteArray::number(modSeq1) + ")";
+        const QByteArray item2Response = "S: * " + QByteArray::number(item2.id()) + " FETCH (UID " + QByteArray::number(item2.id()) + " REV 0 MIMETYPE \"" + item2.mimeType().name().toLatin1() + "\" COLLECTIONID " + QByteArray::number(col.id()) + " MODSEQ " + QByteArray::number(modSeq2) + ")";
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " (UID COLLECTIONID MODSEQ)"
+            << item2Response
+            << item1Response
+            << "S: 2 OK FETCH completed";
+            QTest::newRow("modseq requested") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CHANGEDSINCE MODSEQ " + QByteArray::number(modSeq1) + " (UID COLLECTIONID)"
+            << item2Response
+            << "S: 2 OK FETCH completed";
+            QTest::newRow("changed since modseq") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CHANGEDSINCE MODSEQ " + QByteArray::number(modSeq2) + " (UID COLLECTIONID)"
+            << "S: 2 OK FETCH completed";
+            QTest::newRow("nothing changed since modseq") << scenario;
+        }
+    }
+
+    void testFetchChangedSinceModSeq()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
+    void testFetchChangedSinceModSeqAfterStore_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("root");
+        PimItem item1 = initializer->createItem("item1", col);
+        PimItem item2 = initializer->createItem("item2", col);
+        QCOMPARE(item1.modSeq(), static_cast<qint64>(0));
+        QCOMPARE(item2.modSeq(), static_cast<qint64>(0));
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            // STORE writes the item after the flag change bumped its modSeq,
+            // that must not write the old modSeq back
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 UID STORE " + QByteArray::number(item1.id()) + " NOREV (+FLAGS.SILENT (\\SEEN))"
+            << "S: IGNORE 1"
+            << "C: 3 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CHANGEDSINCE MODSEQ 0 (UID COLLECTIONID)"
+            << "S: * " + QByteArray::number(item1.id()) + " FETCH (UID " + QByteArray::number(item1.id()) + " REV 1 MIMETYPE \"" + item1.mimeType().name().toLatin1() + "\" COLLECTIONID " + QByteArray::number(col.id()) + ")"
+            << "S: 3 OK FETCH completed";
+            QTest::newRow("flags stored") << scenario;
+        }
+    }
+
+    void testFetchChangedSinceModSeqAfterStore()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
+    void testFetchVanished_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("root");
+        PimItem item1 = initializer->createItem("item1", col);
+        PimItem item2 = initializer->createItem("item2", col);
+        PimItem item3 = initializer->createItem("item3", col);
+
+        const qint64 modSeq = DataStore::self()->nextModSeq();
+        QVERIFY(modSeq > 0);
+        QVERIFY(DataStore::self()->cleanupPimItems(PimItem::List() << item1 << item2));
+
+        // the expunge log has been pruned up to modSeq
+        QueryBuilder qb(ModificationSequence::tableName(), QueryBuilder::Update);
+        qb.setColumnValue(ModificationSequence::prunedModSeqColumn(), modSeq);
+        QVERIFY(qb.exec());
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CHANGEDSINCE MODSEQ " + QByteArray::number(modSeq) + " VANISHED (UID COLLECTIONID)"
+            << "S: * VANISHED " + QByteArray::number(item1.id()) + ":" + QByteArray::number(item2.id())
+            << "S: 2 OK FETCH completed";
+            QTest::newRow("vanished items") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CHANGEDSINCE MODSEQ " + QByteArray::number(modSeq - 1) + " VANISHED (UID COLLECTIONID)"
+            << "S: 2 NO The expunge log does not reach back to the requested modification sequence, a full resync is required";
+            QTest::newRow("pruned expunge log") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " VANISHED (UID COLLECTIONID)"
+            << "S: 2 NO VANISHED requires CHANGEDSINCE MODSEQ and a collection";
+            QTest::newRow("vanished without modseq") << scenario;
+        }
+    }
+
+    void testFetchVanished()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
     void testFetchByTag_data()
     {
         initializer.reset(new DbInitializer);
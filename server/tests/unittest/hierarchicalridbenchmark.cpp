@@ -0,0 +1,183 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QTime>
+
+#include <storage/collectionqueryhelper.h>
+#include <storage/collectionridcache.h>
+#include <storage/datastore.h>
+#include <storage/notificationcollector.h>
+#include <handler.h>
+#include <response.h>
+#include <entities.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Resolves hierarchical remote identifiers of deeply nested collections, like
+ * the folder trees of IMAP resources, with a cold and a warm cache.
+ */
+class HierarchicalRidBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    HierarchicalRidBenchmark()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~HierarchicalRidBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    DbInitializer mDbInitializer;
+    Resource mResource;
+    QVector<Collection> mTree;
+
+    // Deepest collection first, like the chains sent by the resources
+    QStringList ridChain(int depth) const
+    {
+        QStringList chain;
+        for (int i = depth - 1; i >= 0; --i) {
+            chain << mTree.at(i).remoteId();
+        }
+        chain << QString();
+        return chain;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mResource = mDbInitializer.createResource("akonadi_hrid_resource_0");
+        Collection parent;
+        for (int i = 0; i < 40; ++i) {
+            parent = mDbInitializer.createCollection(QByteArray("level " + QByteArray::number(i)).constData(), parent);
+            mTree << parent;
+        }
+        // a sibling with the same remote identifier in another parent
+        mDbInitializer.createCollection("level 2", mTree.at(0));
+    }
+
+    void testResolve_data()
+    {
+        QTest::addColumn<int>("depth");
+
+        QTest::newRow("top-level") << 1;
+        QTest::newRow("depth 3") << 3;
+        QTest::newRow("depth 32") << 32;
+        QTest::newRow("depth 40") << 40;
+    }
+
+    void testResolve()
+    {
+        QFETCH(int, depth);
+
+        CollectionRidCache::instance()->clear();
+        const Collection cold = CollectionQueryHelper::resolveHierarchicalRID(ridChain(depth), mResource.id());
+        QCOMPARE(cold.id(), mTree.at(depth - 1).id());
+        QCOMPARE(CollectionRidCache::instance()->count(), depth);
+
+        const Collection warm = CollectionQueryHelper::resolveHierarchicalRID(ridChain(depth), mResource.id());
+        QCOMPARE(warm.id(), cold.id());
+    }
+
+    void testUnknownRid()
+    {
+        QStringList chain = ridChain(5);
+        chain[1] = QLatin1String("does not exist");
+        bool thrown = false;
+        try {
+            CollectionQueryHelper::resolveHierarchicalRID(chain, mResource.id());
+        } catch (const HandlerException &) {
+            thrown = true;
+        }
+        QVERIFY(thrown);
+    }
+
+    void testInvalidation()
+    {
+        CollectionRidCache::instance()->clear();
+        CollectionQueryHelper::resolveHierarchicalRID(ridChain(10), mResource.id());
+
+        Collection col = mTree.at(4);
+        col.setRemoteId(QLatin1String("renamed"));
+        QVERIFY(col.update());
+        DataStore::self()->notificationCollector()->collectionChanged(col, QList<QByteArray>() << "REMOTEID");
+        QCOMPARE(CollectionRidCache::instance()->lookup(mResource.id(), mTree.at(3).id(), QLatin1String("level 4")),
+                 static_cast<Collection::Id>(-1));
+
+        const QStringList oldChain = ridChain(10);
+        mTree[4] = col;
+        QCOMPARE(CollectionQueryHelper::resolveHierarchicalRID(ridChain(10), mResource.id()).id(), mTree.at(9).id());
+        bool thrown = false;
+        try {
+            CollectionQueryHelper::resolveHierarchicalRID(oldChain, mResource.id());
+        } catch (const HandlerException &) {
+            thrown = true;
+        }
+        QVERIFY(thrown);
+    }
+
+    void benchmarkResolve_data()
+    {
+        QTest::addColumn<bool>("cached");
+
+        QTest::newRow("cold") << false;
+        QTest::newRow("warm") << true;
+    }
+
+    void benchmarkResolve()
+    {
+        QFETCH(bool, cached);
+
+        const QStringList chain = ridChain(mTree.count());
+        CollectionQueryHelper::resolveHierarchicalRID(chain, mResource.id());
+
+        QBENCHMARK {
+            if (!cached) {
+                CollectionRidCache::instance()->clear();
+            }
+            CollectionQueryHelper::resolveHierarchicalRID(chain, mResource.id());
+        }
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(HierarchicalRidBenchmark)
+
+#include "hierarchicalridbenchmark.moc"
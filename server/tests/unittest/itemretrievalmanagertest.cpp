@@ -0,0 +1,272 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusMessage>
+#include <QSemaphore>
+#include <QThread>
+
+#include <storage/itemretrievalmanager.h>
+#include <storage/itemretrievalrequest.h>
+
+#include <akdbus.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi::Server;
+
+#define FAKE_RESOURCE "akonadi_fake_resource_0"
+
+/**
+ * A resource that holds back the reply to every item delivery request until
+ * the test lets it deliver, so that the test controls when the next request
+ * is taken from the queue.
+ */
+class FakeResource : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.Akonadi.Resource")
+
+public:
+    int pendingCount() const
+    {
+        return mPending.count();
+    }
+
+    qint64 deliverNext()
+    {
+        const QPair<qint64, QDBusMessage> pending = mPending.takeFirst();
+        QDBusConnection::sessionBus().send(pending.second.createReply(QString()));
+        return pending.first;
+    }
+
+public Q_SLOTS:
+    QString requestItemDeliveryV2(qlonglong uid, const QString &remoteId, const QString &mimeType,
+                                  const QStringList &parts)
+    {
+        Q_UNUSED(remoteId);
+        Q_UNUSED(mimeType);
+        Q_UNUSED(parts);
+        setDelayedReply(true);
+        mPending.append(qMakePair(static_cast<qint64>(uid), message()));
+        return QString();
+    }
+
+private:
+    QList<QPair<qint64, QDBusMessage> > mPending;
+};
+
+/**
+ * Runs an ItemRetrievalManager like ItemRetrievalThread does.
+ */
+class RetrievalThread : public QThread
+{
+public:
+    RetrievalThread()
+        : QThread()
+        , mManager(0)
+    {
+    }
+
+    ItemRetrievalManager *startManager()
+    {
+        start();
+        mStarted.acquire();
+        return mManager;
+    }
+
+protected:
+    void run()
+    {
+        mManager = new ItemRetrievalManager();
+        mStarted.release();
+        exec();
+        delete mManager;
+    }
+
+private:
+    ItemRetrievalManager *mManager;
+    QSemaphore mStarted;
+};
+
+/**
+ * Requests an item from a connection thread, which blocks until the item
+ * has been delivered.
+ */
+class RequestThread : public QThread
+{
+public:
+    RequestThread(ItemRetrievalManager *manager, qint64 id, ItemRetrievalRequest::Priority priority)
+        : QThread()
+        , mManager(manager)
+        , mId(id)
+        , mPriority(priority)
+    {
+    }
+
+protected:
+    void run()
+    {
+        ItemRetrievalRequest *request = new ItemRetrievalRequest();
+        request->id = mId;
+        request->remoteId = QByteArray::number(mId);
+        request->mimeType = "application/octet-stream";
+        request->resourceId = QLatin1String(FAKE_RESOURCE);
+        request->parts << QLatin1String("RFC822");
+        request->priority = mPriority;
+        try {
+            mManager->requestItemDelivery(request);
+        } catch (const ItemRetrieverException &e) {
+            qWarning() << "Request for item" << mId << "failed:" << e.what();
+        }
+    }
+
+private:
+    ItemRetrievalManager *mManager;
+    qint64 mId;
+    ItemRetrievalRequest::Priority mPriority;
+};
+
+class ItemRetrievalManagerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    FakeResource mResource;
+    RetrievalThread mRetrievalThread;
+    ItemRetrievalManager *mManager;
+    QList<RequestThread *> mRequests;
+
+    void request(qint64 id, ItemRetrievalRequest::Priority priority)
+    {
+        RequestThread *thread = new RequestThread(mManager, id, priority);
+        mRequests << thread;
+        thread->start();
+    }
+
+    bool waitForResource()
+    {
+        for (int i = 0; i < 100 && mResource.pendingCount() == 0; ++i) {
+            QTest::qWait(20);
+        }
+        return mResource.pendingCount() > 0;
+    }
+
+    bool waitForQueued(ItemRetrievalRequest::Priority priority, int count)
+    {
+        for (int i = 0; i < 100 && mManager->statistics(priority).queued != count; ++i) {
+            QTest::qWait(20);
+        }
+        return mManager->statistics(priority).queued == count;
+    }
+
+    // Delivers the requests in the order the manager sends them
+    QList<qint64> deliverAll()
+    {
+        QList<qint64> delivered;
+        while (waitForResource()) {
+            delivered << mResource.deliverNext();
+        }
+        Q_FOREACH (RequestThread *thread, mRequests) {
+            thread->wait();
+        }
+        qDeleteAll(mRequests);
+        mRequests.clear();
+        return delivered;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        QVERIFY(bus.registerObject(QLatin1String("/"), &mResource, QDBusConnection::ExportAllSlots));
+        QVERIFY(bus.registerService(AkDBus::agentServiceName(QLatin1String(FAKE_RESOURCE), AkDBus::Resource)));
+
+        mManager = mRetrievalThread.startManager();
+        QVERIFY(mManager);
+    }
+
+    void cleanupTestCase()
+    {
+        mRetrievalThread.quit();
+        mRetrievalThread.wait();
+        QDBusConnection::sessionBus().unregisterService(AkDBus::agentServiceName(QLatin1String(FAKE_RESOURCE), AkDBus::Resource));
+    }
+
+    void testPriorities()
+    {
+        mManager->setAgingInterval(60 * 1000);
+
+        // keeps the resource busy while the others are queued
+        request(1, ItemRetrievalRequest::Bulk);
+        QVERIFY(waitForResource());
+
+        request(2, ItemRetrievalRequest::Bulk);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Bulk, 1));
+        request(3, ItemRetrievalRequest::Bulk);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Bulk, 2));
+        request(10, ItemRetrievalRequest::Normal);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Normal, 1));
+        request(20, ItemRetrievalRequest::Interactive);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Interactive, 1));
+
+        QCOMPARE(deliverAll(), QList<qint64>() << 1 << 20 << 10 << 2 << 3);
+        QCOMPARE(mManager->statistics(ItemRetrievalRequest::Bulk).queued, 0);
+    }
+
+    void testAging()
+    {
+        mManager->setAgingInterval(100);
+
+        request(30, ItemRetrievalRequest::Bulk);
+        QVERIFY(waitForResource());
+
+        // raised by more than two levels before the interactive request arrives
+        request(31, ItemRetrievalRequest::Bulk);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Bulk, 1));
+        QTest::qWait(350);
+        request(40, ItemRetrievalRequest::Interactive);
+        QVERIFY(waitForQueued(ItemRetrievalRequest::Interactive, 1));
+
+        QCOMPARE(deliverAll(), QList<qint64>() << 30 << 31 << 40);
+    }
+
+    void testStatistics()
+    {
+        const ItemRetrievalManager::PriorityStatistics bulk = mManager->statistics(ItemRetrievalRequest::Bulk);
+        QCOMPARE(bulk.queued, 0);
+        QCOMPARE(bulk.processed, static_cast<qint64>(5));
+        QVERIFY(bulk.maxWaitTime >= 350);
+        QVERIFY(bulk.totalWaitTime >= bulk.maxWaitTime);
+
+        const ItemRetrievalManager::PriorityStatistics interactive = mManager->statistics(ItemRetrievalRequest::Interactive);
+        QCOMPARE(interactive.queued, 0);
+        QCOMPARE(interactive.processed, static_cast<qint64>(2));
+
+        QCOMPARE(mManager->statistics(ItemRetrievalRequest::Normal).processed, static_cast<qint64>(1));
+    }
+};
+
+AKTEST_MAIN(ItemRetrievalManagerTest)
+
+#include "itemretrievalmanagertest.moc"
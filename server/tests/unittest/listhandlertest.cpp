@@ -28,7 +28,9 @@
 #include "akdebug.h"
 #include "entities.h"
 #include "dbinitializer.h"
+#include <storage/datastore.h>
 #include <storage/storagedebugger.h>
+#include <storage/querybuilder.h>
 
 #include <QtTest/QTest>
 
@@ -76,6 +78,16 @@ public:
     }
 
     QScopedPointer<DbInitializer> initializer;
+
+    // Collection::update() never writes the modSeq column
+    static bool setModSeq(const Collection &col, qint64 modSeq)
+    {
+        QueryBuilder qb(Collection::tableName(), QueryBuilder::Update);
+        qb.setColumnValue(Collection::modSeqColumn(), modSeq);
+        qb.addValueCondition(Collection::idColumn(), Query::Equals, col.id());
+        return qb.exec();
+    }
+
 private Q_SLOTS:
 
     void testList_data()
@@ -171,6 +183,60 @@ private Q_SLOTS:
         FakeAkonadiServer::instance()->runTest();
     }
 
+    void testListChangedSince_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col1 = initializer->createCollection("col1");
+        Collection col2 = initializer->createCollection("col2", col1);
+        Collection col3 = initializer->createCollection("col3", col2);
+        // Only allocated sequences are reported, higher ones are capped
+        const qint64 modSeq1 = DataStore::self()->nextModSeq();
+        const qint64 modSeq3 = DataStore::self()->nextModSeq();
+        QVERIFY(modSeq1 > 0);
+        QVERIFY(modSeq3 > modSeq1);
+        QVERIFY(setModSeq(col1, modSeq1));
+        QVERIFY(setModSeq(col3, modSeq3));
+        const QByteArray col1Response = initializer->listResponse(col1).replace(" VIRTUAL 0 ", " VIRTUAL 0 MODSEQ " + QByteArray::number(modSeq1) + ' ');
+        const QByteArray col3Response = initializer->listResponse(col3).replace(" VIRTUAL 0 ", " VIRTUAL 0 MODSEQ " + QByteArray::number(modSeq3) + ' ');
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                     << "C: 2 LIST 0 INF (CHANGEDSINCE " + QByteArray::number(modSeq1 - 1) + ") ()"
+                     << col1Response
+                     << col3Response
+                     << "S: 2 OK List completed";
+            QTest::newRow("recursive list changed since") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                     << "C: 2 LIST " + QByteArray::number(col1.id()) + " INF (CHANGEDSINCE " + QByteArray::number(modSeq1) + ") ()"
+                     << col3Response
+                     << "S: 2 OK List completed";
+            QTest::newRow("changed since does not complete the tree") << scenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                     << "C: 2 LIST " + QByteArray::number(col1.id()) + " 1 () (MODSEQ true)"
+                     << initializer->listResponse(col2).replace(" VIRTUAL 0 ", " VIRTUAL 0 MODSEQ 0 ")
+                     << "S: 2 OK List completed";
+            QTest::newRow("list with modseq") << scenario;
+        }
+    }
+
+    void testListChangedSince()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
     void testListFiltered_data()
     {
         initializer.reset(new DbInitializer);
@@ -0,0 +1,261 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QSemaphore>
+#include <QSignalSpy>
+#include <QThread>
+#include <QTime>
+
+#include <agentinfocache.h>
+#include <storage/countquerybuilder.h>
+#include <storage/itemretrievalmanager.h>
+#include <response.h>
+#include <entities.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+#define FAKE_AGENTMANAGER_SERVICE "org.freedesktop.Akonadi.Test.MoveBenchmarkAgentManager"
+
+/**
+ * Serves the agent instances of the benchmark to the AgentInfoCache, with
+ * the agent types in movingTypes declaring MovesWithoutPayload.
+ */
+class FakeAgentManager : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.Akonadi.AgentManager")
+
+public:
+    QStringList movingTypes;
+
+public Q_SLOTS:
+    QStringList agentInstances()
+    {
+        return QStringList() << QLatin1String("akonadi_move_resource_0") << QLatin1String("akonadi_other_resource_0");
+    }
+
+    QString agentInstanceType(const QString &identifier)
+    {
+        return identifier.left(identifier.lastIndexOf(QLatin1Char('_')));
+    }
+
+    QVariantMap agentCustomProperties(const QString &type)
+    {
+        QVariantMap properties;
+        if (movingTypes.contains(type)) {
+            properties.insert(QLatin1String("MovesWithoutPayload"), true);
+        }
+        return properties;
+    }
+
+    bool agentInstanceOnline(const QString &identifier)
+    {
+        Q_UNUSED(identifier);
+        return true;
+    }
+
+    int agentInstanceStatus(const QString &identifier)
+    {
+        Q_UNUSED(identifier);
+        return 0;
+    }
+};
+
+/**
+ * Runs an ItemRetrievalManager like ItemRetrievalThread does. There are no
+ * resources to deliver the items, so every request fails.
+ */
+class RetrievalThread : public QThread
+{
+public:
+    RetrievalThread()
+        : QThread()
+        , mManager(0)
+    {
+    }
+
+    ItemRetrievalManager *startManager()
+    {
+        start();
+        mStarted.acquire();
+        return mManager;
+    }
+
+protected:
+    void run()
+    {
+        mManager = new ItemRetrievalManager();
+        mStarted.release();
+        exec();
+        delete mManager;
+    }
+
+private:
+    ItemRetrievalManager *mManager;
+    QSemaphore mStarted;
+};
+
+/**
+ * Moves items without cached payload within a resource and to another
+ * resource and counts the item retrieval requests this causes.
+ */
+class MoveBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    MoveBenchmark()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~MoveBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    DbInitializer mFirstResource;
+    DbInitializer mSecondResource;
+    RetrievalThread mRetrievalThread;
+    ItemRetrievalManager *mManager;
+    FakeAgentManager mAgentManager;
+    AgentInfoCache *mAgentInfoCache;
+
+    void setMovingTypes(const QStringList &types)
+    {
+        mAgentManager.movingTypes = types;
+        mAgentInfoCache->reload();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mFirstResource.createResource("akonadi_move_resource_0");
+        mSecondResource.createResource("akonadi_other_resource_0");
+        mManager = mRetrievalThread.startManager();
+        QVERIFY(mManager);
+
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        QVERIFY(bus.registerObject(QLatin1String("/AgentManager"), &mAgentManager, QDBusConnection::ExportAllSlots));
+        QVERIFY(bus.registerService(QLatin1String(FAKE_AGENTMANAGER_SERVICE)));
+        mAgentInfoCache = new AgentInfoCache(QLatin1String(FAKE_AGENTMANAGER_SERVICE), this);
+        QCOMPARE(mAgentInfoCache->count(), 2);
+    }
+
+    void cleanupTestCase()
+    {
+        delete mAgentInfoCache;
+        QDBusConnection::sessionBus().unregisterObject(QLatin1String("/AgentManager"));
+        QDBusConnection::sessionBus().unregisterService(QLatin1String(FAKE_AGENTMANAGER_SERVICE));
+        mRetrievalThread.quit();
+        mRetrievalThread.wait();
+    }
+
+    void benchmarkMove_data()
+    {
+        QTest::addColumn<bool>("interResource");
+        QTest::addColumn<QStringList>("movingTypes");
+        QTest::addColumn<bool>("expectRetrieval");
+
+        const QStringList movingTypes = QStringList() << QLatin1String("akonadi_move_resource");
+        QTest::newRow("same resource") << false << QStringList() << true;
+        QTest::newRow("same resource, moves without payload") << false << movingTypes << false;
+        QTest::newRow("other resource, moves without payload") << true << movingTypes << true;
+    }
+
+    void benchmarkMove()
+    {
+        QFETCH(bool, interResource);
+        QFETCH(QStringList, movingTypes);
+        QFETCH(bool, expectRetrieval);
+
+        const int itemCount = qgetenv("AKONADI_BENCHMARK_ITEMS").isEmpty() ? 100 : qgetenv("AKONADI_BENCHMARK_ITEMS").toInt();
+        const QByteArray name = QTest::currentDataTag();
+        const Collection source = mFirstResource.createCollection(QByteArray(name + " source").constData());
+        DbInitializer &destinationResource = interResource ? mSecondResource : mFirstResource;
+        const Collection destination = destinationResource.createCollection(QByteArray(name + " destination").constData());
+        PimItem first, last;
+        for (int i = 0; i < itemCount; ++i) {
+            last = mFirstResource.createItem(QByteArray(name + ' ' + QByteArray::number(i)).constData(), source);
+            if (i == 0) {
+                first = last;
+            }
+        }
+
+        setMovingTypes(movingTypes);
+
+        QList<QByteArray> scenario;
+        scenario << FakeAkonadiServer::defaultScenario()
+                 << "C: 2 UID MOVE " + QByteArray::number(first.id()) + ':' + QByteArray::number(last.id())
+                    + ' ' + QByteArray::number(destination.id());
+        if (expectRetrieval) {
+            // nobody delivers the items
+            scenario << "S: IGNORE 1";
+        } else {
+            scenario << "S: 2 OK MOVE complete";
+        }
+
+        QSignalSpy requests(mManager, SIGNAL(requestAdded()));
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            FakeAkonadiServer::instance()->setScenario(scenario);
+            FakeAkonadiServer::instance()->runTest();
+        }
+
+        qDebug() << itemCount << "uncached items moved" << (interResource ? "to another resource" : "within the resource")
+                 << "in" << time.elapsed() << "ms with" << requests.count() << "retrieval requests";
+
+        CountQueryBuilder moved(PimItem::tableName());
+        moved.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, destination.id());
+        QVERIFY(moved.exec());
+        if (expectRetrieval) {
+            QVERIFY(requests.count() > 0);
+            QCOMPARE(moved.result(), 0);
+        } else {
+            QCOMPARE(requests.count(), 0);
+            QCOMPARE(moved.result(), itemCount);
+        }
+
+        setMovingTypes(QStringList());
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(MoveBenchmark)
+
+#include "movebenchmark.moc"
@@ -0,0 +1,192 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QFile>
+#include <QSettings>
+
+#include <storage/dbconfig.h>
+#include <storage/parthelper.h>
+#include <storage/parttypehelper.h>
+#include <response.h>
+#include <entities.h>
+#include <akstandarddirs.h>
+#include <libs/xdgbasedirs_p.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Stores payloads through PartHelper with General/PayloadCompression enabled
+ * and checks how they end up in the database and that they read back unchanged.
+ */
+class PartCompressionTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    PartCompressionTest()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        // DbConfig reads the setting once, so it has to be in place before the server starts
+        qputenv("XDG_CONFIG_HOME", qPrintable(QString(FakeAkonadiServer::basePath() + QLatin1String("/config"))));
+        qputenv("AKONADI_INSTANCE", qPrintable(FakeAkonadiServer::instanceName()));
+        QSettings settings(AkStandardDirs::serverConfigFile(XdgBaseDirs::WriteOnly), QSettings::IniFormat);
+        settings.setValue(QLatin1String("General/PayloadCompression"), true);
+        settings.sync();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~PartCompressionTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    DbInitializer mInitializer;
+    Collection mCollection;
+
+    static QByteArray compressiblePayload(int size)
+    {
+        QByteArray payload;
+        while (payload.size() < size) {
+            payload += "Please forward the attached report to the trading desk. ";
+        }
+        payload.truncate(size);
+        return payload;
+    }
+
+    static QByteArray randomPayload(int size)
+    {
+        qsrand(42);
+        QByteArray payload(size, '\0');
+        for (int i = 0; i < size; ++i) {
+            payload[i] = static_cast<char>(qrand() % 256);
+        }
+        return payload;
+    }
+
+    Part createPart(const char *name, const QByteArray &payload)
+    {
+        const PimItem item = mInitializer.createItem(name, mCollection);
+        Part part;
+        part.setPimItemId(item.id());
+        part.setPartType(PartTypeHelper::fromFqName(QByteArray("PLD:RFC822")));
+        part.setData(payload);
+        part.setDatasize(payload.size());
+        return part;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QVERIFY(DbConfig::configuredDatabase()->useCompression());
+        mInitializer.createResource("testresource");
+        mCollection = mInitializer.createCollection("root");
+    }
+
+    void testInsert_data()
+    {
+        QTest::addColumn<QByteArray>("payload");
+        QTest::addColumn<bool>("external");
+        QTest::addColumn<bool>("compressed");
+
+        const int threshold = DbConfig::configuredDatabase()->sizeThreshold();
+        QTest::newRow("compressible") << compressiblePayload(threshold / 2) << false << true;
+        QTest::newRow("too small") << compressiblePayload(100) << false << false;
+        QTest::newRow("incompressible") << randomPayload(threshold / 2) << false << false;
+        QTest::newRow("external") << compressiblePayload(threshold * 2) << true << false;
+    }
+
+    void testInsert()
+    {
+        QFETCH(QByteArray, payload);
+        QFETCH(bool, external);
+        QFETCH(bool, compressed);
+
+        Part part = createPart(QTest::currentDataTag(), payload);
+        QVERIFY(PartHelper::insert(&part));
+
+        const Part stored = Part::retrieveById(part.id());
+        QVERIFY(stored.isValid());
+        QCOMPARE(stored.external(), external);
+        QCOMPARE(stored.compressed(), compressed);
+        QCOMPARE(stored.datasize(), static_cast<qint64>(payload.size()));
+        if (compressed) {
+            QVERIFY(stored.data().size() < payload.size());
+        } else if (external) {
+            QFile file(PartHelper::resolveAbsolutePath(stored.data()));
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QCOMPARE(file.readAll(), payload);
+        } else {
+            QCOMPARE(stored.data(), payload);
+        }
+        QCOMPARE(PartHelper::translateData(stored), payload);
+    }
+
+    void testUpdate()
+    {
+        const int threshold = DbConfig::configuredDatabase()->sizeThreshold();
+        Part part = createPart("update", randomPayload(threshold / 2));
+        QVERIFY(PartHelper::insert(&part));
+        QVERIFY(!part.compressed());
+
+        // internal and uncompressed -> compressed
+        const QByteArray compressible = compressiblePayload(threshold / 2);
+        PartHelper::update(&part, compressible, compressible.size());
+        Part stored = Part::retrieveById(part.id());
+        QVERIFY(!stored.external());
+        QVERIFY(stored.compressed());
+        QCOMPARE(PartHelper::translateData(stored), compressible);
+
+        // compressed -> external files are never compressed
+        const QByteArray large = compressiblePayload(threshold * 2);
+        PartHelper::update(&stored, large, large.size());
+        stored = Part::retrieveById(part.id());
+        QVERIFY(stored.external());
+        QVERIFY(!stored.compressed());
+        QCOMPARE(PartHelper::translateData(stored), large);
+
+        // external -> compressed again
+        PartHelper::update(&stored, compressible, compressible.size());
+        stored = Part::retrieveById(part.id());
+        QVERIFY(!stored.external());
+        QVERIFY(stored.compressed());
+        QCOMPARE(PartHelper::translateData(stored), compressible);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(PartCompressionTest)
+
+#include "partcompressiontest.moc"
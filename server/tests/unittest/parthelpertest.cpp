@@ -26,6 +26,7 @@
 #include <QtTest/QTest>
 #include <QDebug>
 #include <QDir>
+#include <QFile>
 
 #define QL1S(x) QString::fromLatin1(x)
 
@@ -46,6 +47,62 @@ class PartHelperTest : public QObject
       QVERIFY( fileName.endsWith( QL1S( "42" ) ) );
     }
 
+    void testShardedFileName_data()
+    {
+      QTest::addColumn<qint64>( "id" );
+      QTest::addColumn<QString>( "fileName" );
+      QTest::newRow( "small id" ) << 42ll << QL1S( "2a/00/42" );
+      QTest::newRow( "second level" ) << 300ll << QL1S( "2c/01/300" );
+      QTest::newRow( "wraps around" ) << 1048831ll << QL1S( "ff/00/1048831" );
+      QTest::newRow( "both levels" ) << 4660ll << QL1S( "34/12/4660" );
+    }
+
+    void testShardedFileName()
+    {
+      QFETCH( qint64, id );
+      QFETCH( QString, fileName );
+
+      Part p;
+      p.setId( id );
+      QCOMPARE( PartHelper::fileNameForPart( &p ), fileName );
+      QCOMPARE( PartHelper::updateFileNameRevision( fileName ), fileName + QL1S( "_r0" ) );
+    }
+
+    void testSharedFile()
+    {
+      QVERIFY( PartHelper::isSharedFile( "dedup/ab/cd/abcdef" ) );
+      QVERIFY( !PartHelper::isSharedFile( "ab/cd/42_r0" ) );
+      QVERIFY( !PartHelper::isSharedFile( "42_r0" ) );
+    }
+
+    void testLinkFile()
+    {
+      akTestSetInstanceIdentifier( QString() );
+
+      Part original;
+      original.setId( 23 );
+      const QByteArray originalFile = ( PartHelper::fileNameForPart( &original ) + QL1S( "_r0" ) ).toLocal8Bit();
+      QFile file( PartHelper::resolveAbsolutePath( originalFile, true ) );
+      QVERIFY( file.open( QIODevice::WriteOnly ) );
+      file.write( "payload" );
+      file.close();
+
+      Part copy;
+      copy.setId( 24 );
+      copy.setExternal( true );
+      copy.setData( originalFile );
+      const QByteArray copyFile = PartHelper::linkFile( &copy );
+      QCOMPARE( copyFile, ( PartHelper::fileNameForPart( &copy ) + QL1S( "_r0" ) ).toLocal8Bit() );
+
+      // the copy keeps its data when the original is removed
+      PartHelper::removeFile( file.fileName() );
+      QFile copied( PartHelper::resolveAbsolutePath( copyFile ) );
+      QVERIFY( copied.open( QIODevice::ReadOnly ) );
+      QCOMPARE( copied.readAll(), QByteArray( "payload" ) );
+      copied.close();
+      PartHelper::removeFile( copied.fileName() );
+    }
+
     void testRemoveFile_data()
     {
       QTest::addColumn<QString>( "instance" );
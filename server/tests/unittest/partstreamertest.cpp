@@ -170,7 +170,9 @@ private Q_SLOTS:
             QVERIFY(streamerSpy.first().count() == 1);
             const Response response = streamerSpy.first().first().value<Akonadi::Server::Response>();
             const QByteArray str = response.asString();
-            const QByteArray expectedResponse = "+ STREAM [FILE " + QByteArray::number(part.id()) + "_r" + QByteArray::number(part.version()) + "]";
+            Part partCopy(part);
+            const QByteArray baseName = PartHelper::fileNameForPart(&partCopy).toLatin1();
+            const QByteArray expectedResponse = "+ STREAM [FILE " + baseName + "_r" + QByteArray::number(part.version()) + "]";
             QCOMPARE(QString::fromUtf8(str), QString::fromUtf8(expectedResponse));
 
             QFile file(PartHelper::resolveAbsolutePath(data));
@@ -183,7 +185,7 @@ private Q_SLOTS:
 
             // Make sure no previous versions are left behind in file_db_data
             for (int i = 0; i < part.version(); ++i) {
-                const QByteArray fileName = QByteArray::number(part.id()) + "_r" + QByteArray::number(part.version());
+                const QByteArray fileName = baseName + "_r" + QByteArray::number(part.version());
                 const QString filePath = PartHelper::resolveAbsolutePath(fileName);
                 QVERIFY(!QFile::exists(filePath));
             }
@@ -194,8 +196,10 @@ private Q_SLOTS:
             QCOMPARE(data, expectedData);
 
             // Make sure nothing is left behind in file_db_data
+            Part partCopy(part);
+            const QByteArray baseName = PartHelper::fileNameForPart(&partCopy).toLatin1();
             for (int i = 0; i <= part.version(); ++i) {
-                const QByteArray fileName = QByteArray::number(part.id()) + "_r" + QByteArray::number(part.version());
+                const QByteArray fileName = baseName + "_r" + QByteArray::number(part.version());
                 const QString filePath = PartHelper::resolveAbsolutePath(fileName);
                 QVERIFY(!QFile::exists(filePath));
             }
@@ -0,0 +1,182 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QPointer>
+
+#include <connectionthread.h>
+#include <storage/accesstimetracker.h>
+#include <response.h>
+
+#include <asapcat/loadgenerator.h>
+#include <asapcat/workload.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Serves each client from a dedicated ConnectionThread, like AkonadiServer does.
+ */
+class LoadBenchmarkServer : public QLocalServer
+{
+public:
+    ~LoadBenchmarkServer()
+    {
+        close();
+        Q_FOREACH (const QPointer<ConnectionThread> &thread, mThreads) {
+            if (thread) {
+                thread->quit();
+                thread->wait();
+                delete thread;
+            }
+        }
+    }
+
+protected:
+    void incomingConnection(quintptr socketDescriptor)
+    {
+        QPointer<ConnectionThread> thread = new ConnectionThread(socketDescriptor, this);
+        connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+        mThreads.append(thread);
+        thread->start();
+    }
+
+private:
+    QVector<QPointer<ConnectionThread> > mThreads;
+};
+
+/**
+ * Runs asapcat workloads against a server on a temporary SQLite database, so
+ * that regressions in the append, fetch and store paths show up in the
+ * benchmark results.
+ */
+class ProtocolLoadBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    ProtocolLoadBenchmark()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+
+        mServer.setMaxPendingConnections(Sessions);
+        if (!mServer.listen(FakeAkonadiServer::socketFile())) {
+            akFatal() << "Failed to listen on" << FakeAkonadiServer::socketFile();
+        }
+    }
+
+    ~ProtocolLoadBenchmark()
+    {
+        mServer.close();
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    enum {
+        Sessions = 4,
+        // "Collection D" of the test data, which has no items yet
+        Collection = 4
+    };
+
+    void run(const Workload &workload, int iterations)
+    {
+        LoadGenerator generator(FakeAkonadiServer::socketFile(), workload, Sessions, iterations);
+        QBENCHMARK_ONCE {
+            generator.start();
+            // The server side runs in this thread's event loop, so we can't block
+            QElapsedTimer timer;
+            timer.start();
+            while (!generator.isFinished() && timer.elapsed() < 300 * 1000) {
+                QTest::qWait(10);
+            }
+        }
+        QVERIFY(generator.isFinished());
+        QCOMPARE(generator.failures(), 0);
+
+        qDebug() << Sessions << "sessions in" << generator.elapsed() << "ms";
+        qDebug("\n%s", generator.stats().report(generator.elapsed()).constData());
+    }
+
+    LoadBenchmarkServer mServer;
+
+private Q_SLOTS:
+    void benchmarkAppend()
+    {
+        const int count = qgetenv("AKONADI_BENCHMARK_ITEMS").isEmpty() ? 250 : qgetenv("AKONADI_BENCHMARK_ITEMS").toInt();
+        const QList<QByteArray> messages = Workload::generateMessages(count, 4096);
+        run(Workload::append(Collection, messages, "application/octet-stream"), 1);
+    }
+
+    void benchmarkFetch_data()
+    {
+        QTest::addColumn<bool>("deferAccessTime");
+
+        QTest::newRow("immediate atime") << false;
+        QTest::newRow("deferred atime") << true;
+    }
+
+    void benchmarkFetch()
+    {
+        QFETCH(bool, deferAccessTime);
+
+        const int iterations = 10;
+        AccessTimeTracker *tracker = 0;
+        if (deferAccessTime) {
+            tracker = new AccessTimeTracker(1);
+            tracker->start();
+        }
+
+        run(Workload::fetch(Collection), iterations);
+
+        // Without the tracker every fetch writes the access time of all items
+        int writeTransactions = Sessions * iterations;
+        if (tracker) {
+            tracker->quit();
+            tracker->wait();
+            writeTransactions = tracker->writeTransactions();
+            QCOMPARE(tracker->pendingCount(), 0);
+            delete tracker;
+        }
+        qDebug() << writeTransactions << "write transactions for the access time of" << Sessions * iterations << "fetches";
+    }
+
+    void benchmarkStore()
+    {
+        run(Workload::flagStorm(Collection, 50), 1);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(ProtocolLoadBenchmark)
+
+#include "protocolloadbenchmark.moc"
@@ -0,0 +1,146 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QThread>
+
+#include <storage/querystatistics.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi::Server;
+
+class RecordingThread : public QThread
+{
+public:
+    RecordingThread(QueryStatistics *statistics)
+        : QThread()
+        , mStatistics(statistics)
+    {
+    }
+
+protected:
+    void run()
+    {
+        for (int i = 0; i < 10000; ++i) {
+            mStatistics->recordStatement(QString::fromLatin1("SELECT id FROM PimItemTable WHERE id = %1").arg(i), 100);
+        }
+    }
+
+private:
+    QueryStatistics *mStatistics;
+};
+
+class QueryStatisticsTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testBuckets()
+    {
+        int lastBucket = 0;
+        for (qint64 value = 0; value < 100000; ++value) {
+            const int bucket = LatencyHistogram::bucketForValue(value);
+            QVERIFY(bucket == lastBucket || bucket == lastBucket + 1);
+            QVERIFY(LatencyHistogram::bucketLowerBound(bucket) <= value);
+            QVERIFY(LatencyHistogram::bucketLowerBound(bucket + 1) > value);
+            lastBucket = bucket;
+        }
+        QCOMPARE(LatencyHistogram::bucketForValue(Q_INT64_C(1) << 40), int(LatencyHistogram::BucketCount) - 1);
+    }
+
+    void testPercentiles()
+    {
+        LatencyHistogram histogram;
+        QCOMPARE(histogram.percentile(50), qint64(0));
+
+        for (int i = 1; i <= 1000; ++i) {
+            histogram.record(i * 10);
+        }
+        QCOMPARE(histogram.count(), 1000);
+        QCOMPARE(histogram.max(), qint64(10000));
+
+        // within the 25% bucket resolution
+        QVERIFY(qAbs(histogram.percentile(50) - 5000) <= 1250);
+        QVERIFY(qAbs(histogram.percentile(95) - 9500) <= 2375);
+        QVERIFY(histogram.percentile(99) <= histogram.max());
+        QVERIFY(qAbs(histogram.total() - 5005000) <= 5005000 / 8);
+
+        histogram.reset();
+        QCOMPARE(histogram.count(), 0);
+        QCOMPARE(histogram.max(), qint64(0));
+    }
+
+    void testNormalize_data()
+    {
+        QTest::addColumn<QString>("statement");
+        QTest::addColumn<QString>("normalized");
+
+        QTest::newRow("placeholders") << QString::fromLatin1("SELECT a FROM T WHERE ( b = :0 AND c = :1 )")
+                                      << QString::fromLatin1("SELECT a FROM T WHERE ( b = ? AND c = ? )");
+        QTest::newRow("in list") << QString::fromLatin1("SELECT a FROM T WHERE ( b IN ( :0, :1, :2 ) )")
+                                 << QString::fromLatin1("SELECT a FROM T WHERE ( b IN ( ? ) )");
+        QTest::newRow("literals") << QString::fromLatin1("SELECT a FROM T WHERE b = 'it''s' AND c = 42 AND d = 1.5")
+                                  << QString::fromLatin1("SELECT a FROM T WHERE b = ? AND c = ? AND d = ?");
+        QTest::newRow("identifiers") << QString::fromLatin1("SELECT Table1.col2 FROM Table1")
+                                     << QString::fromLatin1("SELECT Table1.col2 FROM Table1");
+        QTest::newRow("values") << QString::fromLatin1("INSERT INTO T (a, b) VALUES (:0, :1)")
+                                << QString::fromLatin1("INSERT INTO T (a, b) VALUES (?)");
+        QTest::newRow("set") << QString::fromLatin1("UPDATE T SET a = :0, b = :1 WHERE c = 3")
+                             << QString::fromLatin1("UPDATE T SET a = ?, b = ? WHERE c = ?");
+    }
+
+    void testNormalize()
+    {
+        QFETCH(QString, statement);
+        QFETCH(QString, normalized);
+
+        QCOMPARE(QueryStatistics::normalizeStatement(statement), normalized);
+    }
+
+    void testConcurrentRecording()
+    {
+        QueryStatistics statistics;
+        QList<RecordingThread *> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads << new RecordingThread(&statistics);
+        }
+        Q_FOREACH (RecordingThread *thread, threads) {
+            thread->start();
+        }
+        Q_FOREACH (RecordingThread *thread, threads) {
+            thread->wait();
+        }
+        qDeleteAll(threads);
+
+        const QString report = statistics.report(QLatin1String("Statements"), 0);
+        QVERIFY(report.contains(QLatin1String("(1 entries")));
+        QVERIFY(report.contains(QLatin1String("40000")));
+        QVERIFY(report.contains(QLatin1String("SELECT id FROM PimItemTable WHERE id = ?")));
+
+        statistics.reset();
+        QVERIFY(!statistics.report(QLatin1String("Statements"), 0).contains(QLatin1String("PimItemTable")));
+    }
+};
+
+AKTEST_MAIN(QueryStatisticsTest)
+
+#include "querystatisticstest.moc"
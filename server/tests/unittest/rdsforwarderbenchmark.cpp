@@ -0,0 +1,343 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QThread>
+#include <QTime>
+
+#include <rds/forwarder.h>
+
+#include "aktest.h"
+
+#include <QtTest/QTest>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static char patternByte(qint64 offset)
+{
+    return static_cast<char>((offset * 7) % 251);
+}
+
+/**
+ * Stands in for the local Akonadi server: sends back everything it receives
+ * and closes its side once the other side has.
+ */
+class EchoThread : public QThread
+{
+public:
+    EchoThread(int fd)
+        : QThread()
+        , mFd(fd)
+    {
+    }
+
+    void run()
+    {
+        QByteArray buffer(64 * 1024, 0);
+        while (true) {
+            const ssize_t n = ::read(mFd, buffer.data(), buffer.size());
+            if (n <= 0) {
+                break;
+            }
+            ssize_t offset = 0;
+            while (offset < n) {
+                const ssize_t written = ::write(mFd, buffer.constData() + offset, n - offset);
+                if (written <= 0) {
+                    return;
+                }
+                offset += written;
+            }
+        }
+        ::shutdown(mFd, SHUT_WR);
+    }
+
+private:
+    int mFd;
+};
+
+/**
+ * Stands in for the remote client: writes a pattern and shuts down its
+ * side afterwards.
+ */
+class WriterThread : public QThread
+{
+public:
+    WriterThread(int fd, qint64 size)
+        : QThread()
+        , mFd(fd)
+        , mSize(size)
+    {
+    }
+
+    void run()
+    {
+        QByteArray buffer(64 * 1024, 0);
+        qint64 offset = 0;
+        while (offset < mSize) {
+            const int chunk = qMin<qint64>(buffer.size(), mSize - offset);
+            for (int i = 0; i < chunk; ++i) {
+                buffer[i] = patternByte(offset + i);
+            }
+            int done = 0;
+            while (done < chunk) {
+                const ssize_t written = ::write(mFd, buffer.constData() + done, chunk - done);
+                if (written <= 0) {
+                    return;
+                }
+                done += written;
+            }
+            offset += chunk;
+        }
+        ::shutdown(mFd, SHUT_WR);
+    }
+
+private:
+    int mFd;
+    qint64 mSize;
+};
+
+class RdsForwarderBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    RdsForwarderBenchmark()
+    {
+        // the peers close while data is in flight
+        ::signal(SIGPIPE, SIG_IGN);
+    }
+
+private:
+    // A connected TCP connection on the loopback device, like the remote side of the bridge
+    bool tcpPair(int fds[2])
+    {
+        const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0) {
+            return false;
+        }
+        struct sockaddr_in address;
+        ::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        fds[0] = fds[1] = -1;
+        if (::bind(listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0
+            && ::listen(listener, 1) == 0
+            && ::getsockname(listener, reinterpret_cast<struct sockaddr *>(&address), &length) == 0) {
+            fds[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (::connect(fds[0], reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0) {
+                fds[1] = ::accept(listener, 0, 0);
+            }
+        }
+        ::close(listener);
+        return fds[0] >= 0 && fds[1] >= 0;
+    }
+
+    // Reads back the pattern from @p fd up to the end of the stream and returns its size
+    qint64 readPattern(int fd, qint64 offset = 0)
+    {
+        QByteArray buffer(64 * 1024, 0);
+        while (true) {
+            const ssize_t n = ::read(fd, buffer.data(), buffer.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            for (ssize_t i = 0; i < n; ++i) {
+                if (buffer[static_cast<int>(i)] != patternByte(offset + i)) {
+                    qWarning() << "Mismatch at offset" << offset + i;
+                    return -1;
+                }
+            }
+            offset += n;
+        }
+        return offset;
+    }
+
+    void forwardingModes()
+    {
+        QTest::addColumn<int>("mode");
+        QTest::newRow("splice") << static_cast<int>(Forwarder::Splice);
+        QTest::newRow("copy") << static_cast<int>(Forwarder::Copy);
+    }
+
+private Q_SLOTS:
+    void testForwarding_data()
+    {
+        forwardingModes();
+    }
+
+    void testForwarding()
+    {
+        QFETCH(int, mode);
+
+        int remote[2];
+        int local[2];
+        QVERIFY(tcpPair(remote));
+        QVERIFY(::socketpair(AF_UNIX, SOCK_STREAM, 0, local) == 0);
+
+        Forwarder forwarder(remote[1], local[1]);
+        forwarder.setMode(static_cast<Forwarder::Mode>(mode));
+        // as if the bridge had read the first bytes already, the echo sends
+        // them back, so they have to arrive at the client first
+        QByteArray head;
+        for (int i = 0; i < 1000; ++i) {
+            head.append(patternByte(i));
+        }
+        forwarder.setPendingData(QByteArray(), head);
+
+        EchoThread echo(local[0]);
+        echo.start();
+        forwarder.start();
+
+        const qint64 size = 8 * 1024 * 1024;
+        WriterThread writer(remote[0], size);
+        writer.start();
+
+        QByteArray first(head.size(), 0);
+        int done = 0;
+        while (done < first.size()) {
+            const ssize_t n = ::read(remote[0], first.data() + done, first.size() - done);
+            QVERIFY(n > 0);
+            done += n;
+        }
+        QCOMPARE(first, head);
+        QCOMPARE(readPattern(remote[0]), size);
+
+        QVERIFY(writer.wait(10000));
+        QVERIFY(echo.wait(10000));
+        QVERIFY(forwarder.wait(10000));
+        QCOMPARE(forwarder.bytesToSecond(), size + head.size());
+        QCOMPARE(forwarder.bytesToFirst(), size + head.size());
+
+        ::close(remote[0]);
+        ::close(local[0]);
+    }
+
+    void testBackpressure_data()
+    {
+        forwardingModes();
+    }
+
+    void testBackpressure()
+    {
+        QFETCH(int, mode);
+
+        int remote[2];
+        int local[2];
+        QVERIFY(tcpPair(remote));
+        QVERIFY(::socketpair(AF_UNIX, SOCK_STREAM, 0, local) == 0);
+
+        Forwarder forwarder(remote[1], local[1]);
+        forwarder.setMode(static_cast<Forwarder::Mode>(mode));
+        forwarder.start();
+
+        // Nobody reads on the local side, so the forwarder has to stop reading
+        // and the client eventually can't write anymore
+        ::fcntl(remote[0], F_SETFL, ::fcntl(remote[0], F_GETFL) | O_NONBLOCK);
+        const QByteArray chunk(64 * 1024, 'x');
+        const qint64 limit = 256 * 1024 * 1024;
+        qint64 written = 0;
+        QTime blocked;
+        blocked.start();
+        // blocked for half a second means the forwarder doesn't take any more
+        while (written < limit && blocked.elapsed() < 500) {
+            const ssize_t n = ::write(remote[0], chunk.constData(), chunk.size());
+            if (n > 0) {
+                written += n;
+                blocked.restart();
+                continue;
+            }
+            QVERIFY(errno == EAGAIN || errno == EWOULDBLOCK);
+            QTest::qSleep(50);
+        }
+        qDebug() << written / 1024 << "KiB in flight when the client got blocked";
+        QVERIFY(written < limit);
+
+        // Once the local side reads, everything arrives
+        ::shutdown(remote[0], SHUT_WR);
+        qint64 received = 0;
+        QByteArray buffer(64 * 1024, 0);
+        while (true) {
+            const ssize_t n = ::read(local[0], buffer.data(), buffer.size());
+            if (n <= 0) {
+                break;
+            }
+            received += n;
+        }
+        QCOMPARE(received, written);
+
+        forwarder.stop();
+        QVERIFY(forwarder.wait(10000));
+        ::close(remote[0]);
+        ::close(local[0]);
+    }
+
+    void benchmarkThroughput_data()
+    {
+        forwardingModes();
+    }
+
+    void benchmarkThroughput()
+    {
+        QFETCH(int, mode);
+
+        int remote[2];
+        int local[2];
+        QVERIFY(tcpPair(remote));
+        QVERIFY(::socketpair(AF_UNIX, SOCK_STREAM, 0, local) == 0);
+
+        Forwarder forwarder(remote[1], local[1]);
+        forwarder.setMode(static_cast<Forwarder::Mode>(mode));
+        EchoThread echo(local[0]);
+        echo.start();
+        forwarder.start();
+
+        const qint64 size = 512 * 1024 * 1024;
+        WriterThread writer(remote[0], size);
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            writer.start();
+            QCOMPARE(readPattern(remote[0]), size);
+        }
+        const int elapsed = qMax(1, time.elapsed());
+        qDebug() << size / 1024 / 1024 << "MiB forwarded in both directions in" << elapsed << "ms,"
+                 << (size / 1024 / 1024) * 1000 / elapsed << "MiB/s";
+
+        QVERIFY(writer.wait(10000));
+        QVERIFY(echo.wait(10000));
+        QVERIFY(forwarder.wait(10000));
+        ::close(remote[0]);
+        ::close(local[0]);
+    }
+};
+
+AKTEST_MAIN(RdsForwarderBenchmark)
+
+#include "rdsforwarderbenchmark.moc"
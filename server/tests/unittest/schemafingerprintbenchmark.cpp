@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <storage/datastore.h>
+#include <storage/dbinitializer.h>
+
+#include "akonadischema.h"
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+class SchemaFingerprintBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    SchemaFingerprintBenchmark()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~SchemaFingerprintBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    QStringList schemaDescriptions() const
+    {
+        return QStringList() << QLatin1String(":akonadidb.xml")
+                             << QLatin1String(":dbupdate.xml");
+    }
+
+private Q_SLOTS:
+    void testFingerprint()
+    {
+        AkonadiSchema schema;
+        DbInitializer::Ptr initializer = DbInitializer::createInstance(DataStore::self()->database(), &schema);
+
+        const QByteArray fingerprint = initializer->schemaFingerprint(schemaDescriptions());
+        QVERIFY(!fingerprint.isEmpty());
+        QCOMPARE(initializer->schemaFingerprint(schemaDescriptions()), fingerprint);
+
+        // stored by DataStore::init()
+        QVERIFY(initializer->isSchemaUpToDate(fingerprint));
+        QVERIFY(!initializer->isSchemaUpToDate("0123456789"));
+        QVERIFY(!initializer->isSchemaUpToDate(QByteArray()));
+
+        // an empty fingerprint forces a full check on next startup
+        QVERIFY(initializer->storeSchemaFingerprint(QByteArray()));
+        QVERIFY(!initializer->isSchemaUpToDate(fingerprint));
+
+        QVERIFY(DataStore::self()->init());
+        QVERIFY(initializer->isSchemaUpToDate(fingerprint));
+    }
+
+    void benchmarkInit_data()
+    {
+        QTest::addColumn<bool>("cached");
+
+        QTest::newRow("full verification") << false;
+        QTest::newRow("cached fingerprint") << true;
+    }
+
+    void benchmarkInit()
+    {
+        QFETCH(bool, cached);
+
+        AkonadiSchema schema;
+        DbInitializer::Ptr initializer = DbInitializer::createInstance(DataStore::self()->database(), &schema);
+
+        QBENCHMARK {
+            if (!cached) {
+                initializer->storeSchemaFingerprint(QByteArray());
+            }
+            QVERIFY(DataStore::self()->init());
+        }
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(SchemaFingerprintBenchmark)
+
+#include "schemafingerprintbenchmark.moc"
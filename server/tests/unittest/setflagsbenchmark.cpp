@@ -0,0 +1,206 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QTime>
+
+#include <storage/datastore.h>
+#include <storage/selectquerybuilder.h>
+#include <storage/countquerybuilder.h>
+#include <handlerhelper.h>
+#include <entities.h>
+
+#include "datasetgenerator.h"
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Replaces the flags of all items of a single collection (like marking a
+ * whole folder as read does) with DataStore::setItemsFlags(), compared to
+ * loading and changing the flags of one item after the other.
+ *
+ * Uses 1000 items by default, set AKONADI_BENCHMARK_ITEMS to e.g. 100000 for meaningful numbers.
+ */
+class SetFlagsBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    SetFlagsBenchmark()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~SetFlagsBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    PimItem::List mItems;
+    Flag::List mFlags;
+
+    static bool setFlagsPerItem(const PimItem::List &items, const Flag::List &flags)
+    {
+        Q_FOREACH (PimItem item, items) {
+            const Flag::List current = item.flags();
+            Q_FOREACH (const Flag &flag, current) {
+                if (!flags.contains(flag) && !item.removeFlag(flag)) {
+                    return false;
+                }
+            }
+            Q_FOREACH (const Flag &flag, flags) {
+                if (!current.contains(flag) && !item.addFlag(flag)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static int countRelations(const PimItem::List &items, const Flag &flag = Flag())
+    {
+        // the items are sorted by id and have been created in one go
+        CountQueryBuilder qb(PimItemFlagRelation::tableName());
+        qb.addValueCondition(PimItemFlagRelation::leftColumn(), Query::GreaterOrEqual, items.first().id());
+        qb.addValueCondition(PimItemFlagRelation::leftColumn(), Query::LessOrEqual, items.last().id());
+        if (flag.isValid()) {
+            qb.addValueCondition(PimItemFlagRelation::rightColumn(), Query::Equals, flag.id());
+        }
+        if (!qb.exec()) {
+            return -1;
+        }
+        return qb.result();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        int itemCount = qgetenv("AKONADI_BENCHMARK_ITEMS").toInt();
+        if (itemCount <= 0) {
+            itemCount = 1000;
+        }
+
+        DatasetGenerator::Options options;
+        options.depth = 0;
+        options.items = itemCount;
+        options.tags = 0;
+        options.headerSize = 64;
+        options.payloadRatio = 0.0;
+        options.batchSize = 10000;
+
+        DatasetGenerator generator(options);
+        QVERIFY(generator.generate());
+        QCOMPARE(generator.collections().count(), 1);
+
+        SelectQueryBuilder<PimItem> qb;
+        qb.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, generator.collections().first().id());
+        qb.addSortColumn(PimItem::idColumn(), Query::Ascending);
+        QVERIFY(qb.exec());
+        mItems = qb.result();
+        QCOMPARE(mItems.count(), itemCount);
+
+        mFlags = HandlerHelper::resolveFlags(QVector<QByteArray>() << "\\SEEN" << "$TODO");
+        QCOMPARE(mFlags.count(), 2);
+    }
+
+    void testSetItemsFlags()
+    {
+        // more items than fit into a single chunk with any database
+        const PimItem::List items = mItems.mid(0, 2500);
+        const Flag todo = mFlags.last();
+
+        DataStore *store = DataStore::self();
+        QVERIFY(store->beginTransaction());
+
+        bool flagsChanged = false;
+        QVERIFY(store->setItemsFlags(items, mFlags, &flagsChanged, true));
+        QVERIFY(flagsChanged);
+        QCOMPARE(countRelations(items), 2 * items.count());
+        QCOMPARE(countRelations(items, todo), items.count());
+
+        // nothing to do the second time
+        QVERIFY(store->setItemsFlags(items, mFlags, &flagsChanged, true));
+        QVERIFY(!flagsChanged);
+        QCOMPARE(countRelations(items), 2 * items.count());
+
+        QVERIFY(store->setItemsFlags(items, Flag::List() << todo, &flagsChanged, true));
+        QVERIFY(flagsChanged);
+        QCOMPARE(countRelations(items), items.count());
+        QCOMPARE(countRelations(items, todo), items.count());
+
+        QVERIFY(store->setItemsFlags(items, Flag::List(), &flagsChanged, true));
+        QVERIFY(flagsChanged);
+        QCOMPARE(countRelations(items), 0);
+
+        QVERIFY(store->rollbackTransaction());
+    }
+
+    void benchmarkSetItemsFlags_data()
+    {
+        QTest::addColumn<bool>("setBased");
+
+        QTest::newRow("set-based") << true;
+        QTest::newRow("per item") << false;
+    }
+
+    void benchmarkSetItemsFlags()
+    {
+        QFETCH(bool, setBased);
+
+        DataStore *store = DataStore::self();
+        const int before = countRelations(mItems);
+
+        // the changes are rolled back afterwards, so that each run starts with the same flags
+        QVERIFY(store->beginTransaction());
+
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            if (setBased) {
+                QVERIFY(store->setItemsFlags(mItems, mFlags, 0, true));
+            } else {
+                QVERIFY(setFlagsPerItem(mItems, mFlags));
+            }
+        }
+
+        qDebug() << "Flags of" << mItems.count() << "items replaced" << (setBased ? "set-based" : "per item")
+                 << "in" << time.elapsed() << "ms";
+        QCOMPARE(countRelations(mItems), 2 * mItems.count());
+
+        QVERIFY(store->rollbackTransaction());
+        QCOMPARE(countRelations(mItems), before);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(SetFlagsBenchmark)
+
+#include "setflagsbenchmark.moc"
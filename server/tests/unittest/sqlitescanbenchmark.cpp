@@ -0,0 +1,177 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QTime>
+
+#include <storage/datastore.h>
+#include <storage/columnreader.h>
+#include <entities.h>
+#include <utils.h>
+
+#include "fakeakonadiserver.h"
+#include "dbinitializer.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Scans the whole PimItem table the way FetchHelper does on the QSQLITE3
+ * driver, comparing rows cached as QVariants, forward-only rows converted
+ * on access and the ColumnReader.
+ *
+ * Uses 10000 items by default, set AKONADI_BENCHMARK_ITEMS to e.g. 1000000 for meaningful numbers.
+ */
+class SqliteScanBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    SqliteScanBenchmark()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~SqliteScanBenchmark()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    DbInitializer mDbInitializer;
+    int mItemCount;
+
+    QSqlQuery scanQuery(bool forwardOnly)
+    {
+        QSqlQuery query(DataStore::self()->database());
+        query.setForwardOnly(forwardOnly);
+        const bool ok = query.exec(QLatin1String("SELECT ") + PimItem::idFullColumnName() + QLatin1String(", ")
+                                   + PimItem::remoteIdFullColumnName() + QLatin1String(", ")
+                                   + MimeType::nameFullColumnName() + QLatin1String(", ")
+                                   + PimItem::revFullColumnName() + QLatin1String(", ")
+                                   + PimItem::collectionIdFullColumnName() + QLatin1String(", ")
+                                   + PimItem::sizeFullColumnName()
+                                   + QLatin1String(" FROM ") + PimItem::tableName()
+                                   + QLatin1String(" INNER JOIN ") + MimeType::tableName()
+                                   + QLatin1String(" ON ") + PimItem::mimeTypeIdFullColumnName()
+                                   + QLatin1String(" = ") + MimeType::idFullColumnName()
+                                   + QLatin1String(" ORDER BY ") + PimItem::idFullColumnName() + QLatin1String(" DESC"));
+        if (!ok) {
+            qWarning() << query.lastError().text();
+        }
+        return query;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mItemCount = qgetenv("AKONADI_BENCHMARK_ITEMS").toInt();
+        if (mItemCount <= 0) {
+            mItemCount = 10000;
+        }
+
+        mDbInitializer.createResource("testresource");
+        const Collection col = mDbInitializer.createCollection("root");
+        MimeType mimeType;
+        mimeType.setName(QLatin1String("message/rfc822"));
+        QVERIFY(mimeType.insert());
+
+        QVERIFY(DataStore::self()->beginTransaction());
+        QSqlQuery insert(DataStore::self()->database());
+        QVERIFY(insert.prepare(QLatin1String("INSERT INTO ") + PimItem::tableName() + QLatin1String(" (")
+                               + PimItem::revColumn() + QLatin1String(", ")
+                               + PimItem::remoteIdColumn() + QLatin1String(", ")
+                               + PimItem::collectionIdColumn() + QLatin1String(", ")
+                               + PimItem::mimeTypeIdColumn() + QLatin1String(", ")
+                               + PimItem::sizeColumn() + QLatin1String(") VALUES (?, ?, ?, ?, ?)")));
+        for (int i = 0; i < mItemCount; ++i) {
+            insert.addBindValue(i % 7);
+            insert.addBindValue(QString::fromLatin1("<%1.JavaMail.evans@thyme>").arg(i));
+            insert.addBindValue(col.id());
+            insert.addBindValue(mimeType.id());
+            insert.addBindValue(1000 + i % 50000);
+            QVERIFY2(insert.exec(), qPrintable(insert.lastError().text()));
+        }
+        QVERIFY(DataStore::self()->commitTransaction());
+    }
+
+    void benchmarkScan_data()
+    {
+        QTest::addColumn<bool>("forwardOnly");
+        QTest::addColumn<bool>("columnReader");
+
+        QTest::newRow("cached rows, QVariant") << false << false;
+        QTest::newRow("forward-only, QVariant") << true << false;
+        QTest::newRow("forward-only, ColumnReader") << true << true;
+    }
+
+    void benchmarkScan()
+    {
+        QFETCH(bool, forwardOnly);
+        QFETCH(bool, columnReader);
+
+        int rows = 0;
+        qint64 checksum = 0;
+        QTime time;
+        QBENCHMARK_ONCE {
+            time.start();
+            QSqlQuery query = scanQuery(forwardOnly);
+            const ColumnReader columns(query);
+            while (query.next()) {
+                if (columnReader) {
+                    checksum += columns.toLongLong(0);
+                    checksum += columns.toByteArray(1).size();
+                    checksum += columns.toByteArray(2).size();
+                    checksum += columns.toInt(3);
+                    checksum += columns.toLongLong(4);
+                    checksum += columns.toLongLong(5);
+                } else {
+                    checksum += query.value(0).toLongLong();
+                    checksum += Utils::variantToByteArray(query.value(1)).size();
+                    checksum += Utils::variantToByteArray(query.value(2)).size();
+                    checksum += query.value(3).toInt();
+                    checksum += query.value(4).toLongLong();
+                    checksum += query.value(5).toLongLong();
+                }
+                ++rows;
+            }
+        }
+
+        qDebug() << rows << "items scanned" << (forwardOnly ? "forward-only" : "cached")
+                 << (columnReader ? "with ColumnReader" : "with QVariant")
+                 << "in" << time.elapsed() << "ms, checksum" << checksum;
+        QCOMPARE(rows, mItemCount);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(SqliteScanBenchmark)
+
+#include "sqlitescanbenchmark.moc"
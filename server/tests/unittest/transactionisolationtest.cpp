@@ -0,0 +1,156 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QThread>
+
+#include <storage/datastore.h>
+#include <storage/countquerybuilder.h>
+#include <entities.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+/**
+ * Checks whether a flag exists and creates it if not, in one transaction on
+ * the DataStore of its own thread, like e.g. the Create and Append handlers
+ * check for an existing collection or item before inserting one.
+ */
+class CheckThenInsertThread : public QThread
+{
+public:
+    enum Result {
+        Failed,
+        Found,
+        Inserted
+    };
+
+    CheckThenInsertThread(const QString &flagName, int startDelay, int checkDelay)
+        : QThread()
+        , mFlagName(flagName)
+        , mStartDelay(startDelay)
+        , mCheckDelay(checkDelay)
+        , mResult(Failed)
+    {
+    }
+
+    Result result() const
+    {
+        return mResult;
+    }
+
+protected:
+    void run()
+    {
+        msleep(mStartDelay);
+
+        DataStore *store = DataStore::self();
+        if (store->beginTransaction()) {
+            mResult = checkThenInsert();
+            if (mResult == Failed) {
+                store->rollbackTransaction();
+            } else if (!store->commitTransaction()) {
+                mResult = Failed;
+            }
+        }
+        store->close();
+    }
+
+private:
+    Result checkThenInsert()
+    {
+        CountQueryBuilder qb(Flag::tableName());
+        qb.addValueCondition(Flag::nameColumn(), Query::Equals, mFlagName);
+        if (!qb.exec()) {
+            return Failed;
+        }
+        const bool exists = qb.result() > 0;
+
+        // give the other thread the chance to run its check in between
+        msleep(mCheckDelay);
+
+        if (exists) {
+            return Found;
+        }
+        Flag flag;
+        flag.setName(mFlagName);
+        return flag.insert() ? Inserted : Failed;
+    }
+
+    QString mFlagName;
+    int mStartDelay;
+    int mCheckDelay;
+    Result mResult;
+};
+
+class TransactionIsolationTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    TransactionIsolationTest()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~TransactionIsolationTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testInterleavedCheckThenInsert()
+    {
+        // The second transaction starts while the first one sits between
+        // its check and its insert. It must see the first one's flag instead
+        // of running its check outside of the transaction and failing on the
+        // unique name.
+        const QString flagName = QLatin1String("\\Isolation");
+        CheckThenInsertThread first(flagName, 0, 300);
+        CheckThenInsertThread second(flagName, 100, 0);
+        first.start();
+        second.start();
+        QVERIFY(first.wait(10000));
+        QVERIFY(second.wait(10000));
+
+        QCOMPARE(first.result(), CheckThenInsertThread::Inserted);
+        QCOMPARE(second.result(), CheckThenInsertThread::Found);
+
+        CountQueryBuilder qb(Flag::tableName());
+        qb.addValueCondition(Flag::nameColumn(), Query::Equals, flagName);
+        QVERIFY(qb.exec());
+        QCOMPARE(qb.result(), 1);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(TransactionIsolationTest)
+
+#include "transactionisolationtest.moc"
@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2015 Till Adam <adam@kde.org>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef AKSQLCOLUMN_H
+#define AKSQLCOLUMN_H
+
+#include <QtCore/QtGlobal>
+
+/**
+ * Raw access to a column of the current row of a query, shared between the
+ * server and the QSQLITE3 driver.
+ *
+ * The server passes an instance to QSqlResult::virtual_hook() with Hook as
+ * id. A driver that supports it fills in the value of @c column without
+ * converting it to a QVariant; all other drivers leave @c type at Invalid.
+ * Text is UTF-8 encoded and @c data is only valid until the query moves to
+ * another row.
+ */
+struct AkSqlColumn
+{
+  enum {
+    Hook = 0x414b5343 // 'AKSC'
+  };
+
+  enum Type {
+    Invalid,
+    Null,
+    Integer,
+    Float,
+    Text,
+    Blob
+  };
+
+  explicit AkSqlColumn( int column )
+    : column( column ), type( Invalid ), integer( 0 ), real( 0.0 ), data( 0 ), size( 0 )
+  {
+  }
+
+  int column;
+  Type type;
+  qint64 integer;
+  double real;
+  const char *data;
+  int size;
+};
+
+#endif